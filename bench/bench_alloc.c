@@ -0,0 +1,65 @@
+#include "bench_alloc.h"
+#include <malloc.h>
+#include <stdbool.h>
+
+// Linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free so
+// every heap call made by the client code passes through here. Sizes come
+// from malloc_usable_size, which keeps the wrappers header-free.
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+static BenchAllocStats stats;
+
+static void track_alloc(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+    // Job workers and the outbox allocate too
+    __atomic_add_fetch(&stats.allocations, 1, __ATOMIC_RELAXED);
+    size_t now = __atomic_add_fetch(&stats.current_bytes, malloc_usable_size(ptr), __ATOMIC_RELAXED);
+    size_t peak = __atomic_load_n(&stats.peak_bytes, __ATOMIC_RELAXED);
+    while (now > peak &&
+           !__atomic_compare_exchange_n(&stats.peak_bytes, &peak, now, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static void track_free(void* ptr) {
+    if (ptr) {
+        __atomic_sub_fetch(&stats.current_bytes, malloc_usable_size(ptr), __ATOMIC_RELAXED);
+    }
+}
+
+void* __wrap_malloc(size_t size) {
+    void* ptr = __real_malloc(size);
+    track_alloc(ptr);
+    return ptr;
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    void* ptr = __real_calloc(count, size);
+    track_alloc(ptr);
+    return ptr;
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    track_free(ptr);
+    void* grown = __real_realloc(ptr, size);
+    // A failed realloc leaves the old block in place
+    track_alloc(grown ? grown : ptr);
+    return grown;
+}
+
+void __wrap_free(void* ptr) {
+    track_free(ptr);
+    __real_free(ptr);
+}
+
+BenchAllocStats bench_alloc_stats(void) {
+    return stats;
+}
+
+void bench_alloc_reset_peak(void) {
+    stats.peak_bytes = stats.current_bytes;
+}
@@ -0,0 +1,19 @@
+#ifndef BENCH_ALLOC_H
+#define BENCH_ALLOC_H
+
+#include <stddef.h>
+
+// Heap counters fed by the --wrap=malloc/calloc/realloc/free link wrappers
+typedef struct {
+    size_t allocations;
+    size_t current_bytes;
+    size_t peak_bytes;
+} BenchAllocStats;
+
+// Snapshot of the counters
+BenchAllocStats bench_alloc_stats(void);
+
+// Restart peak tracking from the current usage
+void bench_alloc_reset_peak(void);
+
+#endif // BENCH_ALLOC_H
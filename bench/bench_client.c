@@ -0,0 +1,943 @@
+// Host benchmark of the whole client without a network.
+//
+// Drives the real discord_* entry points through the replay transport, either
+// from a session recorded on a 3DS (--replay FILE, see RECORD_FILE in main.c)
+// or from the payload corpus. Reports wall and CPU time, allocations and peak
+// heap per operation; --latency/--jitter add simulated network delay.
+// --sends N then pushes N messages through the outbox, whose corpus replies
+// include 503s and 429s, and reports how long the queue took to drain.
+// --aborts N cancels N slow requests part-way and reports the time from the
+// cancel to the call returning, and whether the client state survived.
+// --window MS wraps the transport in the GET coalescer like main.c does, and
+// --dupes N has four threads issue the same N GETs at once through it.
+// --history N stores the messages page as N channels' compressed history and
+// reports the ratio, restore time and how many fit in HISTORY_BUDGET.
+// --readers N runs N threads reading client views while the client switches
+// servers, and checks every snapshot they saw was complete.
+// --poll SECONDS watches eight channels posting at different rates through a
+// mock that rate-limits like Discord, and reports each channel's probes and
+// whether the poller kept to its request budget.
+// --switcher N indexes N generated channel names (40 per server) for the
+// quick switcher, then times prefix, full-name, typo and word searches
+// against a plain scan of every name.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "discord_api.h"
+#include "timing.h"
+#include "bench_alloc.h"
+#include "mem.h"
+#include "outbox.h"
+#include "history.h"
+#include "client_view.h"
+#include "poller.h"
+#include "switcher.h"
+
+typedef enum {
+    OP_CONNECT,
+    OP_FETCH_SERVERS,
+    OP_SWITCH_SERVER,
+    OP_FETCH_MESSAGES,
+    OP_FETCH_USERS,
+    OP_COUNT
+} BenchOp;
+
+typedef struct {
+    int calls;
+    int failures;
+    double wall_ms;
+    double cpu_ms;
+    size_t allocations;
+    size_t peak_bytes;
+} OpStats;
+
+static const char* op_names[OP_COUNT] = {
+    "connect", "fetch_servers", "switch_server", "fetch_messages", "fetch_users"
+};
+
+static const char message_json[] =
+    "{\"id\":\"1200000000000000001\",\"channel_id\":\"1100000000000000001\",\"content\":\"bench\","
+    "\"author\":{\"id\":\"1000000000000000001\",\"username\":\"bench\"},\"nonce\":\"0\"}";
+
+static const char server_error_json[] = "{\"message\": \"Service Unavailable\", \"code\": 0}";
+
+static const char rate_limit_json[] =
+    "{\"message\": \"You are being rate limited.\", \"retry_after\": 0.05, \"global\": false}";
+
+static const char user_json[] =
+    "{\"id\":\"1000000000000000001\",\"username\":\"bench\",\"global_name\":\"Bench\","
+    "\"avatar\":null,\"discriminator\":\"0\",\"public_flags\":0,\"flags\":0,"
+    "\"locale\":\"en-US\",\"mfa_enabled\":false,\"premium_type\":0,\"verified\":true}";
+
+static double cpu_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static char* read_file(const char* path, size_t* size) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        printf("Failed to open %s\n", path);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    char* data = malloc(len + 1);
+    if (data && fread(data, 1, len, f) != (size_t)len) {
+        free(data);
+        data = NULL;
+    }
+    if (data) {
+        data[len] = '\0';
+        *size = len;
+    }
+    fclose(f);
+    return data;
+}
+
+static bool add_corpus_file(Transport* transport, const char* corpus_dir, const char* file, const char* endpoint) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", corpus_dir, file);
+
+    size_t size = 0;
+    char* body = read_file(path, &size);
+    if (!body) {
+        return false;
+    }
+    bool ok = transport_replay_add(transport, "GET", endpoint, 200, body, size);
+    free(body);
+    return ok;
+}
+
+// Serve the corpus for every guild/channel id
+static Transport* corpus_transport(const char* corpus_dir, uint32_t latency, uint32_t jitter) {
+    Transport* transport = transport_replay_create(NULL, latency, jitter);
+    if (!transport) {
+        return NULL;
+    }
+
+    bool ok = transport_replay_add(transport, "GET", "/users/@me", 200, user_json, sizeof(user_json) - 1) &&
+              add_corpus_file(transport, corpus_dir, "guilds_200.json", "/users/@me/guilds") &&
+              add_corpus_file(transport, corpus_dir, "channels_500.json", "/guilds/*/channels") &&
+              add_corpus_file(transport, corpus_dir, "messages_page.json", "/channels/*/messages?limit=50") &&
+              add_corpus_file(transport, corpus_dir, "members_1000.json", "/guilds/*/members?limit=50") &&
+              // Replies cycle in order: every other send is retried once
+              transport_replay_add(transport, "POST", "/channels/*/messages", 200,
+                                   message_json, sizeof(message_json) - 1) &&
+              transport_replay_add(transport, "POST", "/channels/*/messages", 503,
+                                   server_error_json, sizeof(server_error_json) - 1) &&
+              transport_replay_add(transport, "POST", "/channels/*/messages", 200,
+                                   message_json, sizeof(message_json) - 1) &&
+              transport_replay_add(transport, "POST", "/channels/*/messages", 429,
+                                   rate_limit_json, sizeof(rate_limit_json) - 1);
+    if (!ok) {
+        transport_destroy(transport);
+        return NULL;
+    }
+    return transport;
+}
+
+static void run_op(DiscordClient* client, BenchOp op, int round, OpStats* stats) {
+    BenchAllocStats before = bench_alloc_stats();
+    bench_alloc_reset_peak();
+    double cpu_start = cpu_now_ms();
+    u64 wall_start = timing_now();
+
+    bool ok = false;
+    switch (op) {
+        case OP_CONNECT:
+            client->connected = false;
+            ok = discord_connect(client);
+            break;
+        case OP_FETCH_SERVERS:
+            ok = discord_fetch_servers(client);
+            break;
+        case OP_SWITCH_SERVER:
+            ok = client->server_count > 0 &&
+                 discord_switch_server(client, client->servers[round % client->server_count].id);
+            break;
+        case OP_FETCH_MESSAGES:
+            ok = discord_fetch_messages(client);
+            break;
+        case OP_FETCH_USERS:
+            ok = discord_fetch_users(client);
+            break;
+        default:
+            break;
+    }
+
+    stats->wall_ms += timing_ticks_to_ms(timing_now() - wall_start);
+    stats->cpu_ms += cpu_now_ms() - cpu_start;
+
+    BenchAllocStats after = bench_alloc_stats();
+    stats->calls++;
+    stats->failures += ok ? 0 : 1;
+    stats->allocations += after.allocations - before.allocations;
+    if (after.peak_bytes - before.current_bytes > stats->peak_bytes) {
+        stats->peak_bytes = after.peak_bytes - before.current_bytes;
+    }
+}
+
+// Queue messages through the outbox worker and wait for it to drain
+static void run_outbox(DiscordClient* client, int sends) {
+    if (!outbox_init(client, NULL)) {
+        return;
+    }
+
+    u64 start = timing_now();
+    char text[64];
+    for (int i = 0; i < sends; i++) {
+        snprintf(text, sizeof(text), "bench message %d", i);
+        while (!outbox_enqueue("1100000000000000001", text)) {
+            timing_sleep_ms(1);
+        }
+    }
+
+    OutboxStats stats = outbox_get_stats();
+    int max_depth = stats.depth;
+    while (stats.depth > 0) {
+        timing_sleep_ms(1);
+        stats = outbox_get_stats();
+    }
+    double elapsed = timing_ticks_to_ms(timing_now() - start);
+    outbox_cleanup();
+
+    printf("\noutbox: %d sent, %d retries, %d failed, max depth %d, drained in %.1f ms\n",
+           stats.sent, stats.retries, stats.failed, max_depth, elapsed);
+    printf("outbox latency p50 %.1f ms, p95 %.1f ms\n", stats.p50_latency_ms, stats.p95_latency_ms);
+}
+
+// Cancel hook that fires at a fixed time, like B pressed mid-request
+static bool abort_poll(void* ctx) {
+    return timing_now() >= *(u64*)ctx;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Abandon slow fetches and switches 20 ms in and check nothing leaked into
+// the client
+static void run_aborts(DiscordClient* client, const char* corpus_dir, int aborts) {
+    Transport* slow = corpus_transport(corpus_dir, 1000, 0);
+    double* times = malloc(aborts * sizeof(double));
+    DiscordClient* before = malloc(sizeof(DiscordClient));
+    if (!slow || !times || !before || client->server_count == 0) {
+        transport_destroy(slow);
+        free(times);
+        free(before);
+        return;
+    }
+
+    Transport* fast = client->transport;
+    client->transport = slow;
+    u64 cancel_at = 0;
+    discord_set_cancel_hook(client, abort_poll, &cancel_at);
+    memcpy(before, client, sizeof(DiscordClient));
+
+    int completed = 0;
+    for (int i = 0; i < aborts; i++) {
+        cancel_at = timing_now() + TIMING_TICKS_PER_SEC / 50;
+        bool ok;
+        if (i % 2 == 0) {
+            ok = discord_fetch_messages(client);
+        } else {
+            ok = discord_switch_server(client, client->servers[i % client->server_count].id);
+        }
+        times[i] = timing_ticks_to_ms(timing_now() - cancel_at);
+        completed += ok ? 1 : 0;
+    }
+    bool intact = memcmp(before, client, sizeof(DiscordClient)) == 0;
+
+    discord_set_cancel_hook(client, NULL, NULL);
+    client->transport = fast;
+    transport_destroy(slow);
+
+    qsort(times, aborts, sizeof(double), compare_doubles);
+    printf("\nabort: %d requests, %d completed anyway, time-to-abort p50 %.2f ms, max %.2f ms, state %s\n",
+           aborts, completed, times[(aborts - 1) / 2], times[aborts - 1], intact ? "intact" : "CHANGED");
+
+    free(times);
+    free(before);
+}
+
+typedef struct {
+    Transport* transport;
+    int requests;
+} DupeWorker;
+
+// Counts requests that reach the replay transport
+typedef struct {
+    Transport base;
+    Transport* inner;
+    int performed;
+} CountingTransport;
+
+static bool counting_perform(Transport* transport, const TransportRequest* request,
+                             TransportResponse* response, NetSample* sample) {
+    CountingTransport* ct = (CountingTransport*)transport;
+    __atomic_fetch_add(&ct->performed, 1, __ATOMIC_RELAXED);
+    return ct->inner->perform(ct->inner, request, response, sample);
+}
+
+static void counting_destroy(Transport* transport) {
+    transport_destroy(((CountingTransport*)transport)->inner);
+}
+
+static void dupe_worker(void* arg) {
+    DupeWorker* worker = (DupeWorker*)arg;
+    for (int i = 0; i < worker->requests; i++) {
+        TransportRequest request = { .method = "GET", .endpoint = "/guilds/1/members?limit=50", .token = "bench" };
+        TransportResponse response = {0};
+        NetSample sample;
+        memset(&sample, 0, sizeof(sample));
+        if (worker->transport->perform(worker->transport, &request, &response, &sample)) {
+            mem_free(response.body);
+        }
+    }
+}
+
+// Four threads asking for the same members page at the same time, as when
+// L/R are mashed while background fetches run
+static void run_dupes(const char* corpus_dir, int requests) {
+    CountingTransport counter = {
+        .base = { .name = "counting", .perform = counting_perform, .destroy = counting_destroy },
+        .inner = corpus_transport(corpus_dir, 20, 0),
+    };
+    if (!counter.inner) {
+        return;
+    }
+    Transport* transport = transport_coalesce_create(&counter.base, 0);
+
+    DupeWorker worker = { transport, requests };
+    Thread threads[4];
+    for (int i = 0; i < 4; i++) {
+        threads[i] = threadCreate(dupe_worker, &worker, 64 * 1024, 0x30, -2, false);
+    }
+    for (int i = 0; i < 4; i++) {
+        if (threads[i]) {
+            threadJoin(threads[i], U64_MAX);
+            threadFree(threads[i]);
+        }
+    }
+
+    TransportCoalesceStats stats = {0};
+    transport_coalesce_stats(transport, &stats);
+    printf("\ncoalesce: %d GETs from 4 threads, %d reached the network, %d attached, %d debounced\n",
+           stats.requests, counter.performed, stats.attached, stats.debounced);
+    transport_destroy(transport);
+}
+
+// Leave N channels with a full page each, then come back to every one still
+// kept and check it restores exactly
+static void run_history(DiscordClient* client, int channels) {
+    DiscordMessage* restored = malloc(MAX_MESSAGES * sizeof(DiscordMessage));
+    double* times = malloc(channels * sizeof(double));
+    if (!restored || !times || !discord_fetch_messages(client) || client->message_count == 0) {
+        free(restored);
+        free(times);
+        return;
+    }
+
+    char channel_id[32];
+    double store_ms = 0;
+    for (int i = 0; i < channels; i++) {
+        snprintf(channel_id, sizeof(channel_id), "%d", 1000 + i);
+        u64 start = timing_now();
+        history_store(channel_id, client->messages, client->message_count);
+        store_ms += timing_ticks_to_ms(timing_now() - start);
+    }
+    HistoryStats stored = history_get_stats();
+
+    int loaded = 0;
+    int mismatched = 0;
+    for (int i = 0; i < channels; i++) {
+        snprintf(channel_id, sizeof(channel_id), "%d", 1000 + i);
+        int count = 0;
+        u64 start = timing_now();
+        if (!history_load(channel_id, restored, &count)) {
+            continue;
+        }
+        times[loaded++] = timing_ticks_to_ms(timing_now() - start);
+        if (count != client->message_count ||
+            memcmp(restored, client->messages, count * sizeof(DiscordMessage)) != 0) {
+            mismatched++;
+        }
+    }
+
+    printf("\nhistory: %d channels stored, %d resident in %d KB budget (%zu KB), %d evicted\n",
+           channels, stored.channels, HISTORY_BUDGET / 1024, stored.compressed_bytes / 1024, stored.evicted);
+    if (stored.compressed_bytes > 0 && loaded > 0) {
+        qsort(times, loaded, sizeof(double), compare_doubles);
+        printf("history: ratio %.1fx of serialized text, %.1fx of DiscordMessage arrays, store %.2f ms\n",
+               (double)stored.raw_bytes / stored.compressed_bytes,
+               (double)stored.struct_bytes / stored.compressed_bytes, store_ms / channels);
+        printf("history: restore p50 %.3f ms, max %.3f ms per %d-message window, %d of %d identical\n",
+               times[(loaded - 1) / 2], times[loaded - 1], client->message_count, loaded - mismatched,
+               loaded);
+    }
+
+    free(restored);
+    free(times);
+}
+
+typedef struct {
+    int reader;
+    volatile bool* stop;
+    int reads;
+    int torn;
+} ViewReader;
+
+// Render-like reader: walk every list of the current view and check it is
+// complete and was not reclaimed underneath us
+static void view_reader(void* arg) {
+    ViewReader* r = (ViewReader*)arg;
+    while (!*r->stop) {
+        const ClientView* view = client_view_acquire(r->reader);
+        uint32_t version = view->version;
+        bool ok = view->message_count >= 0 && view->message_count <= MAX_MESSAGES &&
+                  view->server_count >= 0 && view->server_count <= MAX_SERVERS &&
+                  view->channel_count >= 0 && view->channel_count <= MAX_CHANNELS &&
+                  view->user_count >= 0 && view->user_count <= MAX_USERS;
+        for (int i = 0; ok && i < view->message_count; i++) {
+            ok = view->messages[i].id[0] != '\0';
+        }
+        for (int i = 0; ok && i < view->server_count; i++) {
+            ok = view->servers[i].id[0] != '\0';
+        }
+        for (int i = 0; ok && i < view->channel_count; i++) {
+            ok = view->channels[i].id[0] != '\0';
+        }
+        for (int i = 0; ok && i < view->user_count; i++) {
+            ok = view->users[i].id[0] != '\0';
+        }
+        // Only the empty initial view has version 0; a reclaimed one is reset to it
+        ok = ok && view->version == version && (version != 0 || view->server_count == 0);
+        client_view_release(r->reader);
+
+        r->reads++;
+        r->torn += ok ? 0 : 1;
+    }
+}
+
+static void run_readers(DiscordClient* client, int readers, int rounds) {
+    if (readers > CLIENT_VIEW_MAX_READERS) {
+        readers = CLIENT_VIEW_MAX_READERS;
+    }
+
+    volatile bool stop = false;
+    ViewReader state[CLIENT_VIEW_MAX_READERS];
+    Thread threads[CLIENT_VIEW_MAX_READERS];
+    for (int i = 0; i < readers; i++) {
+        state[i] = (ViewReader){ .reader = i, .stop = &stop };
+        threads[i] = threadCreate(view_reader, &state[i], 64 * 1024, 0x30, -2, false);
+    }
+
+    ClientViewStats before = client_view_get_stats();
+    u64 start = timing_now();
+    for (int round = 0; round < rounds && client->server_count > 0; round++) {
+        discord_switch_server(client, client->servers[round % client->server_count].id);
+        discord_fetch_messages(client);
+        discord_fetch_users(client);
+    }
+    double elapsed = timing_ticks_to_ms(timing_now() - start);
+
+    stop = true;
+    int reads = 0;
+    int torn = 0;
+    for (int i = 0; i < readers; i++) {
+        if (threads[i]) {
+            threadJoin(threads[i], U64_MAX);
+            threadFree(threads[i]);
+        }
+        reads += state[i].reads;
+        torn += state[i].torn;
+    }
+    ClientViewStats after = client_view_get_stats();
+
+    printf("\nviews: %u published, %u reclaimed, max %d live; %d readers made %d reads in %.0f ms, %d torn\n",
+           after.published - before.published, after.reclaimed - before.reclaimed, after.max_live,
+           readers, reads, elapsed, torn);
+}
+
+static const char* switcher_words[] = {
+    "general", "random", "memes", "music", "gaming", "homebrew", "help", "dev", "art", "news",
+    "off", "topic", "voice", "lounge", "support", "announcements", "rules", "media", "clips", "pokemon",
+    "smash", "mario", "zelda", "speedrun", "modding", "python", "rust", "events", "trading", "bots"
+};
+#define SWITCHER_WORDS (int)(sizeof(switcher_words) / sizeof(switcher_words[0]))
+#define SWITCHER_CHANNELS_PER_SERVER 40
+#define SWITCHER_QUERIES 2000
+
+static uint32_t switcher_rand(uint32_t* state) {
+    *state = *state * 1664525u + 1013904223u;
+    return *state >> 8;
+}
+
+// What a switcher without an index does: fold every name and check that the
+// query's letters appear in it in order
+static int naive_search(char (*names)[64], int count, const char* query) {
+    int found = 0;
+    for (int i = 0; i < count; i++) {
+        const char* q = query;
+        for (const char* c = names[i]; *c && *q; c++) {
+            char lower = (*c >= 'A' && *c <= 'Z') ? (char)(*c - 'A' + 'a') : (*c == '-' ? ' ' : *c);
+            if (lower == *q) {
+                q++;
+            }
+        }
+        found += *q == '\0';
+    }
+    return found;
+}
+
+static void run_switcher(int channels) {
+    int servers = (channels + SWITCHER_CHANNELS_PER_SERVER - 1) / SWITCHER_CHANNELS_PER_SERVER;
+    char (*names)[64] = malloc((size_t)channels * sizeof(*names));
+    double* times = malloc(SWITCHER_QUERIES * sizeof(double));
+    DiscordServer* server_list = calloc(servers, sizeof(DiscordServer));
+    DiscordChannel* channel_list = calloc(SWITCHER_CHANNELS_PER_SERVER, sizeof(DiscordChannel));
+    if (!names || !times || !server_list || !channel_list) {
+        return;
+    }
+
+    // A fresh index, filled the way fetches fill it: the server list, then
+    // each server's channels as it is opened
+    switcher_cleanup();
+    switcher_init();
+    uint32_t seed = 12345;
+    for (int s = 0; s < servers; s++) {
+        snprintf(server_list[s].id, sizeof(server_list[s].id), "%llu", 1100000000000000000ULL + s);
+        snprintf(server_list[s].name, sizeof(server_list[s].name), "%s %s %d",
+                 switcher_words[switcher_rand(&seed) % SWITCHER_WORDS],
+                 switcher_words[switcher_rand(&seed) % SWITCHER_WORDS], s);
+    }
+    u64 start = timing_now();
+    switcher_add_servers(server_list, servers);
+    double add_ms = 0;
+    for (int s = 0; s < servers; s++) {
+        int count = 0;
+        for (int c = s * SWITCHER_CHANNELS_PER_SERVER; c < channels && count < SWITCHER_CHANNELS_PER_SERVER; c++) {
+            DiscordChannel* channel = &channel_list[count++];
+            snprintf(channel->id, sizeof(channel->id), "%llu", 1200000000000000000ULL + c);
+            snprintf(channel->name, sizeof(channel->name), "%s-%s-%d",
+                     switcher_words[switcher_rand(&seed) % SWITCHER_WORDS],
+                     switcher_words[switcher_rand(&seed) % SWITCHER_WORDS], c % 100);
+            snprintf(names[c], sizeof(names[c]), "%s", channel->name);
+        }
+        switcher_add_channels(server_list[s].id, channel_list, count);
+    }
+    add_ms = timing_ticks_to_ms(timing_now() - start);
+    SwitcherStats index = switcher_get_stats();
+
+    static const char* kinds[4] = { "prefix", "full", "typo", "word" };
+    int found[4] = {0};
+    int asked[4] = {0};
+    SwitcherResult results[SWITCHER_MAX_RESULTS];
+    double naive_ms = 0;
+    for (int q = 0; q < SWITCHER_QUERIES; q++) {
+        int target = (int)(switcher_rand(&seed) % channels);
+        int kind = q % 4;
+        char query[64];
+        snprintf(query, sizeof(query), "%s", names[target]);
+        size_t len = strlen(query);
+        if (kind == 0) {
+            query[3] = '\0';
+        } else if (kind == 2 && len > 4) {
+            char swap = query[len / 2];
+            query[len / 2] = query[len / 2 + 1];
+            query[len / 2 + 1] = swap;
+        } else if (kind == 3) {
+            char* dash = strchr(query, '-');
+            memmove(query, dash + 1, strlen(dash + 1) + 1);
+            *strchr(query, '-') = '\0';
+        }
+
+        u64 search_start = timing_now();
+        int count = switcher_search(query, results, SWITCHER_MAX_RESULTS);
+        times[q] = timing_ticks_to_ms(timing_now() - search_start);
+
+        // A prefix or a word names many channels; only check the others
+        if (kind == 1 || kind == 2) {
+            char id[32];
+            snprintf(id, sizeof(id), "%llu", 1200000000000000000ULL + target);
+            for (int r = 0; r < count; r++) {
+                if (strcmp(results[r].id, id) == 0) {
+                    found[kind]++;
+                    break;
+                }
+            }
+        } else {
+            found[kind] += count > 0;
+        }
+        asked[kind]++;
+
+        for (char* c = query; *c; c++) {
+            *c = *c == '-' ? ' ' : *c;
+        }
+        u64 naive_start = timing_now();
+        naive_search(names, channels, query);
+        naive_ms += timing_ticks_to_ms(timing_now() - naive_start);
+    }
+
+    qsort(times, SWITCHER_QUERIES, sizeof(double), compare_doubles);
+    printf("\nswitcher: %d servers + %d channels indexed in %.2f ms (%.2f us each), %d trigrams, "
+           "%zu postings, %zu KB\n", servers, channels, add_ms, add_ms * 1000.0 / (servers + channels),
+           index.trigrams, index.postings, index.bytes / 1024);
+    printf("switcher: search p50 %.3f ms, p95 %.3f ms, max %.3f ms over %d queries; plain scan %.3f ms each\n",
+           times[(SWITCHER_QUERIES - 1) / 2], times[(SWITCHER_QUERIES * 95 - 1) / 100],
+           times[SWITCHER_QUERIES - 1], SWITCHER_QUERIES, naive_ms / SWITCHER_QUERIES);
+    printf("switcher: target in top %d:", SWITCHER_MAX_RESULTS);
+    for (int k = 0; k < 4; k++) {
+        printf(" %s %d/%d%s", kinds[k], found[k], asked[k], k == 0 || k == 3 ? " (any)" : "");
+    }
+    printf("\n");
+
+    free(names);
+    free(times);
+    free(server_list);
+    free(channel_list);
+}
+
+// Channels of a fake guild for --poll, posting at fixed rates per minute
+#define POLL_CHANNELS 8
+#define POLL_FOCUS 2
+#define POLL_HISTORY 1024
+
+static const int poll_rates[POLL_CHANNELS] = { 1200, 600, 300, 120, 60, 10, 0, 0 };
+
+// Serves message probes for the channels above and enforces the poller's own
+// budget as a sliding-window rate limit, answering 429 past it
+typedef struct {
+    Transport base;
+    uint64_t started;
+    uint64_t inject_at;             // One unprovoked 429 once this passes
+    uint64_t times[POLL_HISTORY];   // Recent request times, a ring
+    int requests;
+    int max_in_window;
+    int rate_limited;
+    uint64_t baseline[POLL_CHANNELS];   // Newest message at the first probe
+    int delivered[POLL_CHANNELS];       // New messages returned to after= probes
+} PollMock;
+
+static uint64_t poll_channel_id(int channel) {
+    return 1300000000000000000ULL + channel;
+}
+
+// Every channel starts with one message; ids grow by one per message
+static uint64_t poll_newest_id(const PollMock* mock, int channel, uint64_t now) {
+    double elapsed_ms = timing_ticks_to_ms(now - mock->started);
+    return 1400000000000000000ULL + (uint64_t)channel * 1000000 + 1 +
+           (uint64_t)(poll_rates[channel] * elapsed_ms / 60000.0);
+}
+
+static bool poll_respond(TransportResponse* response, NetSample* sample, long status, const char* body,
+                         size_t len) {
+    response->body = mem_alloc(MEM_NET, len + 1);
+    if (!response->body) {
+        return false;
+    }
+    memcpy(response->body, body, len);
+    response->body[len] = '\0';
+    response->size = len;
+    response->status = status;
+    sample->http_status = status;
+    sample->bytes_down = len;
+    return true;
+}
+
+static bool poll_perform(Transport* transport, const TransportRequest* request,
+                         TransportResponse* response, NetSample* sample) {
+    PollMock* mock = (PollMock*)transport;
+    uint64_t now = timing_now();
+
+    mock->times[mock->requests++ % POLL_HISTORY] = now;
+    int in_window = 0;
+    int recent = mock->requests < POLL_HISTORY ? mock->requests : POLL_HISTORY;
+    for (int i = 0; i < recent; i++) {
+        if (timing_ticks_to_ms(now - mock->times[i]) < POLLER_BUDGET_WINDOW_MS) {
+            in_window++;
+        }
+    }
+    if (in_window > mock->max_in_window) {
+        mock->max_in_window = in_window;
+    }
+    bool inject = mock->inject_at && now >= mock->inject_at;
+    if (inject || in_window > POLLER_BUDGET_REQUESTS + POLLER_BUDGET_BURST) {
+        char body[96];
+        int len = snprintf(body, sizeof(body), "{\"message\": \"You are being rate limited.\", "
+                           "\"retry_after\": %.3f}", POLLER_BUDGET_WINDOW_MS / 5000.0);
+        mock->inject_at = 0;
+        mock->rate_limited++;
+        return poll_respond(response, sample, 429, body, len);
+    }
+
+    unsigned long long channel_id = 0;
+    unsigned long long after = 0;
+    if (sscanf(request->endpoint, "/channels/%llu/messages?limit=%*d&after=%llu", &channel_id, &after) < 1 ||
+        channel_id < poll_channel_id(0) || channel_id >= poll_channel_id(POLL_CHANNELS)) {
+        static const char unknown[] = "{\"message\": \"Unknown Channel\"}";
+        return poll_respond(response, sample, 404, unknown, sizeof(unknown) - 1);
+    }
+    int channel = (int)(channel_id - poll_channel_id(0));
+    uint64_t newest = poll_newest_id(mock, channel, now);
+
+    // Newest first, like Discord; limit=1 without after returns just the newest
+    char body[MAX_MESSAGES * 32 + 8];
+    size_t len = 0;
+    body[len++] = '[';
+    if (!after) {
+        if (!mock->baseline[channel]) {
+            mock->baseline[channel] = newest;
+        }
+        len += snprintf(body + len, sizeof(body) - len, "{\"id\":\"%llu\"}", (unsigned long long)newest);
+    } else {
+        for (uint64_t id = newest; id > after && newest - id < MAX_MESSAGES; id--) {
+            len += snprintf(body + len, sizeof(body) - len, "%s{\"id\":\"%llu\"}", id == newest ? "" : ",",
+                            (unsigned long long)id);
+            mock->delivered[channel]++;
+        }
+    }
+    body[len++] = ']';
+    return poll_respond(response, sample, 200, body, len);
+}
+
+static void poll_destroy(Transport* transport) {
+    (void)transport;
+}
+
+// Watch the channels above for the given time with one of them on screen, and
+// check the poller stays within its budget while keeping up with each channel
+static void run_poll(int seconds) {
+    PollMock mock = {
+        .base = { .name = "poll", .perform = poll_perform, .destroy = poll_destroy },
+        .started = timing_now(),
+    };
+    mock.inject_at = mock.started + (uint64_t)seconds * TIMING_TICKS_PER_SEC / 2;
+
+    DiscordClient* client = malloc(sizeof(DiscordClient));
+    if (!client) {
+        return;
+    }
+    discord_init(client, "bench-token", &mock.base);
+    if (!poller_init(client, NULL)) {
+        discord_cleanup(client);
+        free(client);
+        return;
+    }
+
+    char channel_id[32];
+    for (int i = 0; i < POLL_CHANNELS; i++) {
+        snprintf(channel_id, sizeof(channel_id), "%llu", (unsigned long long)poll_channel_id(i));
+        if (i == POLL_FOCUS) {
+            poller_set_focus(channel_id, "1", NULL);
+        } else {
+            poller_watch(channel_id, "1");
+        }
+    }
+
+    // Pick up the focused channel's updates like main.c's loop does
+    int refreshes = 0;
+    uint64_t end = mock.started + (uint64_t)seconds * TIMING_TICKS_PER_SEC;
+    while (timing_now() < end) {
+        svcSleepThread(16 * 1000000LL);
+        if (poller_take_focus_update()) {
+            refreshes++;
+        }
+    }
+    int unread = poller_unread_for_server("1");
+    poller_cleanup();
+    double elapsed_ms = timing_ticks_to_ms(timing_now() - mock.started);
+
+    PollerChannel watched[POLLER_MAX_CHANNELS];
+    int count = poller_list(watched, POLLER_MAX_CHANNELS);
+    PollerStats stats = poller_get_stats();
+
+    // Browse many more channels than the table holds, then come back: each
+    // one must be polled while on screen, without crowding out the watch list
+    int visits = POLLER_MAX_CHANNELS * 4;
+    int unpolled = 0;
+    for (int i = 0; i <= visits; i++) {
+        uint64_t id = i < visits ? poll_channel_id(POLL_CHANNELS + i) : poll_channel_id(POLL_FOCUS);
+        snprintf(channel_id, sizeof(channel_id), "%llu", (unsigned long long)id);
+        poller_set_focus(channel_id, "1", NULL);
+
+        PollerChannel table[POLLER_MAX_CHANNELS];
+        int listed = poller_list(table, POLLER_MAX_CHANNELS);
+        bool found = false;
+        for (int k = 0; k < listed && !found; k++) {
+            found = table[k].channel_id == id;
+        }
+        unpolled += !found;
+    }
+    PollerChannel after_visits[POLLER_MAX_CHANNELS];
+    int kept = poller_list(after_visits, POLLER_MAX_CHANNELS);
+
+    printf("\npoll: %d channels for %.1f s, budget %d per %d ms (+%d burst)\n", count, elapsed_ms / 1000.0,
+           POLLER_BUDGET_REQUESTS, POLLER_BUDGET_WINDOW_MS, POLLER_BUDGET_BURST);
+    printf("%-8s %8s %8s %7s %11s %9s %8s\n", "channel", "rate/min", "smoothed", "probes", "interval ms",
+           "delivered", "posted");
+    uint64_t now = timing_now();
+    for (int i = 0; i < count; i++) {
+        int channel = (int)(watched[i].channel_id - poll_channel_id(0));
+        uint64_t posted = mock.baseline[channel] ? poll_newest_id(&mock, channel, now) - mock.baseline[channel] : 0;
+        printf("%-8d %8d %8.1f %7d %11.0f %9d %8llu%s\n", channel, poll_rates[channel], watched[i].rate_per_min,
+               watched[i].probes, watched[i].probes ? elapsed_ms / watched[i].probes : 0.0,
+               mock.delivered[channel], (unsigned long long)posted, channel == POLL_FOCUS ? " focused" : "");
+    }
+    printf("poll: %d requests, %.1f per window against a budget of %d, at most %d in any window\n",
+           mock.requests, mock.requests * POLLER_BUDGET_WINDOW_MS / elapsed_ms, POLLER_BUDGET_REQUESTS,
+           mock.max_in_window);
+    printf("poll: %d 429s (1 injected), %d seen by the poller, %d budget waits, %d failed\n",
+           mock.rate_limited, stats.rate_limited, stats.throttled, stats.failed);
+    printf("poll: %d new messages counted, %d unread outside the focus, %d focus refreshes\n",
+           stats.new_messages, unread, refreshes);
+    printf("poll: %d other channels opened in turn, %d left unpolled while open, %d in the table after\n",
+           visits, unpolled, kept);
+
+    discord_cleanup(client);
+    free(client);
+}
+
+static void usage(const char* argv0) {
+    printf("Usage: %s [--corpus DIR | --replay FILE] [--rounds N] [--latency MS] [--jitter MS] [--sends N]"
+           " [--aborts N]\n       [--window MS] [--dupes N] [--history N] [--readers N] [--poll SECONDS]"
+           " [--switcher N]\n", argv0);
+}
+
+int main(int argc, char* argv[]) {
+    const char* corpus_dir = "corpus";
+    const char* replay_path = NULL;
+    int rounds = 50;
+    uint32_t latency = 0;
+    uint32_t jitter = 0;
+    int sends = 20;
+    int aborts = 20;
+    int window = -1;
+    int dupes = 20;
+    int history = 100;
+    int readers = 2;
+    int poll = 5;
+    int switcher = 5000;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--corpus") == 0 && i + 1 < argc) {
+            corpus_dir = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) {
+            rounds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--latency") == 0 && i + 1 < argc) {
+            latency = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--jitter") == 0 && i + 1 < argc) {
+            jitter = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--sends") == 0 && i + 1 < argc) {
+            sends = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--aborts") == 0 && i + 1 < argc) {
+            aborts = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+            window = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--dupes") == 0 && i + 1 < argc) {
+            dupes = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--history") == 0 && i + 1 < argc) {
+            history = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--readers") == 0 && i + 1 < argc) {
+            readers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--poll") == 0 && i + 1 < argc) {
+            poll = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--switcher") == 0 && i + 1 < argc) {
+            switcher = atoi(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    mem_init();
+    
+    Transport* transport = replay_path ? transport_replay_create(replay_path, latency, jitter)
+                                       : corpus_transport(corpus_dir, latency, jitter);
+    if (!transport) {
+        return 1;
+    }
+    if (window >= 0) {
+        transport = transport_coalesce_create(transport, (uint32_t)window);
+    }
+
+    DiscordClient* client = malloc(sizeof(DiscordClient));
+    if (!client) {
+        transport_destroy(transport);
+        return 1;
+    }
+
+    net_stats_init(NULL);
+    history_init();
+    switcher_init();
+    client_view_init();
+    discord_init(client, "bench-token", transport);
+
+    OpStats stats[OP_COUNT];
+    memset(stats, 0, sizeof(stats));
+
+    for (int round = 0; round < rounds; round++) {
+        for (int op = 0; op < OP_COUNT; op++) {
+            run_op(client, (BenchOp)op, round, &stats[op]);
+        }
+    }
+
+    printf("%-16s %6s %6s %10s %10s %8s %9s\n", "operation", "calls", "fails",
+           "wall ms", "cpu ms", "allocs", "peak KB");
+    for (int op = 0; op < OP_COUNT; op++) {
+        OpStats* s = &stats[op];
+        printf("%-16s %6d %6d %10.3f %10.3f %8.1f %9.1f\n", op_names[op], s->calls, s->failures,
+               s->wall_ms / s->calls, s->cpu_ms / s->calls,
+               (double)s->allocations / s->calls, s->peak_bytes / 1024.0);
+    }
+
+    if (sends > 0) {
+        run_outbox(client, sends);
+    }
+    if (aborts > 0 && !replay_path) {
+        run_aborts(client, corpus_dir, aborts);
+    }
+    if (dupes > 0 && !replay_path) {
+        run_dupes(corpus_dir, dupes);
+    }
+    if (history > 0) {
+        run_history(client, history);
+    }
+    if (readers > 0) {
+        run_readers(client, readers, rounds);
+    }
+    if (poll > 0) {
+        run_poll(poll);
+    }
+    if (switcher > 0) {
+        run_switcher(switcher);
+    }
+
+    TransportCoalesceStats coalesce;
+    if (transport_coalesce_stats(client->transport, &coalesce)) {
+        printf("\nrequests saved: %d of %d GETs (%d attached, %d debounced)\n",
+               coalesce.attached + coalesce.debounced, coalesce.requests,
+               coalesce.attached, coalesce.debounced);
+    }
+
+    printf("\n");
+    mem_dump(stdout);
+    
+    discord_cleanup(client);
+    history_cleanup();
+    switcher_cleanup();
+    client_view_cleanup();
+    free(client);
+    net_stats_cleanup();
+    return 0;
+}
@@ -0,0 +1,600 @@
+// Host benchmark for JSON parsing and field extraction.
+//
+// Runs json_parse plus the discord_parse_* extraction used by discord_fetch_*
+// over each recorded payload in the corpus and reports ns/byte, tokens/sec,
+// heap allocations and peak heap per call. Results can be saved as a baseline
+// and later compared against it.
+//
+// A second table runs plain jsmn and the structural scanner (json_scan.h)
+// over the same payloads, checks they produce identical tokens and reports
+// the speedup.
+//
+// With --workers N a third table reruns the extraction cases with the job
+// system (job.h) splitting each array across N workers, checks the results
+// match the single-threaded parse and reports the speedup.
+//
+// A markup table parses the message contents (plus a few heavily formatted
+// samples) into spans (markup.h), as ingestion does, and renders them as the
+// top screen would: parse cost per message, render cost per visible line.
+//
+// The writer_* cases measure the request-body side instead: the payload is
+// escaped as a single JSON string value by json_writer, and the parse column
+// reports the write time.
+//
+// The text_* cases decode every string value in the payload to console
+// glyphs (text.h), as ingestion does for display fields; the parse column
+// reports the decode time alone.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "discord_parse.h"
+#include "json_helper.h"
+#include "json_writer.h"
+#include "json_scan.h"
+#include "text.h"
+#include "job.h"
+#include "markup.h"
+#include "timing.h"
+#include "bench_alloc.h"
+#include "mem.h"
+
+typedef enum {
+    CASE_MESSAGES,
+    CASE_SERVERS,
+    CASE_USERS,
+    CASE_CHANNELS,
+    CASE_WRITER,
+    CASE_TEXT
+} CaseKind;
+
+typedef struct {
+    const char* name;
+    const char* file;
+    CaseKind kind;
+} BenchCase;
+
+typedef struct {
+    char name[32];
+    double total_ns_per_byte;
+    double parse_ns_per_byte;
+    double mtokens_per_sec;
+    double allocs_per_call;
+    double peak_kb;
+} BenchResult;
+
+static const BenchCase cases[] = {
+    { "messages_page", "messages_page.json", CASE_MESSAGES },
+    { "guilds_200",    "guilds_200.json",    CASE_SERVERS },
+    { "channels_500",  "channels_500.json",  CASE_CHANNELS },
+    { "members_1000",  "members_1000.json",  CASE_USERS },
+    { "writer_messages", "messages_page.json", CASE_WRITER },
+    { "text_messages", "messages_page.json", CASE_TEXT },
+    { "text_members",  "members_1000.json",  CASE_TEXT },
+};
+
+#define CASE_COUNT (int)(sizeof(cases) / sizeof(cases[0]))
+
+static char* read_file(const char* path, size_t* size) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    char* data = malloc(len + 1);
+    if (data && fread(data, 1, len, f) != (size_t)len) {
+        free(data);
+        data = NULL;
+    }
+    if (data) {
+        data[len] = '\0';
+        *size = len;
+    }
+    fclose(f);
+    return data;
+}
+
+// Escape json as one string value into a request body
+static bool write_body(const char* json, NetSample* sample) {
+    static char body[JSON_ESCAPED_MAX(1024 * 1024) + 64];
+    size_t len = strlen(json);
+    if (JSON_ESCAPED_MAX(len) + 64 > sizeof(body)) {
+        return false;
+    }
+
+    u64 start = timing_now();
+    JsonWriter writer;
+    json_writer_init(&writer, body, sizeof(body));
+    json_writer_begin_object(&writer);
+    json_writer_key(&writer, "content");
+    json_writer_string_n(&writer, json, len);
+    json_writer_key(&writer, "tts");
+    json_writer_bool(&writer, false);
+    json_writer_end_object(&writer);
+    bool ok = json_writer_finish(&writer);
+    sample->parse_ms = timing_ticks_to_ms(timing_now() - start);
+    return ok;
+}
+
+// Decode every string token to console glyphs
+static bool decode_strings(const char* json, NetSample* sample) {
+    static char text[64 * 1024];
+    jsmntok_t* tokens = NULL;
+    int r = json_parse_alloc(json, &tokens);
+    if (r < 1) {
+        mem_free(tokens);
+        return false;
+    }
+
+    u64 start = timing_now();
+    for (int i = 0; i < r; i++) {
+        if (tokens[i].type == JSMN_STRING) {
+            text_decode_json(json + tokens[i].start, tokens[i].end - tokens[i].start,
+                             text, sizeof(text), TEXT_CONSOLE);
+        }
+    }
+    sample->parse_ms = timing_ticks_to_ms(timing_now() - start);
+
+    mem_free(tokens);
+    return true;
+}
+
+static bool run_once(const BenchCase* c, DiscordClient* client, const char* json, NetSample* sample) {
+    switch (c->kind) {
+        case CASE_MESSAGES:
+            return discord_parse_messages(client, json, sample);
+        case CASE_SERVERS:
+            return discord_parse_servers(client, json, sample);
+        case CASE_USERS:
+            return discord_parse_users(client, json, sample);
+        case CASE_CHANNELS:
+            return discord_parse_channels(client, json, sample);
+        case CASE_WRITER:
+            return write_body(json, sample);
+        case CASE_TEXT:
+            return decode_strings(json, sample);
+    }
+    return false;
+}
+
+static bool run_case(const BenchCase* c, const char* corpus_dir, double min_seconds,
+                     DiscordClient* client, BenchResult* result) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", corpus_dir, c->file);
+
+    size_t size = 0;
+    char* json = read_file(path, &size);
+    if (!json) {
+        printf("%-16s missing %s\n", c->name, path);
+        return false;
+    }
+
+    jsmntok_t* tokens = NULL;
+    int token_count = json_parse_alloc(json, &tokens);
+    mem_free(tokens);
+    if (token_count < 0) {
+        printf("%-16s invalid JSON (%d)\n", c->name, token_count);
+        free(json);
+        return false;
+    }
+
+    // Warm up caches and the allocator
+    NetSample sample;
+    for (int i = 0; i < 3; i++) {
+        if (!run_once(c, client, json, &sample)) {
+            printf("%-16s extraction failed\n", c->name);
+            free(json);
+            return false;
+        }
+    }
+
+    BenchAllocStats before = bench_alloc_stats();
+    bench_alloc_reset_peak();
+
+    double parse_ms = 0;
+    int iterations = 0;
+    u64 limit = (u64)(min_seconds * TIMING_TICKS_PER_SEC);
+    u64 start = timing_now();
+    u64 elapsed = 0;
+    while (iterations < 5 || elapsed < limit) {
+        run_once(c, client, json, &sample);
+        parse_ms += sample.parse_ms;
+        iterations++;
+        elapsed = timing_now() - start;
+    }
+
+    BenchAllocStats after = bench_alloc_stats();
+    double total_ns = timing_ticks_to_us(elapsed) * 1000.0 / iterations;
+    double parse_ns = parse_ms * 1000000.0 / iterations;
+
+    snprintf(result->name, sizeof(result->name), "%s", c->name);
+    result->total_ns_per_byte = total_ns / size;
+    result->parse_ns_per_byte = parse_ns / size;
+    result->mtokens_per_sec = c->kind >= CASE_WRITER ? 0 : token_count / (parse_ns / 1000.0);
+    result->allocs_per_call = (double)(after.allocations - before.allocations) / iterations;
+    result->peak_kb = (after.peak_bytes - before.current_bytes) / 1024.0;
+
+    printf("%-16s %8zu %7d %10.2f %10.2f %8.1f %7.1f %8.1f\n", c->name, size, token_count,
+           result->parse_ns_per_byte, result->total_ns_per_byte, result->mtokens_per_sec,
+           result->allocs_per_call, result->peak_kb);
+
+    free(json);
+    return true;
+}
+
+static bool save_baseline(const char* path, const BenchResult* results, int count) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        printf("Failed to write %s\n", path);
+        return false;
+    }
+    fprintf(f, "# case total_ns_per_byte parse_ns_per_byte mtokens_per_sec allocs_per_call peak_kb\n");
+    for (int i = 0; i < count; i++) {
+        fprintf(f, "%s %.4f %.4f %.3f %.2f %.2f\n", results[i].name, results[i].total_ns_per_byte,
+                results[i].parse_ns_per_byte, results[i].mtokens_per_sec,
+                results[i].allocs_per_call, results[i].peak_kb);
+    }
+    fclose(f);
+    printf("\nSaved baseline to %s\n", path);
+    return true;
+}
+
+static double percent_change(double base, double now) {
+    return base > 0 ? (now - base) * 100.0 / base : 0;
+}
+
+// Returns the number of regressed cases, or -1 if the baseline can't be read
+static int compare_baseline(const char* path, const BenchResult* results, int count, double threshold) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        printf("Failed to read %s\n", path);
+        return -1;
+    }
+
+    printf("\n%-16s %18s %18s %16s\n", "vs baseline", "total ns/B", "allocs/call", "peak KB");
+
+    int regressions = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        BenchResult base;
+        if (line[0] == '#' ||
+            sscanf(line, "%31s %lf %lf %lf %lf %lf", base.name, &base.total_ns_per_byte,
+                   &base.parse_ns_per_byte, &base.mtokens_per_sec, &base.allocs_per_call,
+                   &base.peak_kb) != 6) {
+            continue;
+        }
+
+        for (int i = 0; i < count; i++) {
+            const BenchResult* now = &results[i];
+            if (strcmp(now->name, base.name) != 0) {
+                continue;
+            }
+
+            double time_delta = percent_change(base.total_ns_per_byte, now->total_ns_per_byte);
+            double peak_delta = percent_change(base.peak_kb, now->peak_kb);
+            bool regressed = time_delta > threshold || peak_delta > threshold ||
+                             now->allocs_per_call > base.allocs_per_call + 0.5;
+
+            printf("%-16s %8.2f (%+6.1f%%) %7.1f -> %-7.1f %7.1f (%+5.1f%%)%s\n", now->name,
+                   now->total_ns_per_byte, time_delta, base.allocs_per_call, now->allocs_per_call,
+                   now->peak_kb, peak_delta, regressed ? "  REGRESSION" : "");
+            if (regressed) {
+                regressions++;
+            }
+        }
+    }
+
+    fclose(f);
+    return regressions;
+}
+
+// Plain jsmn, growing the token array the way json_parse_alloc used to
+static int jsmn_parse_alloc(const char* json, size_t len, jsmntok_t** tokens) {
+    size_t capacity = len / 12 + 64;
+    jsmntok_t* buffer = mem_alloc(MEM_JSON, capacity * sizeof(jsmntok_t));
+    *tokens = buffer;
+    if (!buffer) {
+        return JSMN_ERROR_NOMEM;
+    }
+
+    jsmn_parser parser;
+    jsmn_init(&parser);
+
+    int r;
+    while ((r = jsmn_parse(&parser, json, len, buffer, capacity)) == JSMN_ERROR_NOMEM) {
+        capacity *= 2;
+        jsmntok_t* grown = mem_realloc(MEM_JSON, buffer, capacity * sizeof(jsmntok_t));
+        if (!grown) {
+            break;
+        }
+        buffer = grown;
+        *tokens = buffer;
+    }
+    return r;
+}
+
+typedef int (*TokenizeFn)(const char* json, size_t len, jsmntok_t** tokens);
+
+static double time_tokenizer(TokenizeFn fn, const char* json, size_t len, double min_seconds) {
+    int iterations = 0;
+    u64 limit = (u64)(min_seconds * TIMING_TICKS_PER_SEC);
+    u64 start = timing_now();
+    u64 elapsed = 0;
+    while (iterations < 5 || elapsed < limit) {
+        jsmntok_t* tokens = NULL;
+        fn(json, len, &tokens);
+        mem_free(tokens);
+        iterations++;
+        elapsed = timing_now() - start;
+    }
+    return timing_ticks_to_us(elapsed) * 1000.0 / iterations / len;
+}
+
+// jsmn vs the structural scanner; returns false if their tokens differ
+static bool compare_tokenizers(const char* corpus_dir, double min_seconds) {
+    bool all_match = true;
+
+    printf("\n%-16s %8s %10s %10s %8s %6s\n", "tokenizer", "bytes", "jsmn ns/B", "scan ns/B",
+           "speedup", "match");
+    for (int i = 0; i < CASE_COUNT; i++) {
+        if (cases[i].kind >= CASE_WRITER) {
+            continue;
+        }
+
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", corpus_dir, cases[i].file);
+        size_t size = 0;
+        char* json = read_file(path, &size);
+        if (!json) {
+            continue;
+        }
+
+        jsmntok_t* expected = NULL;
+        jsmntok_t* actual = NULL;
+        int expected_count = jsmn_parse_alloc(json, size, &expected);
+        int actual_count = json_scan_tokenize(json, size, &actual);
+        bool match = expected_count == actual_count && expected_count > 0 &&
+                     memcmp(expected, actual, expected_count * sizeof(jsmntok_t)) == 0;
+        mem_free(expected);
+        mem_free(actual);
+        all_match = all_match && match;
+
+        double jsmn_ns = time_tokenizer(jsmn_parse_alloc, json, size, min_seconds);
+        double scan_ns = time_tokenizer(json_scan_tokenize, json, size, min_seconds);
+        printf("%-16s %8zu %10.2f %10.2f %7.1fx %6s\n", cases[i].name, size, jsmn_ns, scan_ns,
+               jsmn_ns / scan_ns, match ? "yes" : "NO");
+        free(json);
+    }
+    return all_match;
+}
+
+static double time_parse(const BenchCase* c, DiscordClient* client, const char* json, double min_seconds) {
+    int iterations = 0;
+    u64 limit = (u64)(min_seconds * TIMING_TICKS_PER_SEC);
+    u64 start = timing_now();
+    u64 elapsed = 0;
+    while (iterations < 5 || elapsed < limit) {
+        NetSample sample = {0};
+        run_once(c, client, json, &sample);
+        iterations++;
+        elapsed = timing_now() - start;
+    }
+    return timing_ticks_to_us(elapsed) / iterations;
+}
+
+// Single-threaded vs split across workers; returns false if results differ
+static bool compare_parallel(const char* corpus_dir, double min_seconds, int workers) {
+    bool all_match = true;
+    DiscordClient* expected = calloc(2, sizeof(DiscordClient));
+    if (!expected) {
+        return false;
+    }
+    DiscordClient* actual = expected + 1;
+
+    printf("\n%-16s %8s %9s %9s %8s %6s\n", "parallel", "bytes", "1 core us", "split us",
+           "speedup", "match");
+    for (int i = 0; i < CASE_COUNT; i++) {
+        if (cases[i].kind >= CASE_WRITER) {
+            continue;
+        }
+
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", corpus_dir, cases[i].file);
+        size_t size = 0;
+        char* json = read_file(path, &size);
+        if (!json) {
+            continue;
+        }
+
+        NetSample sample = {0};
+        run_once(&cases[i], expected, json, &sample);
+        double single_us = time_parse(&cases[i], expected, json, min_seconds);
+
+        job_system_init(workers);
+        run_once(&cases[i], actual, json, &sample);
+        double split_us = time_parse(&cases[i], actual, json, min_seconds);
+        job_system_cleanup();
+
+        bool match = memcmp(expected, actual, sizeof(DiscordClient)) == 0;
+        all_match = all_match && match;
+        printf("%-16s %8zu %9.1f %9.1f %7.2fx %6s%s\n", cases[i].name, size, single_us, split_us,
+               single_us / split_us, match ? "yes" : "NO",
+               size < DISCORD_PARSE_PARALLEL_MIN ? "  (below split threshold)" : "");
+        free(json);
+    }
+    free(expected);
+    return all_match;
+}
+
+#define MARKUP_SAMPLES 64
+#define TOP_SCREEN_COLUMNS 50
+
+static const char* const markup_formatted[] = {
+    "**bold** and *italic* with `inline code`, ||a spoiler|| and ~~old~~ __new__ text",
+    "ping <@&1174110232440759103> in <#1174195958050660376> about ***this*** <a:party:1174117527689446914>",
+    "```c\nint main(void) {\n    return 0;\n}\n``` see `main` and **do not** ship _debug_builds",
+    "snake_case_names stay plain, \\*escaped\\* too, but _this_ is italic **and __nested__**",
+};
+
+// Parse and render message contents; returns false if none were found
+static bool bench_markup(const char* corpus_dir, double min_seconds) {
+    static char raw[MARKUP_SAMPLES][MAX_TEXT_LENGTH];
+    static char text[MARKUP_SAMPLES][MAX_TEXT_LENGTH];
+    static MarkupSpans spans[MARKUP_SAMPLES];
+    char line[MARKUP_RENDER_MAX];
+    char path[512];
+    size_t size = 0;
+    int count = 0;
+
+    snprintf(path, sizeof(path), "%s/messages_page.json", corpus_dir);
+    char* json = read_file(path, &size);
+    if (!json) {
+        return false;
+    }
+    jsmntok_t* tokens = NULL;
+    int r = json_parse_alloc(json, &tokens);
+    for (int i = 1; i < r && count < MARKUP_SAMPLES; i = json_skip(tokens, r, i)) {
+        jsmntok_t* content = json_object_get(json, tokens, r, i, "content");
+        if (content) {
+            json_get_text(json, content, raw[count++], MAX_TEXT_LENGTH);
+        }
+    }
+    mem_free(tokens);
+    free(json);
+    for (size_t i = 0; i < sizeof(markup_formatted) / sizeof(markup_formatted[0]) && count < MARKUP_SAMPLES; i++) {
+        snprintf(raw[count++], MAX_TEXT_LENGTH, "%s", markup_formatted[i]);
+    }
+
+    // Visible lines as the top screen wraps them, two columns of indent
+    int lines = 0;
+    int span_total = 0;
+    for (int i = 0; i < count; i++) {
+        markup_parse(raw[i], text[i], sizeof(text[i]), &spans[i], NULL, NULL);
+        span_total += spans[i].span_count;
+        int column = 2;
+        lines++;
+        for (const char* c = text[i]; *c; c++) {
+            if (*c == '\n' || column == TOP_SCREEN_COLUMNS) {
+                lines++;
+                column = 2;
+            }
+            column += *c != '\n';
+        }
+    }
+
+    int iterations = 0;
+    u64 limit = (u64)(min_seconds * TIMING_TICKS_PER_SEC);
+    u64 start = timing_now();
+    u64 parse_ticks = 0;
+    while (iterations < 5 || parse_ticks < limit) {
+        for (int i = 0; i < count; i++) {
+            markup_parse(raw[i], text[i], sizeof(text[i]), &spans[i], NULL, NULL);
+        }
+        iterations++;
+        parse_ticks = timing_now() - start;
+    }
+    double parse_ns = timing_ticks_to_us(parse_ticks) * 1000.0 / iterations / count;
+
+    iterations = 0;
+    start = timing_now();
+    u64 render_ticks = 0;
+    while (iterations < 5 || render_ticks < limit) {
+        for (int i = 0; i < count; i++) {
+            markup_render(text[i], &spans[i], line, sizeof(line));
+        }
+        iterations++;
+        render_ticks = timing_now() - start;
+    }
+    double render_ns = timing_ticks_to_us(render_ticks) * 1000.0 / iterations / lines;
+
+    printf("\n%-16s %8s %8s %10s %14s\n", "markup", "messages", "spans", "parse ns", "render ns/line");
+    printf("%-16s %8d %8.2f %10.1f %14.1f\n", "messages_page", count, (double)span_total / count,
+           parse_ns, render_ns);
+    return true;
+}
+
+static void usage(const char* argv0) {
+    printf("Usage: %s [--corpus DIR] [--time SECONDS] [--save FILE] [--compare FILE] [--threshold PCT]"
+           " [--workers N]\n", argv0);
+}
+
+int main(int argc, char* argv[]) {
+    const char* corpus_dir = "corpus";
+    const char* save_path = NULL;
+    const char* compare_path = NULL;
+    double min_seconds = 0.5;
+    double threshold = 10.0;
+    int workers = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--corpus") == 0 && i + 1 < argc) {
+            corpus_dir = argv[++i];
+        } else if (strcmp(argv[i], "--time") == 0 && i + 1 < argc) {
+            min_seconds = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc) {
+            save_path = argv[++i];
+        } else if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc) {
+            compare_path = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            workers = atoi(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    mem_init();
+    
+    DiscordClient* client = malloc(sizeof(DiscordClient));
+    if (!client) {
+        printf("Failed to allocate DiscordClient\n");
+        return 1;
+    }
+    memset(client, 0, sizeof(DiscordClient));
+
+    BenchResult results[CASE_COUNT];
+    int result_count = 0;
+
+    printf("%-16s %8s %7s %10s %10s %8s %7s %8s\n", "case", "bytes", "tokens",
+           "parse ns/B", "total ns/B", "Mtok/s", "allocs", "peak KB");
+    for (int i = 0; i < CASE_COUNT; i++) {
+        if (run_case(&cases[i], corpus_dir, min_seconds, client, &results[result_count])) {
+            result_count++;
+        }
+    }
+
+    int status = result_count == CASE_COUNT ? 0 : 1;
+
+    if (!compare_tokenizers(corpus_dir, min_seconds)) {
+        printf("Structural scanner disagrees with jsmn\n");
+        status = 1;
+    }
+
+    if (!bench_markup(corpus_dir, min_seconds)) {
+        status = 1;
+    }
+
+    if (workers > 0 && !compare_parallel(corpus_dir, min_seconds, workers)) {
+        printf("Parallel parse disagrees with the single-threaded one\n");
+        status = 1;
+    }
+
+    if (save_path && !save_baseline(save_path, results, result_count)) {
+        status = 1;
+    }
+    if (compare_path) {
+        int regressions = compare_baseline(compare_path, results, result_count, threshold);
+        if (regressions != 0) {
+            status = 1;
+        }
+    }
+
+    free(client);
+    return status;
+}
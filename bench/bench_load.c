@@ -0,0 +1,385 @@
+// Host load driver: the real client over libcurl against a mock server.
+//
+// Runs connect, then rounds of fetch servers / switch server / fetch messages /
+// fetch members / post, through the same curl transport and coalescer as the
+// 3DS build, against --base (see mock/mock_discord.py and mock/run_load.py).
+// With --downloads DIR each round also saves one attachment through the
+// download manager (mock attachments can be cut off to exercise resume), and
+// with --upload FILE it posts FILE to the channel, streamed from disk.
+// --images ATLAS fetches every server icon and member avatar through the
+// image cache, checks the decoded pixels against the mock's pattern, then
+// starts a second session on the same atlas, which must not fetch any.
+// Reports wall-time p50/p95, CPU time, allocations and peak heap per operation,
+// then one "load:" summary line for run_load.py to collect.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "discord_api.h"
+#include "timing.h"
+#include "bench_alloc.h"
+#include "mem.h"
+#include "net_stats.h"
+#include "history.h"
+#include "client_view.h"
+#include "download.h"
+#include "image_cache.h"
+
+typedef enum {
+    OP_FETCH_SERVERS,
+    OP_SWITCH_SERVER,
+    OP_FETCH_MESSAGES,
+    OP_FETCH_USERS,
+    OP_POST_MESSAGE,
+    OP_DOWNLOAD,
+    OP_UPLOAD,
+    OP_COUNT
+} LoadOp;
+
+typedef struct {
+    int calls;
+    int failures;
+    double* wall_ms;            // One per call, sorted for the report
+    double cpu_ms;
+    size_t allocations;
+    size_t peak_bytes;
+} LoadStats;
+
+static const char* op_names[OP_COUNT] = {
+    "fetch_servers", "switch_server", "fetch_messages", "fetch_users", "post_message", "download", "upload"
+};
+
+static const char* upload_path = NULL;
+
+// Give up on a download that has not finished after this long
+#define DOWNLOAD_WAIT_MS 60000
+
+static double cpu_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Save the first attachment on screen that is not stored yet, and wait for it
+static bool download_one(DiscordClient* client) {
+    const DiscordAttachment* attachment = NULL;
+    for (int i = 0; i < client->message_count && !attachment; i++) {
+        const DiscordMessage* msg = &client->messages[i];
+        if (msg->attachment_count > 0 && msg->attachment.url[0] != '\0' &&
+            download_status(msg->attachment.id, NULL) != DOWNLOAD_DONE) {
+            attachment = &msg->attachment;
+        }
+    }
+    if (!attachment || !download_queue(attachment)) {
+        return false;
+    }
+
+    u64 deadline = timing_now() + (u64)DOWNLOAD_WAIT_MS * TIMING_TICKS_PER_SEC / 1000;
+    DownloadStatus status;
+    while (timing_now() < deadline) {
+        DownloadState state = download_status(attachment->id, &status);
+        if (state == DOWNLOAD_DONE) {
+            return true;
+        }
+        if (state == DOWNLOAD_FAILED) {
+            return false;
+        }
+        timing_sleep_ms(5);
+    }
+    return false;
+}
+
+// Give up on an image that is not ready after this long
+#define IMAGE_WAIT_MS 10000
+
+// Pixel (x, y) of the mock's image for hash as RGBA5551; image_pixel() in
+// mock/mock_discord.py
+static uint16_t expected_pixel(const char* hash, int x, int y) {
+    size_t len = strlen(hash);
+    const char* hex = hash + len - 32;
+    uint8_t colors[16];
+    for (int i = 0; i < 16; i++) {
+        unsigned int byte = 0;
+        sscanf(hex + i * 2, "%2x", &byte);
+        colors[i] = (uint8_t)byte;
+    }
+    int kind = (int)strtol(hash + len - 1, NULL, 16) % 4;
+    int block = IMAGE_CACHE_SIZE / 4;
+    int k = (x / block + y / block) % 4;
+    uint8_t r = colors[k * 3], g = colors[k * 3 + 1], b = colors[k * 3 + 2];
+    if (kind == 3) {
+        g = b = r;
+    }
+    if (k == 0 && (kind == 0 || kind == 2)) {
+        return 0;
+    }
+    return (uint16_t)(((r >> 3) << 11) | ((g >> 3) << 6) | ((b >> 3) << 1) | 1);
+}
+
+// Wait for one image and count the pixels that differ; -1 if it never came
+static int check_image(ImageKind kind, const char* owner_id, const char* hash) {
+    static ImageBitmap bitmap;
+    u64 deadline = timing_now() + (u64)IMAGE_WAIT_MS * TIMING_TICKS_PER_SEC / 1000;
+    while (!image_cache_get(kind, owner_id, hash, &bitmap)) {
+        if (timing_now() >= deadline) {
+            return -1;
+        }
+        timing_sleep_ms(1);
+    }
+    int wrong = 0;
+    for (int y = 0; y < IMAGE_CACHE_SIZE; y++) {
+        for (int x = 0; x < IMAGE_CACHE_SIZE; x++) {
+            wrong += bitmap.pixels[y * IMAGE_CACHE_SIZE + x] != expected_pixel(hash, x, y);
+        }
+    }
+    return wrong;
+}
+
+// One session of the image cache over every icon and avatar the client has;
+// returns the images that were missing or wrong, plus one if a repeat
+// session fetched anything
+static int image_session(DiscordClient* client, Transport* transport, const char* cdn, const char* atlas,
+                         bool repeat) {
+    if (!image_cache_init(transport, cdn, atlas)) {
+        return 1;
+    }
+    int icons = 0, avatars = 0, bad = 0;
+    u64 start = timing_now();
+    for (int i = 0; i < client->server_count; i++) {
+        if (client->servers[i].icon[0] != '\0') {
+            icons++;
+            bad += check_image(IMAGE_SERVER_ICON, client->servers[i].id, client->servers[i].icon) != 0;
+        }
+    }
+    for (int i = 0; i < client->user_count; i++) {
+        if (client->users[i].avatar[0] != '\0') {
+            avatars++;
+            bad += check_image(IMAGE_USER_AVATAR, client->users[i].id, client->users[i].avatar) != 0;
+        }
+    }
+    double ms = timing_ticks_to_ms(timing_now() - start);
+    ImageCacheStats images = image_cache_get_stats();
+    printf("images %s: %d icons + %d avatars in %.0f ms, %d fetched (%.1f KB, decode %.3f ms each), "
+           "%d from the card, %d wrong or missing\n", repeat ? "again" : "first", icons, avatars, ms, images.fetched,
+           images.bytes / 1024.0, images.fetched > 0 ? images.decode_ms / images.fetched : 0.0,
+           images.card_loads, bad);
+    image_cache_cleanup();
+    return bad + (repeat && images.fetched > 0);
+}
+
+static bool run_op(DiscordClient* client, LoadOp op, int round) {
+    char content[64];
+    switch (op) {
+        case OP_FETCH_SERVERS:
+            return discord_fetch_servers(client);
+        case OP_SWITCH_SERVER:
+            return client->server_count > 0 &&
+                   discord_switch_server(client, client->servers[round % client->server_count].id);
+        case OP_FETCH_MESSAGES:
+            return discord_fetch_messages(client);
+        case OP_FETCH_USERS:
+            return discord_fetch_users(client);
+        case OP_POST_MESSAGE:
+            snprintf(content, sizeof(content), "load test message %d", round);
+            return strlen(client->current_channel_id) > 0 &&
+                   discord_post_message(client, client->current_channel_id, content, NULL, NULL, NULL) == 200;
+        case OP_DOWNLOAD:
+            return download_one(client);
+        case OP_UPLOAD:
+            snprintf(content, sizeof(content), "load test upload %d", round);
+            return strlen(client->current_channel_id) > 0 &&
+                   discord_upload_file(client, client->current_channel_id, content, upload_path,
+                                       NULL, NULL, NULL, NULL, NULL) == 200;
+        default:
+            return false;
+    }
+}
+
+static void measure_op(DiscordClient* client, LoadOp op, int round, LoadStats* stats) {
+    BenchAllocStats before = bench_alloc_stats();
+    bench_alloc_reset_peak();
+    double cpu_start = cpu_now_ms();
+    u64 wall_start = timing_now();
+
+    bool ok = run_op(client, op, round);
+
+    stats->wall_ms[stats->calls++] = timing_ticks_to_ms(timing_now() - wall_start);
+    stats->cpu_ms += cpu_now_ms() - cpu_start;
+    stats->failures += ok ? 0 : 1;
+
+    BenchAllocStats after = bench_alloc_stats();
+    stats->allocations += after.allocations - before.allocations;
+    if (after.peak_bytes - before.current_bytes > stats->peak_bytes) {
+        stats->peak_bytes = after.peak_bytes - before.current_bytes;
+    }
+}
+
+static void usage(const char* argv0) {
+    printf("Usage: %s [--base URL] [--name NAME] [--rounds N] [--window MS] [--downloads DIR] [--upload FILE] [--images ATLAS]\n", argv0);
+}
+
+int main(int argc, char* argv[]) {
+    const char* base = "http://127.0.0.1:8080/api/v10";
+    const char* name = "load";
+    int rounds = 20;
+    int window = 1000;
+    const char* download_dir = NULL;
+    const char* image_atlas = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--base") == 0 && i + 1 < argc) {
+            base = argv[++i];
+        } else if (strcmp(argv[i], "--name") == 0 && i + 1 < argc) {
+            name = argv[++i];
+        } else if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) {
+            rounds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+            window = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--downloads") == 0 && i + 1 < argc) {
+            download_dir = argv[++i];
+        } else if (strcmp(argv[i], "--upload") == 0 && i + 1 < argc) {
+            upload_path = argv[++i];
+        } else if (strcmp(argv[i], "--images") == 0 && i + 1 < argc) {
+            image_atlas = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (rounds < 1) {
+        rounds = 1;
+    }
+
+    mem_init();
+
+    // Same stack as main.c, minus the recorder
+    Transport* transport = transport_curl_create(base);
+    if (!transport) {
+        return 1;
+    }
+    if (window >= 0) {
+        transport = transport_coalesce_create(transport, (uint32_t)window);
+    }
+
+    DiscordClient* client = malloc(sizeof(DiscordClient));
+    if (!client) {
+        transport_destroy(transport);
+        return 1;
+    }
+    LoadStats stats[OP_COUNT];
+    memset(stats, 0, sizeof(stats));
+    for (int op = 0; op < OP_COUNT; op++) {
+        if ((op != OP_DOWNLOAD || download_dir) && (op != OP_UPLOAD || upload_path)) {
+            stats[op].wall_ms = malloc(rounds * sizeof(double));
+        }
+    }
+
+    net_stats_init(NULL);
+    history_init();
+    client_view_init();
+    discord_init(client, "load-token", transport);
+
+    double cpu_start = cpu_now_ms();
+    u64 wall_start = timing_now();
+    u64 connect_start = timing_now();
+    if (!discord_connect(client)) {
+        printf("load: %s failed to connect to %s\n", name, base);
+        return 1;
+    }
+    double connect_ms = timing_ticks_to_ms(timing_now() - connect_start);
+    if (download_dir && !download_init(transport, download_dir)) {
+        return 1;
+    }
+
+    for (int round = 0; round < rounds; round++) {
+        for (int op = 0; op < OP_COUNT; op++) {
+            if (stats[op].wall_ms) {
+                measure_op(client, (LoadOp)op, round, &stats[op]);
+            }
+        }
+    }
+    double wall_ms = timing_ticks_to_ms(timing_now() - wall_start);
+    double cpu_ms = cpu_now_ms() - cpu_start;
+
+    printf("%-16s %6s %6s %9s %9s %9s %8s %9s\n", "operation", "calls", "fails",
+           "p50 ms", "p95 ms", "cpu ms", "allocs", "peak KB");
+    double worst_p95 = 0;
+    size_t peak = 0;
+    int failures = 0;
+    for (int op = 0; op < OP_COUNT; op++) {
+        LoadStats* s = &stats[op];
+        if (s->calls == 0) {
+            continue;
+        }
+        qsort(s->wall_ms, s->calls, sizeof(double), compare_doubles);
+        double p50 = s->wall_ms[(s->calls - 1) / 2];
+        double p95 = s->wall_ms[(s->calls * 95 - 1) / 100];
+        printf("%-16s %6d %6d %9.1f %9.1f %9.3f %8.1f %9.1f\n", op_names[op], s->calls, s->failures,
+               p50, p95, s->cpu_ms / s->calls, (double)s->allocations / s->calls, s->peak_bytes / 1024.0);
+        if (p95 > worst_p95) {
+            worst_p95 = p95;
+        }
+        if (s->peak_bytes > peak) {
+            peak = s->peak_bytes;
+        }
+        failures += s->failures;
+    }
+
+    double total_p50 = 0, total_p95 = 0;
+    net_stats_percentiles(NET_METRIC_TOTAL, &total_p50, &total_p95);
+    if (download_dir) {
+        DownloadStats downloads = download_get_stats();
+        printf("\ndownloads: %d completed, %d resumed, %d retries, %d deduplicated, %d failed, %.1f KB\n",
+               downloads.completed, downloads.resumed, downloads.retries, downloads.deduplicated,
+               downloads.failed, downloads.bytes / 1024.0);
+    }
+    struct stat upload_st;
+    if (upload_path && stats[OP_UPLOAD].calls > 0 && stat(upload_path, &upload_st) == 0) {
+        // The same sort as the table above, so index (calls - 1) / 2 is p50
+        double p50 = stats[OP_UPLOAD].wall_ms[(stats[OP_UPLOAD].calls - 1) / 2];
+        printf("\nuploads: %.1f KB file, %.2f MB/s at p50, peak heap %.1f KB\n", upload_st.st_size / 1024.0,
+               p50 > 0 ? upload_st.st_size / (p50 / 1000.0) / 1e6 : 0.0, stats[OP_UPLOAD].peak_bytes / 1024.0);
+    }
+    if (image_atlas) {
+        // The mock serves the CDN paths at its root
+        char cdn[128];
+        snprintf(cdn, sizeof(cdn), "%s", base);
+        char* api = strstr(cdn, "/api/");
+        if (api) {
+            *api = '\0';
+        }
+        if (client->user_count == 0) {
+            discord_fetch_users(client);
+        }
+        printf("\n");
+        remove(image_atlas);
+        failures += image_session(client, transport, cdn, image_atlas, false);
+        failures += image_session(client, transport, cdn, image_atlas, true);
+    }
+    printf("\nrequests: total time p50 %.1f ms, p95 %.1f ms (last %d), connect %.1f ms\n",
+           total_p50, total_p95, NET_STATS_WINDOW, connect_ms);
+    printf("load: %s rounds=%d wall_ms=%.0f cpu_ms=%.1f cpu_pct=%.1f peak_kb=%.0f worst_p95_ms=%.1f failures=%d\n",
+           name, rounds, wall_ms, cpu_ms, 100.0 * cpu_ms / wall_ms, peak / 1024.0, worst_p95, failures);
+
+    printf("\n");
+    mem_dump(stdout);
+
+    download_cleanup();
+    discord_cleanup(client);
+    history_cleanup();
+    client_view_cleanup();
+    free(client);
+    for (int op = 0; op < OP_COUNT; op++) {
+        free(stats[op].wall_ms);
+    }
+    net_stats_cleanup();
+    return failures > 0 ? 2 : 0;
+}
@@ -0,0 +1,352 @@
+// Host benchmark of the render path.
+//
+// "lists" formats a server list the way ui.c does through a VList, for
+// backing stores of 10 to 10000 entries, with the cursor sweeping the whole
+// list. A frame only formats the visible rows, so its cost should not depend
+// on the list length; "all rows" formats every entry per frame for
+// comparison, as a loop over the whole store without the cap would.
+//
+// "screens" runs ui.c itself: both screens are rendered into the console
+// emulator (console_emu.c) from a client holding 10 to MAX_SERVERS servers
+// and channels, the server cursor and message scroll sweeping their ranges.
+// ns/frame covers both screens, the emulator's parsing included; bytes,
+// escapes and cells are what a frame sends to the two consoles.
+//
+// "loop" runs the main loop's render-and-wait cycle for a few seconds with
+// no input while a thread publishes a new client view every second, once
+// drawing every vblank as the loop used to and once paced by wake.h, and
+// reports the share of the time the loop's thread spent on the CPU.
+//
+// --snapshot DIR writes the screens of a few fixed states to DIR, and
+// --compare DIR renders the same states and reports any that differ, so a
+// change to ui.c can be checked against the screens from before it.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "client_view.h"
+#include "console_emu.h"
+#include "discord_api.h"
+#include "markup.h"
+#include "timing.h"
+#include "ui.h"
+#include "vlist.h"
+#include "wake.h"
+
+#define VISIBLE_ROWS 6
+
+// Room for a styled 50x30 snapshot
+#define SNAPSHOT_MAX (64 * 1024)
+
+static const char* const words[] = {
+    "Samus", "Lucina", "Kirby", "Homebrew", "Retro", "Pixel", "Luma", "Dev", "Lounge", "Hub"
+};
+
+// Message contents, some with markup so the renderer emits spans
+static const char* const contents[] = {
+    "anyone tried the new **luma** build?",
+    "works fine on my o3ds, `boot.firm` from the release page",
+    "~~never mind~~ found it, thanks",
+    "the *old* one still crashes on __wake__ though",
+    "gm",
+    "has anyone got the homebrew launcher running on 11.17 yet? asking for a friend",
+};
+
+static void fill_servers(DiscordServer* servers, int count) {
+    for (int i = 0; i < count; i++) {
+        snprintf(servers[i].id, sizeof(servers[i].id), "%llu", 1174157304761885470ULL + i);
+        snprintf(servers[i].name, sizeof(servers[i].name), "%s %s %d", words[i % 10], words[(i / 10) % 10], i);
+    }
+}
+
+// Same layout as ui_format_server, minus the unread lookup
+static void format_server(int index, bool selected, char* line, size_t size, void* ctx) {
+    const DiscordServer* servers = (const DiscordServer*)ctx;
+    snprintf(line, size, "%s%c %.30s\x1b[0m", selected ? "\x1b[42;30m" : "", selected ? '>' : ' ',
+             servers[index].name);
+}
+
+// Nanoseconds per frame, the cursor moving one row each frame
+static double time_frames(const DiscordServer* servers, int count, bool all_rows, int frames) {
+    static char out[16 * 1024 * 1024];
+    VList list;
+    vlist_init(&list, all_rows ? count : VISIBLE_ROWS);
+    vlist_set_count(&list, count);
+
+    size_t sink = 0;
+    u64 start = timing_now();
+    for (int frame = 0; frame < frames; frame++) {
+        vlist_set_cursor(&list, frame % count);
+        sink += vlist_render(&list, format_server, (void*)servers, out, sizeof(out));
+    }
+    double ns = timing_ticks_to_us(timing_now() - start) * 1000.0 / frames;
+    if (sink == 0) {
+        printf("nothing rendered\n");
+    }
+    return ns;
+}
+
+static void bench_lists(int frames) {
+    static const int sizes[] = { 10, 100, 1000, 10000 };
+    DiscordServer* servers = malloc(10000 * sizeof(DiscordServer));
+    if (!servers) {
+        return;
+    }
+    fill_servers(servers, 10000);
+
+    printf("%-8s %14s %16s\n", "entries", "ns/frame", "all rows ns");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        int count = sizes[i];
+        double visible = time_frames(servers, count, false, frames);
+        // Formatting everything is slow at 10k; fewer frames give the same mean
+        double all = time_frames(servers, count, true, frames / count > 20 ? frames / count : 20);
+        printf("%-8d %14.0f %16.0f\n", count, visible, all);
+    }
+    free(servers);
+}
+
+// A connected client with count servers and channels, full member and
+// message lists, published for the renderer
+static void fill_client(DiscordClient* client, int count) {
+    memset(client, 0, sizeof(DiscordClient));
+    client->connected = true;
+
+    fill_servers(client->servers, count);
+    client->server_count = count;
+    for (int i = 0; i < count; i++) {
+        DiscordChannel* channel = &client->channels[i];
+        snprintf(channel->id, sizeof(channel->id), "%llu", 1174157304761886000ULL + i);
+        snprintf(channel->name, sizeof(channel->name), "%s-%s-%d", words[(i / 10) % 10], words[i % 10], i);
+    }
+    client->channel_count = count;
+    strcpy(client->current_server_id, client->servers[0].id);
+    strcpy(client->current_channel_id, client->channels[0].id);
+
+    for (int i = 0; i < MAX_USERS; i++) {
+        DiscordUser* user = &client->users[i];
+        snprintf(user->id, sizeof(user->id), "%llu", 90000000000000000ULL + i);
+        snprintf(user->username, sizeof(user->username), "%s%d", words[i % 10], i);
+        snprintf(user->discriminator, sizeof(user->discriminator), "%04d", (i * 37) % 10000);
+        user->online = i % 3 != 0;
+    }
+    client->user_count = MAX_USERS;
+
+    for (int i = 0; i < MAX_MESSAGES; i++) {
+        DiscordMessage* msg = &client->messages[i];
+        snprintf(msg->id, sizeof(msg->id), "%llu", 1200000000000000000ULL + i);
+        snprintf(msg->author, sizeof(msg->author), "%s%d", words[(i * 7) % 10], (i * 7) % MAX_USERS);
+        snprintf(msg->timestamp, sizeof(msg->timestamp), "%02d:%02d", 12 + i / 60, i % 60);
+        markup_parse(contents[i % 6], msg->content, sizeof(msg->content), &msg->markup, NULL, NULL);
+    }
+    client->message_count = MAX_MESSAGES;
+
+    client_view_publish(client);
+}
+
+// Put the UI in the state of frame: the server cursor on row frame and the
+// messages scrolled by frame, both wrapping
+static void set_frame(UIState* state, const DiscordClient* client, int frame) {
+    state->focus = UI_FOCUS_SERVERS;
+    vlist_set_count(&state->server_list, client->server_count);
+    vlist_set_cursor(&state->server_list, frame % client->server_count);
+    state->message_scroll = frame % (client->message_count - 10);
+}
+
+static void render_frame(DiscordClient* client, UIState* state, ConsoleEmuFrame* top, ConsoleEmuFrame* bottom) {
+    console_emu_capture(true);
+    ui_render_top_screen(client, state);
+    ui_render_bottom_screen(client, state);
+    *top = console_emu_end_frame(console_emu_screen(GFX_TOP));
+    *bottom = console_emu_end_frame(console_emu_screen(GFX_BOTTOM));
+    console_emu_capture(false);
+}
+
+static void bench_screens(DiscordClient* client, int frames) {
+    static const int sizes[] = { 10, 50, MAX_SERVERS };
+
+    printf("\n%-8s %10s %10s %9s %9s %12s\n", "servers", "ns/frame", "bytes", "escapes", "cells", "cells/byte");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        fill_client(client, sizes[i]);
+        UIState state;
+        ui_state_init(&state);
+
+        ConsoleEmuFrame top, bottom;
+        size_t bytes = 0;
+        long escapes = 0, cells = 0;
+        u64 start = timing_now();
+        for (int frame = 0; frame < frames; frame++) {
+            set_frame(&state, client, frame);
+            render_frame(client, &state, &top, &bottom);
+            bytes += top.bytes + bottom.bytes;
+            escapes += top.escapes + bottom.escapes;
+            cells += top.cells_changed + bottom.cells_changed;
+        }
+        double ns = timing_ticks_to_us(timing_now() - start) * 1000.0 / frames;
+        printf("%-8d %10.0f %10zu %9ld %9ld %12.3f\n", sizes[i], ns, bytes / frames, escapes / frames,
+               cells / frames, bytes ? (double)cells / bytes : 0.0);
+    }
+}
+
+// Stands in for the network side during the loop benchmark
+typedef struct {
+    DiscordClient* client;
+    volatile bool running;
+} Publisher;
+
+static void publisher_thread(void* arg) {
+    Publisher* publisher = (Publisher*)arg;
+    while (publisher->running) {
+        timing_sleep_ms(1000);
+        client_view_publish(publisher->client);
+    }
+}
+
+static double thread_cpu_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Idle main loop for seconds; paced uses wake.h, otherwise every iteration
+// draws and waits for the vblank
+static void run_loop(DiscordClient* client, bool paced, int seconds) {
+    UIState state;
+    ui_state_init(&state);
+    ConsoleEmuFrame top, bottom;
+
+    Publisher publisher = { client, true };
+    Thread thread = threadCreate(publisher_thread, &publisher, 16 * 1024, 0x30, -2, false);
+
+    int iterations = 0, rendered = 0;
+    wake_init();
+    double cpu_start = thread_cpu_ms();
+    u64 start = timing_now();
+    while (timing_ticks_to_ms(timing_now() - start) < seconds * 1000.0) {
+        iterations++;
+        if (!paced || wake_begin_frame(false, false)) {
+            render_frame(client, &state, &top, &bottom);
+            rendered++;
+        }
+        if (paced) {
+            wake_end_frame();
+        } else {
+            gspWaitForVBlank();
+        }
+    }
+    double cpu_ms = thread_cpu_ms() - cpu_start;
+    double wall_ms = timing_ticks_to_ms(timing_now() - start);
+
+    publisher.running = false;
+    threadJoin(thread, U64_MAX);
+    threadFree(thread);
+    wake_cleanup();
+
+    printf("%-8s %10d %10d %11.2f%%\n", paced ? "wake" : "vblank", iterations, rendered, 100.0 * cpu_ms / wall_ms);
+}
+
+static void bench_loop(DiscordClient* client, int seconds) {
+    fill_client(client, 50);
+    printf("\n%-8s %10s %10s %12s\n", "loop", "iterations", "rendered", "cpu duty");
+    run_loop(client, false, seconds);
+    run_loop(client, true, seconds);
+}
+
+// Snapshot states: list size, then the frame set_frame sets up
+static const int snapshot_states[][2] = {
+    { 10, 0 }, { 10, 9 }, { 50, 25 }, { MAX_SERVERS, 0 }, { MAX_SERVERS, 137 }, { MAX_SERVERS, 199 },
+};
+
+// Render every snapshot state and write (compare == false) or check
+// (compare == true) its screens in dir. Returns the mismatches.
+static int snapshot_screens(DiscordClient* client, const char* dir, bool compare) {
+    static char screen[SNAPSHOT_MAX];
+    static char expected[SNAPSHOT_MAX];
+    int mismatches = 0;
+
+    for (size_t i = 0; i < sizeof(snapshot_states) / sizeof(snapshot_states[0]); i++) {
+        fill_client(client, snapshot_states[i][0]);
+        UIState state;
+        ui_state_init(&state);
+        set_frame(&state, client, snapshot_states[i][1]);
+        ConsoleEmuFrame top, bottom;
+        render_frame(client, &state, &top, &bottom);
+
+        for (int s = 0; s < 2; s++) {
+            char path[512];
+            snprintf(path, sizeof(path), "%s/%s_%d_%d.txt", dir, s == 0 ? "top" : "bottom",
+                     snapshot_states[i][0], snapshot_states[i][1]);
+            size_t len = console_emu_snapshot(console_emu_screen(s == 0 ? GFX_TOP : GFX_BOTTOM), true,
+                                              screen, sizeof(screen));
+
+            FILE* file = fopen(path, compare ? "rb" : "wb");
+            if (!file) {
+                printf("Cannot open %s\n", path);
+                mismatches++;
+                continue;
+            }
+            if (!compare) {
+                fwrite(screen, 1, len, file);
+            } else {
+                size_t got = fread(expected, 1, sizeof(expected), file);
+                if (got != len || memcmp(expected, screen, len) != 0) {
+                    printf("Mismatch: %s\n", path);
+                    mismatches++;
+                }
+            }
+            fclose(file);
+        }
+    }
+    return mismatches;
+}
+
+int main(int argc, char* argv[]) {
+    int frames = 20000;
+    int loop_seconds = 3;
+    const char* snapshot_dir = NULL;
+    const char* compare_dir = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--loop") == 0 && i + 1 < argc) {
+            loop_seconds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc) {
+            snapshot_dir = argv[++i];
+        } else if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc) {
+            compare_dir = argv[++i];
+        } else {
+            printf("Usage: %s [--frames N] [--loop SECONDS] [--snapshot DIR | --compare DIR]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    DiscordClient* client = malloc(sizeof(DiscordClient));
+    if (!client) {
+        return 1;
+    }
+    // The outbox and poller are left uninitialized: the screens show no
+    // pending messages or unread counts
+    client_view_init();
+    ui_init();
+
+    int status = 0;
+    if (snapshot_dir || compare_dir) {
+        int mismatches = snapshot_screens(client, compare_dir ? compare_dir : snapshot_dir, compare_dir != NULL);
+        if (compare_dir) {
+            printf("%d screen(s) differ\n", mismatches);
+        }
+        status = mismatches > 0 ? 1 : 0;
+    } else {
+        bench_lists(frames);
+        bench_screens(client, frames / 10);
+        if (loop_seconds > 0) {
+            bench_loop(client, loop_seconds);
+        }
+    }
+
+    ui_cleanup();
+    client_view_cleanup();
+    free(client);
+    return status;
+}
@@ -0,0 +1,321 @@
+#define _GNU_SOURCE
+#include "console_emu.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// libctru's default tab stop
+#define TAB_SIZE 3
+
+static PrintConsole* selected = NULL;
+static PrintConsole* screens[2] = { NULL, NULL };
+static FILE* terminal = NULL;   // stdout while capture is on
+static FILE* capture = NULL;
+
+static const ConsoleCell default_pen = { ' ', 7, 0, 0 };
+
+static void blank(PrintConsole* console, int y, int x0, int x1) {
+    ConsoleCell cell = { ' ', console->pen.fg, console->pen.bg, 0 };
+    for (int x = x0; x < x1; x++) {
+        console->cells[y][x] = cell;
+    }
+}
+
+static void clamp_cursor(PrintConsole* console) {
+    if (console->cursorX < 0) {
+        console->cursorX = 0;
+    }
+    if (console->cursorX > console->windowWidth - 1) {
+        console->cursorX = console->windowWidth - 1;
+    }
+    if (console->cursorY < 0) {
+        console->cursorY = 0;
+    }
+    if (console->cursorY > console->windowHeight - 1) {
+        console->cursorY = console->windowHeight - 1;
+    }
+}
+
+static void new_row(PrintConsole* console) {
+    console->cursorX = 0;
+    if (++console->cursorY < console->windowHeight) {
+        return;
+    }
+    // Scroll the window up a line
+    memmove(console->cells[0], console->cells[1], (console->windowHeight - 1) * sizeof(console->cells[0]));
+    blank(console, console->windowHeight - 1, 0, console->windowWidth);
+    console->cursorY = console->windowHeight - 1;
+}
+
+static void apply_sgr(PrintConsole* console, const int* params, int count) {
+    static const u8 attrs[10] = {
+        0, CONSOLE_EMU_BOLD, CONSOLE_EMU_FAINT, CONSOLE_EMU_ITALIC, CONSOLE_EMU_UNDERLINE,
+        CONSOLE_EMU_BLINK, 0, CONSOLE_EMU_REVERSE, 0, CONSOLE_EMU_STRIKE
+    };
+    for (int i = 0; i < count; i++) {
+        int p = params[i];
+        if (p == 0) {
+            console->pen = default_pen;
+        } else if (p < 10) {
+            console->pen.attr |= attrs[p];
+        } else if (p >= 30 && p <= 37) {
+            console->pen.fg = (u8)(p - 30);
+        } else if (p == 39) {
+            console->pen.fg = default_pen.fg;
+        } else if (p >= 40 && p <= 47) {
+            console->pen.bg = (u8)(p - 40);
+        } else if (p == 49) {
+            console->pen.bg = default_pen.bg;
+        }
+    }
+}
+
+static void run_escape(PrintConsole* console) {
+    char final = console->escape[console->escape_len - 1];
+    int params[8] = {0};
+    int count = 0;
+
+    // Parameters between "ESC[" and the final byte, ';'-separated
+    const char* p = console->escape + 2;
+    while (p < console->escape + console->escape_len - 1 && count < 8) {
+        params[count++] = (int)strtol(p, (char**)&p, 10);
+        if (*p == ';') {
+            p++;
+        } else {
+            break;
+        }
+    }
+    if (count == 0) {
+        count = 1;
+    }
+    int n = params[0] > 0 ? params[0] : 1;
+
+    console->escapes++;
+    switch (final) {
+        case 'H':
+        case 'f':
+            console->cursorY = params[0];
+            console->cursorX = params[1];
+            break;
+        case 'A':
+            console->cursorY -= n;
+            break;
+        case 'B':
+            console->cursorY += n;
+            break;
+        case 'C':
+            console->cursorX += n;
+            break;
+        case 'D':
+            console->cursorX -= n;
+            break;
+        case 'J':
+            if (params[0] == 2) {
+                for (int y = 0; y < console->windowHeight; y++) {
+                    blank(console, y, 0, console->windowWidth);
+                }
+                console->cursorX = 0;
+                console->cursorY = 0;
+                console->clears++;
+            } else if (params[0] == 0) {
+                blank(console, console->cursorY, console->cursorX, console->windowWidth);
+                for (int y = console->cursorY + 1; y < console->windowHeight; y++) {
+                    blank(console, y, 0, console->windowWidth);
+                }
+            }
+            break;
+        case 'K':
+            if (params[0] == 0) {
+                blank(console, console->cursorY, console->cursorX, console->windowWidth);
+            } else if (params[0] == 1) {
+                blank(console, console->cursorY, 0, console->cursorX + 1);
+            } else {
+                blank(console, console->cursorY, 0, console->windowWidth);
+            }
+            break;
+        case 'm':
+            apply_sgr(console, params, count);
+            break;
+        case 's':
+            console->savedX = console->cursorX;
+            console->savedY = console->cursorY;
+            break;
+        case 'u':
+            console->cursorX = console->savedX;
+            console->cursorY = console->savedY;
+            break;
+        default:
+            break;
+    }
+    clamp_cursor(console);
+}
+
+static void put_byte(PrintConsole* console, char c) {
+    if (console->escape_len >= 0) {
+        console->escape[console->escape_len++] = c;
+        if (console->escape_len == 2 && c != '[') {
+            console->escape_len = -1;       // Not a CSI sequence; dropped
+        } else if (console->escape_len > 2 && c >= 0x40 && c <= 0x7E) {
+            run_escape(console);
+            console->escape_len = -1;
+        } else if (console->escape_len == (int)sizeof(console->escape)) {
+            console->escape_len = -1;
+        }
+        return;
+    }
+
+    switch (c) {
+        case '\x1b':
+            console->escape[0] = c;
+            console->escape_len = 1;
+            return;
+        case '\n':
+            new_row(console);
+            return;
+        case '\r':
+            console->cursorX = 0;
+            return;
+        case '\t':
+            console->cursorX += TAB_SIZE - console->cursorX % TAB_SIZE;
+            if (console->cursorX >= console->windowWidth) {
+                new_row(console);
+            }
+            return;
+        case '\b':
+            if (console->cursorX > 0) {
+                console->cursorX--;
+            }
+            return;
+        default:
+            break;
+    }
+
+    // Wrap before a character that would not fit, like libctru
+    if (console->cursorX >= console->windowWidth) {
+        new_row(console);
+    }
+    ConsoleCell cell = console->pen;
+    cell.ch = (u8)c;
+    console->cells[console->cursorY][console->cursorX++] = cell;
+}
+
+static ssize_t capture_write(void* cookie, const char* buf, size_t size) {
+    (void)cookie;
+    if (selected) {
+        selected->bytes += size;
+        for (size_t i = 0; i < size; i++) {
+            put_byte(selected, buf[i]);
+        }
+    }
+    return (ssize_t)size;
+}
+
+PrintConsole* consoleInit(gfxScreen_t screen, PrintConsole* console) {
+    static PrintConsole fallback;
+    if (!console) {
+        console = &fallback;
+    }
+    memset(console, 0, sizeof(PrintConsole));
+    console->windowWidth = screen == GFX_TOP ? 50 : 40;
+    console->windowHeight = CONSOLE_MAX_HEIGHT;
+    console->pen = default_pen;
+    console->escape_len = -1;
+    for (int y = 0; y < console->windowHeight; y++) {
+        blank(console, y, 0, console->windowWidth);
+    }
+    memcpy(console->shown, console->cells, sizeof(console->cells));
+    screens[screen] = console;
+    consoleSelect(console);
+    return console;
+}
+
+PrintConsole* consoleSelect(PrintConsole* console) {
+    // What was printed so far belongs to the previous console
+    fflush(stdout);
+    PrintConsole* previous = selected;
+    selected = console;
+    return previous;
+}
+
+void consoleClear(void) {
+    printf("\x1b[2J");
+}
+
+PrintConsole* console_emu_screen(gfxScreen_t screen) {
+    return screens[screen];
+}
+
+void console_emu_capture(bool on) {
+    fflush(stdout);
+    if (on && !terminal) {
+        if (!capture) {
+            cookie_io_functions_t io = { .write = capture_write };
+            capture = fopencookie(NULL, "w", io);
+            setvbuf(capture, NULL, _IOFBF, 4096);
+        }
+        terminal = stdout;
+        stdout = capture;
+    } else if (!on && terminal) {
+        stdout = terminal;
+        terminal = NULL;
+    }
+}
+
+ConsoleEmuFrame console_emu_end_frame(PrintConsole* console) {
+    fflush(stdout);
+
+    ConsoleEmuFrame frame = { console->bytes, console->escapes, console->clears, 0 };
+    for (int y = 0; y < console->windowHeight; y++) {
+        for (int x = 0; x < console->windowWidth; x++) {
+            if (memcmp(&console->cells[y][x], &console->shown[y][x], sizeof(ConsoleCell)) != 0) {
+                frame.cells_changed++;
+            }
+        }
+    }
+    memcpy(console->shown, console->cells, sizeof(console->cells));
+    console->bytes = 0;
+    console->escapes = 0;
+    console->clears = 0;
+    return frame;
+}
+
+size_t console_emu_snapshot(const PrintConsole* console, bool styles, char* out, size_t size) {
+    size_t pos = 0;
+    if (size == 0) {
+        return 0;
+    }
+
+    for (int y = 0; y < console->windowHeight; y++) {
+        const ConsoleCell* row = console->cells[y];
+        int len = console->windowWidth;
+        while (len > 0 && row[len - 1].ch == ' ' && row[len - 1].bg == default_pen.bg) {
+            len--;
+        }
+        for (int x = 0; x < len && pos + 1 < size; x++) {
+            out[pos++] = (char)row[x].ch;
+        }
+        if (pos + 1 < size) {
+            out[pos++] = '\n';
+        }
+
+        if (styles) {
+            // "column:fg/bg/attr" wherever the style changes from the left
+            ConsoleCell style = default_pen;
+            bool any = false;
+            for (int x = 0; x < console->windowWidth; x++) {
+                if (row[x].fg != style.fg || row[x].bg != style.bg || row[x].attr != style.attr) {
+                    style = row[x];
+                    int n = snprintf(out + pos, size - pos, "%s%d:%d/%d/%02x", any ? " " : "~ ",
+                                     x, style.fg, style.bg, style.attr);
+                    pos += n > 0 && (size_t)n < size - pos ? (size_t)n : 0;
+                    any = true;
+                }
+            }
+            if (any && pos + 1 < size) {
+                out[pos++] = '\n';
+            }
+        }
+    }
+    out[pos] = '\0';
+    return pos;
+}
@@ -0,0 +1,50 @@
+#ifndef CONSOLE_EMU_H
+#define CONSOLE_EMU_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <3ds.h>
+
+// Host emulation of libctru's text console, for measuring ui.c off-device.
+//
+// consoleInit/consoleSelect/consoleClear (declared in shim/3ds.h) work as on
+// the 3DS: while capture is on, stdout feeds the selected console, which
+// interprets the ANSI subset libctru implements (cursor position and moves,
+// SGR colours and attributes, 2J/K erase, save/restore) on its cell grid.
+// Each console counts the bytes and escape sequences written to it, and
+// console_emu_end_frame reports how many cells changed since the last frame.
+
+// PrintConsole.pen.attr / ConsoleCell.attr bits
+#define CONSOLE_EMU_BOLD 0x01
+#define CONSOLE_EMU_FAINT 0x02
+#define CONSOLE_EMU_ITALIC 0x04
+#define CONSOLE_EMU_UNDERLINE 0x08
+#define CONSOLE_EMU_BLINK 0x10
+#define CONSOLE_EMU_REVERSE 0x20
+#define CONSOLE_EMU_STRIKE 0x40
+
+typedef struct {
+    size_t bytes;               // Written to the console
+    int escapes;                // Escape sequences among them
+    int clears;                 // consoleClear / ESC[2J
+    int cells_changed;          // Cells that differ from the last frame
+} ConsoleEmuFrame;
+
+// Route stdout into the selected console (true) or back to the terminal
+void console_emu_capture(bool on);
+
+// Console last initialized on screen, or NULL; lets a benchmark reach the
+// consoles ui.c keeps to itself
+PrintConsole* console_emu_screen(gfxScreen_t screen);
+
+// Close console's frame: its counters since the previous call, and the
+// cells changed since then
+ConsoleEmuFrame console_emu_end_frame(PrintConsole* console);
+
+// Write console's grid into out as text, one line per row with trailing
+// blanks trimmed. With styles, each row is followed by a line giving every
+// cell's colours and attributes, so highlights are compared too. Returns the
+// bytes written, excluding the NUL.
+size_t console_emu_snapshot(const PrintConsole* console, bool styles, char* out, size_t size);
+
+#endif // CONSOLE_EMU_H
@@ -0,0 +1,270 @@
+#!/usr/bin/env python3
+"""Generate the recorded-payload corpus used by bench_json.
+
+The payloads mirror the shape of real Discord API v10 responses (field order,
+nesting, nulls, escapes, non-ASCII text) with synthetic ids and names. Output
+is deterministic so the checked-in files only change when this script does.
+"""
+import json
+import os
+import random
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+rng = random.Random(3)
+
+EPOCH_MS = 1420070400000
+snowflake_time = 1700000000000
+
+
+def snowflake():
+    global snowflake_time
+    snowflake_time += rng.randint(1, 90000)
+    return str(((snowflake_time - EPOCH_MS) << 22) | rng.randint(0, (1 << 22) - 1))
+
+
+def iso(ms):
+    import datetime
+    t = datetime.datetime.fromtimestamp(ms / 1000, datetime.timezone.utc)
+    return t.strftime("%Y-%m-%dT%H:%M:%S.") + "%03d000+00:00" % (ms % 1000)
+
+
+WORDS = ("the a to and of it is in that you for on this was with but just like "
+         "lol yeah what not have so be are do can if get no my we at one all "
+         "3ds homebrew build patch release firmware luma emulator save cart "
+         "game server bot channel message update error crash fixed works "
+         "thanks nice idea maybe tomorrow today again wait really cool").split()
+ACCENTED = ["café", "naïve", "déjà vu", "Ünïcödé", "señor", "smörgåsbord", "façade"]
+EMOJI = ["😂", "👍", "🎮", "🔥", "❤️", "🤔", "✨"]
+NAMES = ["bubble", "retro", "pixel", "zelda_fan", "homebrewer", "cia_wizard",
+         "luma", "kirby", "samus", "ness", "marth", "lucina", "palutena", "shulk"]
+
+
+def hex_hash():
+    return "%032x" % rng.getrandbits(128)
+
+
+def sentence(lo=3, hi=22):
+    words = [rng.choice(WORDS) for _ in range(rng.randint(lo, hi))]
+    roll = rng.random()
+    if roll < 0.15:
+        words.insert(rng.randrange(len(words)), rng.choice(ACCENTED))
+    elif roll < 0.3:
+        words.append(rng.choice(EMOJI))
+    elif roll < 0.38:
+        words.insert(0, '"%s"' % rng.choice(WORDS))
+    elif roll < 0.45:
+        words.append("\n" + " ".join(rng.choice(WORDS) for _ in range(5)))
+    elif roll < 0.5:
+        words.append("C:\\3ds\\%s.3dsx" % rng.choice(NAMES))
+    return " ".join(words)
+
+
+def user(name=None):
+    name = name or "%s%d" % (rng.choice(NAMES), rng.randint(1, 9999))
+    return {
+        "id": snowflake(),
+        "username": name,
+        "avatar": hex_hash() if rng.random() < 0.8 else None,
+        "discriminator": "0",
+        "public_flags": rng.choice([0, 0, 64, 128, 256]),
+        "flags": rng.choice([0, 0, 64, 128, 256]),
+        "banner": None,
+        "accent_color": None,
+        "global_name": name.replace("_", " ").title() if rng.random() < 0.7 else None,
+        "avatar_decoration_data": None,
+        "banner_color": None,
+        "clan": None,
+    }
+
+
+def embed():
+    e = {
+        "type": rng.choice(["rich", "link", "article"]),
+        "url": "https://example.com/%s/%d" % (rng.choice(WORDS), rng.randint(1, 99999)),
+        "title": sentence(2, 8),
+        "description": sentence(10, 40),
+        "color": rng.randint(0, 0xFFFFFF),
+        "content_scan_version": 1,
+    }
+    if rng.random() < 0.6:
+        e["thumbnail"] = {
+            "url": "https://images.example.com/%s.png" % hex_hash(),
+            "proxy_url": "https://images-ext-1.discordapp.net/external/%s/%s.png" % (hex_hash(), hex_hash()),
+            "width": 400, "height": 400, "flags": 0,
+        }
+    if rng.random() < 0.4:
+        e["fields"] = [{"name": sentence(1, 3), "value": sentence(2, 10), "inline": rng.random() < 0.5}
+                       for _ in range(rng.randint(1, 4))]
+    return e
+
+
+def attachment():
+    ext = rng.choice(["png", "jpg", "bmp", "zip", "3dsx", "txt"])
+    name = "%s_%d.%s" % (rng.choice(WORDS), rng.randint(1, 999), ext)
+    a = {
+        "id": snowflake(),
+        "filename": name,
+        "size": rng.randint(1000, 8000000),
+        "url": "https://cdn.discordapp.com/attachments/%s/%s/%s?ex=%x&is=%x&hm=%s&" % (
+            snowflake(), snowflake(), name, rng.getrandbits(32), rng.getrandbits(32), hex_hash() + hex_hash()),
+        "proxy_url": "https://media.discordapp.net/attachments/%s/%s/%s" % (snowflake(), snowflake(), name),
+        "content_type": {"png": "image/png", "jpg": "image/jpeg", "bmp": "image/bmp",
+                         "zip": "application/zip", "3dsx": "application/octet-stream",
+                         "txt": "text/plain; charset=utf-8"}[ext],
+        "content_scan_version": 1,
+    }
+    if ext in ("png", "jpg", "bmp"):
+        a["width"] = rng.choice([400, 320, 800])
+        a["height"] = rng.choice([240, 480])
+        a["placeholder"] = "%s==" % hex_hash()[:24]
+        a["placeholder_version"] = 1
+    return a
+
+
+def message(channel_id, authors, ts, depth=0):
+    author = rng.choice(authors)
+    mentions = [rng.choice(authors) for _ in range(rng.choice([0, 0, 0, 1, 2]))]
+    content = sentence()
+    for m in mentions:
+        content = "<@%s> %s" % (m["id"], content)
+    if rng.random() < 0.1:
+        content += " <:%s:%s>" % (rng.choice(WORDS), snowflake())
+    if rng.random() < 0.05:
+        content = "```c\nint main(void) {\n    return 0;\n}\n```"
+    msg = {
+        "type": 0,
+        "content": content,
+        "mentions": mentions,
+        "mention_roles": [],
+        "attachments": [attachment() for _ in range(rng.choice([0, 0, 0, 0, 1, 2]))],
+        "embeds": [embed() for _ in range(rng.choice([0, 0, 0, 1]))],
+        "timestamp": iso(ts),
+        "edited_timestamp": iso(ts + 60000) if rng.random() < 0.1 else None,
+        "flags": 0,
+        "components": [],
+        "id": snowflake(),
+        "channel_id": channel_id,
+        "author": author,
+        "pinned": False,
+        "mention_everyone": False,
+        "tts": False,
+    }
+    if rng.random() < 0.3:
+        msg["reactions"] = [{
+            "emoji": {"id": None, "name": rng.choice(EMOJI)},
+            "count": rng.randint(1, 12),
+            "count_details": {"burst": 0, "normal": 1},
+            "burst_colors": [],
+            "me_burst": False,
+            "burst_me": False,
+            "me": rng.random() < 0.3,
+            "burst_count": 0,
+        } for _ in range(rng.randint(1, 3))]
+    if depth == 0 and rng.random() < 0.25:
+        msg["type"] = 19
+        ref = message(channel_id, authors, ts - 600000, depth + 1)
+        msg["message_reference"] = {"type": 0, "channel_id": channel_id, "message_id": ref["id"],
+                                    "guild_id": "1000000000000000001"}
+        msg["referenced_message"] = ref
+    return msg
+
+
+def messages_page():
+    channel_id = snowflake()
+    authors = [user() for _ in range(12)]
+    ts = 1717000000000
+    page = []
+    for _ in range(50):
+        ts -= rng.randint(5000, 900000)
+        page.append(message(channel_id, authors, ts))
+    return page
+
+
+def guilds(count):
+    out = []
+    for _ in range(count):
+        features = rng.sample(["COMMUNITY", "NEWS", "INVITE_SPLASH", "BANNER", "ANIMATED_ICON",
+                               "VANITY_URL", "DISCOVERABLE", "WELCOME_SCREEN_ENABLED",
+                               "MEMBER_VERIFICATION_GATE_ENABLED", "PREVIEW_ENABLED",
+                               "ROLE_ICONS", "SOUNDBOARD", "AUTO_MODERATION"], rng.randint(0, 8))
+        out.append({
+            "id": snowflake(),
+            "name": "%s %s" % (rng.choice(NAMES).title(), rng.choice(["Hub", "Club", "Dev", "Lounge", "Café", "Homebrew", "🎮 Gaming"])),
+            "icon": hex_hash() if rng.random() < 0.85 else None,
+            "banner": hex_hash() if rng.random() < 0.2 else None,
+            "owner": rng.random() < 0.05,
+            "permissions": str(rng.getrandbits(40)),
+            "features": features,
+        })
+    return out
+
+
+def channels(count):
+    guild_id = snowflake()
+    out = []
+    categories = []
+    for i in range(count):
+        kind = rng.choice([0, 0, 0, 0, 2, 4, 5, 13, 15]) if i > 0 else 4
+        ch = {
+            "id": snowflake(),
+            "type": kind,
+            "last_message_id": snowflake() if kind in (0, 5) else None,
+            "flags": 0,
+            "guild_id": guild_id,
+            "name": "%s-%s" % (rng.choice(WORDS), rng.choice(WORDS)),
+            "parent_id": rng.choice(categories) if categories and kind != 4 else None,
+            "rate_limit_per_user": rng.choice([0, 0, 0, 5, 30]),
+            "topic": sentence(4, 20) if kind in (0, 5) and rng.random() < 0.5 else None,
+            "position": i,
+            "permission_overwrites": [{
+                "id": snowflake(),
+                "type": rng.choice([0, 1]),
+                "allow": str(rng.getrandbits(32)),
+                "deny": str(rng.getrandbits(32)),
+            } for _ in range(rng.randint(0, 3))],
+            "nsfw": False,
+        }
+        if kind == 2:
+            ch["bitrate"] = 64000
+            ch["user_limit"] = 0
+            ch["rtc_region"] = None
+        if kind == 4:
+            categories.append(ch["id"])
+        out.append(ch)
+    return out
+
+
+def members(count):
+    out = []
+    for _ in range(count):
+        u = user()
+        out.append({
+            "avatar": None,
+            "banner": None,
+            "communication_disabled_until": None,
+            "flags": 0,
+            "joined_at": iso(1600000000000 + rng.randint(0, 10 ** 11)),
+            "nick": u["username"].upper() if rng.random() < 0.2 else None,
+            "pending": False,
+            "premium_since": None,
+            "roles": [snowflake() for _ in range(rng.randint(0, 4))],
+            "unusual_dm_activity_until": None,
+            "user": u,
+            "mute": False,
+            "deaf": False,
+        })
+    return out
+
+
+def write(name, data):
+    path = os.path.join(HERE, name)
+    with open(path, "w", encoding="utf-8") as f:
+        json.dump(data, f, ensure_ascii=False, separators=(",", ":"))
+    print("%-22s %8d bytes" % (name, os.path.getsize(path)))
+
+
+if __name__ == "__main__":
+    write("messages_page.json", messages_page())
+    write("guilds_200.json", guilds(200))
+    write("channels_500.json", channels(500))
+    write("members_1000.json", members(1000))
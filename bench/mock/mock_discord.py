@@ -0,0 +1,551 @@
+#!/usr/bin/env python3
+"""Mock Discord REST API for load testing the client on a PC (or a 3DS on the LAN).
+
+Serves the endpoints the client uses under /api/v10 with synthetic payloads
+shaped like the corpus (see ../corpus/generate.py), sized by a scenario file:
+how many guilds, channels per guild and members per guild, and how fast each
+channel posts. The scenario can also inject network trouble: latency with
+jitter, stalls part-way through a response body, 429s with retry_after, and
+503s.
+
+Messages can be posted with files as multipart/form-data; the body is parsed
+as it arrives and files are only hashed, never kept, so uploads of any size
+can be measured. Attachment links point back at the mock (/attachments/ID/NAME), which serves
+deterministic bytes and honours Range, and can cut a share of downloads off
+part-way so the client has to resume them. Server icons and avatars are
+served as generated PNGs at /icons and /avatars, sized by ?size= like the
+real CDN.
+
+    ./mock_discord.py scenarios/heavy_account.json --port 8080
+
+prints "listening on PORT" once ready (--port 0 picks a free one). There is
+no gateway: the client only speaks REST.
+"""
+import argparse
+import hashlib
+import importlib.util
+import json
+import os
+import random
+import re
+import sys
+import threading
+import time
+import zlib
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, urlsplit
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+# The corpus generators give every payload its real-world shape
+_spec = importlib.util.spec_from_file_location("generate", os.path.join(HERE, "..", "corpus", "generate.py"))
+gen = importlib.util.module_from_spec(_spec)
+_spec.loader.exec_module(gen)
+
+EPOCH_MS = 1420070400000
+
+DEFAULTS = {
+    "name": "default",
+    "seed": 1,
+    "guilds": 20,
+    "channels": 50,             # Per guild
+    "members": 200,             # Per guild
+    "message_rate": 2.0,        # New messages per minute in every text channel
+    "history": 50,              # Messages in a channel before the first request
+    "latency_ms": 0,
+    "jitter_ms": 0,
+    "stall_rate": 0.0,          # Share of responses that pause mid-body
+    "stall_ms": 0,
+    "rate_limit_every": 0,      # Every Nth request gets a 429 (0: never)
+    "retry_after": 0.5,
+    "error_rate": 0.0,          # Share of requests that get a 503
+    "attachment_max": 65536,    # Attachment sizes are capped to this
+    "cut_rate": 0.0,            # Share of attachment downloads dropped part-way
+}
+
+
+def snowflake_at(ms, seq):
+    return ((ms - EPOCH_MS) << 22) | (seq & 0x3FFFFF)
+
+
+# Messages kept per channel; older ones fall off like a long scrollback
+CHANNEL_KEEP = 1000
+
+
+class Channel:
+    """A text channel whose messages appear at the scenario's rate."""
+
+    def __init__(self, world, channel_id):
+        self.world = world
+        self.id = channel_id
+        self.messages = []      # Oldest first
+        self.nonces = {}
+        self.generated = 0
+        now = time.time() * 1000
+        for i in range(world.scenario["history"]):
+            self.append(gen.message(self.id, world.authors, int(now) - (world.scenario["history"] - i) * 60000))
+
+    def append(self, msg):
+        for attachment in msg.get("attachments", []):
+            self.world.add_attachment(attachment)
+        ms = int(time.time() * 1000)
+        msg["id"] = str(max(snowflake_at(ms, self.world.next_seq()),
+                            int(self.messages[-1]["id"]) + 1 if self.messages else 0))
+        self.messages.append(msg)
+        if len(self.messages) > CHANNEL_KEEP:
+            del self.messages[:-CHANNEL_KEEP]
+        return msg
+
+    def catch_up(self):
+        rate = self.world.scenario["message_rate"]
+        due = int((time.time() - self.world.started) * rate / 60.0)
+        while self.generated < due:
+            self.generated += 1
+            self.append(gen.message(self.id, self.world.authors, int(time.time() * 1000)))
+
+
+class World:
+    """Every guild, channel and member of the scenario, generated on first use."""
+
+    def __init__(self, scenario):
+        self.scenario = scenario
+        self.lock = threading.Lock()
+        self.started = time.time()
+        self.seq = 0
+        self.requests = 0
+        gen.rng.seed(scenario["seed"])
+        self.me = gen.user("mock_user")
+        self.authors = [gen.user() for _ in range(24)]
+        self.guilds = gen.guilds(scenario["guilds"])
+        self.channels = {}      # guild id -> channel list
+        self.members = {}       # (guild id, after, limit) -> page
+        self.text_channels = {}
+        self.attachments = {}   # id -> size
+        self.base_url = ""      # As the client reaches us, from its Host header
+        self.uploads = []       # (filename, size, sha256) of every file posted
+
+    def add_attachment(self, attachment):
+        attachment["size"] = min(attachment["size"], self.scenario["attachment_max"])
+        attachment["url"] = "%s/attachments/%s/%s" % (self.base_url, attachment["id"], attachment["filename"])
+        self.attachments[attachment["id"]] = attachment["size"]
+
+    def attachment_bytes(self, attachment_id):
+        size = self.attachments.get(attachment_id)
+        if size is None:
+            return None
+        return random.Random(int(attachment_id)).randbytes(size)
+
+    def next_seq(self):
+        self.seq += 1
+        return self.seq
+
+    def guild_channels(self, guild_id):
+        if guild_id not in self.channels:
+            channels = gen.channels(self.scenario["channels"])
+            for ch in channels:
+                ch["guild_id"] = guild_id
+            self.channels[guild_id] = channels
+        return self.channels[guild_id]
+
+    def channel(self, channel_id):
+        channel = self.text_channels.get(channel_id)
+        if not channel:
+            channel = self.text_channels[channel_id] = Channel(self, channel_id)
+        channel.catch_up()
+        return channel
+
+    def member_page(self, guild_id, after, limit):
+        # Member i of a guild has id base + i, so after= pages like Discord's
+        base = int(guild_id) + 1
+        first = max(0, after - base + 1) if after else 0
+        count = max(0, min(limit, self.scenario["members"] - first))
+        key = (guild_id, first, count)
+        if key not in self.members:
+            page = gen.members(count)
+            for i, member in enumerate(page):
+                member["user"]["id"] = str(base + first + i)
+            self.members[key] = page
+        return self.members[key]
+
+
+ROUTES = []
+
+
+def route(method, pattern):
+    def wrap(fn):
+        ROUTES.append((method, re.compile("^/api/v10" + pattern + "$"), fn))
+        return fn
+    return wrap
+
+
+@route("GET", r"/users/@me")
+def get_me(world, query, body):
+    return 200, world.me
+
+
+@route("GET", r"/users/@me/guilds")
+def get_guilds(world, query, body):
+    limit = int(query.get("limit", ["200"])[0])
+    return 200, world.guilds[:min(limit, 200)]
+
+
+@route("GET", r"/guilds/(\d+)/channels")
+def get_channels(world, query, body, guild_id):
+    return 200, world.guild_channels(guild_id)
+
+
+@route("GET", r"/guilds/(\d+)/members")
+def get_members(world, query, body, guild_id):
+    limit = min(int(query.get("limit", ["1"])[0]), 1000)
+    after = int(query.get("after", ["0"])[0])
+    return 200, world.member_page(guild_id, after, limit)
+
+
+@route("GET", r"/channels/(\d+)/messages")
+def get_messages(world, query, body, channel_id):
+    channel = world.channel(channel_id)
+    limit = min(int(query.get("limit", ["50"])[0]), 100)
+    messages = channel.messages
+    if "after" in query:
+        after = int(query["after"][0])
+        newer = [m for m in messages if int(m["id"]) > after]
+        page = newer[:limit]
+    else:
+        if "before" in query:
+            before = int(query["before"][0])
+            messages = [m for m in messages if int(m["id"]) < before]
+        page = messages[-limit:]
+    return 200, list(reversed(page))
+
+
+@route("POST", r"/channels/(\d+)/messages")
+def post_message(world, query, body, channel_id):
+    files = []
+    if isinstance(body, list):
+        # Multipart: payload_json plus files[N]
+        payload = next((p for p in body if p["name"] == "payload_json"), None)
+        files = [p for p in body if p["name"].startswith("files[")]
+        body = payload["data"] if payload else b"{}"
+    try:
+        request = json.loads(body or b"{}")
+    except ValueError:
+        return 400, {"message": "400: Bad Request", "code": 50109}
+    content = request.get("content", "")
+    if not content and not files:
+        return 400, {"message": "Cannot send an empty message", "code": 50006}
+    channel = world.channel(channel_id)
+    nonce = request.get("nonce")
+    if nonce and request.get("enforce_nonce") and nonce in channel.nonces:
+        return 200, channel.nonces[nonce]
+    msg = gen.message(channel_id, [world.me], int(time.time() * 1000))
+    msg.update({"content": content, "nonce": nonce, "author": world.me, "type": 0, "attachments": []})
+    for part in files:
+        world.uploads.append((part["filename"], part["size"], part["sha256"]))
+        msg["attachments"].append({"id": str(snowflake_at(int(time.time() * 1000), world.next_seq())),
+                                   "filename": part["filename"], "size": part["size"]})
+    msg.pop("referenced_message", None)
+    msg.pop("message_reference", None)
+    channel.append(msg)
+    if nonce:
+        channel.nonces[nonce] = msg
+    return 200, msg
+
+
+def read_multipart(rfile, length, boundary):
+    """Parse a multipart/form-data body of length bytes as it is read.
+
+    Returns its parts as dicts with name, filename, size and sha256; only
+    payload_json keeps its bytes (as data). None if the body is malformed.
+    """
+    # With a line break in front, the first delimiter looks like the others
+    delimiter = b"\r\n--" + boundary
+    buffer = b"\r\n"
+    parts = []
+    part = None
+    left = length
+    done = False
+
+    def feed(data):
+        if part is not None and data:
+            part["size"] += len(data)
+            part["hash"].update(data)
+            if part["name"] == "payload_json":
+                part["data"] += data
+
+    while not done:
+        chunk = rfile.read(min(left, 65536)) if left else b""
+        left -= len(chunk)
+        buffer += chunk
+        while True:
+            at = buffer.find(delimiter)
+            if at < 0:
+                break
+            end = buffer.find(b"\r\n\r\n", at)
+            if buffer[at + len(delimiter):at + len(delimiter) + 2] == b"--":
+                feed(buffer[:at])
+                done = True
+                break
+            if end < 0:
+                break
+            feed(buffer[:at])
+            headers = buffer[at + len(delimiter):end].decode("utf-8", "replace")
+            name = re.search(r'name="([^"]*)"', headers)
+            filename = re.search(r'filename="([^"]*)"', headers)
+            part = {"name": name.group(1) if name else "", "filename": filename.group(1) if filename else "",
+                    "size": 0, "hash": hashlib.sha256(), "data": b""}
+            parts.append(part)
+            buffer = buffer[end + 4:]
+        if done:
+            break
+        if not chunk:
+            return None
+        # Keep what could be the start of a delimiter for the next read
+        keep = len(delimiter) + 4
+        if part is not None and len(buffer) > keep and buffer.find(delimiter) < 0:
+            feed(buffer[:-keep])
+            buffer = buffer[-keep:]
+    if left:
+        rfile.read(left)
+    for part in parts:
+        part["sha256"] = part.pop("hash").hexdigest()
+    return parts
+
+
+def image_pixel(image_hash, size, x, y):
+    """RGBA of pixel (x, y) of an icon or avatar: a checkerboard of four
+    colours taken from the hash, colour 0 transparent in the alpha types.
+    bench_load checks what the client decoded against the same formula."""
+    colors = bytes.fromhex(image_hash[-32:])
+    kind = int(image_hash[-1], 16) % 4
+    block = max(1, size // 4)
+    k = (x // block + y // block) % 4
+    r, g, b = colors[k * 3:k * 3 + 3]
+    if kind == 3:
+        g = b = r
+    alpha = 0 if k == 0 and kind in (0, 2) else 255
+    return r, g, b, alpha
+
+
+def encode_png(image_hash, size):
+    """The image as a PNG whose colour type depends on the hash (RGBA, RGB,
+    2-bit palette with tRNS, or grey), cycling through the five row filters
+    so the client's decoder sees all of them."""
+    kind = int(image_hash[-1], 16) % 4
+    color_type, depth = [(6, 8), (2, 8), (3, 2), (0, 8)][kind]
+    palette = [image_pixel(image_hash, size, k * max(1, size // 4), 0) for k in range(4)]
+
+    rows = []
+    for y in range(size):
+        pixels = [image_pixel(image_hash, size, x, y) for x in range(size)]
+        if color_type == 6:
+            rows.append(bytes(c for p in pixels for c in p))
+        elif color_type == 2:
+            rows.append(bytes(c for p in pixels for c in p[:3]))
+        elif color_type == 0:
+            rows.append(bytes(p[0] for p in pixels))
+        else:
+            indices = [palette.index(p) for p in pixels] + [0] * 3
+            rows.append(bytes((indices[i] << 6) | (indices[i + 1] << 4) | (indices[i + 2] << 2) | indices[i + 3]
+                              for i in range(0, size, 4)))
+    bpp = {6: 4, 2: 3, 0: 1, 3: 1}[color_type]
+
+    raw = bytearray()
+    prev = bytes(len(rows[0]))
+    for y, row in enumerate(rows):
+        kind_filter = y % 5
+        raw.append(kind_filter)
+        for i, value in enumerate(row):
+            left = row[i - bpp] if i >= bpp else 0
+            up = prev[i]
+            corner = prev[i - bpp] if i >= bpp else 0
+            if kind_filter == 1:
+                value -= left
+            elif kind_filter == 2:
+                value -= up
+            elif kind_filter == 3:
+                value -= (left + up) // 2
+            elif kind_filter == 4:
+                p = left + up - corner
+                pa, pb, pc = abs(p - left), abs(p - up), abs(p - corner)
+                value -= left if pa <= pb and pa <= pc else up if pb <= pc else corner
+            raw.append(value & 0xFF)
+        prev = row
+
+    def chunk(tag, data):
+        body = tag + data
+        return len(data).to_bytes(4, "big") + body + zlib.crc32(body).to_bytes(4, "big")
+
+    header = size.to_bytes(4, "big") * 2 + bytes([depth, color_type, 0, 0, 0])
+    png = b"\x89PNG\r\n\x1a\n" + chunk(b"IHDR", header)
+    if color_type == 3:
+        png += chunk(b"PLTE", bytes(c for p in palette for c in p[:3]))
+        png += chunk(b"tRNS", bytes(p[3] for p in palette))
+    data = zlib.compress(bytes(raw), 9)
+    # Split the image data across chunks, like encoders with a buffer limit
+    for at in range(0, len(data), 512):
+        png += chunk(b"IDAT", data[at:at + 512])
+    return png + chunk(b"IEND", b"")
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def log_message(self, fmt, *args):
+        if self.server.verbose:
+            sys.stderr.write("%s\n" % (fmt % args))
+
+    def handle_any(self, method):
+        world = self.server.world
+        scenario = world.scenario
+        length = int(self.headers.get("Content-Length") or 0)
+        boundary = re.match(r"multipart/form-data; *boundary=(\S+)", self.headers.get("Content-Type") or "")
+        if boundary:
+            started = time.time()
+            body = read_multipart(self.rfile, length, boundary.group(1).encode("ascii"))
+            if body is None:
+                return self.reply(400, {"message": "400: Bad Request", "code": 50109})
+            if self.server.verbose:
+                seconds = max(time.time() - started, 1e-6)
+                for part in body:
+                    if part["filename"]:
+                        sys.stderr.write("upload %s %d bytes %s %.1f MB/s\n" % (
+                            part["filename"], part["size"], part["sha256"], part["size"] / seconds / 1e6))
+        else:
+            body = self.rfile.read(length) if length else b""
+
+        with world.lock:
+            world.base_url = "http://%s" % self.headers.get("Host", "127.0.0.1")
+            world.requests += 1
+            number = world.requests
+            rng = random.Random(scenario["seed"] * 1000003 + number)
+
+        delay = scenario["latency_ms"] + rng.uniform(-1, 1) * scenario["jitter_ms"]
+        if delay > 0:
+            time.sleep(delay / 1000.0)
+
+        url = urlsplit(self.path)
+        match = re.match(r"^/attachments/(\d+)/[^/]+$", url.path)
+        if match and method == "GET":
+            # The CDN: signed links, no Authorization
+            with world.lock:
+                data = world.attachment_bytes(match.group(1))
+            return self.reply_file(data, rng.random() < scenario["cut_rate"])
+        match = re.match(r"^/(icons|avatars)/(\d+)/((?:a_)?[0-9a-f]{32})\.png$", url.path)
+        if match and method == "GET":
+            # Icons and avatars, at ?size= like the CDN (default 128)
+            sizes = parse_qs(url.query).get("size", ["128"])
+            size = min(max(int(sizes[0]) if sizes[0].isdigit() else 128, 16), 1024)
+            return self.reply_file(encode_png(match.group(3), size), False, "image/png")
+
+        if not self.headers.get("Authorization"):
+            return self.reply(401, {"message": "401: Unauthorized", "code": 0})
+        every = scenario["rate_limit_every"]
+        if every and number % every == 0:
+            retry = scenario["retry_after"]
+            return self.reply(429, {"message": "You are being rate limited.", "retry_after": retry,
+                                    "global": False},
+                              {"Retry-After": str(int(retry + 0.999)), "X-RateLimit-Scope": "user"})
+        if rng.random() < scenario["error_rate"]:
+            return self.reply(503, {"message": "Service Unavailable", "code": 0})
+
+        query = parse_qs(url.query)
+        for route_method, pattern, fn in ROUTES:
+            match = pattern.match(url.path)
+            if route_method == method and match:
+                with world.lock:
+                    status, payload = fn(world, query, body, *match.groups())
+                stall = scenario["stall_ms"] if rng.random() < scenario["stall_rate"] else 0
+                return self.reply(status, payload, stall_ms=stall)
+        return self.reply(404, {"message": "404: Not Found", "code": 0})
+
+    def reply(self, status, payload, headers=None, stall_ms=0):
+        data = json.dumps(payload, ensure_ascii=False, separators=(",", ":")).encode("utf-8")
+        self.send_response(status)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(data)))
+        for key, value in (headers or {}).items():
+            self.send_header(key, value)
+        self.end_headers()
+        try:
+            if stall_ms:
+                # Half the body, then nothing for a while, like a stalled link
+                self.wfile.write(data[:len(data) // 2])
+                self.wfile.flush()
+                time.sleep(stall_ms / 1000.0)
+                self.wfile.write(data[len(data) // 2:])
+            else:
+                self.wfile.write(data)
+        except (BrokenPipeError, ConnectionResetError):
+            # The client gave up on the request (cancel or timeout)
+            self.close_connection = True
+
+    def reply_file(self, data, cut, content_type="application/octet-stream"):
+        if data is None:
+            return self.reply(404, {"message": "404: Not Found", "code": 0})
+        start = 0
+        match = re.match(r"^bytes=(\d+)-$", self.headers.get("Range") or "")
+        if match:
+            start = int(match.group(1))
+            if start >= len(data):
+                self.send_response(416)
+                self.send_header("Content-Range", "bytes */%d" % len(data))
+                self.send_header("Content-Length", "0")
+                self.end_headers()
+                return
+        part = data[start:]
+        self.send_response(206 if match else 200)
+        self.send_header("Content-Type", content_type)
+        self.send_header("Content-Length", str(len(part)))
+        if match:
+            self.send_header("Content-Range", "bytes %d-%d/%d" % (start, len(data) - 1, len(data)))
+        self.end_headers()
+        try:
+            if cut:
+                # Drop the connection half way, like a link lost mid-download
+                self.wfile.write(part[:len(part) // 2])
+                self.wfile.flush()
+                self.close_connection = True
+            else:
+                self.wfile.write(part)
+        except (BrokenPipeError, ConnectionResetError):
+            self.close_connection = True
+
+    def do_GET(self):
+        self.handle_any("GET")
+
+    def do_POST(self):
+        self.handle_any("POST")
+
+
+def load_scenario(path):
+    scenario = dict(DEFAULTS)
+    if path:
+        with open(path, encoding="utf-8") as f:
+            scenario.update(json.load(f))
+    unknown = set(scenario) - set(DEFAULTS)
+    if unknown:
+        sys.exit("unknown scenario keys: %s" % ", ".join(sorted(unknown)))
+    return scenario
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("scenario", nargs="?", help="scenario JSON file (defaults if omitted)")
+    parser.add_argument("--host", default="127.0.0.1", help="0.0.0.0 to serve a 3DS on the LAN")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--verbose", action="store_true", help="log every request")
+    args = parser.parse_args()
+
+    server = ThreadingHTTPServer((args.host, args.port), Handler)
+    server.daemon_threads = True
+    server.world = World(load_scenario(args.scenario))
+    server.verbose = args.verbose
+    print("listening on %d" % server.server_address[1], flush=True)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+"""Run bench_load against the mock server once per scenario and compare them.
+
+    ./run_load.py                          # every scenario in scenarios/
+    ./run_load.py scenarios/chatty.json --rounds 50 --verbose
+
+Each scenario gets a fresh mock_discord.py on a free port. bench_load's
+per-operation table is shown with --verbose; the summary lists the client's
+CPU time and share of wall time, peak heap of any one operation, the worst
+operation p95 and the failed calls (expected under injected 429s and 503s).
+"""
+import argparse
+import glob
+import os
+import subprocess
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+BENCH_LOAD = os.path.join(HERE, "..", "bench_load")
+
+
+def run_scenario(path, rounds, verbose):
+    server = subprocess.Popen([sys.executable, os.path.join(HERE, "mock_discord.py"), path, "--port", "0"],
+                              stdout=subprocess.PIPE, text=True)
+    try:
+        line = server.stdout.readline()
+        if not line.startswith("listening on "):
+            sys.exit("mock server failed to start for %s" % path)
+        port = int(line.split()[-1])
+        name = os.path.splitext(os.path.basename(path))[0]
+        result = subprocess.run([BENCH_LOAD, "--base", "http://127.0.0.1:%d/api/v10" % port,
+                                 "--name", name, "--rounds", str(rounds)],
+                                stdout=subprocess.PIPE, text=True)
+    finally:
+        server.terminate()
+        server.wait()
+
+    if verbose:
+        print("== %s\n%s" % (name, result.stdout))
+    for line in result.stdout.splitlines():
+        if line.startswith("load: "):
+            fields = line.split()
+            return name, dict(f.split("=", 1) for f in fields[2:] if "=" in f)
+    return name, None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("scenarios", nargs="*", help="scenario files (default: all)")
+    parser.add_argument("--rounds", type=int, default=20)
+    parser.add_argument("--verbose", action="store_true", help="show each scenario's full report")
+    args = parser.parse_args()
+
+    if not os.path.exists(BENCH_LOAD):
+        sys.exit("build bench_load first: make -C %s bench_load" % os.path.dirname(HERE))
+    paths = args.scenarios or sorted(glob.glob(os.path.join(HERE, "scenarios", "*.json")))
+
+    print("%-16s %9s %9s %6s %9s %12s %6s" % ("scenario", "wall ms", "cpu ms", "cpu %", "peak KB",
+                                             "worst p95 ms", "fails"))
+    for path in paths:
+        name, summary = run_scenario(path, args.rounds, args.verbose)
+        if not summary:
+            print("%-16s did not complete" % name)
+            continue
+        print("%-16s %9s %9s %6s %9s %12s %6s" % (name, summary["wall_ms"], summary["cpu_ms"], summary["cpu_pct"],
+                                                 summary["peak_kb"], summary["worst_p95_ms"],
+                                                 summary["failures"]), flush=True)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,295 @@
+#ifndef SHIM_3DS_H
+#define SHIM_3DS_H
+
+// Minimal stand-in for libctru's <3ds.h> so the platform-independent parts of
+// the client (JSON parsing, extraction, instrumentation, background workers)
+// and the console UI build on a PC. Only what those files actually use
+// belongs here.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+
+typedef s32 Result;
+typedef u32 Handle;
+
+#define U64_MAX UINT64_MAX
+
+#define R_FAILED(res) ((Result)(res) < 0)
+#define R_SUCCEEDED(res) ((Result)(res) >= 0)
+
+#define CUR_THREAD_HANDLE 0xFFFF8000
+
+static inline void svcSleepThread(s64 ns) {
+    struct timespec ts = { ns / 1000000000LL, (long)(ns % 1000000000LL) };
+    nanosleep(&ts, NULL);
+}
+
+static inline Result svcGetThreadPriority(s32* priority, Handle thread) {
+    (void)thread;
+    *priority = 0x30;
+    return 0;
+}
+
+// libctru threads over pthreads. Priority, core and stack size are ignored.
+typedef void (*ThreadFunc)(void*);
+
+typedef struct ShimThread {
+    pthread_t handle;
+    ThreadFunc entry;
+    void* arg;
+}* Thread;
+
+static inline void* shim_thread_start(void* arg) {
+    Thread thread = (Thread)arg;
+    thread->entry(thread->arg);
+    return NULL;
+}
+
+static inline Thread threadCreate(ThreadFunc entry, void* arg, size_t stack_size, int prio,
+                                  int core_id, bool detached) {
+    (void)stack_size; (void)prio; (void)core_id;
+    Thread thread = (Thread)malloc(sizeof(struct ShimThread));
+    if (!thread) {
+        return NULL;
+    }
+    thread->entry = entry;
+    thread->arg = arg;
+    if (pthread_create(&thread->handle, NULL, shim_thread_start, thread) != 0) {
+        free(thread);
+        return NULL;
+    }
+    if (detached) {
+        pthread_detach(thread->handle);
+    }
+    return thread;
+}
+
+static inline Result threadJoin(Thread thread, u64 timeout_ns) {
+    (void)timeout_ns;
+    return pthread_join(thread->handle, NULL) == 0 ? 0 : -1;
+}
+
+static inline void threadFree(Thread thread) {
+    free(thread);
+}
+
+// LightLock / LightEvent over a mutex and condition variable
+typedef pthread_mutex_t LightLock;
+
+static inline void LightLock_Init(LightLock* lock) {
+    pthread_mutex_init(lock, NULL);
+}
+
+static inline void LightLock_Lock(LightLock* lock) {
+    pthread_mutex_lock(lock);
+}
+
+static inline int LightLock_TryLock(LightLock* lock) {
+    return pthread_mutex_trylock(lock) == 0 ? 0 : 1;
+}
+
+static inline void LightLock_Unlock(LightLock* lock) {
+    pthread_mutex_unlock(lock);
+}
+
+typedef enum {
+    RESET_ONESHOT = 0,
+    RESET_STICKY = 1,
+    RESET_PULSE = 2,
+} ResetType;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    ResetType type;
+    bool signaled;
+} LightEvent;
+
+static inline void LightEvent_Init(LightEvent* event, ResetType type) {
+    pthread_mutex_init(&event->mutex, NULL);
+    pthread_cond_init(&event->cond, NULL);
+    event->type = type;
+    event->signaled = false;
+}
+
+static inline void LightEvent_Signal(LightEvent* event) {
+    pthread_mutex_lock(&event->mutex);
+    event->signaled = true;
+    pthread_cond_broadcast(&event->cond);
+    pthread_mutex_unlock(&event->mutex);
+}
+
+static inline void LightEvent_Clear(LightEvent* event) {
+    pthread_mutex_lock(&event->mutex);
+    event->signaled = false;
+    pthread_mutex_unlock(&event->mutex);
+}
+
+// Returns 0 once signalled, 1 on timeout (a negative timeout only polls)
+static inline int LightEvent_WaitTimeout(LightEvent* event, s64 timeout_ns) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    if (timeout_ns > 0) {
+        deadline.tv_sec += timeout_ns / 1000000000LL;
+        deadline.tv_nsec += timeout_ns % 1000000000LL;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    pthread_mutex_lock(&event->mutex);
+    int err = 0;
+    while (!event->signaled && err != ETIMEDOUT && timeout_ns > 0) {
+        err = pthread_cond_timedwait(&event->cond, &event->mutex, &deadline);
+    }
+    bool signaled = event->signaled;
+    if (signaled && event->type != RESET_STICKY) {
+        event->signaled = false;
+    }
+    pthread_mutex_unlock(&event->mutex);
+    return signaled ? 0 : 1;
+}
+
+static inline int LightEvent_TryWait(LightEvent* event) {
+    return LightEvent_WaitTimeout(event, -1) == 0;
+}
+
+static inline void LightEvent_Wait(LightEvent* event) {
+    pthread_mutex_lock(&event->mutex);
+    while (!event->signaled) {
+        pthread_cond_wait(&event->cond, &event->mutex);
+    }
+    if (event->type != RESET_STICKY) {
+        event->signaled = false;
+    }
+    pthread_mutex_unlock(&event->mutex);
+}
+
+// Input: no buttons are ever down on a PC
+#define BIT(n) (1U << (n))
+
+enum {
+    KEY_A = BIT(0),
+    KEY_B = BIT(1),
+    KEY_SELECT = BIT(2),
+    KEY_START = BIT(3),
+    KEY_DRIGHT = BIT(4),
+    KEY_DLEFT = BIT(5),
+    KEY_DUP = BIT(6),
+    KEY_DDOWN = BIT(7),
+    KEY_R = BIT(8),
+    KEY_L = BIT(9),
+    KEY_X = BIT(10),
+    KEY_Y = BIT(11),
+    KEY_TOUCH = BIT(20),
+};
+
+static inline void hidScanInput(void) {
+}
+
+static inline u32 hidKeysDown(void) {
+    return 0;
+}
+
+static inline u32 hidKeysHeld(void) {
+    return 0;
+}
+
+// Software keyboard: always cancelled
+typedef enum { SWKBD_TYPE_NORMAL } SwkbdType;
+typedef enum { SWKBD_BUTTON_NONE = -1, SWKBD_BUTTON_LEFT = 0, SWKBD_BUTTON_CONFIRM = 2 } SwkbdButton;
+typedef enum { SWKBD_ANYTHING, SWKBD_NOTEMPTY_NOTBLANK = 3 } SwkbdValidInput;
+
+typedef struct {
+    int type;
+} SwkbdState;
+
+static inline void swkbdInit(SwkbdState* swkbd, SwkbdType type, int buttons, int max_length) {
+    (void)buttons; (void)max_length;
+    swkbd->type = type;
+}
+
+static inline void swkbdSetHintText(SwkbdState* swkbd, const char* text) {
+    (void)swkbd; (void)text;
+}
+
+static inline void swkbdSetInitialText(SwkbdState* swkbd, const char* text) {
+    (void)swkbd; (void)text;
+}
+
+static inline void swkbdSetValidation(SwkbdState* swkbd, SwkbdValidInput valid, u32 filter, u32 max_digits) {
+    (void)swkbd; (void)valid; (void)filter; (void)max_digits;
+}
+
+static inline SwkbdButton swkbdInputText(SwkbdState* swkbd, char* buf, size_t size) {
+    (void)swkbd;
+    if (size > 0) {
+        buf[0] = '\0';
+    }
+    return SWKBD_BUTTON_LEFT;
+}
+
+// Text consoles, emulated on cell grids by bench/console_emu.c: the top
+// screen holds 50x30 cells, the bottom 40x30, like libctru's 8x8 font
+typedef enum { GFX_TOP = 0, GFX_BOTTOM = 1 } gfxScreen_t;
+
+#define CONSOLE_MAX_WIDTH 50
+#define CONSOLE_MAX_HEIGHT 30
+
+typedef struct {
+    u8 ch;
+    u8 fg;                      // 0-7, ANSI colour order
+    u8 bg;
+    u8 attr;                    // SGR bits, see console_emu.h
+} ConsoleCell;
+
+typedef struct PrintConsole {
+    ConsoleCell cells[CONSOLE_MAX_HEIGHT][CONSOLE_MAX_WIDTH];
+    int windowWidth;
+    int windowHeight;
+    int cursorX;
+    int cursorY;
+    int savedX;
+    int savedY;
+    ConsoleCell pen;            // Colours and attributes of the next character
+    char escape[32];            // Escape sequence being parsed
+    int escape_len;             // -1 outside one
+    // Counters since the last console_emu_end_frame
+    size_t bytes;
+    int escapes;
+    int clears;
+    ConsoleCell shown[CONSOLE_MAX_HEIGHT][CONSOLE_MAX_WIDTH];
+} PrintConsole;
+
+PrintConsole* consoleInit(gfxScreen_t screen, PrintConsole* console);
+PrintConsole* consoleSelect(PrintConsole* console);
+void consoleClear(void);
+
+// Display: nothing to flush, and the vblank comes 60 times a second
+static inline void gfxFlushBuffers(void) {
+}
+
+static inline void gfxSwapBuffers(void) {
+}
+
+static inline void gspWaitForVBlank(void) {
+    svcSleepThread(16666667LL);
+}
+
+#endif // SHIM_3DS_H
@@ -0,0 +1,71 @@
+#ifndef CANCEL_H
+#define CANCEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "timing.h"
+
+// Deadline and cancellation state for one request. Transports check it while
+// waiting on the network and abort as soon as it trips; a request that is
+// aborted never hands partial data back to the caller.
+
+typedef bool (*CancelPollFn)(void* ctx);
+
+typedef struct {
+    volatile bool cancelled;
+    bool expired;               // Cancelled because the deadline passed
+    uint64_t deadline;          // timing_now() ticks, 0 for none
+    uint64_t cancelled_at;      // When cancel was first observed
+    CancelPollFn poll;          // Optional; returning true cancels
+    void* poll_ctx;
+} CancelToken;
+
+// Start a token that expires timeout_ms from now (0 for no deadline)
+static inline void cancel_token_init(CancelToken* token, uint32_t timeout_ms) {
+    token->cancelled = false;
+    token->expired = false;
+    token->deadline = timeout_ms ? timing_now() + (uint64_t)timeout_ms * TIMING_TICKS_PER_SEC / 1000 : 0;
+    token->cancelled_at = 0;
+    token->poll = NULL;
+    token->poll_ctx = NULL;
+}
+
+// Request cancellation; safe to call from another thread
+static inline void cancel_token_cancel(CancelToken* token) {
+    if (!token->cancelled) {
+        token->cancelled_at = timing_now();
+        token->cancelled = true;
+    }
+}
+
+// Milliseconds left before the deadline (UINT32_MAX without one, 0 if passed)
+static inline uint32_t cancel_token_remaining_ms(const CancelToken* token) {
+    if (!token->deadline) {
+        return UINT32_MAX;
+    }
+    uint64_t now = timing_now();
+    if (now >= token->deadline) {
+        return 0;
+    }
+    double ms = timing_ticks_to_ms(token->deadline - now);
+    return ms < 1.0 ? 1 : (uint32_t)ms;
+}
+
+// True if the request should stop: cancelled, past its deadline, or the
+// poll hook asked for it. Only call from the thread making the request.
+static inline bool cancel_token_check(CancelToken* token) {
+    if (!token) {
+        return false;
+    }
+    if (!token->cancelled) {
+        if (token->deadline && timing_now() >= token->deadline) {
+            token->expired = true;
+            cancel_token_cancel(token);
+        } else if (token->poll && token->poll(token->poll_ctx)) {
+            cancel_token_cancel(token);
+        }
+    }
+    return token->cancelled;
+}
+
+#endif // CANCEL_H
@@ -0,0 +1,65 @@
+#ifndef CLIENT_VIEW_H
+#define CLIENT_VIEW_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "discord_api.h"
+
+// Immutable snapshots of the client's lists for the renderer.
+//
+// Network code fills DiscordClient in place, then publishes a copy as a new
+// view with one atomic pointer swap. Readers never take a lock: each one
+// announces the view it is using in its own hazard slot, and a replaced view
+// is only freed once no slot points at it.
+
+// Reader slots; each reading thread uses its own index
+#define CLIENT_VIEW_MAX_READERS 4
+#define CLIENT_VIEW_READER_RENDER 0
+
+typedef struct {
+    uint32_t version;           // Increases with every publish, 0 if retired
+    bool connected;
+    char current_channel_id[32];
+    char current_server_id[32];
+    
+    DiscordMessage messages[MAX_MESSAGES];
+    int message_count;
+    
+    DiscordServer servers[MAX_SERVERS];
+    int server_count;
+    
+    DiscordChannel channels[MAX_CHANNELS];
+    int channel_count;
+    
+    DiscordUser users[MAX_USERS];
+    int user_count;
+} ClientView;
+
+typedef struct {
+    uint32_t published;
+    uint32_t reclaimed;
+    int live;                   // Views allocated, current one included
+    int max_live;
+} ClientViewStats;
+
+// Start with an empty, disconnected view
+void client_view_init(void);
+
+// Snapshot the client's lists as the current view. Publishers are
+// serialized against each other, never against readers.
+bool client_view_publish(const DiscordClient* client);
+
+// Current view, valid until the same reader calls client_view_release. Never
+// NULL; before the first publish it is an empty view.
+const ClientView* client_view_acquire(int reader);
+
+// Let a replaced view be reclaimed
+void client_view_release(int reader);
+
+// Snapshot of the counters
+ClientViewStats client_view_get_stats(void);
+
+// Free every view; no reader may hold one
+void client_view_cleanup(void);
+
+#endif // CLIENT_VIEW_H
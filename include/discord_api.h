@@ -2,32 +2,72 @@
 #define DISCORD_API_H
 
 #include <3ds.h>
+#include "transport.h"
+#include "markup.h"
+
+// Override to point the client at another server, e.g. bench/mock
+#ifndef DISCORD_API_BASE
+#define DISCORD_API_BASE "https://discord.com/api/v10"
+#endif
+
+// Where icons and avatars come from; the mock serves them at its root
+#ifndef DISCORD_CDN_BASE
+#define DISCORD_CDN_BASE "https://cdn.discordapp.com"
+#endif
+
+// Deadline for a single API request, connection setup included
+#ifndef DISCORD_REQUEST_TIMEOUT_MS
+#define DISCORD_REQUEST_TIMEOUT_MS 15000
+#endif
 
 #define MAX_MESSAGES 50
-#define MAX_SERVERS 20
+#define MAX_SERVERS 200
+#define MAX_CHANNELS 200
 #define MAX_USERS 50
 #define MAX_TEXT_LENGTH 256
 
+// Display strings (content, author, names) are stored as console glyphs, see
+// text.h; ids are plain UTF-8. content has its markup stripped into spans.
+// A file attached to a message. url is the signed CDN link, empty if it did
+// not fit.
+typedef struct {
+    char id[32];
+    char filename[64];
+    char url[256];
+    uint32_t size;              // Bytes
+} DiscordAttachment;
+
 typedef struct {
     char id[32];
     char content[MAX_TEXT_LENGTH];
+    MarkupSpans markup;
     char author[64];
     char timestamp[32];
+    DiscordAttachment attachment;   // The first one, if attachment_count > 0
+    int attachment_count;
 } DiscordMessage;
 
 typedef struct {
     char id[32];
     char name[64];
-    char icon[128];
+    char icon[128];             // Icon hash for image_cache.h, "" if none
 } DiscordServer;
 
+typedef struct {
+    char id[32];
+    char name[64];
+} DiscordChannel;
+
 typedef struct {
     char id[32];
     char username[64];
     char discriminator[8];
+    char avatar[48];            // Avatar hash for image_cache.h, "" if none
     bool online;
 } DiscordUser;
 
+// Working state of the network side. The renderer reads the snapshots
+// published after each change instead (client_view.h).
 typedef struct {
     char token[128];
     char current_channel_id[32];
@@ -39,14 +79,30 @@ typedef struct {
     DiscordServer servers[MAX_SERVERS];
     int server_count;
     
+    // Text channels of the current server
+    DiscordChannel channels[MAX_CHANNELS];
+    int channel_count;
+    
     DiscordUser users[MAX_USERS];
     int user_count;
+    bool users_attempted;       // Members requested for current_server_id
     
     bool connected;
+    
+    // HTTP backend, owned by the client
+    Transport* transport;
+    
+    // Polled while fetch_*/switch_server/send_message wait on the network;
+    // returning true abandons the request
+    CancelPollFn cancel_poll;
+    void* cancel_ctx;
 } DiscordClient;
 
-// Initialize Discord client
-void discord_init(DiscordClient* client, const char* token);
+// Initialize Discord client; the client takes ownership of transport
+void discord_init(DiscordClient* client, const char* token, Transport* transport);
+
+// Let poll interrupt blocking requests made on the calling thread
+void discord_set_cancel_hook(DiscordClient* client, CancelPollFn poll, void* ctx);
 
 // Connect to Discord
 bool discord_connect(DiscordClient* client);
@@ -54,18 +110,63 @@ bool discord_connect(DiscordClient* client);
 // Fetch messages from current channel
 bool discord_fetch_messages(DiscordClient* client);
 
+// Fetch them again because they are known to have changed (new messages,
+// a sent one acknowledged): never answered with a page fetched before
+bool discord_refresh_messages(DiscordClient* client);
+
 // Fetch servers (guilds)
 bool discord_fetch_servers(DiscordClient* client);
 
 // Fetch users in current server
 bool discord_fetch_users(DiscordClient* client);
 
-// Send a message
+// Send a message to the current channel and wait for it
 bool discord_send_message(DiscordClient* client, const char* message);
 
-// Switch to a different server
+// Post a message to channel_id. With a nonce, Discord returns the existing
+// message rather than posting a duplicate. Returns the HTTP status (0 if no
+// response arrived); for 429s retry_after_s receives the server's delay.
+// Safe to call from a worker thread: it does not touch the client's lists
+// and ignores the cancel hook; cancel may be NULL for the default deadline.
+long discord_post_message(DiscordClient* client, const char* channel_id, const char* content,
+                          const char* nonce, CancelToken* cancel, double* retry_after_s);
+
+// Progress of an upload: request body bytes handed to the network so far
+typedef void (*DiscordUploadProgressFn)(uint64_t sent, uint64_t total, void* ctx);
+
+// Post a message with the file at path attached (content may be empty). The
+// file is streamed from the card, so it may be far larger than free memory.
+// Returns the HTTP status like discord_post_message and is worker-safe in the
+// same way, but cancel may be NULL for no deadline at all: a stalled upload
+// still ends through the transport's low-speed timeout.
+long discord_upload_file(DiscordClient* client, const char* channel_id, const char* content,
+                         const char* path, const char* nonce, CancelToken* cancel,
+                         DiscordUploadProgressFn progress, void* progress_ctx, double* retry_after_s);
+
+// Newest messages of a channel as seen by one probe
+typedef struct {
+    uint64_t newest_id;         // 0 if none were returned
+    int count;                  // Messages newer than the probe's after_id
+} DiscordProbe;
+
+// Look for messages in channel_id newer than after_id with a light request:
+// limit=1 when after_id is 0, otherwise after=after_id (up to MAX_MESSAGES).
+// Returns the HTTP status like discord_post_message and is worker-safe in
+// the same way.
+long discord_probe_channel(DiscordClient* client, const char* channel_id, uint64_t after_id,
+                           CancelToken* cancel, DiscordProbe* probe, double* retry_after_s);
+
+// Switch to a different server. The current server, channel and lists are
+// only replaced once its channels were fetched, so a failed or cancelled
+// switch leaves the client as it was. The messages of the channel left behind
+// go to the history store, and the new channel's are restored from it if kept.
 bool discord_switch_server(DiscordClient* client, const char* server_id);
 
+// Make channel_id, one of client->channels, the current channel without a
+// request: the messages left behind go to the history store and the new
+// channel shows what history kept until discord_fetch_messages refreshes it.
+bool discord_select_channel(DiscordClient* client, const char* channel_id);
+
 // Cleanup
 void discord_cleanup(DiscordClient* client);
 
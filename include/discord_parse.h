@@ -0,0 +1,33 @@
+#ifndef DISCORD_PARSE_H
+#define DISCORD_PARSE_H
+
+#include "discord_api.h"
+#include "net_stats.h"
+
+// Response extraction, kept apart from the HTTP code so it can also be run
+// over recorded payloads. Each function fills sample->parse_ms and
+// sample->extract_ms.
+
+// Arrays at least this large are split across the job system (job.h) when
+// it has workers. Override with -D.
+#ifndef DISCORD_PARSE_PARALLEL_MIN
+#define DISCORD_PARSE_PARALLEL_MIN (32 * 1024)
+#endif
+
+// Fill client->messages from a /channels/{id}/messages response
+bool discord_parse_messages(DiscordClient* client, const char* json, NetSample* sample);
+
+// Fill client->servers from a /users/@me/guilds response
+bool discord_parse_servers(DiscordClient* client, const char* json, NetSample* sample);
+
+// Fill client->users from a /guilds/{id}/members response
+bool discord_parse_users(DiscordClient* client, const char* json, NetSample* sample);
+
+// Fill client->channels with the text channels of a /guilds/{id}/channels
+// response; on failure the current list is left as it was
+bool discord_parse_channels(DiscordClient* client, const char* json, NetSample* sample);
+
+// Count the messages newer than after_id in a /channels/{id}/messages response
+bool discord_parse_probe(const char* json, uint64_t after_id, DiscordProbe* probe, NetSample* sample);
+
+#endif // DISCORD_PARSE_H
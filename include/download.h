@@ -0,0 +1,93 @@
+#ifndef DOWNLOAD_H
+#define DOWNLOAD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "discord_api.h"
+#include "transport.h"
+
+// Attachment downloads to the SD card.
+//
+// Queued attachments are fetched by up to DOWNLOAD_MAX_ACTIVE workers. Each
+// streams the body from the transport's write callback into one
+// DOWNLOAD_CHUNK_SIZE buffer that goes to a .part file whenever it fills, so
+// a file is never held in RAM whole. An interrupted download keeps its .part
+// file and continues from there with a Range request, and all downloads
+// together stay under DOWNLOAD_MAX_BYTES_PER_SEC.
+//
+// Finished files are stored under a hash of their content and indexed by
+// attachment id (index.txt in the download directory): an attachment that
+// was fetched once is never fetched again, and a file posted twice is kept
+// once.
+
+// Downloads running at once
+#ifndef DOWNLOAD_MAX_ACTIVE
+#define DOWNLOAD_MAX_ACTIVE 2
+#endif
+
+// Bytes buffered per download between writes to the card
+#ifndef DOWNLOAD_CHUNK_SIZE
+#define DOWNLOAD_CHUNK_SIZE (32 * 1024)
+#endif
+
+// Shared bandwidth cap, 0 for none
+#ifndef DOWNLOAD_MAX_BYTES_PER_SEC
+#define DOWNLOAD_MAX_BYTES_PER_SEC (256 * 1024)
+#endif
+
+// Attempts before a download is left failed; each retry resumes
+#ifndef DOWNLOAD_MAX_ATTEMPTS
+#define DOWNLOAD_MAX_ATTEMPTS 3
+#endif
+
+// Downloads queued or running at once
+#define DOWNLOAD_QUEUE 16
+
+// Finished attachments remembered by the index
+#define DOWNLOAD_MAX_STORED 256
+
+typedef enum {
+    DOWNLOAD_NONE,              // Never requested
+    DOWNLOAD_QUEUED,            // Waiting for a worker (or for its retry)
+    DOWNLOAD_ACTIVE,
+    DOWNLOAD_DONE,
+    DOWNLOAD_FAILED             // Out of attempts; queue it again to resume
+} DownloadState;
+
+typedef struct {
+    DownloadState state;
+    uint64_t done;              // Bytes on the card so far
+    uint64_t total;             // Expected size, 0 if unknown
+    char path[160];             // The stored file, once done
+} DownloadStatus;
+
+typedef struct {
+    int queued;
+    int completed;
+    int cached;                 // Requested again after completing: no fetch
+    int deduplicated;           // Content was already stored under another id
+    int resumed;                // Attempts that continued a .part file
+    int retries;
+    int failed;
+    uint64_t bytes;             // Received this session
+} DownloadStats;
+
+// Load the index from dir (created if missing) and start the workers, which
+// use transport's download
+bool download_init(Transport* transport, const char* dir);
+
+// Fetch attachment unless it is stored already; false if it has no url or
+// the queue is full
+bool download_queue(const DiscordAttachment* attachment);
+
+// Where attachment_id stands; status may be NULL
+DownloadState download_status(const char* attachment_id, DownloadStatus* status);
+
+// Snapshot of the counters
+DownloadStats download_get_stats(void);
+
+// Stop the workers, abandoning running downloads; their .part files stay
+// for the next session
+void download_cleanup(void);
+
+#endif // DOWNLOAD_H
@@ -0,0 +1,50 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "discord_api.h"
+
+// Compressed message windows for channels that are not on screen. Leaving a
+// channel deflates its messages (primed with a dictionary of common chat
+// text, see tools/gen_history_dict.py) into a MEM_CACHE block; coming back
+// inflates them so the channel shows instantly while the refresh loads.
+// Least recently used windows are dropped to stay within HISTORY_BUDGET, or
+// when the cache budget needs the memory.
+
+#define HISTORY_MAX_CHANNELS 64
+
+// Bytes of compressed history kept resident. Override with -D.
+#ifndef HISTORY_BUDGET
+#define HISTORY_BUDGET (128 * 1024)
+#endif
+
+typedef struct {
+    int channels;               // Windows resident
+    size_t compressed_bytes;
+    size_t raw_bytes;           // Same windows serialized, before deflate
+    size_t struct_bytes;        // Same windows as DiscordMessage arrays
+    int stored;
+    int restored;
+    int evicted;
+    double last_inflate_ms;     // Time to restore the last window
+    double avg_inflate_ms;
+} HistoryStats;
+
+// Reset the store and register its evictor
+void history_init(void);
+
+// Compress count messages of channel_id, replacing any older window
+bool history_store(const char* channel_id, const DiscordMessage* messages, int count);
+
+// Restore channel_id's window into messages (MAX_MESSAGES entries) and drop
+// it from the store. Returns false, leaving *count at 0, if none is kept.
+bool history_load(const char* channel_id, DiscordMessage* messages, int* count);
+
+// Snapshot of the counters
+HistoryStats history_get_stats(void);
+
+// Free every window and unregister the evictor
+void history_cleanup(void);
+
+#endif // HISTORY_H
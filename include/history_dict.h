@@ -0,0 +1,64 @@
+// Generated by tools/gen_history_dict.py; do not edit.
+#ifndef HISTORY_DICT_H
+#define HISTORY_DICT_H
+
+static const char history_dictionary[4097] =
+    "firmware release homebrew message message emulator message homebrew tomorrow"
+    " message again luma all but all get and one bot but build cool build idea bu"
+    "ild yeah but and can update cart today channel it cool is error cool error y"
+    "eah fixed luma idea today if channel just build luma works maybe cart one on"
+    "e patch wait release at release if server for server one thanks are thanks b"
+    "ut this crash was really C:\\3ds\\marth.3dsx C:\\3ds\\samus.3dsx but build c"
+    "art what cia_wizard1408 cia_wizard3080 cool not crash lol crash tomorrow do "
+    "thanks emulator today firmware fixed game can homebrew build homebrew firmwa"
+    "re homebrew tomorrow homebrewer2523 homebrewer4925 homebrewer9263 idea cool "
+    "is server lol that luma that marth5957 maybe tomorrow nice what patch in pix"
+    "el8948 server is so patch this lol tomorrow crash tomorrow firmware tomorrow"
+    " homebrew tomorrow today was works what wait with bot works emulator works t"
+    "omorrow 3ds firmware again server all tomorrow and firmware channel idea cha"
+    "nnel nice emulator can emulator one firmware the homebrew lol just message m"
+    "aybe really message wait release idea server maybe the emulator works really"
+    " at just build build channel bot channel message error error firmware my get"
+    " channel have thanks luma server message 3ds message channel nice update rea"
+    "lly cool save really server firmware server have server homebrew to tomorrow"
+    " today error today maybe tomorrow of tomorrow server update emulator update "
+    "tomorrow we emulator cart homebrew channel error channel today emulator have"
+    " firmware cool firmware game have firmware homebrew idea homebrew luma homeb"
+    "rew what idea firmware message patch message works patch channel really serv"
+    "er this emulator tomorrow have what emulator with emulator yeah tomorrow 3ds"
+    " server bubble7787 cart build fixed cool fixed idea have again have not patc"
+    "h cart really not server get this all today luma today with today yeah what "
+    "error works game works have works wait yeah and you yeah are today cool like"
+    " fixed not game like idea idea just idea like like not works samus7410 with "
+    "game yeah yeah channel homebrew all emulator and homebrew build thanks firmw"
+    "are for palutena1089 palutena7496 release have save do wait message C:\\3ds\\"
+    "palutena.3dsx again tomorrow build tomorrow cia_wizard8880 error firmware fi"
+    "rmware maybe fixed tomorrow homebrew error homebrewer3128 release server \077"
+    "\077 C:\\3ds\\retro.3dsx be firmware channel for crash patch emulator of get"
+    " save homebrew homebrew idea server in build just server lol channel nice th"
+    "anks this update C:\\3ds\\zelda_fan.3dsx idea build like patch save error sh"
+    "ulk8463 with luma again channel firmware server homebrew just homebrew save "
+    "idea emulator nice emulator release again release channel save firmware than"
+    "ks homebrew this firmware zelda_fan3205 are homebrew but tomorrow firmware a"
+    "ll with channel C:\\3ds\\luma.3dsx emulator channel homebrew release message"
+    " firmware channel update cia_wizard4234 crash homebrew emulator do error emu"
+    "lator error tomorrow firmware if firmware on fixed get like that really chan"
+    "nel thanks what to firmware update channel wait today emulator game emulator"
+    " save firmware firmware just emulator message maybe release crash tomorrow i"
+    "dea firmware thanks tomorrow thanks emulator get firmware not patch server t"
+    "omorrow all idea update message lol channel server emulator patch channel em"
+    "ulator release tomorrow C:\\3ds\\homebrewer.3dsx emulator just today channel"
+    " channel this yeah message C:\\3ds\\kirby.3dsx again homebrew what luma C:\\"
+    "3ds\\lucina.3dsx like channel server release tomorrow fixed on firmware 3ds "
+    "tomorrow firmware channel emulator emulator emulator fixed tomorrow save na\213"
+    "ve caf\202 patch firmware C:\\3ds\\cia_wizard.3dsx \232n\213c\224d\202 se\244"
+    "or fa\207ade d\202j\205 vu sm\224rg\206sbord {\012       return my we of to "
+    "no so on if do can you 3ds main(void) {\012   was for one but the lol not an"
+    "d   return 0;\012}\012``` all bot get that just cart game have wait yeah lum"
+    "a nice this what save cool idea with ```c\012int main(void) {\012  like cras"
+    "h maybe error again build really works fixed today patch update thanks relea"
+    "se server message homebrew channel tomorrow firmware emulator <:<@";
+
+#define HISTORY_DICTIONARY_SIZE 4096
+
+#endif // HISTORY_DICT_H
@@ -0,0 +1,86 @@
+#ifndef IMAGE_CACHE_H
+#define IMAGE_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "transport.h"
+
+// Server icons and user avatars as small bitmaps.
+//
+// Images are keyed by the hash Discord gives them, which changes whenever
+// the image does, so a cached entry never goes stale. Each is requested from
+// the CDN with ?size=IMAGE_CACHE_SIZE, the size it is shown at, decoded and
+// stored as one IMAGE_CACHE_SIZE square cell of a packed atlas file on the
+// SD card. The atlas survives restarts: an icon is downloaded once, ever,
+// until its slot is reused for a newer one. The most recently used bitmaps
+// are also kept in RAM.
+//
+// Lookups never block: a miss queues the image for a background worker,
+// which reads it from the atlas or fetches it and wakes the UI when it is
+// ready.
+
+// Cell edge in pixels and the ?size= requested; a power of two from 16 up
+#ifndef IMAGE_CACHE_SIZE
+#define IMAGE_CACHE_SIZE 32
+#endif
+
+// Cells in the atlas file
+#ifndef IMAGE_CACHE_SLOTS
+#define IMAGE_CACHE_SLOTS 256
+#endif
+
+// Bitmaps kept in RAM (MEM_CACHE, evictable)
+#ifndef IMAGE_CACHE_RAM
+#define IMAGE_CACHE_RAM 32
+#endif
+
+// Largest PNG accepted from the CDN, in bytes and pixels per side
+#ifndef IMAGE_MAX_BYTES
+#define IMAGE_MAX_BYTES (64 * 1024)
+#endif
+#define IMAGE_MAX_DIMENSION 256
+
+// Images waiting for the worker
+#define IMAGE_QUEUE 32
+
+typedef enum {
+    IMAGE_SERVER_ICON,          // /icons/{guild id}/{hash}.png
+    IMAGE_USER_AVATAR           // /avatars/{user id}/{hash}.png
+} ImageKind;
+
+typedef struct {
+    // RGBA5551 like GPU_RGBA5551: red in bits 15-11, green 10-6, blue 5-1,
+    // alpha in bit 0; rows top to bottom
+    uint16_t pixels[IMAGE_CACHE_SIZE * IMAGE_CACHE_SIZE];
+    uint8_t average[3];         // Mean RGB of the opaque pixels
+} ImageBitmap;
+
+typedef struct {
+    int ram_hits;
+    int card_loads;             // Read from the atlas instead of the network
+    int fetched;
+    int failed;                 // Not retried until the next session
+    int replaced;               // Atlas cells reused for a newer image
+    int stored;                 // Atlas cells in use
+    uint64_t bytes;             // Downloaded this session
+    double decode_ms;           // Decoding and scaling, all fetches together
+} ImageCacheStats;
+
+// Open (or create) the atlas at atlas_path and start the worker, which
+// fetches from cdn_base (e.g. DISCORD_CDN_BASE) with transport's download
+bool image_cache_init(Transport* transport, const char* cdn_base, const char* atlas_path);
+
+// Copy the image of owner_id with hash into out if it is ready; otherwise
+// queue it and return false. An empty hash (no image set) is never queued.
+bool image_cache_get(ImageKind kind, const char* owner_id, const char* hash, ImageBitmap* out);
+
+// Like image_cache_get, but copy only the average colour (for list rows)
+bool image_cache_average(ImageKind kind, const char* owner_id, const char* hash, uint8_t rgb[3]);
+
+// Snapshot of the counters
+ImageCacheStats image_cache_get_stats(void);
+
+// Stop the worker, save the atlas's use order and free the RAM cache
+void image_cache_cleanup(void);
+
+#endif // IMAGE_CACHE_H
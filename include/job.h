@@ -0,0 +1,48 @@
+#ifndef JOB_H
+#define JOB_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Small job system for splitting CPU-heavy work (large JSON pages) across
+// cores. Every worker owns a queue; a worker that runs dry steals from the
+// others, and a thread waiting on a batch runs queued jobs itself. With no
+// workers (Old 3DS) jobs simply run on the thread that waits for them.
+
+#define JOB_MAX_WORKERS 4
+#define JOB_QUEUE_CAPACITY 32
+
+typedef void (*JobFn)(void* arg);
+
+// Tracks a batch of submitted jobs
+typedef struct {
+    volatile int pending;
+} JobCounter;
+
+typedef struct {
+    int workers;
+    uint32_t executed[JOB_MAX_WORKERS + 1];     // Per worker; last is waiting threads
+    uint32_t stolen;                            // Jobs run by a worker that didn't own them
+} JobStats;
+
+// Start workers threads (0 to JOB_MAX_WORKERS) below the caller's priority.
+// On the 3DS the first worker is pinned to core 2, the New 3DS extra core.
+bool job_system_init(int workers);
+
+// Number of worker threads running
+int job_system_workers(void);
+
+// Queue fn(arg) as part of counter's batch. Runs it inline if every queue
+// is full or there are no workers.
+void job_submit(JobCounter* counter, JobFn fn, void* arg);
+
+// Wait for counter's batch, running queued jobs meanwhile
+void job_wait(JobCounter* counter);
+
+// Snapshot of the counters
+JobStats job_get_stats(void);
+
+// Stop the workers; queued jobs are run first
+void job_system_cleanup(void);
+
+#endif // JOB_H
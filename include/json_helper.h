@@ -8,13 +8,30 @@
 // Helper function to compare JSON token with string
 bool json_token_equals(const char* json, jsmntok_t* tok, const char* s);
 
-// Get string value from JSON token
+// Get string value from JSON token, unescaped and as valid UTF-8
 int json_get_string(const char* json, jsmntok_t* tok, char* output, size_t max_len);
 
+// Get string value from JSON token as console glyphs, ready to print
+int json_get_text(const char* json, jsmntok_t* tok, char* output, size_t max_len);
+
 // Find a key in JSON object and return its value token
 jsmntok_t* json_find_token(const char* json, jsmntok_t* tokens, int num_tokens, const char* key);
 
 // Parse JSON string
 int json_parse(const char* json, jsmntok_t* tokens, size_t max_tokens);
 
+// Parse JSON string into a heap token array that grows as needed, using the
+// structural scanner in json_scan.h (same tokens as jsmn, faster).
+// Returns the token count (or a jsmn error); release *tokens with mem_free.
+int json_parse_alloc(const char* json, jsmntok_t** tokens);
+
+// Index of the first token after tokens[index] and all of its children
+int json_skip(jsmntok_t* tokens, int num_tokens, int index);
+
+// Find a key among the direct members of the object at tokens[object_index]
+jsmntok_t* json_object_get(const char* json, jsmntok_t* tokens, int num_tokens, int object_index, const char* key);
+
+// Get an integer primitive, or default_value if tok is missing or not a number
+int json_get_int(const char* json, jsmntok_t* tok, int default_value);
+
 #endif // JSON_HELPER_H
@@ -0,0 +1,59 @@
+#ifndef JSON_SCAN_H
+#define JSON_SCAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#define JSMN_HEADER
+#include "jsmn.h"
+
+// Two-stage JSON tokenizer producing the same tokens as non-strict jsmn.
+//
+// Stage 1 builds a structural index: the offsets of { } [ ] : , outside
+// strings, plus a (start, end) offset pair for every string and primitive.
+// String bodies are skipped several bytes per step (SSE2 or NEON on the host,
+// 32-bit SWAR on the 3DS) looking only for '"' and '\\'.
+//
+// Stage 2 turns the index into jsmntok_t records, keeping a stack of open
+// containers so closing brackets are O(1) instead of jsmn's backwards scan.
+//
+// Unlike jsmn, escape sequences and control bytes are not validated here;
+// that is left to whoever unescapes the string.
+
+// Offsets produced per stage 1 call
+#define JSON_SCAN_BATCH 512
+
+// Deepest nesting accepted
+#define JSON_SCAN_MAX_DEPTH 64
+
+typedef struct {
+    const char* json;
+    size_t len;
+    size_t pos;
+    int error;      // 0, or JSMN_ERROR_PART for an unterminated string
+} JsonScanner;
+
+// Stage 1: index json[0..len)
+void json_scan_init(JsonScanner* scanner, const char* json, size_t len);
+
+// Fill offsets with up to max entries (max >= 2); returns 0 when done
+int json_scan_next(JsonScanner* scanner, uint32_t* offsets, int max);
+
+// Stages 1 + 2: tokenize into a heap array (MEM_JSON) that grows as needed.
+// Returns the token count or a JSMN_ERROR_* code; release *tokens with
+// mem_free.
+int json_scan_tokenize(const char* json, size_t len, jsmntok_t** tokens);
+
+// Split the top-level array of objects in json[0..len) into at most parts
+// ranges of whole elements, without scanning all of it: from each 1/parts
+// mark it cuts at the next "},{" whose object opens with the same key as the
+// first element. A cut can still land inside a nested array or a string, so
+// the ranges are only a guess, and they are right exactly when every range
+// tokenizes without error: range 0 starts at a real boundary, and a range
+// that tokenizes cleanly ends outside any string or nested container, so the
+// next one starts at a real boundary too. ranges[2i] and ranges[2i+1]
+// receive the start and end offsets of range i (separators excluded).
+// Returns the number of ranges, or 0 if json is not an array of objects.
+int json_scan_split_array(const char* json, size_t len, int parts, size_t* ranges);
+
+#endif // JSON_SCAN_H
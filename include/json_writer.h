@@ -0,0 +1,58 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming JSON writer for request bodies. Writes straight into a
+// caller-provided buffer and never allocates. Strings are escaped and their
+// UTF-8 validated in a single pass; invalid sequences become U+FFFD.
+//
+// Initialise with a NULL buffer to only measure the output length, e.g. to
+// size an allocation exactly before writing for real. A window writer keeps
+// only a slice of the output, so a document larger than any buffer can be
+// streamed by writing it again for each slice.
+
+#define JSON_WRITER_MAX_DEPTH 16
+
+// Worst-case size of n bytes of text once escaped and quoted
+#define JSON_ESCAPED_MAX(n) ((n) * 6 + 2)
+
+typedef struct {
+    char* buffer;
+    size_t capacity;
+    size_t length;      // Bytes written (or needed, when counting)
+    bool overflow;      // Output did not fit, or the document is malformed
+    int depth;
+    uint32_t has_member;    // Bit per depth: a value was already written
+    bool after_key;
+    bool window;        // Only output bytes [skip, skip + capacity) are kept
+    size_t skip;
+} JsonWriter;
+
+// Start a document in buffer (or count only if buffer is NULL)
+void json_writer_init(JsonWriter* writer, char* buffer, size_t capacity);
+
+// Start a document of which only the capacity bytes from offset skip are
+// written to buffer (not NUL-terminated); length still counts all of it
+void json_writer_init_window(JsonWriter* writer, char* buffer, size_t capacity, size_t skip);
+
+void json_writer_begin_object(JsonWriter* writer);
+void json_writer_end_object(JsonWriter* writer);
+void json_writer_begin_array(JsonWriter* writer);
+void json_writer_end_array(JsonWriter* writer);
+
+// Object key; must be followed by exactly one value
+void json_writer_key(JsonWriter* writer, const char* key);
+
+void json_writer_string(JsonWriter* writer, const char* value);
+void json_writer_string_n(JsonWriter* writer, const char* value, size_t len);
+void json_writer_int(JsonWriter* writer, long long value);
+void json_writer_bool(JsonWriter* writer, bool value);
+void json_writer_null(JsonWriter* writer);
+
+// NUL-terminate the output; returns false if it overflowed or is incomplete
+bool json_writer_finish(JsonWriter* writer);
+
+#endif // JSON_WRITER_H
@@ -0,0 +1,85 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Leveled log for the network side and its workers.
+//
+// log_write formats straight into a slot of a lock-free ring shared by every
+// thread, so a call costs a vsnprintf and a few atomics and never touches
+// the console or the SD card. A background thread drains the ring every
+// LOG_FLUSH_MS, or once half of it filled, into the log file and a short
+// history the UI's log pane draws from. When the ring is full new records
+// are dropped and counted.
+
+// Records held between flushes; a power of two
+#ifndef LOG_CAPACITY
+#define LOG_CAPACITY 256
+#endif
+
+// Drain interval of the flush thread
+#ifndef LOG_FLUSH_MS
+#define LOG_FLUSH_MS 250
+#endif
+
+// Records below this level are discarded before formatting
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_INFO
+#endif
+
+// Newest records kept for the log pane
+#define LOG_RECENT 8
+
+// Text of a record, NUL included; longer messages are truncated
+#define LOG_TEXT_MAX 84
+
+typedef enum {
+    LOG_DEBUG,
+    LOG_INFO,
+    LOG_WARN,
+    LOG_ERROR,
+    LOG_LEVEL_COUNT
+} LogLevel;
+
+typedef struct {
+    uint64_t time;              // timing_now() when written
+    LogLevel level;
+    char text[LOG_TEXT_MAX];
+} LogRecord;
+
+typedef struct {
+    uint32_t written;           // Records that made it into the ring
+    uint32_t dropped;           // Records lost to a full ring
+    uint32_t flushed;           // Records drained by the flush thread
+} LogStats;
+
+// Start the flush thread, appending to path (NULL keeps records in memory
+// only). Records written before this wait in the ring.
+bool log_init(const char* path);
+
+// Record a message; safe from any thread
+void log_write(LogLevel level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+// Drain the ring now rather than at the next interval, e.g. before an error
+// screen shows log_recent
+void log_flush(void);
+
+// Also run fn on the flush thread after each drain, for other files written
+// in the background (net_stats' CSV); one hook at a time, NULL to remove it
+void log_set_flush_hook(void (*fn)(void));
+
+// Copy up to max of the newest flushed records into out, oldest first.
+// Returns the number copied.
+int log_recent(LogRecord* out, int max);
+
+// Short name of level ("INFO", ...)
+const char* log_level_name(LogLevel level);
+
+// Snapshot of the counters
+LogStats log_get_stats(void);
+
+// Drain what is left and stop the flush thread
+void log_cleanup(void);
+
+#endif // LOG_H
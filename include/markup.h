@@ -0,0 +1,67 @@
+#ifndef MARKUP_H
+#define MARKUP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Discord markdown, mentions and custom emoji, parsed once at ingestion.
+//
+// markup_parse strips the markup from a message's content and describes it
+// as a short list of spans over the remaining text: style runs (bold, code,
+// spoiler, ...) and references (<@id> becomes "@name", <#id> "#channel",
+// <:name:id> ":name:", each keeping its id). Spans hold offsets, not
+// pointers, so they stay valid when a message is copied into a view or the
+// history store. The renderer only walks the spans (markup_render).
+
+// Spans and ids kept per message; markup past these limits renders plain
+#define MARKUP_MAX_SPANS 16
+#define MARKUP_MAX_REFS 6
+
+// Room markup_render needs for a full message: the text plus one escape
+// sequence and one reset per span
+#define MARKUP_RENDER_MAX (256 + MARKUP_MAX_SPANS * 32)
+
+// Span has no entry in refs
+#define MARKUP_NO_REF 0xFF
+
+typedef enum {
+    MARKUP_BOLD = 1 << 0,
+    MARKUP_ITALIC = 1 << 1,
+    MARKUP_UNDERLINE = 1 << 2,
+    MARKUP_STRIKE = 1 << 3,
+    MARKUP_CODE = 1 << 4,
+    MARKUP_SPOILER = 1 << 5,
+    MARKUP_MENTION = 1 << 6,    // User, role or channel; ref is its id
+    MARKUP_EMOJI = 1 << 7       // Custom emoji; ref is its id
+} MarkupStyle;
+
+typedef struct {
+    uint8_t start;              // Offset into the stripped text
+    uint8_t length;
+    uint8_t style;              // MarkupStyle bits
+    uint8_t ref;                // Index into refs, or MARKUP_NO_REF
+} MarkupSpan;
+
+typedef struct {
+    MarkupSpan spans[MARKUP_MAX_SPANS];
+    uint64_t refs[MARKUP_MAX_REFS];
+    uint8_t span_count;
+    uint8_t ref_count;
+} MarkupSpans;
+
+// Display name for a user mention, or NULL if unknown
+typedef const char* (*MarkupResolveFn)(uint64_t id, void* ctx);
+
+// Parse src (console glyphs, see text.h) into plain text and spans. text
+// receives at most size - 1 bytes (size <= 256, as spans use 8-bit offsets)
+// and is always NUL-terminated. resolve may be NULL.
+void markup_parse(const char* src, char* text, size_t size, MarkupSpans* spans,
+                  MarkupResolveFn resolve, void* ctx);
+
+// Write text with spans applied as console escape sequences into out
+// (MARKUP_RENDER_MAX bytes avoids truncation). Returns the bytes written,
+// excluding the NUL.
+size_t markup_render(const char* text, const MarkupSpans* spans, char* out, size_t size);
+
+#endif // MARKUP_H
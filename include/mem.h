@@ -0,0 +1,85 @@
+#ifndef MEM_H
+#define MEM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Heap accounting. Every allocation made by the client goes through these
+// wrappers with a subsystem tag, so current/peak usage can be shown on the
+// debug overlay and dumped at exit.
+
+typedef enum {
+    MEM_NET,        // Response buffers, request bodies, transports
+    MEM_JSON,       // Token arrays
+    MEM_MESSAGES,   // Message store (DiscordClient)
+    MEM_CACHE,      // Evictable caches
+    MEM_UI,         // UI state
+    MEM_SYSTEM,     // SOC buffer and other fixed blocks
+    MEM_TAG_COUNT
+} MemTag;
+
+// Soft per-subsystem budgets in bytes, 0 means unlimited. Override with -D.
+#ifndef MEM_BUDGET_NET
+#define MEM_BUDGET_NET 0
+#endif
+#ifndef MEM_BUDGET_JSON
+#define MEM_BUDGET_JSON 0
+#endif
+#ifndef MEM_BUDGET_MESSAGES
+#define MEM_BUDGET_MESSAGES 0
+#endif
+#ifndef MEM_BUDGET_CACHE
+#define MEM_BUDGET_CACHE (2 * 1024 * 1024)
+#endif
+#ifndef MEM_BUDGET_UI
+#define MEM_BUDGET_UI 0
+#endif
+
+typedef struct {
+    size_t current;
+    size_t peak;
+    size_t allocations;
+    size_t budget;
+    size_t evictions;   // Times evictors were run because of this tag
+    size_t failures;    // Allocations that failed even after eviction
+} MemStats;
+
+// Evictor: free up to `needed` bytes, return how many were released
+typedef size_t (*MemEvictFn)(size_t needed, void* context);
+
+// Reset counters and apply the default budgets
+void mem_init(void);
+
+// Tagged allocation functions; release with mem_free
+void* mem_alloc(MemTag tag, size_t size);
+void* mem_calloc(MemTag tag, size_t count, size_t size);
+void* mem_realloc(MemTag tag, void* ptr, size_t size);
+void mem_free(void* ptr);
+
+// Account for memory allocated outside the wrappers (e.g. aligned blocks)
+void mem_account(MemTag tag, long delta);
+
+// Change a budget at runtime
+void mem_set_budget(MemTag tag, size_t budget);
+
+// Register a cache evictor. It runs when its tag goes over budget, and for
+// every tag when malloc itself fails.
+bool mem_register_evictor(MemTag tag, MemEvictFn fn, void* context);
+
+// Remove an evictor registered with the same function and context
+void mem_unregister_evictor(MemEvictFn fn, void* context);
+
+// Snapshot of one subsystem
+MemStats mem_get_stats(MemTag tag);
+
+// Total bytes currently accounted
+size_t mem_total_current(void);
+
+// Short label for a tag
+const char* mem_tag_name(MemTag tag);
+
+// Write a per-subsystem report
+void mem_dump(FILE* f);
+
+#endif // MEM_H
@@ -0,0 +1,52 @@
+#ifndef MULTIPART_H
+#define MULTIPART_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "json_writer.h"
+
+// multipart/form-data body of a message with one file, the way Discord's
+// POST /channels/{id}/messages takes it: a payload_json part, then the file
+// as files[0].
+//
+// The body is produced in order, piece by piece, for TransportRequest.read.
+// The file is read from the card straight into the transport's buffer, and
+// payload_json is written again by its callback for each slice of it that is
+// asked for, so neither is ever copied whole into memory.
+
+// Writes payload_json; called once to measure it and again for every read
+// that overlaps it, and must write the same document each time
+typedef void (*MultipartJsonFn)(JsonWriter* writer, void* ctx);
+
+typedef struct {
+    char content_type[80];      // For TransportRequest.content_type
+    uint64_t length;            // Whole body, for TransportRequest.read_len
+    uint64_t offset;            // Bytes produced so far
+
+    MultipartJsonFn json;
+    void* json_ctx;
+    size_t json_len;
+    FILE* file;
+    uint64_t file_size;
+
+    char json_head[160];        // Boundary and headers before each part
+    char file_head[224];
+    char tail[64];              // Closing boundary
+    size_t json_head_len;
+    size_t file_head_len;
+    size_t tail_len;
+} MultipartBody;
+
+// Open the file at path and lay out the body; filename is what Discord shows
+bool multipart_open(MultipartBody* body, const char* path, const char* filename,
+                    MultipartJsonFn json, void* json_ctx);
+
+// TransportRequest.read over a MultipartBody
+bool multipart_read(char* buffer, size_t size, size_t* length, void* ctx);
+
+// Close the file
+void multipart_close(MultipartBody* body);
+
+#endif // MULTIPART_H
@@ -0,0 +1,85 @@
+#ifndef NET_STATS_H
+#define NET_STATS_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#define NET_STATS_WINDOW 64
+
+// CSV rows held for the log's flush thread; a full queue is written by the
+// thread recording the next sample instead
+#ifndef NET_STATS_CSV_PENDING
+#define NET_STATS_CSV_PENDING 32
+#endif
+
+// One HTTP request as seen by the client. The curl times are cumulative from
+// the start of the transfer, exactly as CURLINFO_*_TIME reports them.
+typedef struct {
+    char method[8];
+    char endpoint[96];
+    bool ok;
+    long http_status;
+
+    double namelookup_ms;
+    double connect_ms;
+    double appconnect_ms;
+    double starttransfer_ms;
+    double total_ms;
+
+    long long bytes_down;
+    long long bytes_up;
+
+    // Time spent in json_parse and in extracting fields into DiscordClient
+    double parse_ms;
+    double extract_ms;
+    
+    // Request abandoned by cancellation or its deadline, and how long the
+    // transport took to stop after that was requested
+    bool aborted;
+    double abort_ms;
+    
+    // Answered from an identical request instead of the network
+    bool coalesced;
+} NetSample;
+
+// Per-phase metrics shown in the HUD (derived from the cumulative times)
+typedef enum {
+    NET_METRIC_DNS,
+    NET_METRIC_CONNECT,
+    NET_METRIC_TLS,
+    NET_METRIC_SERVER,
+    NET_METRIC_TOTAL,
+    NET_METRIC_PARSE,
+    NET_METRIC_EXTRACT,
+    NET_METRIC_COUNT
+} NetMetric;
+
+// Start collecting samples. csv_path may be NULL to disable the CSV log;
+// rows are written to it from the log's flush thread (log_init first).
+void net_stats_init(const char* csv_path);
+
+// Reset a sample before a request is issued
+void net_stats_begin(NetSample* sample, const char* method, const char* endpoint);
+
+// Record a finished request (after parsing, if any)
+void net_stats_record(const NetSample* sample);
+
+// Duration of a single phase of a sample in milliseconds
+double net_stats_metric(const NetSample* sample, NetMetric metric);
+
+// Rolling p50/p95 over the last NET_STATS_WINDOW samples
+bool net_stats_percentiles(NetMetric metric, double* p50, double* p95);
+
+// Number of samples recorded this session
+int net_stats_sample_count(void);
+
+// Copy the most recent sample into out; false if none yet
+bool net_stats_last(NetSample* out);
+
+// Short label for a metric
+const char* net_stats_metric_name(NetMetric metric);
+
+// Write the queued rows and close the CSV log
+void net_stats_cleanup(void);
+
+#endif // NET_STATS_H
@@ -0,0 +1,85 @@
+#ifndef OUTBOX_H
+#define OUTBOX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "discord_api.h"
+
+// Queue of outgoing messages, persisted to the SD card and drained by a
+// background worker. Every entry carries a nonce that Discord enforces, so a
+// retry after a lost response never posts the message twice. An entry can
+// carry a file from the card, which is streamed up with the message.
+
+#define OUTBOX_CAPACITY 32
+
+// Delay before the first retry; doubles per attempt up to the maximum
+#ifndef OUTBOX_RETRY_BASE_MS
+#define OUTBOX_RETRY_BASE_MS 1000
+#endif
+
+#ifndef OUTBOX_RETRY_MAX_MS
+#define OUTBOX_RETRY_MAX_MS 60000
+#endif
+
+typedef enum {
+    OUTBOX_PENDING,     // Waiting to be sent (or retried)
+    OUTBOX_SENDING,     // Request in flight
+    OUTBOX_FAILED       // Rejected by Discord, will not be retried
+} OutboxState;
+
+typedef struct {
+    char nonce[24];
+    char channel_id[32];
+    char content[MAX_TEXT_LENGTH];
+    char file_path[128];        // File to attach, "" for text only
+    OutboxState state;
+    int attempts;
+    long last_status;           // HTTP status of the last attempt, 0 if none
+    uint64_t queued_at;         // timing_now() when queued (or loaded)
+    uint64_t next_attempt_at;
+    uint64_t sent;              // Upload progress of the attempt in flight
+    uint64_t total;
+} OutboxEntry;
+
+typedef struct {
+    int depth;                  // Entries not yet acknowledged (incl. failed)
+    int sent;                   // Acknowledged this session
+    int retries;                // Attempts after the first
+    int failed;                 // Rejected permanently
+    double last_latency_ms;     // Queue to acknowledgement
+    double p50_latency_ms;
+    double p95_latency_ms;
+} OutboxStats;
+
+// Load persisted entries from path (NULL for memory only) and start the worker
+bool outbox_init(DiscordClient* client, const char* path);
+
+// Queue a message for channel_id; returns false if the outbox is full
+bool outbox_enqueue(const char* channel_id, const char* content);
+
+// Queue the file at path for channel_id with an optional caption; returns
+// false if the outbox is full or the file cannot be opened
+bool outbox_enqueue_file(const char* channel_id, const char* content, const char* path);
+
+// Abort the upload in flight for channel_id, or else drop its oldest waiting
+// or failed upload; returns false if it has none
+bool outbox_cancel_upload(const char* channel_id);
+
+// Copy up to max entries for channel_id, oldest first; returns the count
+int outbox_list(const char* channel_id, OutboxEntry* out, int max);
+
+// Remove the newest failed text entry for channel_id and copy its text to
+// buffer
+bool outbox_take_failed(const char* channel_id, char* buffer, size_t size);
+
+// True if messages were acknowledged since the last call
+bool outbox_take_acked(void);
+
+// Queue depth and send latency
+OutboxStats outbox_get_stats(void);
+
+// Stop the worker, waiting for an in-flight send, and persist the queue
+void outbox_cleanup(void);
+
+#endif // OUTBOX_H
@@ -0,0 +1,23 @@
+#ifndef PNG_H
+#define PNG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Minimal PNG decoder for icons and avatars: non-interlaced images of any
+// colour type at 8 bits per channel, plus 1/2/4-bit grey and palette images.
+// The image data is inflated one row at a time, so besides the output only
+// two rows are held.
+
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint8_t* pixels;            // RGBA8, rows top to bottom, MEM_NET; mem_free it
+} PngImage;
+
+// Decode data into image; fails on anything unsupported, corrupt, or wider
+// or taller than max_dimension
+bool png_decode(const uint8_t* data, size_t size, uint32_t max_dimension, PngImage* image);
+
+#endif // PNG_H
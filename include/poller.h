@@ -0,0 +1,108 @@
+#ifndef POLLER_H
+#define POLLER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "discord_api.h"
+
+// Background polling of watched channels for unread counts.
+//
+// A worker probes each watched channel with discord_probe_channel (limit=1
+// once, then after=<last seen id>) and adapts the channel's interval to its
+// smoothed message rate, aiming at about one new message per probe. The
+// focused channel, the one on screen, is polled within tighter bounds. All
+// probes draw from one token bucket, so the request rate never exceeds
+// POLLER_BUDGET_REQUESTS per POLLER_BUDGET_WINDOW_MS whatever the number of
+// channels, and a 429 pauses every probe for the time Discord asks.
+
+// Table size; the watch list gets all but one slot, kept for the focused
+// channel
+#define POLLER_MAX_CHANNELS 16
+
+// Request budget shared by all channels, and the burst allowed above it
+#ifndef POLLER_BUDGET_REQUESTS
+#define POLLER_BUDGET_REQUESTS 20
+#endif
+
+#ifndef POLLER_BUDGET_WINDOW_MS
+#define POLLER_BUDGET_WINDOW_MS 60000
+#endif
+
+#ifndef POLLER_BUDGET_BURST
+#define POLLER_BUDGET_BURST 3
+#endif
+
+// Interval bounds for the focused channel and for the others
+#ifndef POLLER_FOCUS_MIN_MS
+#define POLLER_FOCUS_MIN_MS 5000
+#endif
+
+#ifndef POLLER_FOCUS_MAX_MS
+#define POLLER_FOCUS_MAX_MS 20000
+#endif
+
+#ifndef POLLER_MIN_MS
+#define POLLER_MIN_MS 15000
+#endif
+
+#ifndef POLLER_MAX_MS
+#define POLLER_MAX_MS 300000
+#endif
+
+typedef struct {
+    uint64_t channel_id;
+    uint64_t server_id;         // 0 if unknown
+    uint64_t last_message_id;   // Newest seen, 0 before the first probe
+    uint64_t next_probe_at;     // timing_now() ticks
+    uint64_t last_probe_at;
+    float rate_per_min;         // Smoothed new messages per minute
+    uint32_t interval_ms;
+    uint16_t unread;
+    uint16_t probes;
+    bool watched;               // False if polled only while focused
+} PollerChannel;
+
+typedef struct {
+    int watched;
+    int probes;
+    int new_messages;
+    int rate_limited;           // 429 responses
+    int failed;                 // No response or unusable body
+    int throttled;              // Probes that waited for the budget
+} PollerStats;
+
+// Load the watch list from path (one "channel_id [server_id]" per line, NULL
+// for none) and start the worker
+bool poller_init(DiscordClient* client, const char* path);
+
+// Start polling channel_id; false if the watch list is full
+bool poller_watch(const char* channel_id, const char* server_id);
+
+// Stop polling channel_id, unless it is the focused one
+void poller_unwatch(const char* channel_id);
+
+// channel_id is on screen and read up to newest_message_id (NULL or "" if
+// unknown). Its unread count is cleared and it is polled while it stays
+// focused; a channel that isn't watched is dropped once focus moves on.
+void poller_set_focus(const char* channel_id, const char* server_id, const char* newest_message_id);
+
+// Hold every probe while the system sleeps or the app is suspended (on), and
+// resume with whatever fell due meanwhile (off)
+void poller_set_suspended(bool on);
+
+// True if the focused channel got new messages since the last call
+bool poller_take_focus_update(void);
+
+// Unread messages across the watched channels of server_id
+int poller_unread_for_server(const char* server_id);
+
+// Copy up to max watched channels; returns the count
+int poller_list(PollerChannel* out, int max);
+
+// Probe counts and budget pressure
+PollerStats poller_get_stats(void);
+
+// Stop the worker, waiting for an in-flight probe
+void poller_cleanup(void);
+
+#endif // POLLER_H
@@ -0,0 +1,50 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "timing.h"
+
+// Scoped profiling zones recorded into a fixed-size ring buffer.
+// A zone costs two tick reads and one atomic increment, so it stays enabled in
+// release builds. Build with -DPROFILER_ENABLED=0 to compile the zones out.
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 1
+#endif
+
+// Number of events kept (must be a power of two). Older events are overwritten.
+#define PROFILER_CAPACITY 8192
+
+typedef struct {
+    const char* name;
+    uint64_t start;
+} ProfileZone;
+
+// Reset the ring buffer and the trace time origin
+void profiler_init(void);
+
+// Open a zone; name must be a string literal or otherwise outlive the trace
+static inline ProfileZone profiler_zone_begin(const char* name) {
+    ProfileZone zone = { name, timing_now() };
+    return zone;
+}
+
+// Close a zone and append it to the ring buffer
+void profiler_zone_end(ProfileZone* zone);
+
+// Write the buffered events as a Chrome trace-event JSON file
+bool profiler_dump(const char* path);
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#if PROFILER_ENABLED
+// Profile the rest of the enclosing block
+#define PROFILE_ZONE(name) \
+    ProfileZone PROFILE_CONCAT(profile_zone_, __LINE__) \
+        __attribute__((cleanup(profiler_zone_end))) = profiler_zone_begin(name)
+#else
+#define PROFILE_ZONE(name) do { } while (0)
+#endif
+
+#endif // PROFILER_H
@@ -0,0 +1,72 @@
+#ifndef SWITCHER_H
+#define SWITCHER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "discord_api.h"
+
+// Quick switcher: fuzzy search over every server and channel name seen this
+// session.
+//
+// Names are indexed as they arrive, from discord_fetch_servers and from the
+// channel list of each server opened. Each name is folded to lower case
+// (with - _ . as spaces), two spaces are put in front, and every run of
+// three bytes gets a posting list of the names that contain it. A query is
+// folded and padded the same way; counting its trigrams over their posting
+// lists finds the names sharing at least half of them (any, if that leaves
+// too few), and only those are scored. A search thus touches a handful of postings instead of every name,
+// a typo still leaves enough trigrams in common, and thanks to the padding
+// the first letters of a name are a trigram of their own, so one or two
+// typed letters match by prefix.
+
+// Names indexed at most; postings hold 16-bit entry numbers
+#ifndef SWITCHER_MAX_ENTRIES
+#define SWITCHER_MAX_ENTRIES 16384
+#endif
+
+// Results returned by one search at most
+#define SWITCHER_MAX_RESULTS 8
+
+typedef enum {
+    SWITCHER_SERVER,
+    SWITCHER_CHANNEL
+} SwitcherKind;
+
+typedef struct {
+    SwitcherKind kind;
+    char id[32];
+    char server_id[32];         // The channel's server, or the server itself
+    char name[64];              // Console glyphs, as in DiscordServer.name
+    char server_name[64];       // For channels; "" if the server is unknown
+    int score;
+} SwitcherResult;
+
+typedef struct {
+    int entries;                // Names indexed, renamed ones included
+    int trigrams;               // Distinct trigrams
+    size_t postings;
+    size_t bytes;               // Index and names together
+    int searches;
+    double last_search_ms;
+    double max_search_ms;
+} SwitcherStats;
+
+// Start with an empty index
+void switcher_init(void);
+
+// Index servers by name; known ones with the same name are skipped
+void switcher_add_servers(const DiscordServer* servers, int count);
+
+// Index the text channels of server_id
+void switcher_add_channels(const char* server_id, const DiscordChannel* channels, int count);
+
+// Best matches for query, highest score first; returns the count
+int switcher_search(const char* query, SwitcherResult* results, int max);
+
+// Index size and search times
+SwitcherStats switcher_get_stats(void);
+
+// Free the index
+void switcher_cleanup(void);
+
+#endif // SWITCHER_H
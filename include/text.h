@@ -0,0 +1,28 @@
+#ifndef TEXT_H
+#define TEXT_H
+
+#include <stddef.h>
+
+// Decoding of JSON string values for storage and display.
+//
+// text_decode_json does everything in one pass over the raw string body:
+// JSON escapes (including \uXXXX surrogate pairs), UTF-8 validation and, in
+// console mode, mapping each code point to one glyph of the console font
+// through the table generated by tools/gen_glyph_table.py. It runs once when
+// a response is parsed, so rendering is a plain printf.
+
+typedef enum {
+    TEXT_UTF8,      // Valid UTF-8; malformed input becomes U+FFFD
+    TEXT_CONSOLE    // One console glyph byte per visible code point
+} TextMode;
+
+// Glyphs for UI decorations (console font, code page 437)
+#define TEXT_GLYPH_BULLET "\x07"
+#define TEXT_GLYPH_SQUARE "\xfe"
+
+// Decode the body of a JSON string (the bytes between the quotes) into out.
+// Output is truncated on a character boundary and always NUL-terminated when
+// size > 0. Returns the number of bytes written, excluding the NUL.
+size_t text_decode_json(const char* src, size_t len, char* out, size_t size, TextMode mode);
+
+#endif // TEXT_H
@@ -0,0 +1,50 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdint.h>
+
+// Monotonic tick source shared by the instrumentation code.
+// On the 3DS this is the ARM11 system tick counter, on the host build it is
+// CLOCK_MONOTONIC in nanoseconds.
+#ifdef __3DS__
+#include <3ds.h>
+
+#define TIMING_TICKS_PER_SEC SYSCLOCK_ARM11
+
+static inline uint64_t timing_now(void) {
+    return svcGetSystemTick();
+}
+
+// Put the calling thread to sleep
+static inline void timing_sleep_ms(uint32_t ms) {
+    svcSleepThread((s64)ms * 1000000LL);
+}
+#else
+#include <time.h>
+
+#define TIMING_TICKS_PER_SEC 1000000000ULL
+
+static inline uint64_t timing_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Put the calling thread to sleep
+static inline void timing_sleep_ms(uint32_t ms) {
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+#endif
+
+// Convert a tick delta to milliseconds
+static inline double timing_ticks_to_ms(uint64_t ticks) {
+    return (double)ticks * 1000.0 / (double)TIMING_TICKS_PER_SEC;
+}
+
+// Convert a tick delta to microseconds
+static inline double timing_ticks_to_us(uint64_t ticks) {
+    return (double)ticks * 1000000.0 / (double)TIMING_TICKS_PER_SEC;
+}
+
+#endif // TIMING_H
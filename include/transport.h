@@ -0,0 +1,110 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "net_stats.h"
+#include "cancel.h"
+
+// HTTP layer used by discord_api.c. Each backend embeds Transport as its
+// first member and fills in the function pointers.
+
+typedef struct {
+    const char* method;     // "GET", "POST", ...
+    const char* endpoint;   // Path below the API base, e.g. "/users/@me"
+    const char* token;      // Sent as the Authorization header
+    const char* body;       // Request body or NULL
+    size_t body_len;
+    CancelToken* cancel;    // Deadline and cancellation, may be NULL
+    bool fresh;             // Known to have changed: never answered from an
+                            // earlier identical request (transport_coalesce)
+    
+    // A body too large for memory (a file upload) is streamed instead: read
+    // fills buffer with up to size bytes and sets *length (0 once all of
+    // read_len was given); returning false aborts the request
+    const char* content_type;   // NULL for application/json
+    bool (*read)(char* buffer, size_t size, size_t* length, void* ctx);
+    void* read_ctx;
+    uint64_t read_len;
+} TransportRequest;
+
+typedef struct {
+    long status;            // HTTP status code
+    char* body;             // NUL-terminated, released with mem_free
+    size_t size;
+} TransportResponse;
+
+// A streamed GET of an absolute URL (an attachment on the CDN). The body is
+// handed to write as it arrives and never held whole in memory.
+typedef struct {
+    const char* url;
+    uint64_t offset;        // Resume from this byte with a Range header, 0 for all
+    CancelToken* cancel;    // May be NULL
+    // Called once before any data with the status and the body length (-1
+    // if unknown); returning false aborts, e.g. on an error status
+    bool (*begin)(long status, int64_t length, void* ctx);
+    // Called with each piece of the body; returning false aborts
+    bool (*write)(const void* data, size_t size, void* ctx);
+    void* ctx;
+} TransportDownload;
+
+typedef struct Transport Transport;
+
+struct Transport {
+    const char* name;
+    
+    // Perform one request. Returns false if no HTTP response was received,
+    // including when request->cancel tripped before the body was complete.
+    // Fills the network part of sample (times, byte counts, status).
+    // May be called from several threads at once (main loop and outbox).
+    bool (*perform)(Transport* transport, const TransportRequest* request,
+                    TransportResponse* response, NetSample* sample);
+    
+    void (*destroy)(Transport* transport);
+    
+    // Stream a download; NULL if the backend has no network of its own.
+    // Returns false if no complete response was received; sample->http_status
+    // holds the status either way.
+    bool (*download)(Transport* transport, const TransportDownload* request, NetSample* sample);
+};
+
+// Real network backend using libcurl against base_url (e.g. DISCORD_API_BASE)
+Transport* transport_curl_create(const char* base_url);
+
+// In-memory replay of recorded exchanges, matched by method + endpoint.
+// path may be NULL to start empty. Every reply is delayed by latency_ms plus
+// a random 0..jitter_ms.
+Transport* transport_replay_create(const char* path, uint32_t latency_ms, uint32_t jitter_ms);
+
+// Add one canned response to a replay transport
+bool transport_replay_add(Transport* transport, const char* method, const char* endpoint,
+                          long status, const char* body, size_t body_len);
+
+// Forward to inner and append every exchange to path in replay format
+// (streamed request bodies are recorded as empty). Takes ownership of inner; if path can't be opened, inner is returned as is.
+Transport* transport_record_create(Transport* inner, const char* path);
+
+// Requests answered without going to the network
+typedef struct {
+    int requests;       // GETs seen
+    int attached;       // Shared an identical request already in flight
+    int debounced;      // Served from one that finished within the window
+} TransportCoalesceStats;
+
+// Share identical GETs: one that matches a request in flight waits for its
+// response, one that matches a response less than window_ms old reuses it.
+// Other methods pass through and invalidate the kept responses. Takes
+// ownership of inner; returns inner if out of memory.
+Transport* transport_coalesce_create(Transport* inner, uint32_t window_ms);
+
+// Counters of a coalescing transport; false for any other transport
+bool transport_coalesce_stats(const Transport* transport, TransportCoalesceStats* stats);
+
+// Run request through transport's download, or fail if it has none
+bool transport_download(Transport* transport, const TransportDownload* request, NetSample* sample);
+
+// Destroy any transport
+void transport_destroy(Transport* transport);
+
+#endif // TRANSPORT_H
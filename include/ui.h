@@ -3,17 +3,67 @@
 
 #include <3ds.h>
 #include "discord_api.h"
+#include "vlist.h"
+#include "switcher.h"
+
+// Rows shown at once by each bottom-screen list
+#define UI_LIST_ROWS 6
+
+// Debug overlays cycled with SELECT
+typedef enum {
+    UI_OVERLAY_NONE,
+    UI_OVERLAY_NET,
+    UI_OVERLAY_MEM,
+    UI_OVERLAY_LOG,
+    UI_OVERLAY_COUNT
+} UIOverlay;
+
+// What the D-pad scrolls, moved with left/right
+typedef enum {
+    UI_FOCUS_MESSAGES,
+    UI_FOCUS_SERVERS,
+    UI_FOCUS_CHANNELS,
+    UI_FOCUS_MEMBERS,
+    UI_FOCUS_COUNT
+} UIFocus;
 
 // UI state
 typedef struct {
     int selected_server;
+    int selected_channel;       // Index of the current channel in the client's list
     int selected_user;
     int message_scroll;
+    UIFocus focus;
+    VList server_list;
+    VList channel_list;
+    VList member_list;
+    UIOverlay overlay;
+    bool switcher_open;         // Quick switcher results replace the lists
+    char switcher_query[64];
+    SwitcherResult switcher_results[SWITCHER_MAX_RESULTS];
+    VList switcher_list;
+    bool switch_pending;    // L/R pressed while a request was in flight
+    bool exit_requested;    // START pressed while a request was in flight
+    u32 deferred_keys;      // Other keys pressed then, for the main loop
 } UIState;
 
 // Initialize UI
 void ui_init(void);
 
+// Start state: first server, message view focused, lists at the top
+void ui_state_init(UIState* state);
+
+// Let B/START/L/R interrupt requests the client makes on the UI thread
+void ui_attach(DiscordClient* client, UIState* state);
+
+// Make the server switch asked for with L/R during a request that was not
+// itself a switch (a refresh, a channel fetch...)
+void ui_resume_switch(DiscordClient* client, UIState* state);
+
+// Tell the poller the current channel is on screen and read up to its
+// newest message
+void ui_mark_read(DiscordClient* client);
+
 // Render top screen (messages)
 void ui_render_top_screen(DiscordClient* client, UIState* state);
 
@@ -0,0 +1,41 @@
+#ifndef VLIST_H
+#define VLIST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Scrolling window over a list of any length.
+//
+// A VList holds only a cursor and the first visible row. The rows stay in
+// their backing store (a ClientView array) and vlist_render formats just the
+// visible ones through a callback, so a frame costs the same for a list of
+// ten as for ten thousand.
+
+typedef struct {
+    int count;                  // Rows in the backing store
+    int cursor;                 // Selected row, 0 when empty
+    int top;                    // First visible row
+    int rows;                   // Rows visible at once
+} VList;
+
+// Write row index into line, at most size - 1 bytes plus the NUL. selected
+// is true for the cursor row.
+typedef void (*VListFormatFn)(int index, bool selected, char* line, size_t size, void* ctx);
+
+// Empty list showing rows rows at a time
+void vlist_init(VList* list, int rows);
+
+// The backing store now holds count rows; keeps the cursor and window in range
+void vlist_set_count(VList* list, int count);
+
+// Put the cursor on index, scrolling just enough to show it
+void vlist_set_cursor(VList* list, int index);
+
+// Move the cursor by delta rows, stopping at either end
+void vlist_move(VList* list, int delta);
+
+// Format the visible rows into out, one per line. Returns the bytes written,
+// excluding the NUL.
+size_t vlist_render(const VList* list, VListFormatFn format, void* ctx, char* out, size_t size);
+
+#endif // VLIST_H
@@ -0,0 +1,59 @@
+#ifndef WAKE_H
+#define WAKE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Main loop pacing: render only when something changed, and stop spinning
+// at 60 Hz once the user has gone idle.
+//
+// Anything that changes what is on screen calls wake_request, from any
+// thread: a published client view, outbox progress, new unread counts, new
+// log records. The main loop asks wake_begin_frame whether to draw, and
+// wake_end_frame waits for the next iteration: the vblank while input is
+// recent, otherwise up to WAKE_IDLE_POLL_MS or until a wake_request,
+// leaving the core to the rest of the system.
+
+// Input-free time after which the loop stops following the vblank
+#ifndef WAKE_IDLE_AFTER_MS
+#define WAKE_IDLE_AFTER_MS 3000
+#endif
+
+// Input polling interval while idle; also the latency of the first press
+#ifndef WAKE_IDLE_POLL_MS
+#define WAKE_IDLE_POLL_MS 50
+#endif
+
+// Redraw interval for screens that change with time alone (overlays)
+#ifndef WAKE_LIVE_MS
+#define WAKE_LIVE_MS 1000
+#endif
+
+typedef struct {
+    uint32_t frames;            // Loop iterations
+    uint32_t rendered;          // Iterations that drew the screens
+    uint32_t idle_waits;        // Iterations that slept instead of vblank
+    uint32_t requests;          // wake_request calls
+} WakeStats;
+
+// Start with a redraw pending and the user active
+void wake_init(void);
+
+// The screens are out of date; safe from any thread
+void wake_request(void);
+
+// Main thread, once per loop iteration: true if the screens should be drawn.
+// input: a key is down or held. live: what is shown changes with time
+// alone, so it is redrawn every WAKE_LIVE_MS.
+bool wake_begin_frame(bool input, bool live);
+
+// Main thread, after the frame: wait for the next iteration
+void wake_end_frame(void);
+
+// Snapshot of the counters
+WakeStats wake_get_stats(void);
+
+// Release the wake event
+void wake_cleanup(void);
+
+#endif // WAKE_H
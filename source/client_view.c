@@ -0,0 +1,141 @@
+#include "client_view.h"
+#include "mem.h"
+#include "profiler.h"
+#include "wake.h"
+#include <stdio.h>
+#include <string.h>
+#include <3ds.h>
+
+// A replaced view waits here while a reader may still hold it. Each reader
+// holds at most one view, so one slot per reader is always enough.
+#define RETIRED_CAPACITY (CLIENT_VIEW_MAX_READERS + 1)
+
+static const ClientView empty_view;
+
+static ClientView* current = NULL;
+static ClientView* hazards[CLIENT_VIEW_MAX_READERS];
+static ClientView* retired[RETIRED_CAPACITY];
+static int retired_count = 0;
+
+// Serializes publishers; readers never touch it
+static LightLock publish_lock;
+static bool initialized = false;
+static ClientViewStats stats;
+
+static bool is_hazard(const ClientView* view) {
+    for (int i = 0; i < CLIENT_VIEW_MAX_READERS; i++) {
+        if (__atomic_load_n(&hazards[i], __ATOMIC_SEQ_CST) == view) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void free_view(ClientView* view) {
+    // A reader that kept a stale pointer sees version 0 instead of a valid list
+    view->version = 0;
+    mem_free(view);
+    stats.reclaimed++;
+    stats.live--;
+}
+
+// Free retired views no reader points at; called with publish_lock held
+static void reclaim(void) {
+    int kept = 0;
+    for (int i = 0; i < retired_count; i++) {
+        if (is_hazard(retired[i])) {
+            retired[kept++] = retired[i];
+        } else {
+            free_view(retired[i]);
+        }
+    }
+    retired_count = kept;
+}
+
+void client_view_init(void) {
+    LightLock_Init(&publish_lock);
+    memset(hazards, 0, sizeof(hazards));
+    memset(&stats, 0, sizeof(stats));
+    current = NULL;
+    retired_count = 0;
+    initialized = true;
+}
+
+bool client_view_publish(const DiscordClient* client) {
+    PROFILE_ZONE(__func__);
+
+    if (!initialized) {
+        return false;
+    }
+
+    ClientView* view = mem_alloc(MEM_MESSAGES, sizeof(ClientView));
+    if (!view) {
+        return false;
+    }
+    view->connected = client->connected;
+    memcpy(view->current_channel_id, client->current_channel_id, sizeof(view->current_channel_id));
+    memcpy(view->current_server_id, client->current_server_id, sizeof(view->current_server_id));
+    view->message_count = client->message_count;
+    memcpy(view->messages, client->messages, client->message_count * sizeof(DiscordMessage));
+    view->server_count = client->server_count;
+    memcpy(view->servers, client->servers, client->server_count * sizeof(DiscordServer));
+    view->channel_count = client->channel_count;
+    memcpy(view->channels, client->channels, client->channel_count * sizeof(DiscordChannel));
+    view->user_count = client->user_count;
+    memcpy(view->users, client->users, client->user_count * sizeof(DiscordUser));
+
+    LightLock_Lock(&publish_lock);
+    view->version = ++stats.published;
+    stats.live++;
+    if (stats.live > stats.max_live) {
+        stats.max_live = stats.live;
+    }
+
+    ClientView* old = __atomic_exchange_n(&current, view, __ATOMIC_SEQ_CST);
+    if (old) {
+        retired[retired_count++] = old;
+    }
+    reclaim();
+    LightLock_Unlock(&publish_lock);
+    wake_request();
+    return true;
+}
+
+const ClientView* client_view_acquire(int reader) {
+    ClientView* view;
+    // Announce the view, then make sure it wasn't replaced (and possibly
+    // freed) before the announcement became visible
+    do {
+        view = __atomic_load_n(&current, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&hazards[reader], view, __ATOMIC_SEQ_CST);
+    } while (view != __atomic_load_n(&current, __ATOMIC_SEQ_CST));
+
+    return view ? view : &empty_view;
+}
+
+void client_view_release(int reader) {
+    __atomic_store_n(&hazards[reader], NULL, __ATOMIC_RELEASE);
+}
+
+ClientViewStats client_view_get_stats(void) {
+    LightLock_Lock(&publish_lock);
+    ClientViewStats result = stats;
+    LightLock_Unlock(&publish_lock);
+    return result;
+}
+
+void client_view_cleanup(void) {
+    if (!initialized) {
+        return;
+    }
+
+    LightLock_Lock(&publish_lock);
+    ClientView* last = __atomic_exchange_n(&current, NULL, __ATOMIC_SEQ_CST);
+    if (last) {
+        retired[retired_count++] = last;
+    }
+    memset(hazards, 0, sizeof(hazards));
+    reclaim();
+    LightLock_Unlock(&publish_lock);
+    initialized = false;
+}
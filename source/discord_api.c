@@ -1,170 +1,152 @@
 #include "discord_api.h"
 #include "json_helper.h"
+#include "json_writer.h"
+#include "multipart.h"
+#include "mem.h"
+#include "discord_parse.h"
+#include "history.h"
+#include "switcher.h"
+#include "client_view.h"
+#include "net_stats.h"
+#include "profiler.h"
+#include "timing.h"
+#include "log.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include <curl/curl.h>
 
-#define DISCORD_API_BASE "https://discord.com/api/v10"
 #define MAX_RESPONSE_SIZE (1024 * 512) // 512KB max response
 
-// Structure to hold HTTP response
-typedef struct {
-    char* data;
-    size_t size;
-} HTTPResponse;
-
-// Callback for curl to write response data
-static size_t write_callback(void* contents, size_t size, size_t nmemb, void* userp) {
-    size_t realsize = size * nmemb;
-    HTTPResponse* resp = (HTTPResponse*)userp;
-    
-    char* ptr = realloc(resp->data, resp->size + realsize + 1);
-    if (ptr == NULL) {
-        printf("Failed to allocate memory for response\n");
-        return 0;
+// Perform a request through the client's transport.
+// Failed requests are recorded here; on success the caller records the sample
+// once it has added its parse/extract times.
+static char* discord_api_perform(DiscordClient* client, const TransportRequest* request, NetSample* sample) {
+    CancelToken* cancel = request->cancel;
+    TransportResponse response = {0};
+    
+    net_stats_begin(sample, request->method, request->endpoint);
+    
+    if (!client->transport || !client->transport->perform(client->transport, request, &response, sample)) {
+        if (cancel && cancel->cancelled) {
+            sample->aborted = true;
+            sample->abort_ms = timing_ticks_to_ms(timing_now() - cancel->cancelled_at);
+            log_write(LOG_WARN, cancel->expired ? "Request timed out" : "Request cancelled");
+        }
+        net_stats_record(sample);
+        return NULL;
     }
     
-    resp->data = ptr;
-    memcpy(&(resp->data[resp->size]), contents, realsize);
-    resp->size += realsize;
-    resp->data[resp->size] = 0;
-    
-    return realsize;
+    sample->ok = true;
+    return response.body;
 }
 
-// Make HTTP GET request to Discord API
-static char* discord_api_get(DiscordClient* client, const char* endpoint) {
-    CURL* curl;
-    CURLcode res;
-    HTTPResponse response = {0};
-    
-    response.data = malloc(1);
-    response.size = 0;
-    
-    curl = curl_easy_init();
-    if (!curl) {
-        free(response.data);
-        return NULL;
-    }
-    
-    char url[512];
-    snprintf(url, sizeof(url), "%s%s", DISCORD_API_BASE, endpoint);
-    
-    char auth_header[256];
-    snprintf(auth_header, sizeof(auth_header), "Authorization: %s", client->token);
-    
-    struct curl_slist* headers = NULL;
-    headers = curl_slist_append(headers, auth_header);
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-    headers = curl_slist_append(headers, "User-Agent: Discord3DS/1.0");
-    
-    curl_easy_setopt(curl, CURLOPT_URL, url);
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void*)&response);
-    curl_easy_setopt(curl, CURLOPT_USERAGENT, "Discord3DS/1.0");
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 2L);
-    
-    res = curl_easy_perform(curl);
-    
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
-    
-    if (res != CURLE_OK) {
-        printf("curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-        free(response.data);
-        return NULL;
-    }
-    
-    return response.data;
+// Make HTTP request with an in-memory body (or none)
+static char* discord_api_request(DiscordClient* client, const char* method, const char* endpoint,
+                                 const char* body, size_t body_len, CancelToken* cancel, NetSample* sample) {
+    TransportRequest request = {
+        .method = method,
+        .endpoint = endpoint,
+        .token = client->token,
+        .body = body,
+        .body_len = body_len,
+        .cancel = cancel,
+    };
+    return discord_api_perform(client, &request, sample);
 }
 
-// Make HTTP POST request to Discord API
-static char* discord_api_post(DiscordClient* client, const char* endpoint, const char* json_data) {
-    CURL* curl;
-    CURLcode res;
-    HTTPResponse response = {0};
-    
-    response.data = malloc(1);
-    response.size = 0;
-    
-    curl = curl_easy_init();
-    if (!curl) {
-        free(response.data);
-        return NULL;
-    }
-    
-    char url[512];
-    snprintf(url, sizeof(url), "%s%s", DISCORD_API_BASE, endpoint);
-    
-    char auth_header[256];
-    snprintf(auth_header, sizeof(auth_header), "Authorization: %s", client->token);
-    
-    struct curl_slist* headers = NULL;
-    headers = curl_slist_append(headers, auth_header);
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-    headers = curl_slist_append(headers, "User-Agent: Discord3DS/1.0");
-    
-    curl_easy_setopt(curl, CURLOPT_URL, url);
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json_data);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void*)&response);
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 2L);
-    
-    res = curl_easy_perform(curl);
-    
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
-    
-    if (res != CURLE_OK) {
-        printf("curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-        free(response.data);
-        return NULL;
+// Deadline for a request made on the UI thread, interruptible by the hook
+static void discord_request_token(DiscordClient* client, CancelToken* cancel) {
+    cancel_token_init(cancel, DISCORD_REQUEST_TIMEOUT_MS);
+    cancel->poll = client->cancel_poll;
+    cancel->poll_ctx = client->cancel_ctx;
+}
+
+// Make HTTP GET request to Discord API; a fresh one skips the responses
+// the coalescing transport keeps
+static char* discord_api_get_fresh(DiscordClient* client, const char* endpoint, bool fresh, NetSample* sample) {
+    PROFILE_ZONE("http_get");
+    CancelToken cancel;
+    discord_request_token(client, &cancel);
+    TransportRequest request = {
+        .method = "GET",
+        .endpoint = endpoint,
+        .token = client->token,
+        .cancel = &cancel,
+        .fresh = fresh,
+    };
+    return discord_api_perform(client, &request, sample);
+}
+
+static char* discord_api_get(DiscordClient* client, const char* endpoint, NetSample* sample) {
+    return discord_api_get_fresh(client, endpoint, false, sample);
+}
+
+// Make HTTP POST request to Discord API with a body built by a JsonWriter.
+// The transport sends the writer's buffer as-is, without copying it.
+static char* discord_api_post(DiscordClient* client, const char* endpoint, const JsonWriter* body,
+                              CancelToken* cancel, NetSample* sample) {
+    PROFILE_ZONE("http_post");
+    return discord_api_request(client, "POST", endpoint, body->buffer, body->length, cancel, sample);
+}
+
+// Read the delay Discord asks for from a 429 body
+static void parse_retry_after(const char* response, double* retry_after_s) {
+    jsmntok_t* tokens = NULL;
+    int r = json_parse_alloc(response, &tokens);
+    jsmntok_t* retry = r > 0 ? json_object_get(response, tokens, r, 0, "retry_after") : NULL;
+    if (retry) {
+        *retry_after_s = strtod(response + retry->start, NULL);
     }
-    
-    return response.data;
+    mem_free(tokens);
 }
 
-void discord_init(DiscordClient* client, const char* token) {
+void discord_init(DiscordClient* client, const char* token, Transport* transport) {
+    PROFILE_ZONE(__func__);
+    
     memset(client, 0, sizeof(DiscordClient));
     strncpy(client->token, token, sizeof(client->token) - 1);
     client->connected = false;
-    
-    // Initialize curl globally
-    curl_global_init(CURL_GLOBAL_DEFAULT);
+    client->transport = transport;
+}
+
+void discord_set_cancel_hook(DiscordClient* client, CancelPollFn poll, void* ctx) {
+    client->cancel_poll = poll;
+    client->cancel_ctx = ctx;
 }
 
 bool discord_connect(DiscordClient* client) {
+    PROFILE_ZONE(__func__);
+    
     // Verify token by fetching user info
-    char* response = discord_api_get(client, "/users/@me");
+    NetSample sample;
+    char* response = discord_api_get(client, "/users/@me", &sample);
     if (!response) {
-        printf("Failed to connect to Discord API\n");
+        log_write(LOG_ERROR, "Failed to connect to Discord API");
         return false;
     }
     
     // Parse response to verify authentication
     jsmntok_t tokens[128];
+    u64 parse_start = timing_now();
     int r = json_parse(response, tokens, 128);
+    sample.parse_ms = timing_ticks_to_ms(timing_now() - parse_start);
+    net_stats_record(&sample);
     
     if (r < 0) {
-        printf("Failed to parse user info JSON\n");
-        free(response);
+        log_write(LOG_ERROR, "Failed to parse user info JSON");
+        mem_free(response);
         return false;
     }
     
     // Check if we got a valid user object (should have "id" field)
     jsmntok_t* id_token = json_find_token(response, tokens, r, "id");
     if (!id_token) {
-        printf("Invalid token or authentication failed\n");
-        free(response);
+        log_write(LOG_ERROR, "Invalid token or authentication failed");
+        mem_free(response);
         return false;
     }
     
-    free(response);
+    mem_free(response);
     
     client->connected = true;
     
@@ -178,39 +160,26 @@ bool discord_connect(DiscordClient* client) {
         // Fetch channels for first server to set current_channel_id
         char endpoint[256];
         snprintf(endpoint, sizeof(endpoint), "/guilds/%s/channels", client->servers[0].id);
-        char* channels_response = discord_api_get(client, endpoint);
+        char* channels_response = discord_api_get(client, endpoint, &sample);
         
         if (channels_response) {
-            jsmntok_t channel_tokens[256];
-            int ch_count = json_parse(channels_response, channel_tokens, 256);
-            
-            if (ch_count > 0 && channel_tokens[0].type == JSMN_ARRAY && channel_tokens[0].size > 0) {
-                // Find first text channel
-                for (int i = 1; i < ch_count; i++) {
-                    jsmntok_t* type_token = json_find_token(channels_response, &channel_tokens[i], ch_count - i, "type");
-                    if (type_token) {
-                        char type_str[16];
-                        json_get_string(channels_response, type_token, type_str, sizeof(type_str));
-                        // Type 0 is text channel
-                        if (strcmp(type_str, "0") == 0) {
-                            jsmntok_t* ch_id_token = json_find_token(channels_response, &channel_tokens[i], ch_count - i, "id");
-                            if (ch_id_token) {
-                                json_get_string(channels_response, ch_id_token, client->current_channel_id, sizeof(client->current_channel_id));
-                                break;
-                            }
-                        }
-                    }
-                }
+            if (sample.http_status >= 200 && sample.http_status < 300 &&
+                discord_parse_channels(client, channels_response, &sample) && client->channel_count > 0) {
+                strcpy(client->current_channel_id, client->channels[0].id);
+                switcher_add_channels(client->servers[0].id, client->channels, client->channel_count);
             }
-            
-            free(channels_response);
+            net_stats_record(&sample);
+            mem_free(channels_response);
         }
     }
     
+    client_view_publish(client);
     return true;
 }
 
-bool discord_fetch_messages(DiscordClient* client) {
+static bool fetch_messages(DiscordClient* client, bool fresh) {
+    PROFILE_ZONE("discord_fetch_messages");
+    
     if (!client->connected || strlen(client->current_channel_id) == 0) {
         return false;
     }
@@ -218,231 +187,280 @@ bool discord_fetch_messages(DiscordClient* client) {
     char endpoint[256];
     snprintf(endpoint, sizeof(endpoint), "/channels/%s/messages?limit=50", client->current_channel_id);
     
-    char* response = discord_api_get(client, endpoint);
+    NetSample sample;
+    char* response = discord_api_get_fresh(client, endpoint, fresh, &sample);
     if (!response) {
-        printf("Failed to fetch messages\n");
+        log_write(LOG_ERROR, "Failed to fetch messages");
         return false;
     }
     
-    jsmntok_t tokens[2048]; // Large buffer for messages
-    int r = json_parse(response, tokens, 2048);
+    bool ok = discord_parse_messages(client, response, &sample);
+    net_stats_record(&sample);
     
-    if (r < 0 || tokens[0].type != JSMN_ARRAY) {
-        printf("Failed to parse messages JSON\n");
-        free(response);
-        return false;
+    mem_free(response);
+    if (ok) {
+        client_view_publish(client);
     }
+    return ok;
+}
+
+bool discord_fetch_messages(DiscordClient* client) {
+    return fetch_messages(client, false);
+}
+
+bool discord_refresh_messages(DiscordClient* client) {
+    return fetch_messages(client, true);
+}
+
+bool discord_fetch_servers(DiscordClient* client) {
+    PROFILE_ZONE(__func__);
     
-    // Clear existing messages
-    client->message_count = 0;
-    
-    // Parse message array (tokens[0] is the array)
-    int array_size = tokens[0].size;
-    if (array_size > MAX_MESSAGES) {
-        array_size = MAX_MESSAGES;
+    if (!client->connected) {
+        return false;
     }
     
-    int tok_idx = 1; // Start after array token
-    for (int i = 0; i < array_size && client->message_count < MAX_MESSAGES; i++) {
-        if (tok_idx >= r || tokens[tok_idx].type != JSMN_OBJECT) {
-            break;
-        }
-        
-        DiscordMessage* msg = &client->messages[client->message_count];
-        
-        // Extract message fields
-        jsmntok_t* id_token = json_find_token(response, &tokens[tok_idx], r - tok_idx, "id");
-        jsmntok_t* content_token = json_find_token(response, &tokens[tok_idx], r - tok_idx, "content");
-        jsmntok_t* timestamp_token = json_find_token(response, &tokens[tok_idx], r - tok_idx, "timestamp");
-        
-        // Get author object and extract username
-        jsmntok_t* author_token = json_find_token(response, &tokens[tok_idx], r - tok_idx, "author");
-        
-        if (id_token) {
-            json_get_string(response, id_token, msg->id, sizeof(msg->id));
-        }
-        
-        if (content_token) {
-            json_get_string(response, content_token, msg->content, sizeof(msg->content));
-        }
-        
-        if (timestamp_token) {
-            char full_timestamp[64];
-            json_get_string(response, timestamp_token, full_timestamp, sizeof(full_timestamp));
-            // Extract just time portion (HH:MM) from ISO 8601 timestamp
-            if (strlen(full_timestamp) >= 16) {
-                snprintf(msg->timestamp, sizeof(msg->timestamp), "%c%c:%c%c", 
-                         full_timestamp[11], full_timestamp[12], 
-                         full_timestamp[14], full_timestamp[15]);
-            }
-        }
-        
-        if (author_token) {
-            // Find username within author object
-            int author_idx = author_token - tokens;
-            jsmntok_t* username_token = json_find_token(response, &tokens[author_idx], r - author_idx, "username");
-            if (username_token) {
-                json_get_string(response, username_token, msg->author, sizeof(msg->author));
-            }
-        }
-        
-        client->message_count++;
-        
-        // Skip to next object in array
-        tok_idx += tokens[tok_idx].size + 1;
+    NetSample sample;
+    char* response = discord_api_get(client, "/users/@me/guilds", &sample);
+    if (!response) {
+        log_write(LOG_ERROR, "Failed to fetch servers");
+        return false;
     }
     
-    // Reverse messages so oldest is first
-    for (int i = 0; i < client->message_count / 2; i++) {
-        DiscordMessage temp = client->messages[i];
-        client->messages[i] = client->messages[client->message_count - 1 - i];
-        client->messages[client->message_count - 1 - i] = temp;
-    }
+    bool ok = discord_parse_servers(client, response, &sample);
+    net_stats_record(&sample);
     
-    free(response);
-    return true;
+    mem_free(response);
+    if (ok) {
+        switcher_add_servers(client->servers, client->server_count);
+        client_view_publish(client);
+    }
+    return ok;
 }
 
-bool discord_fetch_servers(DiscordClient* client) {
-    if (!client->connected) {
+bool discord_fetch_users(DiscordClient* client) {
+    PROFILE_ZONE(__func__);
+    
+    if (!client->connected || strlen(client->current_server_id) == 0) {
         return false;
     }
     
-    char* response = discord_api_get(client, "/users/@me/guilds");
+    // Once per server, even if it fails: members are not worth retrying
+    // on every frame
+    client->users_attempted = true;
+    char endpoint[256];
+    snprintf(endpoint, sizeof(endpoint), "/guilds/%s/members?limit=50", client->current_server_id);
+    
+    NetSample sample;
+    char* response = discord_api_get(client, endpoint, &sample);
     if (!response) {
-        printf("Failed to fetch servers\n");
+        log_write(LOG_ERROR, "Failed to fetch users");
         return false;
     }
     
-    jsmntok_t tokens[512];
-    int r = json_parse(response, tokens, 512);
+    bool ok = discord_parse_users(client, response, &sample);
+    net_stats_record(&sample);
     
-    if (r < 0 || tokens[0].type != JSMN_ARRAY) {
-        printf("Failed to parse servers JSON\n");
-        free(response);
-        return false;
+    mem_free(response);
+    if (ok) {
+        client_view_publish(client);
     }
+    return ok;
+}
+
+long discord_post_message(DiscordClient* client, const char* channel_id, const char* content,
+                          const char* nonce, CancelToken* cancel, double* retry_after_s) {
+    PROFILE_ZONE(__func__);
     
-    client->server_count = 0;
-    int array_size = tokens[0].size;
-    if (array_size > MAX_SERVERS) {
-        array_size = MAX_SERVERS;
+    char endpoint[256];
+    snprintf(endpoint, sizeof(endpoint), "/channels/%s/messages", channel_id);
+    
+    // Create JSON payload, escaping the message so quotes and newlines survive
+    char json_data[JSON_ESCAPED_MAX(MAX_TEXT_LENGTH) + 96];
+    JsonWriter writer;
+    json_writer_init(&writer, json_data, sizeof(json_data));
+    json_writer_begin_object(&writer);
+    json_writer_key(&writer, "content");
+    json_writer_string(&writer, content);
+    if (nonce) {
+        // Discord returns the existing message instead of posting a duplicate
+        json_writer_key(&writer, "nonce");
+        json_writer_string(&writer, nonce);
+        json_writer_key(&writer, "enforce_nonce");
+        json_writer_bool(&writer, true);
+    }
+    json_writer_end_object(&writer);
+    if (!json_writer_finish(&writer)) {
+        log_write(LOG_WARN, "Message too long to send");
+        return 0;
     }
     
-    int tok_idx = 1;
-    for (int i = 0; i < array_size && client->server_count < MAX_SERVERS; i++) {
-        if (tok_idx >= r || tokens[tok_idx].type != JSMN_OBJECT) {
-            break;
-        }
-        
-        DiscordServer* server = &client->servers[client->server_count];
-        
-        jsmntok_t* id_token = json_find_token(response, &tokens[tok_idx], r - tok_idx, "id");
-        jsmntok_t* name_token = json_find_token(response, &tokens[tok_idx], r - tok_idx, "name");
-        
-        if (id_token && name_token) {
-            json_get_string(response, id_token, server->id, sizeof(server->id));
-            json_get_string(response, name_token, server->name, sizeof(server->name));
-            client->server_count++;
-        }
-        
-        tok_idx += tokens[tok_idx].size + 1;
+    CancelToken deadline;
+    if (!cancel) {
+        cancel_token_init(&deadline, DISCORD_REQUEST_TIMEOUT_MS);
+        cancel = &deadline;
     }
     
-    free(response);
-    return true;
+    NetSample sample;
+    char* response = discord_api_post(client, endpoint, &writer, cancel, &sample);
+    if (!response) {
+        return 0;
+    }
+    
+    net_stats_record(&sample);
+    
+    if (sample.http_status == 429 && retry_after_s) {
+        parse_retry_after(response, retry_after_s);
+    }
+    
+    mem_free(response);
+    return sample.http_status;
 }
 
-bool discord_fetch_users(DiscordClient* client) {
-    if (!client->connected || strlen(client->current_server_id) == 0) {
+// payload_json of an upload and the progress reporting around its body
+typedef struct {
+    MultipartBody body;
+    const char* content;
+    const char* nonce;
+    const char* filename;
+    DiscordUploadProgressFn progress;
+    void* progress_ctx;
+} DiscordUpload;
+
+static void write_upload_payload(JsonWriter* writer, void* ctx) {
+    const DiscordUpload* upload = (const DiscordUpload*)ctx;
+    json_writer_begin_object(writer);
+    if (upload->content && upload->content[0] != '\0') {
+        json_writer_key(writer, "content");
+        json_writer_string(writer, upload->content);
+    }
+    if (upload->nonce) {
+        json_writer_key(writer, "nonce");
+        json_writer_string(writer, upload->nonce);
+        json_writer_key(writer, "enforce_nonce");
+        json_writer_bool(writer, true);
+    }
+    // Ties files[0] to its name in the message
+    json_writer_key(writer, "attachments");
+    json_writer_begin_array(writer);
+    json_writer_begin_object(writer);
+    json_writer_key(writer, "id");
+    json_writer_int(writer, 0);
+    json_writer_key(writer, "filename");
+    json_writer_string(writer, upload->filename);
+    json_writer_end_object(writer);
+    json_writer_end_array(writer);
+    json_writer_end_object(writer);
+}
+
+static bool read_upload(char* buffer, size_t size, size_t* length, void* ctx) {
+    DiscordUpload* upload = (DiscordUpload*)ctx;
+    if (!multipart_read(buffer, size, length, &upload->body)) {
         return false;
     }
+    if (upload->progress && *length > 0) {
+        upload->progress(upload->body.offset, upload->body.length, upload->progress_ctx);
+    }
+    return true;
+}
+
+long discord_upload_file(DiscordClient* client, const char* channel_id, const char* content,
+                         const char* path, const char* nonce, CancelToken* cancel,
+                         DiscordUploadProgressFn progress, void* progress_ctx, double* retry_after_s) {
+    PROFILE_ZONE(__func__);
+    
+    DiscordUpload upload = {0};
+    const char* slash = strrchr(path, '/');
+    upload.filename = slash ? slash + 1 : path;
+    upload.content = content;
+    upload.nonce = nonce;
+    upload.progress = progress;
+    upload.progress_ctx = progress_ctx;
+    if (!multipart_open(&upload.body, path, upload.filename, write_upload_payload, &upload)) {
+        return 0;
+    }
     
     char endpoint[256];
-    snprintf(endpoint, sizeof(endpoint), "/guilds/%s/members?limit=50", client->current_server_id);
-    
-    char* response = discord_api_get(client, endpoint);
+    snprintf(endpoint, sizeof(endpoint), "/channels/%s/messages", channel_id);
+    TransportRequest request = {
+        .method = "POST",
+        .endpoint = endpoint,
+        .token = client->token,
+        .cancel = cancel,
+        .content_type = upload.body.content_type,
+        .read = read_upload,
+        .read_ctx = &upload,
+        .read_len = upload.body.length,
+    };
+    
+    NetSample sample;
+    char* response = discord_api_perform(client, &request, &sample);
+    multipart_close(&upload.body);
     if (!response) {
-        printf("Failed to fetch users\n");
-        return false;
+        return 0;
     }
     
-    jsmntok_t tokens[1024];
-    int r = json_parse(response, tokens, 1024);
+    net_stats_record(&sample);
     
-    if (r < 0 || tokens[0].type != JSMN_ARRAY) {
-        printf("Failed to parse users JSON\n");
-        free(response);
-        return false;
+    if (sample.http_status == 429 && retry_after_s) {
+        parse_retry_after(response, retry_after_s);
     }
     
-    client->user_count = 0;
-    int array_size = tokens[0].size;
-    if (array_size > MAX_USERS) {
-        array_size = MAX_USERS;
+    mem_free(response);
+    return sample.http_status;
+}
+
+long discord_probe_channel(DiscordClient* client, const char* channel_id, uint64_t after_id,
+                           CancelToken* cancel, DiscordProbe* probe, double* retry_after_s) {
+    PROFILE_ZONE(__func__);
+    
+    char endpoint[256];
+    if (after_id) {
+        snprintf(endpoint, sizeof(endpoint), "/channels/%s/messages?limit=%d&after=%llu", channel_id,
+                 MAX_MESSAGES, (unsigned long long)after_id);
+    } else {
+        snprintf(endpoint, sizeof(endpoint), "/channels/%s/messages?limit=1", channel_id);
     }
     
-    int tok_idx = 1;
-    for (int i = 0; i < array_size && client->user_count < MAX_USERS; i++) {
-        if (tok_idx >= r || tokens[tok_idx].type != JSMN_OBJECT) {
-            break;
-        }
-        
-        DiscordUser* user = &client->users[client->user_count];
-        
-        // Get user object within member
-        jsmntok_t* user_token = json_find_token(response, &tokens[tok_idx], r - tok_idx, "user");
-        if (user_token) {
-            int user_idx = user_token - tokens;
-            
-            jsmntok_t* id_token = json_find_token(response, &tokens[user_idx], r - user_idx, "id");
-            jsmntok_t* username_token = json_find_token(response, &tokens[user_idx], r - user_idx, "username");
-            jsmntok_t* discriminator_token = json_find_token(response, &tokens[user_idx], r - user_idx, "discriminator");
-            
-            if (id_token && username_token) {
-                json_get_string(response, id_token, user->id, sizeof(user->id));
-                json_get_string(response, username_token, user->username, sizeof(user->username));
-                
-                if (discriminator_token) {
-                    json_get_string(response, discriminator_token, user->discriminator, sizeof(user->discriminator));
-                } else {
-                    strcpy(user->discriminator, "0");
-                }
-                
-                // For now, assume all users are online (presence requires WebSocket)
-                user->online = true;
-                
-                client->user_count++;
-            }
+    CancelToken deadline;
+    if (!cancel) {
+        cancel_token_init(&deadline, DISCORD_REQUEST_TIMEOUT_MS);
+        cancel = &deadline;
+    }
+    
+    NetSample sample;
+    char* response = discord_api_request(client, "GET", endpoint, NULL, 0, cancel, &sample);
+    if (!response) {
+        return 0;
+    }
+    
+    if (sample.http_status == 200) {
+        if (!discord_parse_probe(response, after_id, probe, &sample)) {
+            sample.ok = false;
         }
-        
-        tok_idx += tokens[tok_idx].size + 1;
+    } else if (sample.http_status == 429 && retry_after_s) {
+        parse_retry_after(response, retry_after_s);
     }
+    net_stats_record(&sample);
     
-    free(response);
-    return true;
+    mem_free(response);
+    return sample.ok ? sample.http_status : 0;
 }
 
 bool discord_send_message(DiscordClient* client, const char* message) {
+    PROFILE_ZONE(__func__);
+    
     if (!client->connected || !message || strlen(message) == 0 || strlen(client->current_channel_id) == 0) {
         return false;
     }
     
-    char endpoint[256];
-    snprintf(endpoint, sizeof(endpoint), "/channels/%s/messages", client->current_channel_id);
-    
-    // Create JSON payload
-    char json_data[MAX_TEXT_LENGTH + 64];
-    snprintf(json_data, sizeof(json_data), "{\"content\":\"%s\"}", message);
-    
-    char* response = discord_api_post(client, endpoint, json_data);
-    if (!response) {
-        printf("Failed to send message\n");
+    CancelToken cancel;
+    discord_request_token(client, &cancel);
+    long status = discord_post_message(client, client->current_channel_id, message, NULL, &cancel, NULL);
+    if (status < 200 || status >= 300) {
+        log_write(LOG_ERROR, "Failed to send message");
         return false;
     }
     
-    free(response);
-    
     // Refresh messages to show the new one
     discord_fetch_messages(client);
     
@@ -450,62 +468,75 @@ bool discord_send_message(DiscordClient* client, const char* message) {
 }
 
 bool discord_switch_server(DiscordClient* client, const char* server_id) {
+    PROFILE_ZONE(__func__);
+    
     if (!client->connected || !server_id) {
         return false;
     }
     
-    // Update current server ID
-    strncpy(client->current_server_id, server_id, sizeof(client->current_server_id) - 1);
-    client->current_server_id[sizeof(client->current_server_id) - 1] = '\0';
-    
-    // Clear current channel ID
-    client->current_channel_id[0] = '\0';
-    
     // Fetch channels for the server
     char endpoint[256];
     snprintf(endpoint, sizeof(endpoint), "/guilds/%s/channels", server_id);
-    char* channels_response = discord_api_get(client, endpoint);
+    NetSample sample;
+    char* channels_response = discord_api_get(client, endpoint, &sample);
     
     if (!channels_response) {
-        printf("Failed to fetch channels for server\n");
+        log_write(LOG_ERROR, "Failed to fetch channels for server");
         return false;
     }
     
-    jsmntok_t channel_tokens[256];
-    int ch_count = json_parse(channels_response, channel_tokens, 256);
-    
-    if (ch_count > 0 && channel_tokens[0].type == JSMN_ARRAY && channel_tokens[0].size > 0) {
-        // Find first text channel
-        for (int i = 1; i < ch_count; i++) {
-            jsmntok_t* type_token = json_find_token(channels_response, &channel_tokens[i], ch_count - i, "type");
-            if (type_token) {
-                char type_str[16];
-                json_get_string(channels_response, type_token, type_str, sizeof(type_str));
-                // Type 0 is text channel
-                if (strcmp(type_str, "0") == 0) {
-                    jsmntok_t* ch_id_token = json_find_token(channels_response, &channel_tokens[i], ch_count - i, "id");
-                    if (ch_id_token) {
-                        json_get_string(channels_response, ch_id_token, client->current_channel_id, sizeof(client->current_channel_id));
-                        break;
-                    }
-                }
-            }
-        }
+    // An error reply (401, 429, 5xx...) or a bad body leaves the old server,
+    // its channels and its messages untouched
+    bool ok = sample.http_status >= 200 && sample.http_status < 300 &&
+              discord_parse_channels(client, channels_response, &sample);
+    net_stats_record(&sample);
+    mem_free(channels_response);
+    if (!ok) {
+        log_write(LOG_ERROR, "Failed to fetch channels for server (HTTP %ld)", sample.http_status);
+        return false;
     }
     
-    free(channels_response);
+    // Commit the switch only now that the channels are in, keeping the
+    // channel we leave as compressed history
+    switcher_add_channels(server_id, client->channels, client->channel_count);
+    history_store(client->current_channel_id, client->messages, client->message_count);
+    strncpy(client->current_server_id, server_id, sizeof(client->current_server_id) - 1);
+    client->current_server_id[sizeof(client->current_server_id) - 1] = '\0';
+    strcpy(client->current_channel_id, client->channel_count > 0 ? client->channels[0].id : "");
     
-    // Clear message count since we're switching to a different server
-    client->message_count = 0;
+    // Show the new channel's last known messages until the refresh arrives
+    history_load(client->current_channel_id, client->messages, &client->message_count);
     client->user_count = 0;
+    client->users_attempted = false;
+    client_view_publish(client);
     
     return strlen(client->current_channel_id) > 0;
 }
 
+bool discord_select_channel(DiscordClient* client, const char* channel_id) {
+    PROFILE_ZONE(__func__);
+    
+    if (!client->connected || !channel_id || strlen(channel_id) == 0) {
+        return false;
+    }
+    if (strcmp(client->current_channel_id, channel_id) == 0) {
+        return true;
+    }
+    
+    history_store(client->current_channel_id, client->messages, client->message_count);
+    strncpy(client->current_channel_id, channel_id, sizeof(client->current_channel_id) - 1);
+    client->current_channel_id[sizeof(client->current_channel_id) - 1] = '\0';
+    history_load(client->current_channel_id, client->messages, &client->message_count);
+    client_view_publish(client);
+    return true;
+}
+
 void discord_cleanup(DiscordClient* client) {
+    PROFILE_ZONE(__func__);
+    
     client->connected = false;
     memset(client->token, 0, sizeof(client->token));
     
-    // Cleanup curl
-    curl_global_cleanup();
+    transport_destroy(client->transport);
+    client->transport = NULL;
 }
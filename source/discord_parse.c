@@ -0,0 +1,423 @@
+#include "discord_parse.h"
+#include "json_helper.h"
+#include "json_scan.h"
+#include "job.h"
+#include "markup.h"
+#include "mem.h"
+#include "timing.h"
+#include "log.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+// Fill out from the array element at tokens[index]; false skips the element
+typedef bool (*ExtractFn)(const char* json, jsmntok_t* tokens, int count, int index, void* out);
+
+// One range of array elements, tokenized and extracted on its own
+typedef struct {
+    const char* json;
+    size_t len;
+    ExtractFn extract;
+    char* out;
+    size_t stride;
+    int max;
+    int found;
+    bool ok;
+} ParsePart;
+
+// Users a message mentions, for resolving <@id> in its content
+#define MESSAGE_MAX_MENTIONS 8
+
+typedef struct {
+    uint64_t ids[MESSAGE_MAX_MENTIONS];
+    char names[MESSAGE_MAX_MENTIONS][64];
+    int count;
+} MentionNames;
+
+static const char* resolve_mention(uint64_t id, void* ctx) {
+    MentionNames* mentions = (MentionNames*)ctx;
+    for (int i = 0; i < mentions->count; i++) {
+        if (mentions->ids[i] == id) {
+            return mentions->names[i];
+        }
+    }
+    return NULL;
+}
+
+static void extract_mentions(const char* json, jsmntok_t* tokens, int r, jsmntok_t* array, MentionNames* out) {
+    out->count = 0;
+    if (!array || array->type != JSMN_ARRAY) {
+        return;
+    }
+    int idx = array - tokens + 1;
+    for (int i = 0; i < array->size && idx < r && out->count < MESSAGE_MAX_MENTIONS; i++) {
+        jsmntok_t* id_token = json_object_get(json, tokens, r, idx, "id");
+        jsmntok_t* username_token = json_object_get(json, tokens, r, idx, "username");
+        if (id_token && username_token) {
+            char id[32];
+            json_get_string(json, id_token, id, sizeof(id));
+            out->ids[out->count] = strtoull(id, NULL, 10);
+            json_get_text(json, username_token, out->names[out->count], sizeof(out->names[0]));
+            out->count++;
+        }
+        idx = json_skip(tokens, r, idx);
+    }
+}
+
+// First element of a message's attachments array, and the array's length
+static void extract_attachments(const char* json, jsmntok_t* tokens, int r, jsmntok_t* array, DiscordMessage* msg) {
+    if (!array || array->type != JSMN_ARRAY || array->size == 0) {
+        return;
+    }
+    msg->attachment_count = array->size;
+    
+    int idx = array - tokens + 1;
+    DiscordAttachment* attachment = &msg->attachment;
+    jsmntok_t* id_token = json_object_get(json, tokens, r, idx, "id");
+    jsmntok_t* filename_token = json_object_get(json, tokens, r, idx, "filename");
+    jsmntok_t* size_token = json_object_get(json, tokens, r, idx, "size");
+    jsmntok_t* url_token = json_object_get(json, tokens, r, idx, "url");
+    if (id_token) {
+        json_get_string(json, id_token, attachment->id, sizeof(attachment->id));
+    }
+    if (filename_token) {
+        json_get_text(json, filename_token, attachment->filename, sizeof(attachment->filename));
+    }
+    if (size_token) {
+        int size = json_get_int(json, size_token, 0);
+        attachment->size = size > 0 ? (uint32_t)size : 0;
+    }
+    // A cut-off signed link is useless, so leave it empty instead
+    if (url_token && (size_t)(url_token->end - url_token->start) < sizeof(attachment->url)) {
+        json_get_string(json, url_token, attachment->url, sizeof(attachment->url));
+    }
+}
+
+static bool extract_message(const char* json, jsmntok_t* tokens, int r, int index, void* out) {
+    DiscordMessage* msg = (DiscordMessage*)out;
+    if (tokens[index].type != JSMN_OBJECT) {
+        return false;
+    }
+    memset(msg, 0, sizeof(DiscordMessage));
+    
+    // Extract message fields (direct members only, so nested ids in
+    // mentions or referenced_message are not picked up)
+    jsmntok_t* id_token = json_object_get(json, tokens, r, index, "id");
+    jsmntok_t* content_token = json_object_get(json, tokens, r, index, "content");
+    jsmntok_t* timestamp_token = json_object_get(json, tokens, r, index, "timestamp");
+    
+    // Get author object and extract username
+    jsmntok_t* author_token = json_object_get(json, tokens, r, index, "author");
+    
+    if (id_token) {
+        json_get_string(json, id_token, msg->id, sizeof(msg->id));
+    }
+    
+    if (content_token) {
+        // Markup is parsed once here; the renderer only walks the spans
+        char raw[MAX_TEXT_LENGTH];
+        MentionNames mentions;
+        json_get_text(json, content_token, raw, sizeof(raw));
+        extract_mentions(json, tokens, r, json_object_get(json, tokens, r, index, "mentions"), &mentions);
+        markup_parse(raw, msg->content, sizeof(msg->content), &msg->markup, resolve_mention, &mentions);
+    }
+    
+    if (timestamp_token) {
+        char full_timestamp[64];
+        json_get_string(json, timestamp_token, full_timestamp, sizeof(full_timestamp));
+        // Extract just time portion (HH:MM) from ISO 8601 timestamp
+        if (strlen(full_timestamp) >= 16) {
+            snprintf(msg->timestamp, sizeof(msg->timestamp), "%c%c:%c%c", 
+                     full_timestamp[11], full_timestamp[12], 
+                     full_timestamp[14], full_timestamp[15]);
+        }
+    }
+    
+    if (author_token) {
+        // Find username within author object
+        int author_idx = author_token - tokens;
+        jsmntok_t* username_token = json_object_get(json, tokens, r, author_idx, "username");
+        if (username_token) {
+            json_get_text(json, username_token, msg->author, sizeof(msg->author));
+        }
+    }
+    
+    extract_attachments(json, tokens, r, json_object_get(json, tokens, r, index, "attachments"), msg);
+    return true;
+}
+
+static bool extract_server(const char* json, jsmntok_t* tokens, int r, int index, void* out) {
+    DiscordServer* server = (DiscordServer*)out;
+    
+    jsmntok_t* id_token = json_object_get(json, tokens, r, index, "id");
+    jsmntok_t* name_token = json_object_get(json, tokens, r, index, "name");
+    
+    if (!id_token || !name_token) {
+        return false;
+    }
+    json_get_string(json, id_token, server->id, sizeof(server->id));
+    json_get_text(json, name_token, server->name, sizeof(server->name));
+    
+    // Icon hash, null when the server has none
+    server->icon[0] = '\0';
+    json_get_string(json, json_object_get(json, tokens, r, index, "icon"), server->icon, sizeof(server->icon));
+    return true;
+}
+
+static bool extract_user(const char* json, jsmntok_t* tokens, int r, int index, void* out) {
+    DiscordUser* user = (DiscordUser*)out;
+    
+    // Get user object within member
+    jsmntok_t* user_token = json_object_get(json, tokens, r, index, "user");
+    if (!user_token) {
+        return false;
+    }
+    int user_idx = user_token - tokens;
+    
+    jsmntok_t* id_token = json_object_get(json, tokens, r, user_idx, "id");
+    jsmntok_t* username_token = json_object_get(json, tokens, r, user_idx, "username");
+    jsmntok_t* discriminator_token = json_object_get(json, tokens, r, user_idx, "discriminator");
+    
+    if (!id_token || !username_token) {
+        return false;
+    }
+    json_get_string(json, id_token, user->id, sizeof(user->id));
+    json_get_text(json, username_token, user->username, sizeof(user->username));
+    
+    if (discriminator_token) {
+        json_get_string(json, discriminator_token, user->discriminator, sizeof(user->discriminator));
+    } else {
+        strcpy(user->discriminator, "0");
+    }
+    
+    user->avatar[0] = '\0';
+    json_get_string(json, json_object_get(json, tokens, r, user_idx, "avatar"), user->avatar, sizeof(user->avatar));
+    
+    // For now, assume all users are online (presence requires WebSocket)
+    user->online = true;
+    return true;
+}
+
+static bool extract_text_channel(const char* json, jsmntok_t* tokens, int r, int index, void* out) {
+    DiscordChannel* channel = (DiscordChannel*)out;
+    
+    // Type 0 is a text channel, 5 an announcement channel
+    jsmntok_t* type_token = json_object_get(json, tokens, r, index, "type");
+    int type = json_get_int(json, type_token, -1);
+    if (type != 0 && type != 5) {
+        return false;
+    }
+    jsmntok_t* ch_id_token = json_object_get(json, tokens, r, index, "id");
+    jsmntok_t* name_token = json_object_get(json, tokens, r, index, "name");
+    if (!ch_id_token) {
+        return false;
+    }
+    json_get_string(json, ch_id_token, channel->id, sizeof(channel->id));
+    if (name_token) {
+        json_get_text(json, name_token, channel->name, sizeof(channel->name));
+    } else {
+        channel->name[0] = '\0';
+    }
+    return true;
+}
+
+static bool extract_id(const char* json, jsmntok_t* tokens, int r, int index, void* out) {
+    jsmntok_t* id_token = json_object_get(json, tokens, r, index, "id");
+    if (!id_token) {
+        return false;
+    }
+    *(uint64_t*)out = strtoull(json + id_token->start, NULL, 10);
+    return true;
+}
+
+static void parse_part(void* arg) {
+    ParsePart* part = (ParsePart*)arg;
+    jsmntok_t* tokens = NULL;
+    int r = json_scan_tokenize(part->json, part->len, &tokens);
+    
+    // The range is a comma-separated run of elements, so its top-level
+    // tokens are the elements themselves. An error means the split guessed
+    // wrong (see json_scan_split_array).
+    part->ok = r >= 0;
+    part->found = 0;
+    for (int i = 0; i < r && part->found < part->max; i = json_skip(tokens, r, i)) {
+        if (part->extract(part->json, tokens, r, i, part->out + part->found * part->stride)) {
+            part->found++;
+        }
+    }
+    mem_free(tokens);
+}
+
+// Split a large array across the job system. Returns the element count, or
+// -1 to fall back to a single-threaded parse.
+static int parse_array_parallel(const char* json, size_t len, ExtractFn extract, void* out, size_t stride,
+                                int max, NetSample* sample) {
+    int parts = job_system_workers() + 1;
+    if (parts < 2 || len < DISCORD_PARSE_PARALLEL_MIN) {
+        return -1;
+    }
+    
+    u64 parse_start = timing_now();
+    size_t ranges[2 * (JOB_MAX_WORKERS + 1)];
+    int n = json_scan_split_array(json, len, parts, ranges);
+    if (n < 2) {
+        return -1;
+    }
+    
+    ParsePart part[JOB_MAX_WORKERS + 1];
+    JobCounter counter = {0};
+    bool ok = true;
+    for (int i = 0; i < n; i++) {
+        part[i] = (ParsePart){
+            .json = json + ranges[2 * i],
+            .len = ranges[2 * i + 1] - ranges[2 * i],
+            .extract = extract,
+            .out = mem_calloc(MEM_JSON, max, stride),
+            .stride = stride,
+            .max = max,
+        };
+        ok = ok && part[i].out;
+    }
+    if (ok) {
+        for (int i = 0; i < n; i++) {
+            job_submit(&counter, parse_part, &part[i]);
+        }
+        job_wait(&counter);
+    }
+    
+    // Keep the first max elements, in array order. out is the client's own
+    // list, so nothing is copied unless every part parsed.
+    u64 extract_start = timing_now();
+    for (int i = 0; i < n; i++) {
+        ok = ok && part[i].ok;
+    }
+    int count = 0;
+    for (int i = 0; i < n; i++) {
+        for (int k = 0; ok && k < part[i].found && count < max; k++) {
+            memcpy((char*)out + count * stride, part[i].out + k * stride, stride);
+            count++;
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        mem_free(part[i].out);
+    }
+    
+    sample->parse_ms = timing_ticks_to_ms(extract_start - parse_start);
+    sample->extract_ms = timing_ticks_to_ms(timing_now() - extract_start);
+    return ok ? count : -1;
+}
+
+// Extract up to max elements of the top-level array in json into out (stride
+// bytes each). Returns the count, or -1 if json is not an array.
+static int parse_array(const char* json, ExtractFn extract, void* out, size_t stride, int max,
+                       NetSample* sample) {
+    size_t len = strlen(json);
+    int count = parse_array_parallel(json, len, extract, out, stride, max, sample);
+    if (count >= 0) {
+        return count;
+    }
+    
+    jsmntok_t* tokens = NULL;
+    u64 parse_start = timing_now();
+    int r = json_parse_alloc(json, &tokens);
+    u64 extract_start = timing_now();
+    sample->parse_ms = timing_ticks_to_ms(extract_start - parse_start);
+    
+    if (r < 1 || tokens[0].type != JSMN_ARRAY) {
+        mem_free(tokens);
+        return -1;
+    }
+    
+    count = 0;
+    int tok_idx = 1; // Start after array token
+    for (int i = 0; i < tokens[0].size && tok_idx < r && count < max; i++) {
+        if (extract(json, tokens, r, tok_idx, (char*)out + count * stride)) {
+            count++;
+        }
+        // Skip to next object in array
+        tok_idx = json_skip(tokens, r, tok_idx);
+    }
+    
+    mem_free(tokens);
+    sample->extract_ms = timing_ticks_to_ms(timing_now() - extract_start);
+    return count;
+}
+
+bool discord_parse_messages(DiscordClient* client, const char* json, NetSample* sample) {
+    int count = parse_array(json, extract_message, client->messages, sizeof(DiscordMessage),
+                            MAX_MESSAGES, sample);
+    if (count < 0) {
+        log_write(LOG_ERROR, "Failed to parse messages JSON");
+        return false;
+    }
+    client->message_count = count;
+    
+    // Reverse messages so oldest is first
+    for (int i = 0; i < client->message_count / 2; i++) {
+        DiscordMessage temp = client->messages[i];
+        client->messages[i] = client->messages[client->message_count - 1 - i];
+        client->messages[client->message_count - 1 - i] = temp;
+    }
+    return true;
+}
+
+bool discord_parse_servers(DiscordClient* client, const char* json, NetSample* sample) {
+    int count = parse_array(json, extract_server, client->servers, sizeof(DiscordServer),
+                            MAX_SERVERS, sample);
+    if (count < 0) {
+        log_write(LOG_ERROR, "Failed to parse servers JSON");
+        return false;
+    }
+    client->server_count = count;
+    return true;
+}
+
+bool discord_parse_users(DiscordClient* client, const char* json, NetSample* sample) {
+    int count = parse_array(json, extract_user, client->users, sizeof(DiscordUser), MAX_USERS, sample);
+    if (count < 0) {
+        log_write(LOG_ERROR, "Failed to parse users JSON");
+        return false;
+    }
+    client->user_count = count;
+    return true;
+}
+
+bool discord_parse_channels(DiscordClient* client, const char* json, NetSample* sample) {
+    // Parse aside, so a bad response can't clobber the channels being shown
+    DiscordChannel* channels = mem_alloc(MEM_JSON, MAX_CHANNELS * sizeof(DiscordChannel));
+    if (!channels) {
+        return false;
+    }
+    int count = parse_array(json, extract_text_channel, channels, sizeof(DiscordChannel), MAX_CHANNELS, sample);
+    if (count < 0) {
+        log_write(LOG_ERROR, "Failed to parse channels JSON");
+        mem_free(channels);
+        return false;
+    }
+    memcpy(client->channels, channels, count * sizeof(DiscordChannel));
+    client->channel_count = count;
+    mem_free(channels);
+    return true;
+}
+
+bool discord_parse_probe(const char* json, uint64_t after_id, DiscordProbe* probe, NetSample* sample) {
+    uint64_t ids[MAX_MESSAGES];
+    int count = parse_array(json, extract_id, ids, sizeof(uint64_t), MAX_MESSAGES, sample);
+    if (count < 0) {
+        log_write(LOG_ERROR, "Failed to parse probe JSON");
+        return false;
+    }
+    
+    // Snowflakes grow with time, so the largest id is the newest message
+    probe->newest_id = 0;
+    probe->count = 0;
+    for (int i = 0; i < count; i++) {
+        if (ids[i] > after_id) {
+            probe->count++;
+        }
+        if (ids[i] > probe->newest_id) {
+            probe->newest_id = ids[i];
+        }
+    }
+    return true;
+}
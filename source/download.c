@@ -0,0 +1,596 @@
+#include "download.h"
+#include "transport.h"
+#include "cancel.h"
+#include "mem.h"
+#include "timing.h"
+#include "log.h"
+#include "wake.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <3ds.h>
+
+// Index format, one finished attachment per line, appended as they finish:
+//
+//   ATTACHMENT_ID STORED_NAME SIZE
+//
+// STORED_NAME is the FNV-1a hash of the content plus the original extension,
+// so two attachments with the same bytes share one file.
+
+#define DOWNLOAD_STACK_SIZE (32 * 1024)
+#define DOWNLOAD_RETRY_MS 2000
+
+// Longest single sleep of the bandwidth throttle, so cancellation stays quick
+#define THROTTLE_STEP_MS 100
+
+typedef struct {
+    DiscordAttachment attachment;
+    DownloadState state;        // DOWNLOAD_NONE marks a free slot
+    int attempts;
+    uint64_t next_attempt_at;
+    uint64_t done;
+    uint64_t total;
+    CancelToken* cancel;        // While active, so cleanup can abort it
+} DownloadJob;
+
+typedef struct {
+    char id[32];
+    char name[32];
+    uint32_t size;
+} StoredFile;
+
+// One worker's transfer, shared with the transport callbacks
+typedef struct {
+    DownloadJob* job;
+    char part_path[160];
+    FILE* file;
+    char* buffer;               // DOWNLOAD_CHUNK_SIZE bytes
+    size_t used;
+    uint64_t offset;            // Bytes of the .part file before this attempt
+    bool complete;              // The server says there is nothing left to send
+    bool restart;               // The .part file is unusable, start over
+} Transfer;
+
+static DownloadJob jobs[DOWNLOAD_QUEUE];
+static StoredFile stored[DOWNLOAD_MAX_STORED];
+static int stored_count = 0;
+
+static Transport* download_transport = NULL;
+static char download_dir[96];
+static LightLock download_lock;
+static LightLock index_lock;            // Appends to index.txt, kept off download_lock
+static LightEvent worker_wake[DOWNLOAD_MAX_ACTIVE];
+static Thread workers[DOWNLOAD_MAX_ACTIVE];
+static char* buffers[DOWNLOAD_MAX_ACTIVE];
+static volatile bool running = false;
+
+// Shared token bucket for DOWNLOAD_MAX_BYTES_PER_SEC; goes negative while
+// the workers are ahead of the cap
+static LightLock throttle_lock;
+static double allowance = 0;
+static uint64_t refilled_at = 0;
+
+static DownloadStats stats;
+
+static uint64_t ms_to_ticks(uint32_t ms) {
+    return (uint64_t)ms * TIMING_TICKS_PER_SEC / 1000;
+}
+
+// Called with download_lock held
+static StoredFile* find_stored(const char* id) {
+    for (int i = 0; i < stored_count; i++) {
+        if (strcmp(stored[i].id, id) == 0) {
+            return &stored[i];
+        }
+    }
+    return NULL;
+}
+
+// Called with download_lock held
+static DownloadJob* find_job(const char* id) {
+    for (int i = 0; i < DOWNLOAD_QUEUE; i++) {
+        if (jobs[i].state != DOWNLOAD_NONE && strcmp(jobs[i].attachment.id, id) == 0) {
+            return &jobs[i];
+        }
+    }
+    return NULL;
+}
+
+// Remember a finished attachment, forgetting the oldest when full; called
+// with download_lock held
+static void add_stored(const char* id, const char* name, uint32_t size) {
+    if (stored_count == DOWNLOAD_MAX_STORED) {
+        memmove(&stored[0], &stored[1], (DOWNLOAD_MAX_STORED - 1) * sizeof(StoredFile));
+        stored_count--;
+    }
+    StoredFile* file = &stored[stored_count++];
+    snprintf(file->id, sizeof(file->id), "%s", id);
+    snprintf(file->name, sizeof(file->name), "%s", name);
+    file->size = size;
+}
+
+static void load_index(void) {
+    char path[sizeof(download_dir) + 16];
+    snprintf(path, sizeof(path), "%s/index.txt", download_dir);
+
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return;
+    }
+    char id[32];
+    char name[32];
+    unsigned long size;
+    while (fscanf(f, "%31s %31s %lu", id, name, &size) == 3) {
+        add_stored(id, name, (uint32_t)size);
+    }
+    fclose(f);
+}
+
+// Card I/O, so called without download_lock: the renderer takes it
+static void append_index(const StoredFile* file) {
+    char path[sizeof(download_dir) + 16];
+    snprintf(path, sizeof(path), "%s/index.txt", download_dir);
+
+    LightLock_Lock(&index_lock);
+    FILE* f = fopen(path, "a");
+    if (f) {
+        fprintf(f, "%s %s %lu\n", file->id, file->name, (unsigned long)file->size);
+        fclose(f);
+    }
+    LightLock_Unlock(&index_lock);
+    if (!f) {
+        log_write(LOG_ERROR, "Failed to open %s", path);
+    }
+}
+
+// Hold the caller back while all downloads together are over the cap
+static void throttle(size_t bytes, CancelToken* cancel) {
+    if (DOWNLOAD_MAX_BYTES_PER_SEC <= 0) {
+        return;
+    }
+
+    LightLock_Lock(&throttle_lock);
+    uint64_t now = timing_now();
+    allowance += timing_ticks_to_ms(now - refilled_at) * DOWNLOAD_MAX_BYTES_PER_SEC / 1000.0;
+    refilled_at = now;
+    // At most one second of burst after an idle spell
+    if (allowance > DOWNLOAD_MAX_BYTES_PER_SEC) {
+        allowance = DOWNLOAD_MAX_BYTES_PER_SEC;
+    }
+    allowance -= (double)bytes;
+    double owed_ms = allowance < 0 ? -allowance * 1000.0 / DOWNLOAD_MAX_BYTES_PER_SEC : 0;
+    LightLock_Unlock(&throttle_lock);
+
+    // The debt stays in the bucket, so sleeping it off in steps is exact
+    while (owed_ms > 0 && !cancel_token_check(cancel)) {
+        uint32_t step = owed_ms > THROTTLE_STEP_MS ? THROTTLE_STEP_MS : (uint32_t)owed_ms + 1;
+        timing_sleep_ms(step);
+        owed_ms -= step;
+    }
+}
+
+// Write out the chunk buffer and publish the progress
+static bool flush_chunk(Transfer* transfer) {
+    if (transfer->used == 0) {
+        return true;
+    }
+    if (fwrite(transfer->buffer, 1, transfer->used, transfer->file) != transfer->used) {
+        log_write(LOG_ERROR, "Failed to write %s", transfer->part_path);
+        return false;
+    }
+
+    LightLock_Lock(&download_lock);
+    transfer->job->done += transfer->used;
+    LightLock_Unlock(&download_lock);
+    transfer->used = 0;
+
+    // The progress line under the message changed
+    wake_request();
+    return true;
+}
+
+static bool on_begin(long status, int64_t length, void* ctx) {
+    Transfer* transfer = (Transfer*)ctx;
+    uint64_t expected = transfer->job->attachment.size;
+
+    if (status == 206) {
+        // Picking up where the .part file ends
+    } else if (status == 200) {
+        if (transfer->offset > 0) {
+            // The server ignored the Range header and sends everything
+            transfer->file = freopen(transfer->part_path, "wb", transfer->file);
+            if (!transfer->file) {
+                log_write(LOG_ERROR, "Failed to reopen %s", transfer->part_path);
+                return false;
+            }
+            transfer->offset = 0;
+        }
+    } else if (status == 416 && expected > 0 && transfer->offset == expected) {
+        // Only the rename was missing last time
+        transfer->complete = true;
+        return true;
+    } else {
+        if (status == 416) {
+            transfer->restart = true;
+        }
+        log_write(LOG_WARN, "Download of %s: HTTP %ld", transfer->job->attachment.filename, status);
+        return false;
+    }
+
+    LightLock_Lock(&download_lock);
+    transfer->job->done = transfer->offset;
+    transfer->job->total = length >= 0 ? transfer->offset + (uint64_t)length : expected;
+    LightLock_Unlock(&download_lock);
+    return true;
+}
+
+static bool on_write(const void* data, size_t size, void* ctx) {
+    Transfer* transfer = (Transfer*)ctx;
+    const char* bytes = (const char*)data;
+
+    // The body of a 416 is an error page, not part of the file
+    if (transfer->complete) {
+        return true;
+    }
+    throttle(size, transfer->job->cancel);
+
+    while (size > 0) {
+        size_t room = DOWNLOAD_CHUNK_SIZE - transfer->used;
+        size_t take = size < room ? size : room;
+        memcpy(transfer->buffer + transfer->used, bytes, take);
+        transfer->used += take;
+        bytes += take;
+        size -= take;
+        if (transfer->used == DOWNLOAD_CHUNK_SIZE && !flush_chunk(transfer)) {
+            return false;
+        }
+    }
+    __atomic_add_fetch(&stats.bytes, (uint64_t)(bytes - (const char*)data), __ATOMIC_RELAXED);
+    return true;
+}
+
+// 64-bit FNV-1a of a file, read back through the chunk buffer
+static bool hash_file(const char* path, char* buffer, uint64_t* hash, uint64_t* size) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+    uint64_t h = 14695981039346656037ULL;
+    uint64_t total = 0;
+    size_t n;
+    while ((n = fread(buffer, 1, DOWNLOAD_CHUNK_SIZE, f)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            h ^= (unsigned char)buffer[i];
+            h *= 1099511628211ULL;
+        }
+        total += n;
+    }
+    fclose(f);
+    *hash = h;
+    *size = total;
+    return true;
+}
+
+// Extension of the original filename, or "bin"
+static const char* file_extension(const char* filename) {
+    const char* dot = strrchr(filename, '.');
+    if (!dot || dot[1] == '\0' || strlen(dot + 1) > 8 || strchr(dot + 1, ' ')) {
+        return "bin";
+    }
+    return dot + 1;
+}
+
+// Move a complete .part file into the store; false if it turned out wrong
+static bool finish(Transfer* transfer) {
+    const DiscordAttachment* attachment = &transfer->job->attachment;
+    uint64_t hash = 0;
+    uint64_t size = 0;
+    if (!hash_file(transfer->part_path, transfer->buffer, &hash, &size)) {
+        log_write(LOG_ERROR, "Failed to read back %s", transfer->part_path);
+        return false;
+    }
+    if (attachment->size > 0 && size != attachment->size) {
+        log_write(LOG_WARN, "Download of %s: %llu of %lu bytes", attachment->filename,
+                  (unsigned long long)size, (unsigned long)attachment->size);
+        transfer->restart = size > attachment->size;
+        return false;
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.%s", (unsigned long long)hash, file_extension(attachment->filename));
+    char path[sizeof(download_dir) + sizeof(name) + 1];
+    snprintf(path, sizeof(path), "%s/%s", download_dir, name);
+
+    // The lock only covers the table; download_status takes it from the
+    // render path, so the card is never touched while holding it
+    LightLock_Lock(&download_lock);
+    bool duplicate = false;
+    for (int i = 0; i < stored_count; i++) {
+        if (strcmp(stored[i].name, name) == 0) {
+            duplicate = true;
+            break;
+        }
+    }
+    LightLock_Unlock(&download_lock);
+
+    if (duplicate) {
+        remove(transfer->part_path);
+    } else {
+        // A file the index lost track of has the same content by its name
+        remove(path);
+        if (rename(transfer->part_path, path) != 0) {
+            log_write(LOG_ERROR, "Failed to store %s", path);
+            return false;
+        }
+    }
+    StoredFile file;
+    snprintf(file.id, sizeof(file.id), "%s", attachment->id);
+    snprintf(file.name, sizeof(file.name), "%s", name);
+    file.size = (uint32_t)size;
+    append_index(&file);
+
+    LightLock_Lock(&download_lock);
+    add_stored(file.id, file.name, file.size);
+    if (duplicate) {
+        stats.deduplicated++;
+    }
+    stats.completed++;
+    transfer->job->state = DOWNLOAD_NONE;
+    transfer->job->cancel = NULL;
+    LightLock_Unlock(&download_lock);
+
+    log_write(LOG_INFO, "Downloaded %s", attachment->filename);
+    return true;
+}
+
+// One attempt at a job: resume its .part file and finish it if possible
+static bool run_transfer(Transfer* transfer) {
+    DownloadJob* job = transfer->job;
+    snprintf(transfer->part_path, sizeof(transfer->part_path), "%s/%s.part", download_dir, job->attachment.id);
+
+    struct stat st;
+    transfer->offset = stat(transfer->part_path, &st) == 0 ? (uint64_t)st.st_size : 0;
+    transfer->used = 0;
+    transfer->complete = false;
+    transfer->restart = false;
+    if (transfer->offset > 0) {
+        LightLock_Lock(&download_lock);
+        stats.resumed++;
+        LightLock_Unlock(&download_lock);
+    }
+
+    transfer->file = fopen(transfer->part_path, "ab");
+    if (!transfer->file) {
+        log_write(LOG_ERROR, "Failed to open %s", transfer->part_path);
+        return false;
+    }
+
+    TransportDownload request = {0};
+    request.url = job->attachment.url;
+    request.offset = transfer->offset;
+    request.cancel = job->cancel;
+    request.begin = on_begin;
+    request.write = on_write;
+    request.ctx = transfer;
+
+    NetSample sample;
+    net_stats_begin(&sample, "GET", "attachment");
+    bool ok = transport_download(download_transport, &request, &sample);
+    ok = flush_chunk(transfer) && ok;
+    sample.ok = ok;
+    sample.aborted = job->cancel->cancelled;
+    net_stats_record(&sample);
+
+    if (transfer->file) {
+        fclose(transfer->file);
+        transfer->file = NULL;
+    }
+    if (!ok && transfer->restart) {
+        remove(transfer->part_path);
+    }
+    return ok && finish(transfer);
+}
+
+static void download_worker(void* arg) {
+    int index = (int)(intptr_t)arg;
+    Transfer transfer = {0};
+    transfer.buffer = buffers[index];
+
+    while (running) {
+        DownloadJob* job = NULL;
+        int64_t wait_ns = -1;
+
+        LightLock_Lock(&download_lock);
+        uint64_t now = timing_now();
+        for (int i = 0; i < DOWNLOAD_QUEUE; i++) {
+            if (jobs[i].state != DOWNLOAD_QUEUED) {
+                continue;
+            }
+            if (jobs[i].next_attempt_at <= now) {
+                job = &jobs[i];
+                break;
+            }
+            int64_t until = (int64_t)(timing_ticks_to_us(jobs[i].next_attempt_at - now) * 1000.0);
+            if (wait_ns < 0 || until < wait_ns) {
+                wait_ns = until;
+            }
+        }
+        CancelToken cancel;
+        if (job) {
+            cancel_token_init(&cancel, 0);
+            job->state = DOWNLOAD_ACTIVE;
+            job->cancel = &cancel;
+        }
+        LightLock_Unlock(&download_lock);
+
+        if (!job) {
+            if (wait_ns < 0) {
+                LightEvent_Wait(&worker_wake[index]);
+            } else {
+                LightEvent_WaitTimeout(&worker_wake[index], wait_ns);
+            }
+            continue;
+        }
+
+        wake_request();
+        transfer.job = job;
+        if (run_transfer(&transfer)) {
+            wake_request();
+            continue;
+        }
+
+        LightLock_Lock(&download_lock);
+        job->cancel = NULL;
+        if (cancel.cancelled && !running) {
+            // Shutting down; the .part file resumes next session
+            job->state = DOWNLOAD_QUEUED;
+        } else if (++job->attempts >= DOWNLOAD_MAX_ATTEMPTS) {
+            job->state = DOWNLOAD_FAILED;
+            stats.failed++;
+            log_write(LOG_WARN, "Giving up on %s", job->attachment.filename);
+        } else {
+            stats.retries++;
+            job->state = DOWNLOAD_QUEUED;
+            job->next_attempt_at = timing_now() + ms_to_ticks(DOWNLOAD_RETRY_MS * job->attempts);
+        }
+        LightLock_Unlock(&download_lock);
+        wake_request();
+    }
+}
+
+bool download_init(Transport* transport, const char* dir) {
+    LightLock_Init(&download_lock);
+    LightLock_Init(&index_lock);
+    LightLock_Init(&throttle_lock);
+    memset(jobs, 0, sizeof(jobs));
+    memset(&stats, 0, sizeof(stats));
+    stored_count = 0;
+    allowance = DOWNLOAD_MAX_BYTES_PER_SEC;
+    refilled_at = timing_now();
+
+    download_transport = transport;
+    snprintf(download_dir, sizeof(download_dir), "%s", dir);
+    mkdir(download_dir, 0777);
+    load_index();
+
+    // Run below the UI thread so downloads never steal frames
+    s32 priority = 0x30;
+    svcGetThreadPriority(&priority, CUR_THREAD_HANDLE);
+
+    running = true;
+    for (int i = 0; i < DOWNLOAD_MAX_ACTIVE; i++) {
+        LightEvent_Init(&worker_wake[i], RESET_ONESHOT);
+        buffers[i] = mem_alloc(MEM_NET, DOWNLOAD_CHUNK_SIZE);
+        workers[i] = buffers[i] ? threadCreate(download_worker, (void*)(intptr_t)i, DOWNLOAD_STACK_SIZE,
+                                               priority + 1, -2, false) : NULL;
+        if (!workers[i]) {
+            log_write(LOG_ERROR, "Failed to start download worker");
+            download_cleanup();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool download_queue(const DiscordAttachment* attachment) {
+    if (!attachment || attachment->id[0] == '\0' || attachment->url[0] == '\0' || !running) {
+        return false;
+    }
+
+    LightLock_Lock(&download_lock);
+    if (find_stored(attachment->id)) {
+        stats.cached++;
+        LightLock_Unlock(&download_lock);
+        return true;
+    }
+
+    DownloadJob* job = find_job(attachment->id);
+    if (job) {
+        if (job->state == DOWNLOAD_FAILED) {
+            job->state = DOWNLOAD_QUEUED;
+            job->attempts = 0;
+            job->next_attempt_at = timing_now();
+        }
+    } else {
+        for (int i = 0; i < DOWNLOAD_QUEUE && !job; i++) {
+            if (jobs[i].state == DOWNLOAD_NONE) {
+                job = &jobs[i];
+            }
+        }
+        if (!job) {
+            LightLock_Unlock(&download_lock);
+            return false;
+        }
+        memset(job, 0, sizeof(DownloadJob));
+        job->attachment = *attachment;
+        job->state = DOWNLOAD_QUEUED;
+        job->next_attempt_at = timing_now();
+        job->total = attachment->size;
+        stats.queued++;
+    }
+    LightLock_Unlock(&download_lock);
+    wake_request();
+
+    for (int i = 0; i < DOWNLOAD_MAX_ACTIVE; i++) {
+        LightEvent_Signal(&worker_wake[i]);
+    }
+    return true;
+}
+
+DownloadState download_status(const char* attachment_id, DownloadStatus* status) {
+    DownloadStatus result = {0};
+
+    LightLock_Lock(&download_lock);
+    DownloadJob* job = find_job(attachment_id);
+    StoredFile* file = job ? NULL : find_stored(attachment_id);
+    if (job) {
+        result.state = job->state;
+        result.done = job->done;
+        result.total = job->total;
+    } else if (file) {
+        result.state = DOWNLOAD_DONE;
+        result.done = file->size;
+        result.total = file->size;
+        snprintf(result.path, sizeof(result.path), "%s/%s", download_dir, file->name);
+    }
+    LightLock_Unlock(&download_lock);
+
+    if (status) {
+        *status = result;
+    }
+    return result.state;
+}
+
+DownloadStats download_get_stats(void) {
+    LightLock_Lock(&download_lock);
+    DownloadStats snapshot = stats;
+    LightLock_Unlock(&download_lock);
+    snapshot.bytes = __atomic_load_n(&stats.bytes, __ATOMIC_RELAXED);
+    return snapshot;
+}
+
+void download_cleanup(void) {
+    LightLock_Lock(&download_lock);
+    running = false;
+    for (int i = 0; i < DOWNLOAD_QUEUE; i++) {
+        if (jobs[i].cancel) {
+            cancel_token_cancel(jobs[i].cancel);
+        }
+    }
+    LightLock_Unlock(&download_lock);
+
+    for (int i = 0; i < DOWNLOAD_MAX_ACTIVE; i++) {
+        if (workers[i]) {
+            LightEvent_Signal(&worker_wake[i]);
+            threadJoin(workers[i], U64_MAX);
+            threadFree(workers[i]);
+            workers[i] = NULL;
+        }
+        if (buffers[i]) {
+            mem_free(buffers[i]);
+            buffers[i] = NULL;
+        }
+    }
+    download_transport = NULL;
+}
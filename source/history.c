@@ -0,0 +1,380 @@
+#include "history.h"
+#include "history_dict.h"
+#include "mem.h"
+#include "timing.h"
+#include "profiler.h"
+#include "log.h"
+#include <stdio.h>
+#include <string.h>
+#include <zlib.h>
+#include <3ds.h>
+
+// A window is serialized column by column (all ids, then all authors, ...),
+// each string NUL-terminated, so similar text sits together for deflate.
+// Content markup follows as SPANS REFS spans... refs... per message, then
+// the attachment counts and sizes.
+//
+//   COUNT ids... authors... timestamps... contents...
+//   attachment ids... filenames... urls... markup... attachments...
+
+// 16 KB window: covers the dictionary plus most of a 50-message page
+#define HISTORY_WINDOW_BITS 14
+#define HISTORY_MEM_LEVEL 7
+
+typedef struct {
+    char channel_id[32];
+    unsigned char* data;        // Compressed window, MEM_CACHE
+    size_t size;
+    size_t raw_size;
+    int count;
+    uint32_t last_used;
+} HistoryEntry;
+
+static HistoryEntry entries[HISTORY_MAX_CHANNELS];
+static LightLock history_lock;
+static bool initialized = false;
+static uint32_t use_clock = 0;
+
+static HistoryStats stats;
+static double inflate_total_ms = 0;
+
+static voidpf zlib_alloc(voidpf opaque, uInt items, uInt size) {
+    (void)opaque;
+    return mem_alloc(MEM_MESSAGES, (size_t)items * size);
+}
+
+static void zlib_free(voidpf opaque, voidpf ptr) {
+    (void)opaque;
+    mem_free(ptr);
+}
+
+// Take an entry out of the store, leaving its data to the caller; called
+// with history_lock held
+static void unlink_entry(HistoryEntry* entry) {
+    stats.channels--;
+    stats.compressed_bytes -= entry->size;
+    stats.raw_bytes -= entry->raw_size;
+    stats.struct_bytes -= entry->count * sizeof(DiscordMessage);
+    memset(entry, 0, sizeof(HistoryEntry));
+}
+
+static void drop_entry(HistoryEntry* entry) {
+    mem_free(entry->data);
+    unlink_entry(entry);
+}
+
+// Least recently used window, or NULL if none is kept
+static HistoryEntry* oldest_entry(void) {
+    HistoryEntry* oldest = NULL;
+    for (int i = 0; i < HISTORY_MAX_CHANNELS; i++) {
+        if (entries[i].data && (!oldest || entries[i].last_used < oldest->last_used)) {
+            oldest = &entries[i];
+        }
+    }
+    return oldest;
+}
+
+static HistoryEntry* find_entry(const char* channel_id) {
+    for (int i = 0; i < HISTORY_MAX_CHANNELS; i++) {
+        if (entries[i].data && strcmp(entries[i].channel_id, channel_id) == 0) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+static size_t history_evict(size_t needed, void* ctx) {
+    (void)ctx;
+    size_t freed = 0;
+
+    if (LightLock_TryLock(&history_lock) != 0) {
+        return 0;
+    }
+    HistoryEntry* entry;
+    while (freed < needed && (entry = oldest_entry()) != NULL) {
+        freed += entry->size;
+        drop_entry(entry);
+        stats.evicted++;
+    }
+    LightLock_Unlock(&history_lock);
+    return freed;
+}
+
+static size_t serialize(const DiscordMessage* messages, int count, char* out) {
+    size_t pos = 0;
+    out[pos++] = (char)count;
+
+#define HISTORY_COLUMN(field)                               \
+    for (int i = 0; i < count; i++) {                       \
+        size_t len = strlen(messages[i].field) + 1;         \
+        memcpy(out + pos, messages[i].field, len);          \
+        pos += len;                                         \
+    }
+    HISTORY_COLUMN(id)
+    HISTORY_COLUMN(author)
+    HISTORY_COLUMN(timestamp)
+    HISTORY_COLUMN(content)
+    HISTORY_COLUMN(attachment.id)
+    HISTORY_COLUMN(attachment.filename)
+    HISTORY_COLUMN(attachment.url)
+#undef HISTORY_COLUMN
+
+    for (int i = 0; i < count; i++) {
+        const MarkupSpans* markup = &messages[i].markup;
+        out[pos++] = (char)markup->span_count;
+        out[pos++] = (char)markup->ref_count;
+        memcpy(out + pos, markup->spans, markup->span_count * sizeof(MarkupSpan));
+        pos += markup->span_count * sizeof(MarkupSpan);
+        memcpy(out + pos, markup->refs, markup->ref_count * sizeof(uint64_t));
+        pos += markup->ref_count * sizeof(uint64_t);
+    }
+
+    for (int i = 0; i < count; i++) {
+        int attachments = messages[i].attachment_count;
+        out[pos++] = (char)(attachments > 255 ? 255 : attachments);
+        memcpy(out + pos, &messages[i].attachment.size, sizeof(uint32_t));
+        pos += sizeof(uint32_t);
+    }
+    return pos;
+}
+
+static bool deserialize(const char* data, size_t size, DiscordMessage* messages, int* count) {
+    size_t pos = 1;
+    int n = (unsigned char)data[0];
+    if (n > MAX_MESSAGES) {
+        return false;
+    }
+    memset(messages, 0, n * sizeof(DiscordMessage));
+
+#define HISTORY_COLUMN(field)                                           \
+    for (int i = 0; i < n; i++) {                                       \
+        size_t len = strnlen(data + pos, size - pos);                   \
+        if (pos + len >= size || len >= sizeof(messages[i].field)) {    \
+            return false;                                               \
+        }                                                               \
+        memcpy(messages[i].field, data + pos, len + 1);                 \
+        pos += len + 1;                                                 \
+    }
+    HISTORY_COLUMN(id)
+    HISTORY_COLUMN(author)
+    HISTORY_COLUMN(timestamp)
+    HISTORY_COLUMN(content)
+    HISTORY_COLUMN(attachment.id)
+    HISTORY_COLUMN(attachment.filename)
+    HISTORY_COLUMN(attachment.url)
+#undef HISTORY_COLUMN
+
+    for (int i = 0; i < n; i++) {
+        MarkupSpans* markup = &messages[i].markup;
+        if (pos + 2 > size) {
+            return false;
+        }
+        markup->span_count = (unsigned char)data[pos++];
+        markup->ref_count = (unsigned char)data[pos++];
+        size_t spans_size = markup->span_count * sizeof(MarkupSpan);
+        size_t refs_size = markup->ref_count * sizeof(uint64_t);
+        if (markup->span_count > MARKUP_MAX_SPANS || markup->ref_count > MARKUP_MAX_REFS ||
+            pos + spans_size + refs_size > size) {
+            return false;
+        }
+        memcpy(markup->spans, data + pos, spans_size);
+        pos += spans_size;
+        memcpy(markup->refs, data + pos, refs_size);
+        pos += refs_size;
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (pos + 1 + sizeof(uint32_t) > size) {
+            return false;
+        }
+        messages[i].attachment_count = (unsigned char)data[pos++];
+        memcpy(&messages[i].attachment.size, data + pos, sizeof(uint32_t));
+        pos += sizeof(uint32_t);
+    }
+
+    *count = n;
+    return true;
+}
+
+void history_init(void) {
+    LightLock_Init(&history_lock);
+    memset(entries, 0, sizeof(entries));
+    memset(&stats, 0, sizeof(stats));
+    inflate_total_ms = 0;
+    use_clock = 0;
+
+    mem_register_evictor(MEM_CACHE, history_evict, NULL);
+    initialized = true;
+}
+
+bool history_store(const char* channel_id, const DiscordMessage* messages, int count) {
+    PROFILE_ZONE(__func__);
+
+    if (!initialized || !channel_id || channel_id[0] == '\0' || count <= 0 || count > MAX_MESSAGES) {
+        return false;
+    }
+
+    // Each field is at most its array size, NUL included
+    char* raw = mem_alloc(MEM_MESSAGES, 1 + count * sizeof(DiscordMessage));
+    if (!raw) {
+        return false;
+    }
+    size_t raw_size = serialize(messages, count, raw);
+
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    z.zalloc = zlib_alloc;
+    z.zfree = zlib_free;
+    if (deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, HISTORY_WINDOW_BITS,
+                     HISTORY_MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK) {
+        mem_free(raw);
+        return false;
+    }
+    deflateSetDictionary(&z, (const Bytef*)history_dictionary, HISTORY_DICTIONARY_SIZE);
+
+    size_t bound = deflateBound(&z, raw_size);
+    unsigned char* data = mem_alloc(MEM_CACHE, bound);
+    bool ok = false;
+    if (data) {
+        z.next_in = (Bytef*)raw;
+        z.avail_in = (uInt)raw_size;
+        z.next_out = data;
+        z.avail_out = (uInt)bound;
+        ok = deflate(&z, Z_FINISH) == Z_STREAM_END;
+    }
+    size_t size = z.total_out;
+    deflateEnd(&z);
+    mem_free(raw);
+
+    if (!ok) {
+        mem_free(data);
+        return false;
+    }
+    unsigned char* shrunk = mem_realloc(MEM_CACHE, data, size);
+    if (shrunk) {
+        data = shrunk;
+    }
+
+    LightLock_Lock(&history_lock);
+    HistoryEntry* entry = find_entry(channel_id);
+    if (entry) {
+        drop_entry(entry);
+    }
+    // Make room under the budget, then take a free slot (or the oldest)
+    HistoryEntry* oldest;
+    while (stats.compressed_bytes + size > HISTORY_BUDGET && (oldest = oldest_entry()) != NULL) {
+        drop_entry(oldest);
+        stats.evicted++;
+    }
+    entry = NULL;
+    for (int i = 0; i < HISTORY_MAX_CHANNELS && !entry; i++) {
+        if (!entries[i].data) {
+            entry = &entries[i];
+        }
+    }
+    if (!entry) {
+        entry = oldest_entry();
+        drop_entry(entry);
+        stats.evicted++;
+    }
+
+    strncpy(entry->channel_id, channel_id, sizeof(entry->channel_id) - 1);
+    entry->data = data;
+    entry->size = size;
+    entry->raw_size = raw_size;
+    entry->count = count;
+    entry->last_used = ++use_clock;
+
+    stats.channels++;
+    stats.compressed_bytes += size;
+    stats.raw_bytes += raw_size;
+    stats.struct_bytes += count * sizeof(DiscordMessage);
+    stats.stored++;
+    LightLock_Unlock(&history_lock);
+    return true;
+}
+
+bool history_load(const char* channel_id, DiscordMessage* messages, int* count) {
+    PROFILE_ZONE(__func__);
+
+    *count = 0;
+    if (!initialized || !channel_id) {
+        return false;
+    }
+
+    // Take the window out of the store; the client holds it from now on
+    LightLock_Lock(&history_lock);
+    HistoryEntry* entry = find_entry(channel_id);
+    if (!entry) {
+        LightLock_Unlock(&history_lock);
+        return false;
+    }
+    HistoryEntry taken = *entry;
+    unlink_entry(entry);
+    LightLock_Unlock(&history_lock);
+
+    u64 start = timing_now();
+    char* raw = mem_alloc(MEM_MESSAGES, taken.raw_size);
+    bool ok = false;
+    if (raw) {
+        z_stream z;
+        memset(&z, 0, sizeof(z));
+        z.zalloc = zlib_alloc;
+        z.zfree = zlib_free;
+        z.next_in = taken.data;
+        z.avail_in = (uInt)taken.size;
+        z.next_out = (Bytef*)raw;
+        z.avail_out = (uInt)taken.raw_size;
+        if (inflateInit2(&z, HISTORY_WINDOW_BITS) == Z_OK) {
+            int r = inflate(&z, Z_FINISH);
+            if (r == Z_NEED_DICT) {
+                inflateSetDictionary(&z, (const Bytef*)history_dictionary, HISTORY_DICTIONARY_SIZE);
+                r = inflate(&z, Z_FINISH);
+            }
+            ok = r == Z_STREAM_END && z.total_out == taken.raw_size &&
+                 deserialize(raw, taken.raw_size, messages, count);
+            inflateEnd(&z);
+        }
+        mem_free(raw);
+    }
+    mem_free(taken.data);
+    double ms = timing_ticks_to_ms(timing_now() - start);
+
+    LightLock_Lock(&history_lock);
+    if (ok) {
+        stats.restored++;
+        stats.last_inflate_ms = ms;
+        inflate_total_ms += ms;
+        stats.avg_inflate_ms = inflate_total_ms / stats.restored;
+    }
+    LightLock_Unlock(&history_lock);
+
+    if (!ok) {
+        log_write(LOG_ERROR, "Failed to restore history for %s", channel_id);
+        *count = 0;
+    }
+    return ok;
+}
+
+HistoryStats history_get_stats(void) {
+    LightLock_Lock(&history_lock);
+    HistoryStats result = stats;
+    LightLock_Unlock(&history_lock);
+    return result;
+}
+
+void history_cleanup(void) {
+    if (!initialized) {
+        return;
+    }
+    mem_unregister_evictor(history_evict, NULL);
+
+    LightLock_Lock(&history_lock);
+    for (int i = 0; i < HISTORY_MAX_CHANNELS; i++) {
+        if (entries[i].data) {
+            drop_entry(&entries[i]);
+        }
+    }
+    LightLock_Unlock(&history_lock);
+    initialized = false;
+}
@@ -0,0 +1,603 @@
+#include "image_cache.h"
+#include "png.h"
+#include "cancel.h"
+#include "mem.h"
+#include "net_stats.h"
+#include "timing.h"
+#include "log.h"
+#include "wake.h"
+#include <stdio.h>
+#include <string.h>
+#include <3ds.h>
+
+// Atlas file layout, native byte order (it never leaves the console):
+//
+//   AtlasHeader
+//   AtlasKey[IMAGE_CACHE_SLOTS]         which image each cell holds
+//   uint16_t[IMAGE_CACHE_SIZE^2] x IMAGE_CACHE_SLOTS   the cells
+//
+// Only the key table is read at start. A cell is written before its key,
+// and its old key is cleared before that, so an interrupted write loses the
+// image but never shows the wrong one. Cells are filled lowest first and
+// only reused when all are taken, so the file grows without holes.
+
+#define IMAGE_STACK_SIZE (32 * 1024)
+
+// Keys that failed this session, so a missing icon is not fetched each frame
+#define IMAGE_FAILED_KEYS 32
+
+// "i" or "a", owner id, "/", hash
+#define IMAGE_KEY_SIZE 80
+
+#define ATLAS_MAGIC "DIA1"
+#define CELL_BYTES (IMAGE_CACHE_SIZE * IMAGE_CACHE_SIZE * sizeof(uint16_t))
+
+typedef struct {
+    char magic[4];
+    uint16_t cell;
+    uint16_t slots;
+} AtlasHeader;
+
+typedef struct {
+    char key[IMAGE_KEY_SIZE];
+    uint32_t stamp;             // Use order, for picking the cell to reuse
+    uint8_t average[3];
+    uint8_t used;
+} AtlasKey;
+
+typedef struct {
+    int slot;                   // Atlas cell it is a copy of
+    uint32_t used_at;
+    ImageBitmap* bitmap;        // NULL marks a free entry
+} RamEntry;
+
+typedef struct {
+    char key[IMAGE_KEY_SIZE];
+    ImageKind kind;
+    char owner_id[32];
+    char hash[40];
+} ImageRequest;
+
+// The body of one fetch, capped at IMAGE_MAX_BYTES
+typedef struct {
+    uint8_t* data;
+    size_t size;
+} FetchBuffer;
+
+static AtlasKey table[IMAGE_CACHE_SLOTS];
+static RamEntry ram[IMAGE_CACHE_RAM];
+static ImageRequest queue[IMAGE_QUEUE];
+static int queue_count = 0;
+static char active_key[IMAGE_KEY_SIZE];     // Taken by the worker, not done yet
+static char failed_keys[IMAGE_FAILED_KEYS][IMAGE_KEY_SIZE];
+static int failed_next = 0;
+static uint32_t clock_now = 0;
+
+static FILE* atlas = NULL;
+static Transport* image_transport = NULL;
+static char image_cdn[96];
+static LightLock image_lock;
+static LightEvent worker_wake;
+static Thread worker = NULL;
+static CancelToken* in_flight = NULL;
+static volatile bool running = false;
+
+static ImageCacheStats stats;
+
+static long cell_offset(int slot) {
+    return (long)(sizeof(AtlasHeader) + sizeof(table) + (size_t)slot * CELL_BYTES);
+}
+
+static long key_offset(int slot) {
+    return (long)(sizeof(AtlasHeader) + (size_t)slot * sizeof(AtlasKey));
+}
+
+// Called with image_lock held
+static int find_slot(const char* key) {
+    for (int i = 0; i < IMAGE_CACHE_SLOTS; i++) {
+        if (table[i].used && strcmp(table[i].key, key) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Called with image_lock held
+static RamEntry* find_ram(int slot) {
+    for (int i = 0; i < IMAGE_CACHE_RAM; i++) {
+        if (ram[i].bitmap && ram[i].slot == slot) {
+            return &ram[i];
+        }
+    }
+    return NULL;
+}
+
+// Called with image_lock held
+static bool is_waiting(const char* key) {
+    if (strcmp(active_key, key) == 0) {
+        return true;
+    }
+    for (int i = 0; i < queue_count; i++) {
+        if (strcmp(queue[i].key, key) == 0) {
+            return true;
+        }
+    }
+    for (int i = 0; i < IMAGE_FAILED_KEYS; i++) {
+        if (strcmp(failed_keys[i], key) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Hashes are hex, with "a_" in front for animated images
+static bool valid_hash(const char* hash) {
+    size_t len = strlen(hash);
+    if (len == 0 || len >= sizeof(queue[0].hash)) {
+        return false;
+    }
+    return strspn(hash, "0123456789abcdef_") == len;
+}
+
+static size_t image_evict(size_t needed, void* ctx) {
+    (void)ctx;
+    size_t freed = 0;
+
+    if (LightLock_TryLock(&image_lock) != 0) {
+        return 0;
+    }
+    while (freed < needed) {
+        RamEntry* oldest = NULL;
+        for (int i = 0; i < IMAGE_CACHE_RAM; i++) {
+            if (ram[i].bitmap && (!oldest || ram[i].used_at < oldest->used_at)) {
+                oldest = &ram[i];
+            }
+        }
+        if (!oldest) {
+            break;
+        }
+        mem_free(oldest->bitmap);
+        oldest->bitmap = NULL;
+        freed += sizeof(ImageBitmap);
+    }
+    LightLock_Unlock(&image_lock);
+    return freed;
+}
+
+// Keep bitmap in RAM as the copy of slot, replacing the least recently used,
+// which completes the worker's current request
+static void keep_in_ram(int slot, ImageBitmap* bitmap) {
+    ImageBitmap* dropped = NULL;
+
+    LightLock_Lock(&image_lock);
+    RamEntry* entry = NULL;
+    for (int i = 0; i < IMAGE_CACHE_RAM; i++) {
+        if (!ram[i].bitmap) {
+            entry = &ram[i];
+            break;
+        }
+        if (!entry || ram[i].used_at < entry->used_at) {
+            entry = &ram[i];
+        }
+    }
+    dropped = entry->bitmap;
+    entry->slot = slot;
+    entry->used_at = clock_now++;
+    entry->bitmap = bitmap;
+    active_key[0] = '\0';
+    LightLock_Unlock(&image_lock);
+
+    mem_free(dropped);
+}
+
+static bool open_atlas(const char* path) {
+    AtlasHeader header;
+    atlas = fopen(path, "r+b");
+    if (atlas) {
+        if (fread(&header, sizeof(header), 1, atlas) == 1 && memcmp(header.magic, ATLAS_MAGIC, 4) == 0 &&
+            header.cell == IMAGE_CACHE_SIZE && header.slots == IMAGE_CACHE_SLOTS &&
+            fread(table, sizeof(table), 1, atlas) == 1) {
+            return true;
+        }
+        // Another layout or cut short: start over
+        fclose(atlas);
+        log_write(LOG_INFO, "Rebuilding image atlas %s", path);
+    }
+
+    memset(table, 0, sizeof(table));
+    atlas = fopen(path, "w+b");
+    if (!atlas) {
+        log_write(LOG_ERROR, "Failed to create %s", path);
+        return false;
+    }
+    memcpy(header.magic, ATLAS_MAGIC, 4);
+    header.cell = IMAGE_CACHE_SIZE;
+    header.slots = IMAGE_CACHE_SLOTS;
+    if (fwrite(&header, sizeof(header), 1, atlas) != 1 || fwrite(table, sizeof(table), 1, atlas) != 1 ||
+        fflush(atlas) != 0) {
+        log_write(LOG_ERROR, "Failed to write %s", path);
+        fclose(atlas);
+        atlas = NULL;
+        return false;
+    }
+    return true;
+}
+
+static bool write_key(int slot, const AtlasKey* key) {
+    return fseek(atlas, key_offset(slot), SEEK_SET) == 0 && fwrite(key, sizeof(AtlasKey), 1, atlas) == 1;
+}
+
+static bool on_begin(long status, int64_t length, void* ctx) {
+    (void)ctx;
+    return status == 200 && length <= IMAGE_MAX_BYTES;
+}
+
+static bool on_write(const void* data, size_t size, void* ctx) {
+    FetchBuffer* buffer = (FetchBuffer*)ctx;
+    if (size > IMAGE_MAX_BYTES - buffer->size) {
+        return false;
+    }
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+    return true;
+}
+
+// Box-filter the image down (or repeat pixels up) to one cell. Colour is
+// averaged by alpha so transparent pixels do not darken the edges.
+static void scale_to_cell(const PngImage* image, ImageBitmap* out) {
+    uint32_t sum_r = 0, sum_g = 0, sum_b = 0, opaque = 0;
+
+    for (uint32_t oy = 0; oy < IMAGE_CACHE_SIZE; oy++) {
+        uint32_t y0 = oy * image->height / IMAGE_CACHE_SIZE;
+        uint32_t y1 = (oy + 1) * image->height / IMAGE_CACHE_SIZE;
+        if (y1 <= y0) {
+            y1 = y0 + 1;
+        }
+        for (uint32_t ox = 0; ox < IMAGE_CACHE_SIZE; ox++) {
+            uint32_t x0 = ox * image->width / IMAGE_CACHE_SIZE;
+            uint32_t x1 = (ox + 1) * image->width / IMAGE_CACHE_SIZE;
+            if (x1 <= x0) {
+                x1 = x0 + 1;
+            }
+
+            uint32_t r = 0, g = 0, b = 0, a = 0;
+            for (uint32_t y = y0; y < y1; y++) {
+                const uint8_t* p = image->pixels + ((size_t)y * image->width + x0) * 4;
+                for (uint32_t x = x0; x < x1; x++, p += 4) {
+                    r += p[0] * p[3];
+                    g += p[1] * p[3];
+                    b += p[2] * p[3];
+                    a += p[3];
+                }
+            }
+            uint32_t count = (x1 - x0) * (y1 - y0);
+            uint16_t pixel = 0;
+            if (a > 0) {
+                r /= a;
+                g /= a;
+                b /= a;
+                pixel = (uint16_t)(((r >> 3) << 11) | ((g >> 3) << 6) | ((b >> 3) << 1));
+            }
+            if (a / count >= 128) {
+                pixel |= 1;
+                sum_r += r;
+                sum_g += g;
+                sum_b += b;
+                opaque++;
+            }
+            out->pixels[oy * IMAGE_CACHE_SIZE + ox] = pixel;
+        }
+    }
+
+    memset(out->average, 0, sizeof(out->average));
+    if (opaque > 0) {
+        out->average[0] = (uint8_t)(sum_r / opaque);
+        out->average[1] = (uint8_t)(sum_g / opaque);
+        out->average[2] = (uint8_t)(sum_b / opaque);
+    }
+}
+
+// Download and decode one image into bitmap
+static bool fetch_image(const ImageRequest* request, ImageBitmap* bitmap) {
+    char url[sizeof(image_cdn) + 128];
+    snprintf(url, sizeof(url), "%s/%s/%s/%s.png?size=%d", image_cdn,
+             request->kind == IMAGE_SERVER_ICON ? "icons" : "avatars", request->owner_id, request->hash,
+             IMAGE_CACHE_SIZE);
+
+    FetchBuffer buffer = {0};
+    buffer.data = mem_alloc(MEM_NET, IMAGE_MAX_BYTES);
+    if (!buffer.data) {
+        return false;
+    }
+
+    CancelToken cancel;
+    cancel_token_init(&cancel, 0);
+    LightLock_Lock(&image_lock);
+    bool started = running;
+    in_flight = started ? &cancel : NULL;
+    LightLock_Unlock(&image_lock);
+
+    TransportDownload download = {0};
+    download.url = url;
+    download.cancel = &cancel;
+    download.begin = on_begin;
+    download.write = on_write;
+    download.ctx = &buffer;
+
+    NetSample sample;
+    net_stats_begin(&sample, "GET", request->kind == IMAGE_SERVER_ICON ? "icon" : "avatar");
+    bool ok = started && transport_download(image_transport, &download, &sample);
+    sample.ok = ok;
+    sample.aborted = cancel.cancelled;
+    net_stats_record(&sample);
+
+    LightLock_Lock(&image_lock);
+    in_flight = NULL;
+    stats.bytes += buffer.size;
+    LightLock_Unlock(&image_lock);
+
+    PngImage image;
+    if (ok) {
+        uint64_t start = timing_now();
+        ok = png_decode(buffer.data, buffer.size, IMAGE_MAX_DIMENSION, &image);
+        if (ok) {
+            scale_to_cell(&image, bitmap);
+            mem_free(image.pixels);
+        } else {
+            log_write(LOG_WARN, "Image %s could not be decoded", request->key);
+        }
+        double elapsed = timing_ticks_to_ms(timing_now() - start);
+        LightLock_Lock(&image_lock);
+        stats.decode_ms += elapsed;
+        LightLock_Unlock(&image_lock);
+    }
+    mem_free(buffer.data);
+    return ok;
+}
+
+// Put a fetched image in a free cell, or else the least recently used one
+static int store_image(const ImageRequest* request, const ImageBitmap* bitmap) {
+    LightLock_Lock(&image_lock);
+    int slot = -1;
+    for (int i = 0; i < IMAGE_CACHE_SLOTS; i++) {
+        if (!table[i].used) {
+            slot = i;
+            break;
+        }
+        if (slot < 0 || table[i].stamp < table[slot].stamp) {
+            slot = i;
+        }
+    }
+    if (table[slot].used) {
+        stats.replaced++;
+        stats.stored--;
+    }
+    table[slot].used = 0;
+    RamEntry* stale = find_ram(slot);
+    ImageBitmap* dropped = stale ? stale->bitmap : NULL;
+    if (stale) {
+        stale->bitmap = NULL;
+    }
+    AtlasKey key = {0};
+    snprintf(key.key, sizeof(key.key), "%s", request->key);
+    key.stamp = clock_now++;
+    memcpy(key.average, bitmap->average, sizeof(key.average));
+    key.used = 1;
+    LightLock_Unlock(&image_lock);
+    mem_free(dropped);
+
+    AtlasKey empty = {0};
+    bool ok = write_key(slot, &empty) &&
+              fseek(atlas, cell_offset(slot), SEEK_SET) == 0 &&
+              fwrite(bitmap->pixels, CELL_BYTES, 1, atlas) == 1 &&
+              write_key(slot, &key) && fflush(atlas) == 0;
+    if (!ok) {
+        log_write(LOG_ERROR, "Failed to write image atlas");
+        return -1;
+    }
+
+    LightLock_Lock(&image_lock);
+    table[slot] = key;
+    stats.stored++;
+    LightLock_Unlock(&image_lock);
+    return slot;
+}
+
+// Fill bitmap from the atlas cell of slot
+static bool load_image(int slot, ImageBitmap* bitmap) {
+    if (fseek(atlas, cell_offset(slot), SEEK_SET) != 0 || fread(bitmap->pixels, CELL_BYTES, 1, atlas) != 1) {
+        log_write(LOG_ERROR, "Failed to read image atlas");
+        return false;
+    }
+    LightLock_Lock(&image_lock);
+    memcpy(bitmap->average, table[slot].average, sizeof(bitmap->average));
+    LightLock_Unlock(&image_lock);
+    return true;
+}
+
+static void image_worker(void* arg) {
+    (void)arg;
+
+    while (running) {
+        ImageRequest request;
+        bool have = false;
+
+        LightLock_Lock(&image_lock);
+        if (queue_count > 0) {
+            request = queue[0];
+            memmove(&queue[0], &queue[1], (queue_count - 1) * sizeof(ImageRequest));
+            queue_count--;
+            snprintf(active_key, sizeof(active_key), "%s", request.key);
+            have = true;
+        }
+        // Only this thread changes the table, so the slot stays valid
+        int slot = have ? find_slot(request.key) : -1;
+        LightLock_Unlock(&image_lock);
+
+        if (!have) {
+            LightEvent_Wait(&worker_wake);
+            continue;
+        }
+
+        ImageBitmap* bitmap = mem_alloc(MEM_CACHE, sizeof(ImageBitmap));
+        bool ok = false;
+        if (bitmap && slot >= 0) {
+            ok = load_image(slot, bitmap);
+            LightLock_Lock(&image_lock);
+            stats.card_loads += ok;
+            LightLock_Unlock(&image_lock);
+        } else if (bitmap && fetch_image(&request, bitmap)) {
+            slot = store_image(&request, bitmap);
+            ok = slot >= 0;
+            LightLock_Lock(&image_lock);
+            stats.fetched++;
+            LightLock_Unlock(&image_lock);
+        }
+
+        if (ok) {
+            keep_in_ram(slot, bitmap);
+        } else {
+            mem_free(bitmap);
+            LightLock_Lock(&image_lock);
+            active_key[0] = '\0';
+            if (running) {
+                snprintf(failed_keys[failed_next], sizeof(failed_keys[0]), "%s", request.key);
+                failed_next = (failed_next + 1) % IMAGE_FAILED_KEYS;
+                stats.failed++;
+            }
+            LightLock_Unlock(&image_lock);
+            continue;
+        }
+        // The row showing it can be drawn now
+        wake_request();
+    }
+}
+
+bool image_cache_init(Transport* transport, const char* cdn_base, const char* atlas_path) {
+    LightLock_Init(&image_lock);
+    LightEvent_Init(&worker_wake, RESET_ONESHOT);
+    memset(ram, 0, sizeof(ram));
+    memset(failed_keys, 0, sizeof(failed_keys));
+    active_key[0] = '\0';
+    memset(&stats, 0, sizeof(stats));
+    queue_count = 0;
+    failed_next = 0;
+    clock_now = 0;
+
+    if (!open_atlas(atlas_path)) {
+        return false;
+    }
+    for (int i = 0; i < IMAGE_CACHE_SLOTS; i++) {
+        if (table[i].used) {
+            stats.stored++;
+            if (table[i].stamp >= clock_now) {
+                clock_now = table[i].stamp + 1;
+            }
+        }
+    }
+
+    image_transport = transport;
+    snprintf(image_cdn, sizeof(image_cdn), "%s", cdn_base);
+    mem_register_evictor(MEM_CACHE, image_evict, NULL);
+
+    // Below the UI thread, like the other workers
+    s32 priority = 0x30;
+    svcGetThreadPriority(&priority, CUR_THREAD_HANDLE);
+
+    running = true;
+    worker = threadCreate(image_worker, NULL, IMAGE_STACK_SIZE, priority + 1, -2, false);
+    if (!worker) {
+        log_write(LOG_ERROR, "Failed to start image worker");
+        image_cache_cleanup();
+        return false;
+    }
+    return true;
+}
+
+// Copy the bitmap or just its average colour if it is in RAM, else queue it
+static bool lookup(ImageKind kind, const char* owner_id, const char* hash, ImageBitmap* out, uint8_t* average) {
+    if (!running || !owner_id || owner_id[0] == '\0' || !hash || !valid_hash(hash) ||
+        strlen(owner_id) >= sizeof(queue[0].owner_id)) {
+        return false;
+    }
+    char key[IMAGE_KEY_SIZE];
+    snprintf(key, sizeof(key), "%c%s/%s", kind == IMAGE_SERVER_ICON ? 'i' : 'a', owner_id, hash);
+
+    LightLock_Lock(&image_lock);
+    int slot = find_slot(key);
+    RamEntry* entry = slot >= 0 ? find_ram(slot) : NULL;
+    if (entry) {
+        if (out) {
+            memcpy(out, entry->bitmap, sizeof(ImageBitmap));
+        } else {
+            memcpy(average, entry->bitmap->average, sizeof(entry->bitmap->average));
+        }
+        entry->used_at = clock_now;
+        table[slot].stamp = clock_now++;
+        stats.ram_hits++;
+        LightLock_Unlock(&image_lock);
+        return true;
+    }
+
+    bool queued = false;
+    if (queue_count < IMAGE_QUEUE && !is_waiting(key)) {
+        ImageRequest* request = &queue[queue_count++];
+        snprintf(request->key, sizeof(request->key), "%s", key);
+        request->kind = kind;
+        snprintf(request->owner_id, sizeof(request->owner_id), "%s", owner_id);
+        snprintf(request->hash, sizeof(request->hash), "%s", hash);
+        queued = true;
+    }
+    LightLock_Unlock(&image_lock);
+
+    if (queued) {
+        LightEvent_Signal(&worker_wake);
+    }
+    return false;
+}
+
+bool image_cache_get(ImageKind kind, const char* owner_id, const char* hash, ImageBitmap* out) {
+    return lookup(kind, owner_id, hash, out, NULL);
+}
+
+bool image_cache_average(ImageKind kind, const char* owner_id, const char* hash, uint8_t rgb[3]) {
+    return lookup(kind, owner_id, hash, NULL, rgb);
+}
+
+ImageCacheStats image_cache_get_stats(void) {
+    LightLock_Lock(&image_lock);
+    ImageCacheStats snapshot = stats;
+    LightLock_Unlock(&image_lock);
+    return snapshot;
+}
+
+void image_cache_cleanup(void) {
+    LightLock_Lock(&image_lock);
+    running = false;
+    if (in_flight) {
+        cancel_token_cancel(in_flight);
+    }
+    LightLock_Unlock(&image_lock);
+
+    if (worker) {
+        LightEvent_Signal(&worker_wake);
+        threadJoin(worker, U64_MAX);
+        threadFree(worker);
+        worker = NULL;
+    }
+    mem_unregister_evictor(image_evict, NULL);
+
+    // Use stamps only change in RAM while running; save them once here
+    if (atlas) {
+        if (fseek(atlas, key_offset(0), SEEK_SET) != 0 || fwrite(table, sizeof(table), 1, atlas) != 1) {
+            log_write(LOG_ERROR, "Failed to save image atlas");
+        }
+        fclose(atlas);
+        atlas = NULL;
+    }
+    for (int i = 0; i < IMAGE_CACHE_RAM; i++) {
+        mem_free(ram[i].bitmap);
+        ram[i].bitmap = NULL;
+    }
+    image_transport = NULL;
+}
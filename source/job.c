@@ -0,0 +1,197 @@
+#include "job.h"
+#include "profiler.h"
+#include "log.h"
+#include <string.h>
+#include <3ds.h>
+
+#define JOB_STACK_SIZE (32 * 1024)
+
+// Core for each worker: the New 3DS extra core first, then any
+static const int worker_cores[JOB_MAX_WORKERS] = { 2, -2, -2, -2 };
+
+typedef struct {
+    JobFn fn;
+    void* arg;
+    JobCounter* counter;
+} Job;
+
+// Ring of jobs; the owner takes the newest, thieves take the oldest
+typedef struct {
+    Job jobs[JOB_QUEUE_CAPACITY];
+    int head;                   // Oldest
+    int count;
+    LightLock lock;
+    LightEvent wake;
+    Thread thread;
+} JobQueue;
+
+static JobQueue queues[JOB_MAX_WORKERS];
+static int worker_count = 0;
+static bool running = false;
+static unsigned next_queue = 0;
+static JobStats stats;
+
+static bool queue_push(JobQueue* queue, const Job* job) {
+    bool ok = false;
+    LightLock_Lock(&queue->lock);
+    if (queue->count < JOB_QUEUE_CAPACITY) {
+        queue->jobs[(queue->head + queue->count) % JOB_QUEUE_CAPACITY] = *job;
+        queue->count++;
+        ok = true;
+    }
+    LightLock_Unlock(&queue->lock);
+    return ok;
+}
+
+static bool queue_pop_newest(JobQueue* queue, Job* job) {
+    bool ok = false;
+    LightLock_Lock(&queue->lock);
+    if (queue->count > 0) {
+        queue->count--;
+        *job = queue->jobs[(queue->head + queue->count) % JOB_QUEUE_CAPACITY];
+        ok = true;
+    }
+    LightLock_Unlock(&queue->lock);
+    return ok;
+}
+
+static bool queue_pop_oldest(JobQueue* queue, Job* job) {
+    bool ok = false;
+    LightLock_Lock(&queue->lock);
+    if (queue->count > 0) {
+        *job = queue->jobs[queue->head];
+        queue->head = (queue->head + 1) % JOB_QUEUE_CAPACITY;
+        queue->count--;
+        ok = true;
+    }
+    LightLock_Unlock(&queue->lock);
+    return ok;
+}
+
+static void run_job(const Job* job, int runner) {
+    job->fn(job->arg);
+    __atomic_add_fetch(&stats.executed[runner], 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&job->counter->pending, 1, __ATOMIC_RELEASE);
+}
+
+// Own queue first, then steal from the others. runner is the worker index,
+// or worker_count for a thread waiting in job_wait.
+static bool run_one(int runner) {
+    Job job;
+    // Grows while job_system_init starts the workers
+    int workers = __atomic_load_n(&worker_count, __ATOMIC_ACQUIRE);
+    if (workers == 0) {
+        return false;
+    }
+    if (runner < workers && queue_pop_newest(&queues[runner], &job)) {
+        run_job(&job, runner);
+        return true;
+    }
+    for (int i = 1; i <= workers; i++) {
+        int victim = (runner + i) % workers;
+        if (victim != runner && queue_pop_oldest(&queues[victim], &job)) {
+            __atomic_add_fetch(&stats.stolen, 1, __ATOMIC_RELAXED);
+            run_job(&job, runner);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void job_worker(void* arg) {
+    int index = (int)(intptr_t)arg;
+    while (__atomic_load_n(&running, __ATOMIC_ACQUIRE)) {
+        if (!run_one(index)) {
+            LightEvent_Wait(&queues[index].wake);
+        }
+    }
+    // Drain anything queued before the stop
+    while (run_one(index)) {
+    }
+}
+
+bool job_system_init(int workers) {
+    memset(&stats, 0, sizeof(stats));
+    if (workers < 0) {
+        workers = 0;
+    }
+    if (workers > JOB_MAX_WORKERS) {
+        workers = JOB_MAX_WORKERS;
+    }
+
+    s32 priority = 0x30;
+    svcGetThreadPriority(&priority, CUR_THREAD_HANDLE);
+
+    __atomic_store_n(&running, true, __ATOMIC_RELEASE);
+    __atomic_store_n(&worker_count, 0, __ATOMIC_RELEASE);
+    for (int i = 0; i < workers; i++) {
+        JobQueue* queue = &queues[i];
+        memset(queue, 0, sizeof(JobQueue));
+        LightLock_Init(&queue->lock);
+        LightEvent_Init(&queue->wake, RESET_ONESHOT);
+    }
+    // Count a worker in only once its thread exists, so thieves never look
+    // at a queue nobody serves
+    for (int i = 0; i < workers; i++) {
+        __atomic_store_n(&worker_count, i + 1, __ATOMIC_RELEASE);
+        queues[i].thread = threadCreate(job_worker, (void*)(intptr_t)i, JOB_STACK_SIZE,
+                                        priority + 1, worker_cores[i], false);
+        if (!queues[i].thread) {
+            __atomic_store_n(&worker_count, i, __ATOMIC_RELEASE);
+            log_write(LOG_WARN, "Job system: started %d of %d workers", i, workers);
+            break;
+        }
+    }
+    stats.workers = worker_count;
+    return worker_count == workers;
+}
+
+int job_system_workers(void) {
+    return worker_count;
+}
+
+void job_submit(JobCounter* counter, JobFn fn, void* arg) {
+    Job job = { fn, arg, counter };
+    __atomic_add_fetch(&counter->pending, 1, __ATOMIC_RELAXED);
+
+    // Round-robin over the queues; the owner wakes up, idle ones steal
+    for (int tries = 0; tries < worker_count; tries++) {
+        int index = (int)(__atomic_fetch_add(&next_queue, 1, __ATOMIC_RELAXED) % (unsigned)worker_count);
+        if (queue_push(&queues[index], &job)) {
+            for (int i = 0; i < worker_count; i++) {
+                LightEvent_Signal(&queues[i].wake);
+            }
+            return;
+        }
+    }
+    run_job(&job, worker_count);
+}
+
+void job_wait(JobCounter* counter) {
+    PROFILE_ZONE("job_wait");
+    while (__atomic_load_n(&counter->pending, __ATOMIC_ACQUIRE) > 0) {
+        if (!run_one(worker_count)) {
+            // Everything left is already running on a worker
+            svcSleepThread(50000);
+        }
+    }
+}
+
+JobStats job_get_stats(void) {
+    JobStats result;
+    memcpy(&result, &stats, sizeof(result));
+    return result;
+}
+
+void job_system_cleanup(void) {
+    __atomic_store_n(&running, false, __ATOMIC_RELEASE);
+    for (int i = 0; i < worker_count; i++) {
+        LightEvent_Signal(&queues[i].wake);
+    }
+    for (int i = 0; i < worker_count; i++) {
+        threadJoin(queues[i].thread, U64_MAX);
+        threadFree(queues[i].thread);
+        queues[i].thread = NULL;
+    }
+    __atomic_store_n(&worker_count, 0, __ATOMIC_RELEASE);
+}
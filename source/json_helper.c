@@ -1,7 +1,12 @@
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include "jsmn.h"
 #include "json_helper.h"
+#include "json_scan.h"
+#include "text.h"
+#include "profiler.h"
+#include "mem.h"
 
 bool json_token_equals(const char* json, jsmntok_t* tok, const char* s) {
     if (tok->type == JSMN_STRING && 
@@ -17,13 +22,16 @@ int json_get_string(const char* json, jsmntok_t* tok, char* output, size_t max_l
         return -1;
     }
     
-    size_t len = tok->end - tok->start;
-    if (len >= max_len) {
-        len = max_len - 1;
+    text_decode_json(json + tok->start, tok->end - tok->start, output, max_len, TEXT_UTF8);
+    return 0;
+}
+
+int json_get_text(const char* json, jsmntok_t* tok, char* output, size_t max_len) {
+    if (tok == NULL || tok->type != JSMN_STRING) {
+        return -1;
     }
     
-    strncpy(output, json + tok->start, len);
-    output[len] = '\0';
+    text_decode_json(json + tok->start, tok->end - tok->start, output, max_len, TEXT_CONSOLE);
     return 0;
 }
 
@@ -37,7 +45,51 @@ jsmntok_t* json_find_token(const char* json, jsmntok_t* tokens, int num_tokens,
 }
 
 int json_parse(const char* json, jsmntok_t* tokens, size_t max_tokens) {
+    PROFILE_ZONE("json_parse");
     jsmn_parser parser;
     jsmn_init(&parser);
     return jsmn_parse(&parser, json, strlen(json), tokens, max_tokens);
 }
+
+int json_parse_alloc(const char* json, jsmntok_t** tokens) {
+    PROFILE_ZONE("json_parse");
+    return json_scan_tokenize(json, strlen(json), tokens);
+}
+
+int json_skip(jsmntok_t* tokens, int num_tokens, int index) {
+    // Each token accounts for itself; its size adds the children still to visit
+    int pending = 1;
+    while (pending > 0 && index < num_tokens) {
+        pending += tokens[index].size - 1;
+        index++;
+    }
+    return index;
+}
+
+jsmntok_t* json_object_get(const char* json, jsmntok_t* tokens, int num_tokens, int object_index, const char* key) {
+    if (object_index < 0 || object_index >= num_tokens || tokens[object_index].type != JSMN_OBJECT) {
+        return NULL;
+    }
+    
+    int i = object_index + 1;
+    for (int k = 0; k < tokens[object_index].size && i < num_tokens - 1; k++) {
+        if (json_token_equals(json, &tokens[i], key)) {
+            return &tokens[i + 1];
+        }
+        // A key token's size covers its value, so this skips the pair
+        i = json_skip(tokens, num_tokens, i);
+    }
+    return NULL;
+}
+
+int json_get_int(const char* json, jsmntok_t* tok, int default_value) {
+    if (tok == NULL || tok->type != JSMN_PRIMITIVE) {
+        return default_value;
+    }
+    
+    char c = json[tok->start];
+    if (c != '-' && (c < '0' || c > '9')) {
+        return default_value;
+    }
+    return atoi(json + tok->start);
+}
@@ -0,0 +1,365 @@
+#include "json_scan.h"
+#include "mem.h"
+#include <string.h>
+
+// Build with -DJSON_SCAN_FORCE_SWAR to measure the 3DS code path on a PC
+#if defined(JSON_SCAN_FORCE_SWAR)
+#define JSON_SCAN_SWAR 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#else
+#define JSON_SCAN_SWAR 1
+#endif
+
+// Find the first '"' or '\\' in p[0..n), or n if there is none
+#if !defined(JSON_SCAN_SWAR) && defined(__SSE2__)
+static inline size_t find_quote_or_backslash(const char* p, size_t n) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(p + i));
+        __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash));
+        int mask = _mm_movemask_epi8(hits);
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    for (; i < n && p[i] != '"' && p[i] != '\\'; i++) {
+    }
+    return i;
+}
+#elif !defined(JSON_SCAN_SWAR) && defined(__ARM_NEON)
+static inline size_t find_quote_or_backslash(const char* p, size_t n) {
+    const uint8x16_t quote = vdupq_n_u8('"');
+    const uint8x16_t backslash = vdupq_n_u8('\\');
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t chunk = vld1q_u8((const uint8_t*)(p + i));
+        uint8x16_t hits = vorrq_u8(vceqq_u8(chunk, quote), vceqq_u8(chunk, backslash));
+        // Narrow each byte to a nibble: a 64-bit mask with 4 bits per byte
+        uint8x8_t narrowed = vshrn_n_u16(vreinterpretq_u16_u8(hits), 4);
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(narrowed), 0);
+        if (mask) {
+            return i + (__builtin_ctzll(mask) >> 2);
+        }
+    }
+    for (; i < n && p[i] != '"' && p[i] != '\\'; i++) {
+    }
+    return i;
+}
+#else
+// SWAR: a word-sized batch of bytes per step. A byte equal to c becomes zero
+// after XOR with c in every lane, and (v - 0x01..) & ~v & 0x80.. flags zero
+// bytes. Flags above the first hit can be false positives from the borrow,
+// but the lowest one is always exact, which is all we need.
+#if UINTPTR_MAX > 0xFFFFFFFFu
+typedef uint64_t swar_word;
+#define SWAR_CTZ __builtin_ctzll
+#else
+typedef uint32_t swar_word;
+#define SWAR_CTZ __builtin_ctz
+#endif
+
+#define SWAR_ONES ((swar_word)-1 / 0xFF)
+#define SWAR_HIGHS (SWAR_ONES * 0x80)
+
+static inline swar_word swar_zero_bytes(swar_word v) {
+    return (v - SWAR_ONES) & ~v & SWAR_HIGHS;
+}
+
+static inline size_t find_quote_or_backslash(const char* p, size_t n) {
+    const swar_word quote = SWAR_ONES * '"';
+    const swar_word backslash = SWAR_ONES * '\\';
+    size_t i = 0;
+
+    for (; i + sizeof(swar_word) <= n; i += sizeof(swar_word)) {
+        swar_word w;
+        memcpy(&w, p + i, sizeof(w));
+        swar_word mask = swar_zero_bytes(w ^ quote) | swar_zero_bytes(w ^ backslash);
+        if (mask) {
+            // Little-endian: the lowest flagged byte comes first
+            return i + (SWAR_CTZ(mask) >> 3);
+        }
+    }
+    for (; i < n && p[i] != '"' && p[i] != '\\'; i++) {
+    }
+    return i;
+}
+#endif
+
+// End of the string whose opening quote is at start, or len if unterminated
+static inline size_t string_end(const char* json, size_t start, size_t len) {
+    size_t pos = start + 1;
+    while (pos < len) {
+        pos += find_quote_or_backslash(json + pos, len - pos);
+        if (pos >= len) {
+            break;
+        }
+        if (json[pos] == '"') {
+            return pos;
+        }
+        pos += 2; // Skip the escaped byte
+    }
+    return len;
+}
+
+// End of a primitive, with the same delimiters as non-strict jsmn
+static inline size_t primitive_end(const char* json, size_t pos, size_t len) {
+    for (; pos < len; pos++) {
+        switch (json[pos]) {
+            case '\t': case '\r': case '\n': case ' ':
+            case ',': case ']': case '}': case ':':
+                return pos;
+            default:
+                break;
+        }
+    }
+    return pos;
+}
+
+static inline bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Offset of the first "}" "," "{" (whitespace allowed) at or after pos whose
+// object opens with key, pointing at the comma, or end if there is none.
+// key is the quoted first key of the array's first element, so the objects
+// nested inside elements (mentions, embeds) mostly don't qualify.
+static size_t next_object_boundary(const char* json, size_t pos, size_t end, const char* key, size_t key_len) {
+    while (pos < end) {
+        const char* close = memchr(json + pos, '}', end - pos);
+        if (!close) {
+            return end;
+        }
+        size_t i = close - json + 1;
+        while (i < end && is_space(json[i])) {
+            i++;
+        }
+        if (i < end && json[i] == ',') {
+            size_t comma = i++;
+            while (i < end && is_space(json[i])) {
+                i++;
+            }
+            if (i < end && json[i] == '{') {
+                i++;
+                while (i < end && is_space(json[i])) {
+                    i++;
+                }
+                if (i + key_len <= end && memcmp(json + i, key, key_len) == 0) {
+                    return comma;
+                }
+            }
+        }
+        pos = close - json + 1;
+    }
+    return end;
+}
+
+int json_scan_split_array(const char* json, size_t len, int parts, size_t* ranges) {
+    size_t start = 0;
+    size_t end = len;
+    while (start < end && is_space(json[start])) {
+        start++;
+    }
+    while (end > start && is_space(json[end - 1])) {
+        end--;
+    }
+    if (end - start < 2 || json[start] != '[' || json[end - 1] != ']' || parts < 1) {
+        return 0;
+    }
+    start++;
+    end--;
+
+    // The first key of the first element, quotes included
+    size_t key = start;
+    while (key < end && is_space(json[key])) {
+        key++;
+    }
+    if (key >= end || json[key] != '{') {
+        return 0;
+    }
+    key++;
+    while (key < end && is_space(json[key])) {
+        key++;
+    }
+    size_t key_len = 0;
+    if (key < end && json[key] == '"') {
+        size_t key_end = string_end(json, key, end);
+        key_len = key_end < end ? key_end - key + 1 : 0;
+    }
+
+    // Jump to each 1/parts mark and cut at the next object boundary there,
+    // without scanning what lies between
+    size_t range_start = start;
+    int n = 0;
+    for (int i = 1; i < parts; i++) {
+        size_t mark = start + (end - start) / parts * i;
+        if (mark < range_start) {
+            mark = range_start;
+        }
+        size_t comma = next_object_boundary(json, mark, end, json + key, key_len);
+        if (comma >= end) {
+            break;
+        }
+        ranges[2 * n] = range_start;
+        ranges[2 * n + 1] = comma;
+        n++;
+        range_start = comma + 1;
+    }
+    ranges[2 * n] = range_start;
+    ranges[2 * n + 1] = end;
+    return n + 1;
+}
+
+void json_scan_init(JsonScanner* scanner, const char* json, size_t len) {
+    scanner->json = json;
+    scanner->len = len;
+    scanner->pos = 0;
+    scanner->error = 0;
+}
+
+int json_scan_next(JsonScanner* scanner, uint32_t* offsets, int max) {
+    const char* json = scanner->json;
+    size_t len = scanner->len;
+    size_t pos = scanner->pos;
+    int n = 0;
+
+    // Strings and primitives take two slots; never split a pair across calls
+    while (pos < len && n + 2 <= max) {
+        switch (json[pos]) {
+            case '{': case '}': case '[': case ']': case ':': case ',':
+                offsets[n++] = (uint32_t)pos;
+                pos++;
+                break;
+            case ' ': case '\t': case '\r': case '\n':
+                pos++;
+                break;
+            case '"': {
+                size_t end = string_end(json, pos, len);
+                if (end >= len) {
+                    scanner->error = JSMN_ERROR_PART;
+                    scanner->pos = len;
+                    return n;
+                }
+                offsets[n++] = (uint32_t)pos;
+                offsets[n++] = (uint32_t)end;
+                pos = end + 1;
+                break;
+            }
+            default: {
+                size_t end = primitive_end(json, pos, len);
+                offsets[n++] = (uint32_t)pos;
+                offsets[n++] = (uint32_t)end;
+                pos = end;
+                break;
+            }
+        }
+    }
+
+    scanner->pos = pos;
+    return n;
+}
+
+int json_scan_tokenize(const char* json, size_t len, jsmntok_t** tokens) {
+    // Real Discord payloads average roughly one token per 12 bytes
+    size_t capacity = len / 12 + 64;
+    jsmntok_t* out = mem_alloc(MEM_JSON, capacity * sizeof(jsmntok_t));
+    *tokens = out;
+    if (!out) {
+        return JSMN_ERROR_NOMEM;
+    }
+
+    JsonScanner scanner;
+    json_scan_init(&scanner, json, len);
+
+    uint32_t offsets[JSON_SCAN_BATCH];
+    int stack[JSON_SCAN_MAX_DEPTH];
+    int depth = 0;
+    int super = -1;     // Token whose size the next value adds to, as in jsmn
+    size_t count = 0;
+    int n;
+
+    while ((n = json_scan_next(&scanner, offsets, JSON_SCAN_BATCH)) > 0) {
+        // Each offset starts at most one token
+        if (count + (size_t)n > capacity) {
+            size_t grown_capacity = capacity * 2 + (size_t)n;
+            jsmntok_t* grown = mem_realloc(MEM_JSON, out, grown_capacity * sizeof(jsmntok_t));
+            if (!grown) {
+                return JSMN_ERROR_NOMEM;
+            }
+            out = grown;
+            *tokens = out;
+            capacity = grown_capacity;
+        }
+
+        for (int i = 0; i < n; i++) {
+            uint32_t pos = offsets[i];
+            char c = json[pos];
+            jsmntok_t* token;
+
+            switch (c) {
+                case '{':
+                case '[':
+                    if (depth == JSON_SCAN_MAX_DEPTH) {
+                        return JSMN_ERROR_INVAL;
+                    }
+                    if (super != -1) {
+                        out[super].size++;
+                    }
+                    token = &out[count];
+                    token->type = c == '{' ? JSMN_OBJECT : JSMN_ARRAY;
+                    token->start = (int)pos;
+                    token->end = -1;
+                    token->size = 0;
+                    stack[depth++] = (int)count;
+                    super = (int)count;
+                    count++;
+                    break;
+                case '}':
+                case ']':
+                    if (depth == 0 ||
+                        out[stack[depth - 1]].type != (c == '}' ? JSMN_OBJECT : JSMN_ARRAY)) {
+                        return JSMN_ERROR_INVAL;
+                    }
+                    out[stack[--depth]].end = (int)pos + 1;
+                    super = depth > 0 ? stack[depth - 1] : -1;
+                    break;
+                case ':':
+                    // The key just emitted collects the value
+                    super = (int)count - 1;
+                    break;
+                case ',':
+                    super = depth > 0 ? stack[depth - 1] : -1;
+                    break;
+                default:
+                    if (super != -1) {
+                        out[super].size++;
+                    }
+                    token = &out[count++];
+                    if (c == '"') {
+                        token->type = JSMN_STRING;
+                        token->start = (int)pos + 1;
+                    } else {
+                        token->type = JSMN_PRIMITIVE;
+                        token->start = (int)pos;
+                    }
+                    token->end = (int)offsets[++i];
+                    token->size = 0;
+                    break;
+            }
+        }
+    }
+
+    if (scanner.error) {
+        return scanner.error;
+    }
+    if (depth > 0) {
+        return JSMN_ERROR_PART;
+    }
+    return (int)count;
+}
@@ -0,0 +1,244 @@
+#include "json_writer.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char hex_digits[] = "0123456789abcdef";
+
+// Copy the part of output bytes [length, length + len) that falls in the
+// window into the buffer
+static void put_window(JsonWriter* w, const char* data, size_t len) {
+    size_t start = w->length > w->skip ? w->length : w->skip;
+    size_t end = w->length + len < w->skip + w->capacity ? w->length + len : w->skip + w->capacity;
+    if (start < end) {
+        memcpy(w->buffer + (start - w->skip), data + (start - w->length), end - start);
+    }
+}
+
+static void put(JsonWriter* w, const char* data, size_t len) {
+    if (w->window) {
+        put_window(w, data, len);
+    } else if (w->buffer) {
+        // Always leave room for the terminating NUL
+        if (w->length + len >= w->capacity) {
+            w->overflow = true;
+            return;
+        }
+        memcpy(w->buffer + w->length, data, len);
+    }
+    w->length += len;
+}
+
+static void put_char(JsonWriter* w, char c) {
+    if (w->window) {
+        put_window(w, &c, 1);
+    } else if (w->buffer) {
+        if (w->length + 1 >= w->capacity) {
+            w->overflow = true;
+            return;
+        }
+        w->buffer[w->length] = c;
+    }
+    w->length++;
+}
+
+// Emit the separator needed before a new value or key
+static void begin_value(JsonWriter* w) {
+    if (w->after_key) {
+        w->after_key = false;
+        return;
+    }
+    if (w->depth > 0) {
+        uint32_t bit = 1u << w->depth;
+        if (w->has_member & bit) {
+            put_char(w, ',');
+        }
+        w->has_member |= bit;
+    }
+}
+
+static void open_scope(JsonWriter* w, char c) {
+    begin_value(w);
+    if (w->depth + 1 >= JSON_WRITER_MAX_DEPTH) {
+        w->overflow = true;
+        return;
+    }
+    put_char(w, c);
+    w->depth++;
+    w->has_member &= ~(1u << w->depth);
+}
+
+static void close_scope(JsonWriter* w, char c) {
+    if (w->depth == 0 || w->after_key) {
+        w->overflow = true;
+        return;
+    }
+    w->depth--;
+    put_char(w, c);
+}
+
+void json_writer_init(JsonWriter* writer, char* buffer, size_t capacity) {
+    memset(writer, 0, sizeof(JsonWriter));
+    writer->buffer = buffer;
+    writer->capacity = capacity;
+}
+
+void json_writer_init_window(JsonWriter* writer, char* buffer, size_t capacity, size_t skip) {
+    json_writer_init(writer, buffer, capacity);
+    writer->window = true;
+    writer->skip = skip;
+}
+
+void json_writer_begin_object(JsonWriter* writer) {
+    open_scope(writer, '{');
+}
+
+void json_writer_end_object(JsonWriter* writer) {
+    close_scope(writer, '}');
+}
+
+void json_writer_begin_array(JsonWriter* writer) {
+    open_scope(writer, '[');
+}
+
+void json_writer_end_array(JsonWriter* writer) {
+    close_scope(writer, ']');
+}
+
+// Length of the valid UTF-8 sequence at s (lead byte >= 0x80), or 0
+static size_t utf8_sequence_length(const unsigned char* s, const unsigned char* end) {
+    unsigned char c = s[0];
+    size_t len;
+    unsigned char lo = 0x80, hi = 0xBF;   // Allowed range of the second byte
+
+    if (c >= 0xC2 && c <= 0xDF) {
+        len = 2;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        len = 3;
+        if (c == 0xE0) {
+            lo = 0xA0;      // Overlong
+        } else if (c == 0xED) {
+            hi = 0x9F;      // UTF-16 surrogates
+        }
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        len = 4;
+        if (c == 0xF0) {
+            lo = 0x90;      // Overlong
+        } else if (c == 0xF4) {
+            hi = 0x8F;      // Above U+10FFFF
+        }
+    } else {
+        return 0;
+    }
+
+    if ((size_t)(end - s) < len || s[1] < lo || s[1] > hi) {
+        return 0;
+    }
+    for (size_t i = 2; i < len; i++) {
+        if ((s[i] & 0xC0) != 0x80) {
+            return 0;
+        }
+    }
+    return len;
+}
+
+static void put_escaped(JsonWriter* w, const char* value, size_t len) {
+    const unsigned char* s = (const unsigned char*)value;
+    const unsigned char* end = s + len;
+
+    put_char(w, '"');
+    while (s < end) {
+        // Copy the longest run that needs no escaping in one go
+        const unsigned char* run = s;
+        while (s < end && *s >= 0x20 && *s < 0x80 && *s != '"' && *s != '\\') {
+            s++;
+        }
+        if (s > run) {
+            put(w, (const char*)run, s - run);
+        }
+        if (s >= end) {
+            break;
+        }
+
+        unsigned char c = *s;
+        if (c >= 0x80) {
+            size_t seq = utf8_sequence_length(s, end);
+            if (seq > 0) {
+                put(w, (const char*)s, seq);
+                s += seq;
+            } else {
+                put(w, "\\ufffd", 6);
+                s++;
+            }
+            continue;
+        }
+
+        switch (c) {
+            case '"':  put(w, "\\\"", 2); break;
+            case '\\': put(w, "\\\\", 2); break;
+            case '\n': put(w, "\\n", 2); break;
+            case '\r': put(w, "\\r", 2); break;
+            case '\t': put(w, "\\t", 2); break;
+            case '\b': put(w, "\\b", 2); break;
+            case '\f': put(w, "\\f", 2); break;
+            default: {
+                char escape[6] = { '\\', 'u', '0', '0', hex_digits[c >> 4], hex_digits[c & 0xF] };
+                put(w, escape, sizeof(escape));
+                break;
+            }
+        }
+        s++;
+    }
+    put_char(w, '"');
+}
+
+void json_writer_key(JsonWriter* writer, const char* key) {
+    if (writer->after_key) {
+        writer->overflow = true;
+        return;
+    }
+    begin_value(writer);
+    put_escaped(writer, key, strlen(key));
+    put_char(writer, ':');
+    writer->after_key = true;
+}
+
+void json_writer_string(JsonWriter* writer, const char* value) {
+    json_writer_string_n(writer, value, strlen(value));
+}
+
+void json_writer_string_n(JsonWriter* writer, const char* value, size_t len) {
+    begin_value(writer);
+    put_escaped(writer, value, len);
+}
+
+void json_writer_int(JsonWriter* writer, long long value) {
+    char digits[24];
+    int len = snprintf(digits, sizeof(digits), "%lld", value);
+    begin_value(writer);
+    put(writer, digits, (size_t)len);
+}
+
+void json_writer_bool(JsonWriter* writer, bool value) {
+    begin_value(writer);
+    if (value) {
+        put(writer, "true", 4);
+    } else {
+        put(writer, "false", 5);
+    }
+}
+
+void json_writer_null(JsonWriter* writer) {
+    begin_value(writer);
+    put(writer, "null", 4);
+}
+
+bool json_writer_finish(JsonWriter* writer) {
+    if (writer->depth != 0 || writer->after_key) {
+        writer->overflow = true;
+    }
+    if (writer->buffer && writer->capacity > 0 && !writer->window) {
+        size_t end = writer->length < writer->capacity ? writer->length : writer->capacity - 1;
+        writer->buffer[end] = '\0';
+    }
+    return !writer->overflow;
+}
@@ -0,0 +1,222 @@
+#include "log.h"
+#include "timing.h"
+#include "wake.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <3ds.h>
+
+#define LOG_STACK_SIZE (16 * 1024)
+#define LOG_MASK (LOG_CAPACITY - 1)
+
+// A ring slot. seq says whose turn it is, relative to the lap of position
+// pos (pos & ~LOG_MASK): equal means free for the writer of pos, one more
+// means written and waiting for the reader. All-zero slots are free for the
+// first lap, so log_write works before log_init.
+typedef struct {
+    uint32_t seq;
+    LogRecord record;
+} LogSlot;
+
+static LogSlot ring[LOG_CAPACITY];
+static uint32_t head = 0;           // Next position to claim, shared by writers
+static uint32_t tail = 0;           // Next position to read, under drain_lock
+
+static LogRecord recent[LOG_RECENT];
+static int recent_count = 0;
+static int recent_next = 0;
+static LightLock recent_lock;
+static LightLock drain_lock;        // One reader at a time: flush thread or log_flush
+
+static FILE* log_file = NULL;
+static uint64_t started_at = 0;
+static bool initialized = false;
+static LightEvent log_wake;
+static Thread worker = NULL;
+static volatile bool running = false;
+
+static LogStats stats;
+static void (*flush_hook)(void) = NULL;
+
+static const char* const level_names[LOG_LEVEL_COUNT] = { "DEBUG", "INFO", "WARN", "ERROR" };
+
+void log_write(LogLevel level, const char* format, ...) {
+    if (level < LOG_MIN_LEVEL) {
+        return;
+    }
+
+    // Claim a position whose slot the reader has freed
+    uint32_t pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+    LogSlot* slot;
+    for (;;) {
+        slot = &ring[pos & LOG_MASK];
+        uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        int32_t diff = (int32_t)(seq - (pos & ~LOG_MASK));
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&head, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Still holds a record from the previous lap: the ring is full
+            __atomic_add_fetch(&stats.dropped, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->record.time = timing_now();
+    slot->record.level = level;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(slot->record.text, sizeof(slot->record.text), format, args);
+    va_end(args);
+
+    __atomic_store_n(&slot->seq, (pos & ~LOG_MASK) + 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&stats.written, 1, __ATOMIC_RELAXED);
+
+    // A burst filling half the ring drains early instead of dropping
+    if ((pos & (LOG_CAPACITY / 2 - 1)) == LOG_CAPACITY / 2 - 1 && running) {
+        LightEvent_Signal(&log_wake);
+    }
+}
+
+// Move every finished record out of the ring
+static void log_drain(void) {
+    int drained = 0;
+
+    LightLock_Lock(&drain_lock);
+    for (;;) {
+        LogSlot* slot = &ring[tail & LOG_MASK];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != (tail & ~LOG_MASK) + 1) {
+            break;
+        }
+        LogRecord record = slot->record;
+        __atomic_store_n(&slot->seq, (tail & ~LOG_MASK) + LOG_CAPACITY, __ATOMIC_RELEASE);
+        tail++;
+        drained++;
+
+        if (log_file) {
+            fprintf(log_file, "%9.3f %-5s %s\n", timing_ticks_to_ms(record.time - started_at) / 1000.0,
+                    level_names[record.level], record.text);
+        }
+
+        LightLock_Lock(&recent_lock);
+        recent[recent_next] = record;
+        recent_next = (recent_next + 1) % LOG_RECENT;
+        if (recent_count < LOG_RECENT) {
+            recent_count++;
+        }
+        LightLock_Unlock(&recent_lock);
+    }
+
+    if (drained > 0) {
+        if (log_file) {
+            fflush(log_file);
+        }
+        __atomic_add_fetch(&stats.flushed, drained, __ATOMIC_RELAXED);
+        // For the log pane
+        wake_request();
+    }
+    LightLock_Unlock(&drain_lock);
+}
+
+static void log_worker(void* arg) {
+    (void)arg;
+    while (running) {
+        LightEvent_WaitTimeout(&log_wake, (s64)LOG_FLUSH_MS * 1000000LL);
+        log_drain();
+        void (*hook)(void) = __atomic_load_n(&flush_hook, __ATOMIC_ACQUIRE);
+        if (hook) {
+            hook();
+        }
+    }
+}
+
+void log_set_flush_hook(void (*fn)(void)) {
+    __atomic_store_n(&flush_hook, fn, __ATOMIC_RELEASE);
+}
+
+bool log_init(const char* path) {
+    LightLock_Init(&recent_lock);
+    LightLock_Init(&drain_lock);
+    LightEvent_Init(&log_wake, RESET_ONESHOT);
+    recent_count = 0;
+    recent_next = 0;
+    started_at = timing_now();
+
+    log_file = NULL;
+    if (path) {
+        log_file = fopen(path, "a");
+        if (!log_file) {
+            printf("Failed to open %s\n", path);
+        } else {
+            fprintf(log_file, "--- session ---\n");
+        }
+    }
+    initialized = true;
+
+    // Run below the UI thread so writing the card never steals frames
+    s32 priority = 0x30;
+    svcGetThreadPriority(&priority, CUR_THREAD_HANDLE);
+
+    running = true;
+    worker = threadCreate(log_worker, NULL, LOG_STACK_SIZE, priority + 1, -2, false);
+    if (!worker) {
+        printf("Failed to start log flusher\n");
+        running = false;
+        return false;
+    }
+    return true;
+}
+
+void log_flush(void) {
+    if (initialized) {
+        log_drain();
+    }
+}
+
+int log_recent(LogRecord* out, int max) {
+    if (!initialized) {
+        return 0;
+    }
+
+    LightLock_Lock(&recent_lock);
+    int count = recent_count < max ? recent_count : max;
+    for (int i = 0; i < count; i++) {
+        out[i] = recent[(recent_next - count + i + LOG_RECENT) % LOG_RECENT];
+    }
+    LightLock_Unlock(&recent_lock);
+    return count;
+}
+
+const char* log_level_name(LogLevel level) {
+    return level >= 0 && level < LOG_LEVEL_COUNT ? level_names[level] : "?";
+}
+
+LogStats log_get_stats(void) {
+    LogStats snapshot;
+    snapshot.written = __atomic_load_n(&stats.written, __ATOMIC_RELAXED);
+    snapshot.dropped = __atomic_load_n(&stats.dropped, __ATOMIC_RELAXED);
+    snapshot.flushed = __atomic_load_n(&stats.flushed, __ATOMIC_RELAXED);
+    return snapshot;
+}
+
+void log_cleanup(void) {
+    if (worker) {
+        running = false;
+        LightEvent_Signal(&log_wake);
+        threadJoin(worker, U64_MAX);
+        threadFree(worker);
+        worker = NULL;
+    }
+
+    if (initialized) {
+        log_drain();
+    }
+    if (log_file) {
+        fclose(log_file);
+        log_file = NULL;
+    }
+    initialized = false;
+}
@@ -6,8 +6,56 @@
 
 #include "discord_api.h"
 #include "ui.h"
+#include "net_stats.h"
+#include "profiler.h"
+#include "mem.h"
+#include "outbox.h"
+#include "history.h"
+#include "switcher.h"
+#include "client_view.h"
+#include "job.h"
+#include "poller.h"
+#include "download.h"
+#include "image_cache.h"
+#include "log.h"
+#include "wake.h"
 
 #define TOKEN_FILE "sdmc:/3ds/discord_token.txt"
+#define NET_STATS_FILE "sdmc:/3ds/discord_netstats.csv"
+#define TRACE_FILE "sdmc:/3ds/discord_trace.json"
+#define RECORD_FILE "sdmc:/3ds/discord_session.rec"
+#define MEM_REPORT_FILE "sdmc:/3ds/discord_mem.txt"
+#define WATCH_FILE "sdmc:/3ds/discord_watch.txt"
+#define OUTBOX_FILE "sdmc:/3ds/discord_outbox.txt"
+#define LOG_FILE "sdmc:/3ds/discord_log.txt"
+#define DOWNLOAD_DIR "sdmc:/3ds/discord_files"
+#define IMAGE_ATLAS_FILE "sdmc:/3ds/discord_images.bin"
+#define SOC_BUFFER_SIZE 0x100000
+
+// Identical GETs this close together are answered from the first response
+#define REQUEST_DEBOUNCE_MS 1000
+
+// Set on resume from sleep or the HOME menu; the loop refreshes what is shown
+static volatile bool resumed = false;
+
+// Polling would only fail while the system sleeps or another app runs
+static void on_apt_event(APT_HookType hook, void* param) {
+    (void)param;
+    switch (hook) {
+        case APTHOOK_ONSUSPEND:
+        case APTHOOK_ONSLEEP:
+            poller_set_suspended(true);
+            break;
+        case APTHOOK_ONRESTORE:
+        case APTHOOK_ONWAKEUP:
+            poller_set_suspended(false);
+            resumed = true;
+            wake_request();
+            break;
+        default:
+            break;
+    }
+}
 
 // Read Discord token from file
 bool read_token(char* token, size_t max_len) {
@@ -34,17 +82,20 @@ bool read_token(char* token, size_t max_len) {
 int main(int argc, char* argv[]) {
     // Initialize services
     gfxInitDefault();
+    mem_init();
     
     // Initialize network
     Result ret = 0;
-    u32* soc_buffer = (u32*)memalign(0x1000, 0x100000);
+    u32* soc_buffer = (u32*)memalign(0x1000, SOC_BUFFER_SIZE);
     if (!soc_buffer) {
         printf("Failed to allocate SOC buffer\n");
         gfxExit();
         return 1;
     }
     
-    ret = socInit(soc_buffer, 0x100000);
+    mem_account(MEM_SYSTEM, SOC_BUFFER_SIZE);
+    
+    ret = socInit(soc_buffer, SOC_BUFFER_SIZE);
     if (R_FAILED(ret)) {
         printf("socInit failed: 0x%08lX\n", ret);
         free(soc_buffer);
@@ -59,7 +110,7 @@ int main(int argc, char* argv[]) {
     ui_init();
     
     // Allocate DiscordClient on heap to avoid stack overflow
-    DiscordClient* client = (DiscordClient*)malloc(sizeof(DiscordClient));
+    DiscordClient* client = (DiscordClient*)mem_alloc(MEM_MESSAGES, sizeof(DiscordClient));
     if (!client) {
         printf("Failed to allocate DiscordClient\n");
         ui_cleanup();
@@ -69,7 +120,8 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
-    UIState ui_state = {0};
+    UIState ui_state;
+    ui_state_init(&ui_state);
     char token[128] = {0};
     
     printf("Discord 3DS Client\n");
@@ -96,7 +148,7 @@ int main(int argc, char* argv[]) {
             gspWaitForVBlank();
         }
         
-        free(client);
+        mem_free(client);
         ui_cleanup();
         socExit();
         free(soc_buffer);
@@ -107,12 +159,48 @@ int main(int argc, char* argv[]) {
     printf("Token loaded!\n");
     printf("Initializing Discord client...\n");
     
-    discord_init(client, token);
+    // First, so the subsystems below can report through it
+    log_init(LOG_FILE);
+    
+    // The New 3DS has a free core (2) for parsing; the Old 3DS only has the
+    // time-limited system core, so parsing stays on the main thread there
+    bool is_new_3ds = false;
+    APT_CheckNew3DS(&is_new_3ds);
+    if (is_new_3ds) {
+        osSetSpeedupEnable(true);
+    }
+    job_system_init(is_new_3ds ? 1 : 0);
+    
+    profiler_init();
+    net_stats_init(NET_STATS_FILE);
+    history_init();
+    switcher_init();
+    client_view_init();
+    
+    Transport* transport = transport_curl_create(DISCORD_API_BASE);
+    
+    // Hold R while launching to record this session for replay on a PC
+    hidScanInput();
+    if (hidKeysHeld() & KEY_R) {
+        printf("Recording to %s\n", RECORD_FILE);
+        transport = transport_record_create(transport, RECORD_FILE);
+    }
+    transport = transport_coalesce_create(transport, REQUEST_DEBOUNCE_MS);
+    
+    discord_init(client, token, transport);
     
     printf("Connecting to Discord...\n");
     if (!discord_connect(client)) {
         printf("Failed to connect to Discord!\n");
         printf("Check your token and internet.\n");
+        
+        // Why, from the network layer's log
+        LogRecord records[LOG_RECENT];
+        log_flush();
+        int count = log_recent(records, 3);
+        for (int i = 0; i < count; i++) {
+            printf("\x1b[31m%s\x1b[0m\n", records[i].text);
+        }
         printf("\nPress START to exit.\n");
         
         while (aptMainLoop()) {
@@ -129,7 +217,13 @@ int main(int argc, char* argv[]) {
         }
         
         discord_cleanup(client);
-        free(client);
+        history_cleanup();
+        switcher_cleanup();
+        client_view_cleanup();
+        net_stats_cleanup();
+        job_system_cleanup();
+        log_cleanup();
+        mem_free(client);
         ui_cleanup();
         socExit();
         free(soc_buffer);
@@ -142,32 +236,117 @@ int main(int argc, char* argv[]) {
     // Initial data fetch
     discord_fetch_servers(client);
     discord_fetch_messages(client);
+    discord_fetch_users(client);
+    
+    // Start sending queued messages, including any left from last session
+    outbox_init(client, OUTBOX_FILE);
+    
+    // Watch the listed channels and every channel visited for new messages
+    poller_init(client, WATCH_FILE);
+    ui_mark_read(client);
     
-    // Main loop
+    // Save attachments to the SD card on request
+    download_init(client->transport, DOWNLOAD_DIR);
+    
+    // Server icons and avatars, kept on the card across sessions
+    image_cache_init(client->transport, DISCORD_CDN_BASE, IMAGE_ATLAS_FILE);
+    
+    // From here on B/START/L/R can interrupt a slow request
+    ui_attach(client, &ui_state);
+    
+    // Pause polling across sleep and the HOME menu
+    aptHookCookie apt_cookie;
+    aptHook(&apt_cookie, on_apt_event, NULL);
+    
+    // Main loop: input is read every iteration, but the screens are only
+    // drawn when something changed, and an idle loop sleeps between polls
+    wake_init();
     while (aptMainLoop()) {
+        PROFILE_ZONE("frame");
+        
         hidScanInput();
-        u32 kDown = hidKeysDown();
+        // Keys pressed during the last frame's requests come in late
+        u32 kDown = hidKeysDown() | ui_state.deferred_keys;
         u32 kHeld = hidKeysHeld();
+        ui_state.deferred_keys = 0;
         
-        if (kDown & KEY_START) {
+        if ((kDown & KEY_START) || ui_state.exit_requested) {
             break;
         }
         
         // Handle input
-        ui_handle_input(client, &ui_state, kDown, kHeld);
+        {
+            PROFILE_ZONE("input");
+            ui_handle_input(client, &ui_state, kDown, kHeld);
+            ui_resume_switch(client, &ui_state);
+        }
         
-        // Render UI
-        ui_render_top_screen(client, &ui_state);
-        ui_render_bottom_screen(client, &ui_state);
+        // Show messages the outbox got acknowledged
+        if (outbox_take_acked()) {
+            discord_refresh_messages(client);
+        }
+        // The poller saw new messages in the channel on screen
+        if (poller_take_focus_update() && discord_refresh_messages(client)) {
+            ui_mark_read(client);
+        }
+        // Back from sleep: the channel moved on without us
+        if (resumed) {
+            resumed = false;
+            if (discord_refresh_messages(client)) {
+                ui_mark_read(client);
+            }
+        }
+        // L/R during one of those fetches
+        ui_resume_switch(client, &ui_state);
+        if (ui_state.exit_requested) {
+            break;
+        }
         
-        gfxFlushBuffers();
-        gfxSwapBuffers();
-        gspWaitForVBlank();
+        // Overlays show live numbers, so they refresh even without changes
+        if (wake_begin_frame(kDown || kHeld, ui_state.overlay != UI_OVERLAY_NONE)) {
+            {
+                PROFILE_ZONE("render_top");
+                ui_render_top_screen(client, &ui_state);
+            }
+            {
+                PROFILE_ZONE("render_bottom");
+                ui_render_bottom_screen(client, &ui_state);
+            }
+            {
+                PROFILE_ZONE("present");
+                gfxFlushBuffers();
+                gfxSwapBuffers();
+            }
+        }
+        {
+            PROFILE_ZONE("vblank_wait");
+            wake_end_frame();
+        }
     }
+    aptUnhook(&apt_cookie);
     
     // Cleanup
+    image_cache_cleanup();
+    download_cleanup();
+    poller_cleanup();
+    outbox_cleanup();
+    profiler_dump(TRACE_FILE);
     discord_cleanup(client);
-    free(client);
+    history_cleanup();
+    switcher_cleanup();
+    client_view_cleanup();
+    net_stats_cleanup();
+    job_system_cleanup();
+    log_cleanup();
+    wake_cleanup();
+    mem_free(client);
+    
+    // Report heap usage per subsystem for this session
+    FILE* mem_report = fopen(MEM_REPORT_FILE, "w");
+    if (mem_report) {
+        mem_dump(mem_report);
+        fclose(mem_report);
+    }
     ui_cleanup();
     socExit();
     free(soc_buffer);
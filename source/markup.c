@@ -0,0 +1,278 @@
+#include "markup.h"
+#include <stdio.h>
+#include <string.h>
+
+typedef struct {
+    char* text;
+    size_t size;
+    size_t len;
+    MarkupSpans* spans;
+} MarkupBuilder;
+
+// Append n bytes of src drawn with style, extending the previous span when
+// it is identical and adjacent
+static void emit(MarkupBuilder* b, const char* src, size_t n, uint8_t style, uint8_t ref) {
+    if (n > b->size - 1 - b->len) {
+        n = b->size - 1 - b->len;
+    }
+    if (n == 0) {
+        return;
+    }
+    memcpy(b->text + b->len, src, n);
+
+    MarkupSpans* spans = b->spans;
+    if (style) {
+        MarkupSpan* last = spans->span_count ? &spans->spans[spans->span_count - 1] : NULL;
+        if (last && last->style == style && last->ref == ref && last->start + last->length == b->len) {
+            last->length += n;
+        } else if (spans->span_count < MARKUP_MAX_SPANS) {
+            spans->spans[spans->span_count++] = (MarkupSpan){ (uint8_t)b->len, (uint8_t)n, style, ref };
+        }
+    }
+    b->len += n;
+}
+
+static uint8_t add_ref(MarkupSpans* spans, uint64_t id) {
+    for (int i = 0; i < spans->ref_count; i++) {
+        if (spans->refs[i] == id) {
+            return (uint8_t)i;
+        }
+    }
+    if (spans->ref_count == MARKUP_MAX_REFS) {
+        return MARKUP_NO_REF;
+    }
+    spans->refs[spans->ref_count] = id;
+    return spans->ref_count++;
+}
+
+// Digits at p up to a closing '>'; returns the length through '>' or 0
+static size_t parse_snowflake(const char* p, uint64_t* id) {
+    size_t i = 0;
+    *id = 0;
+    while (p[i] >= '0' && p[i] <= '9') {
+        *id = *id * 10 + (uint64_t)(p[i] - '0');
+        i++;
+    }
+    return i > 0 && p[i] == '>' ? i + 1 : 0;
+}
+
+// <@id>, <@!id>, <@&id>, <#id>, <:name:id> or <a:name:id> at src; returns the
+// bytes consumed, or 0 if src is not one of them
+static size_t parse_reference(MarkupBuilder* b, const char* src, uint8_t style,
+                              MarkupResolveFn resolve, void* ctx) {
+    char display[72];
+    uint64_t id;
+    size_t used;
+    uint8_t kind = MARKUP_MENTION;
+
+    if (src[1] == '@') {
+        bool role = src[2] == '&';
+        size_t skip = (src[2] == '!' || role) ? 3 : 2;
+        if (!(used = parse_snowflake(src + skip, &id))) {
+            return 0;
+        }
+        used += skip;
+        const char* name = role ? NULL : (resolve ? resolve(id, ctx) : NULL);
+        snprintf(display, sizeof(display), "@%s", name ? name : (role ? "role" : "unknown"));
+    } else if (src[1] == '#') {
+        if (!(used = parse_snowflake(src + 2, &id))) {
+            return 0;
+        }
+        used += 2;
+        snprintf(display, sizeof(display), "#channel");
+    } else if (src[1] == ':' || (src[1] == 'a' && src[2] == ':')) {
+        const char* name = src + (src[1] == ':' ? 2 : 3);
+        const char* colon = strchr(name, ':');
+        if (!colon || colon == name || colon - name > 32 || !(used = parse_snowflake(colon + 1, &id))) {
+            return 0;
+        }
+        used += colon + 1 - src;
+        snprintf(display, sizeof(display), ":%.*s:", (int)(colon - name), name);
+        kind = MARKUP_EMOJI;
+    } else {
+        return 0;
+    }
+
+    emit(b, display, strlen(display), style | kind, add_ref(b->spans, id));
+    return used;
+}
+
+static bool is_word(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+}
+
+// Whether an italic run opened with c at p would be closed later
+static bool italic_closes(const char* p, char c) {
+    for (const char* q = strchr(p, c); q; q = strchr(q + 1, c)) {
+        if (c == '*' || !is_word(q[1])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Emit a ``` block; the language tag on its first line is dropped
+static void emit_code_block(MarkupBuilder* b, const char* body, size_t len, uint8_t style) {
+    size_t tag = 0;
+    while (tag < len && (is_word(body[tag]) || body[tag] == '+' || body[tag] == '-')) {
+        tag++;
+    }
+    if (tag < len && body[tag] == '\n') {
+        body += tag + 1;
+        len -= tag + 1;
+    }
+    if (len > 0 && body[len - 1] == '\n') {
+        len--;
+    }
+    emit(b, body, len, style | MARKUP_CODE, MARKUP_NO_REF);
+}
+
+void markup_parse(const char* src, char* text, size_t size, MarkupSpans* spans,
+                  MarkupResolveFn resolve, void* ctx) {
+    static const struct {
+        const char* delim;
+        uint8_t style;
+    } toggles[] = {
+        { "**", MARKUP_BOLD },
+        { "__", MARKUP_UNDERLINE },
+        { "~~", MARKUP_STRIKE },
+        { "||", MARKUP_SPOILER },
+    };
+
+    memset(spans, 0, sizeof(MarkupSpans));
+    if (size == 0) {
+        return;
+    }
+    if (size > 256) {
+        size = 256;
+    }
+    MarkupBuilder b = { text, size, 0, spans };
+    uint8_t style = 0;
+    char italic = 0;            // '*' or '_' that opened the italic run
+
+    for (size_t i = 0; src[i] != '\0' && b.len < size - 1;) {
+        const char* p = src + i;
+
+        // Most content has no markup at all: copy plain runs in one go
+        size_t plain = strcspn(p, "\\`<*_~|");
+        if (plain > 0) {
+            emit(&b, p, plain, style, MARKUP_NO_REF);
+            i += plain;
+            continue;
+        }
+
+        if (p[0] == '\\' && p[1] != '\0' && strchr("*_~|`\\<>:#", p[1])) {
+            emit(&b, p + 1, 1, style, MARKUP_NO_REF);
+            i += 2;
+            continue;
+        }
+        if (strncmp(p, "```", 3) == 0) {
+            const char* close = strstr(p + 3, "```");
+            if (close) {
+                emit_code_block(&b, p + 3, close - (p + 3), style);
+                i = close + 3 - src;
+                continue;
+            }
+        } else if (p[0] == '`') {
+            const char* close = strchr(p + 1, '`');
+            if (close) {
+                emit(&b, p + 1, close - (p + 1), style | MARKUP_CODE, MARKUP_NO_REF);
+                i = close + 1 - src;
+                continue;
+            }
+        } else if (p[0] == '<') {
+            size_t used = parse_reference(&b, p, style, resolve, ctx);
+            if (used) {
+                i += used;
+                continue;
+            }
+        }
+
+        // Paired delimiters only open when they are closed later on
+        bool toggled = false;
+        for (size_t t = 0; t < sizeof(toggles) / sizeof(toggles[0]); t++) {
+            if (strncmp(p, toggles[t].delim, 2) == 0 &&
+                ((style & toggles[t].style) || strstr(p + 2, toggles[t].delim))) {
+                style ^= toggles[t].style;
+                i += 2;
+                toggled = true;
+                break;
+            }
+        }
+        if (toggled) {
+            continue;
+        }
+        if (p[0] == '*' || p[0] == '_') {
+            // snake_case words are not italics
+            bool closes = italic == p[0] && !(p[0] == '_' && is_word(p[1]));
+            bool opens = !italic && p[1] != ' ' && p[1] != '\0' && p[1] != p[0] &&
+                         italic_closes(p + 1, p[0]) && !(p[0] == '_' && i > 0 && is_word(p[-1]));
+            if (closes || opens) {
+                style ^= MARKUP_ITALIC;
+                italic = opens ? p[0] : 0;
+                i++;
+                continue;
+            }
+        }
+
+        emit(&b, p, 1, style, MARKUP_NO_REF);
+        i++;
+    }
+    text[b.len] = '\0';
+}
+
+static void append(char* out, size_t size, size_t* pos, const char* src, size_t n) {
+    if (*pos + n > size - 1) {
+        n = size - 1 - *pos;
+    }
+    memcpy(out + *pos, src, n);
+    *pos += n;
+}
+
+// SGR parameters for each style bit, in MarkupStyle order
+static const char* const style_codes[] = {
+    "1",        // Bold
+    "3",        // Italic
+    "4",        // Underline
+    "9",        // Strike
+    "36",       // Code: cyan
+    "37;47",    // Spoiler: white on white, hidden
+    "1;34",     // Mention: bright blue
+    "33",       // Emoji: yellow
+};
+
+size_t markup_render(const char* text, const MarkupSpans* spans, char* out, size_t size) {
+    size_t pos = 0;
+    size_t at = 0;
+    size_t len = strlen(text);
+
+    if (size == 0) {
+        return 0;
+    }
+    for (int s = 0; s < spans->span_count; s++) {
+        const MarkupSpan* span = &spans->spans[s];
+        if (span->start + span->length > len) {
+            break;
+        }
+        append(out, size, &pos, text + at, span->start - at);
+
+        append(out, size, &pos, "\x1b[", 2);
+        bool first = true;
+        for (int bit = 0; bit < 8; bit++) {
+            if (span->style & (1 << bit)) {
+                if (!first) {
+                    append(out, size, &pos, ";", 1);
+                }
+                append(out, size, &pos, style_codes[bit], strlen(style_codes[bit]));
+                first = false;
+            }
+        }
+        append(out, size, &pos, "m", 1);
+        append(out, size, &pos, text + span->start, span->length);
+        append(out, size, &pos, "\x1b[0m", 4);
+        at = span->start + span->length;
+    }
+    append(out, size, &pos, text + at, len - at);
+    out[pos] = '\0';
+    return pos;
+}
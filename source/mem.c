@@ -0,0 +1,232 @@
+#include "mem.h"
+#include "log.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+
+#define MEM_MAGIC 0x4D454D31u
+#define MAX_EVICTORS 8
+
+// Prepended to each block; 16 bytes keeps the payload 8-byte aligned
+typedef struct {
+    size_t size;
+    uint32_t tag;
+    uint32_t magic;
+} __attribute__((aligned(8))) MemHeader;
+
+typedef struct {
+    MemEvictFn fn;
+    void* context;
+    MemTag tag;
+} MemEvictor;
+
+static MemStats stats[MEM_TAG_COUNT];
+static MemEvictor evictors[MAX_EVICTORS];
+static int evictor_count = 0;
+// Set while this thread runs the evictors. Per thread: it only stops an
+// evictor's own allocations from re-entering eviction, and other threads may
+// evict at the same time (evictors only try their locks).
+static __thread bool evicting = false;
+
+static const char* tag_names[MEM_TAG_COUNT] = {
+    "net", "json", "messages", "cache", "ui", "system"
+};
+
+void mem_init(void) {
+    memset(stats, 0, sizeof(stats));
+    stats[MEM_NET].budget = MEM_BUDGET_NET;
+    stats[MEM_JSON].budget = MEM_BUDGET_JSON;
+    stats[MEM_MESSAGES].budget = MEM_BUDGET_MESSAGES;
+    stats[MEM_CACHE].budget = MEM_BUDGET_CACHE;
+    stats[MEM_UI].budget = MEM_BUDGET_UI;
+}
+
+static void add_usage(MemTag tag, size_t size) {
+    size_t now = __atomic_add_fetch(&stats[tag].current, size, __ATOMIC_RELAXED);
+    size_t peak = __atomic_load_n(&stats[tag].peak, __ATOMIC_RELAXED);
+    while (now > peak &&
+           !__atomic_compare_exchange_n(&stats[tag].peak, &peak, now, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+// Run evictors for one tag, or all of them if tag is MEM_TAG_COUNT
+static size_t run_evictors(MemTag tag, size_t needed) {
+    // Evictors free memory through mem_free; never recurse into eviction
+    if (evicting) {
+        return 0;
+    }
+    evicting = true;
+
+    size_t released = 0;
+    for (int i = 0; i < evictor_count && released < needed; i++) {
+        if (tag == MEM_TAG_COUNT || evictors[i].tag == tag) {
+            released += evictors[i].fn(needed - released, evictors[i].context);
+        }
+    }
+
+    evicting = false;
+    return released;
+}
+
+// Make room in an over-budget subsystem before allocating more
+static void enforce_budget(MemTag tag, size_t size) {
+    size_t budget = stats[tag].budget;
+    size_t current = __atomic_load_n(&stats[tag].current, __ATOMIC_RELAXED);
+    if (budget > 0 && current + size > budget) {
+        __atomic_add_fetch(&stats[tag].evictions, 1, __ATOMIC_RELAXED);
+        run_evictors(tag, current + size - budget);
+    }
+}
+
+static void* finish_alloc(MemTag tag, MemHeader* header, size_t size) {
+    header->size = size;
+    header->tag = tag;
+    header->magic = MEM_MAGIC;
+    add_usage(tag, size);
+    __atomic_add_fetch(&stats[tag].allocations, 1, __ATOMIC_RELAXED);
+    return header + 1;
+}
+
+void* mem_alloc(MemTag tag, size_t size) {
+    enforce_budget(tag, size);
+
+    MemHeader* header = malloc(sizeof(MemHeader) + size);
+    if (!header && run_evictors(MEM_TAG_COUNT, size) > 0) {
+        header = malloc(sizeof(MemHeader) + size);
+    }
+    if (!header) {
+        __atomic_add_fetch(&stats[tag].failures, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    return finish_alloc(tag, header, size);
+}
+
+void* mem_calloc(MemTag tag, size_t count, size_t size) {
+    if (size != 0 && count > SIZE_MAX / size) {
+        return NULL;
+    }
+    void* ptr = mem_alloc(tag, count * size);
+    if (ptr) {
+        memset(ptr, 0, count * size);
+    }
+    return ptr;
+}
+
+void* mem_realloc(MemTag tag, void* ptr, size_t size) {
+    if (!ptr) {
+        return mem_alloc(tag, size);
+    }
+
+    MemHeader* header = (MemHeader*)ptr - 1;
+    size_t old_size = header->size;
+    MemTag old_tag = (MemTag)header->tag;
+    if (size > old_size) {
+        enforce_budget(tag, size - old_size);
+    }
+
+    MemHeader* grown = realloc(header, sizeof(MemHeader) + size);
+    if (!grown && run_evictors(MEM_TAG_COUNT, size) > 0) {
+        grown = realloc(header, sizeof(MemHeader) + size);
+    }
+    if (!grown) {
+        __atomic_add_fetch(&stats[tag].failures, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    __atomic_sub_fetch(&stats[old_tag].current, old_size, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&stats[tag].allocations, 1, __ATOMIC_RELAXED);
+    return finish_alloc(tag, grown, size);
+}
+
+void mem_free(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+
+    MemHeader* header = (MemHeader*)ptr - 1;
+    if (header->magic != MEM_MAGIC || header->tag >= MEM_TAG_COUNT) {
+        log_write(LOG_ERROR, "mem_free: block %p was not allocated by mem_alloc", ptr);
+        return;
+    }
+
+    __atomic_sub_fetch(&stats[header->tag].current, header->size, __ATOMIC_RELAXED);
+    header->magic = 0;
+    free(header);
+}
+
+void mem_account(MemTag tag, long delta) {
+    if (delta >= 0) {
+        add_usage(tag, (size_t)delta);
+        __atomic_add_fetch(&stats[tag].allocations, 1, __ATOMIC_RELAXED);
+    } else {
+        __atomic_sub_fetch(&stats[tag].current, (size_t)-delta, __ATOMIC_RELAXED);
+    }
+}
+
+void mem_set_budget(MemTag tag, size_t budget) {
+    if (tag < MEM_TAG_COUNT) {
+        stats[tag].budget = budget;
+    }
+}
+
+bool mem_register_evictor(MemTag tag, MemEvictFn fn, void* context) {
+    if (evictor_count >= MAX_EVICTORS || tag >= MEM_TAG_COUNT) {
+        return false;
+    }
+    evictors[evictor_count].fn = fn;
+    evictors[evictor_count].context = context;
+    evictors[evictor_count].tag = tag;
+    evictor_count++;
+    return true;
+}
+
+void mem_unregister_evictor(MemEvictFn fn, void* context) {
+    for (int i = 0; i < evictor_count; i++) {
+        if (evictors[i].fn == fn && evictors[i].context == context) {
+            evictors[i] = evictors[--evictor_count];
+            return;
+        }
+    }
+}
+
+MemStats mem_get_stats(MemTag tag) {
+    MemStats copy = {0};
+    if (tag < MEM_TAG_COUNT) {
+        copy = stats[tag];
+    }
+    return copy;
+}
+
+size_t mem_total_current(void) {
+    size_t total = 0;
+    for (int i = 0; i < MEM_TAG_COUNT; i++) {
+        total += stats[i].current;
+    }
+    return total;
+}
+
+const char* mem_tag_name(MemTag tag) {
+    if (tag >= MEM_TAG_COUNT) {
+        return "?";
+    }
+    return tag_names[tag];
+}
+
+void mem_dump(FILE* f) {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    size_t arena_in_use = mallinfo2().uordblks;
+#else
+    size_t arena_in_use = (size_t)mallinfo().uordblks;
+#endif
+
+    fprintf(f, "%-9s %10s %10s %8s %10s %6s %6s\n",
+            "subsystem", "current", "peak", "allocs", "budget", "evict", "fail");
+    for (int i = 0; i < MEM_TAG_COUNT; i++) {
+        fprintf(f, "%-9s %10zu %10zu %8zu %10zu %6zu %6zu\n", tag_names[i],
+                stats[i].current, stats[i].peak, stats[i].allocations,
+                stats[i].budget, stats[i].evictions, stats[i].failures);
+    }
+    fprintf(f, "accounted %zu bytes, malloc arena in use %zu bytes\n",
+            mem_total_current(), arena_in_use);
+}
@@ -0,0 +1,120 @@
+#include "multipart.h"
+#include "timing.h"
+#include "log.h"
+#include <string.h>
+#include <sys/stat.h>
+
+// Copy the part of a fixed segment from offset on into buffer
+static size_t copy_segment(const char* segment, size_t segment_len, uint64_t offset,
+                           char* buffer, size_t size) {
+    size_t left = segment_len - (size_t)offset;
+    size_t take = left < size ? left : size;
+    memcpy(buffer, segment + offset, take);
+    return take;
+}
+
+bool multipart_open(MultipartBody* body, const char* path, const char* filename,
+                    MultipartJsonFn json, void* json_ctx) {
+    memset(body, 0, sizeof(MultipartBody));
+
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        log_write(LOG_ERROR, "Failed to stat %s", path);
+        return false;
+    }
+    body->file = fopen(path, "rb");
+    if (!body->file) {
+        log_write(LOG_ERROR, "Failed to open %s", path);
+        return false;
+    }
+    body->file_size = (uint64_t)st.st_size;
+    body->json = json;
+    body->json_ctx = json_ctx;
+
+    // Measure payload_json without keeping it
+    JsonWriter writer;
+    json_writer_init(&writer, NULL, 0);
+    json(&writer, json_ctx);
+    if (!json_writer_finish(&writer)) {
+        log_write(LOG_WARN, "Upload payload is malformed");
+        multipart_close(body);
+        return false;
+    }
+    body->json_len = writer.length;
+
+    // The header is quoted, so keep quotes and line breaks out of the name
+    char safe_name[96];
+    snprintf(safe_name, sizeof(safe_name), "%s", filename);
+    for (char* c = safe_name; *c; c++) {
+        if (*c == '"' || *c == '\\' || *c == '\r' || *c == '\n') {
+            *c = '_';
+        }
+    }
+
+    char boundary[40];
+    snprintf(boundary, sizeof(boundary), "Discord3DS%016llx", (unsigned long long)timing_now());
+    snprintf(body->content_type, sizeof(body->content_type), "multipart/form-data; boundary=%s", boundary);
+
+    body->json_head_len = (size_t)snprintf(body->json_head, sizeof(body->json_head),
+        "--%s\r\nContent-Disposition: form-data; name=\"payload_json\"\r\n"
+        "Content-Type: application/json\r\n\r\n", boundary);
+    body->file_head_len = (size_t)snprintf(body->file_head, sizeof(body->file_head),
+        "\r\n--%s\r\nContent-Disposition: form-data; name=\"files[0]\"; filename=\"%s\"\r\n"
+        "Content-Type: application/octet-stream\r\n\r\n", boundary, safe_name);
+    body->tail_len = (size_t)snprintf(body->tail, sizeof(body->tail), "\r\n--%s--\r\n", boundary);
+
+    body->length = body->json_head_len + body->json_len + body->file_head_len + body->file_size + body->tail_len;
+    return true;
+}
+
+bool multipart_read(char* buffer, size_t size, size_t* length, void* ctx) {
+    MultipartBody* body = (MultipartBody*)ctx;
+    uint64_t json_at = body->json_head_len;
+    uint64_t file_head_at = json_at + body->json_len;
+    uint64_t file_at = file_head_at + body->file_head_len;
+    uint64_t tail_at = file_at + body->file_size;
+    size_t filled = 0;
+
+    while (filled < size && body->offset < body->length) {
+        uint64_t at = body->offset;
+        char* out = buffer + filled;
+        size_t room = size - filled;
+        size_t got;
+
+        if (at < json_at) {
+            got = copy_segment(body->json_head, body->json_head_len, at, out, room);
+        } else if (at < file_head_at) {
+            // Write payload_json again, keeping only this slice
+            JsonWriter writer;
+            size_t skip = (size_t)(at - json_at);
+            json_writer_init_window(&writer, out, room, skip);
+            body->json(&writer, body->json_ctx);
+            got = body->json_len - skip < room ? body->json_len - skip : room;
+        } else if (at < file_at) {
+            got = copy_segment(body->file_head, body->file_head_len, at - file_head_at, out, room);
+        } else if (at < tail_at) {
+            uint64_t left = tail_at - at;
+            size_t want = left < room ? (size_t)left : room;
+            got = fread(out, 1, want, body->file);
+            if (got != want) {
+                // Shorter than it was when the request started
+                log_write(LOG_ERROR, "Upload file could not be read");
+                return false;
+            }
+        } else {
+            got = copy_segment(body->tail, body->tail_len, at - tail_at, out, room);
+        }
+        body->offset += got;
+        filled += got;
+    }
+
+    *length = filled;
+    return true;
+}
+
+void multipart_close(MultipartBody* body) {
+    if (body->file) {
+        fclose(body->file);
+        body->file = NULL;
+    }
+}
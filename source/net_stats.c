@@ -0,0 +1,208 @@
+#include "net_stats.h"
+#include "log.h"
+#include <string.h>
+#include <time.h>
+#include <3ds.h>
+
+static NetSample window[NET_STATS_WINDOW];
+static int window_next = 0;
+static int total_samples = 0;
+
+// Percentiles are recomputed when a sample is recorded, not per frame
+static double cached_p50[NET_METRIC_COUNT];
+static double cached_p95[NET_METRIC_COUNT];
+
+// Samples are recorded from the main loop and from every worker that makes
+// requests (outbox, poller, downloads, images)
+static LightLock stats_lock;
+
+// CSV rows wait here, under stats_lock, so no request waits on the SD card
+typedef struct {
+    NetSample sample;
+    long time;
+} CsvRow;
+
+static CsvRow csv_pending[NET_STATS_CSV_PENDING];
+static int csv_pending_count = 0;
+
+// One writer at a time, and the batch it writes
+static LightLock csv_lock;
+static CsvRow csv_batch[NET_STATS_CSV_PENDING];
+
+static FILE* csv_file = NULL;
+static long session_id = 0;
+
+static void net_stats_flush_csv(void);
+
+static const char* metric_names[NET_METRIC_COUNT] = {
+    "DNS", "TCP", "TLS", "Srv", "Total", "Parse", "Extr"
+};
+
+void net_stats_init(const char* csv_path) {
+    LightLock_Init(&stats_lock);
+    LightLock_Init(&csv_lock);
+    csv_pending_count = 0;
+    memset(window, 0, sizeof(window));
+    window_next = 0;
+    total_samples = 0;
+    memset(cached_p50, 0, sizeof(cached_p50));
+    memset(cached_p95, 0, sizeof(cached_p95));
+    session_id = (long)time(NULL);
+
+    if (!csv_path) {
+        return;
+    }
+
+    csv_file = fopen(csv_path, "a");
+    if (!csv_file) {
+        printf("Failed to open %s\n", csv_path);
+        return;
+    }
+
+    // Write the header only for a fresh file
+    fseek(csv_file, 0, SEEK_END);
+    if (ftell(csv_file) == 0) {
+        fprintf(csv_file, "session,time,method,endpoint,ok,status,"
+                          "namelookup_ms,connect_ms,appconnect_ms,starttransfer_ms,total_ms,"
+                          "bytes_down,bytes_up,parse_ms,extract_ms,aborted,abort_ms,coalesced\n");
+    }
+    log_set_flush_hook(net_stats_flush_csv);
+}
+
+void net_stats_begin(NetSample* sample, const char* method, const char* endpoint) {
+    memset(sample, 0, sizeof(NetSample));
+    strncpy(sample->method, method, sizeof(sample->method) - 1);
+    strncpy(sample->endpoint, endpoint, sizeof(sample->endpoint) - 1);
+}
+
+double net_stats_metric(const NetSample* sample, NetMetric metric) {
+    double connected = sample->appconnect_ms > 0 ? sample->appconnect_ms : sample->connect_ms;
+
+    switch (metric) {
+        case NET_METRIC_DNS:
+            return sample->namelookup_ms;
+        case NET_METRIC_CONNECT:
+            return sample->connect_ms > sample->namelookup_ms ? sample->connect_ms - sample->namelookup_ms : 0;
+        case NET_METRIC_TLS:
+            return sample->appconnect_ms > sample->connect_ms ? sample->appconnect_ms - sample->connect_ms : 0;
+        case NET_METRIC_SERVER:
+            return sample->starttransfer_ms > connected ? sample->starttransfer_ms - connected : 0;
+        case NET_METRIC_TOTAL:
+            return sample->total_ms;
+        case NET_METRIC_PARSE:
+            return sample->parse_ms;
+        case NET_METRIC_EXTRACT:
+            return sample->extract_ms;
+        default:
+            return 0;
+    }
+}
+
+static void update_percentiles(void) {
+    int count = total_samples < NET_STATS_WINDOW ? total_samples : NET_STATS_WINDOW;
+    double values[NET_STATS_WINDOW];
+
+    for (int m = 0; m < NET_METRIC_COUNT; m++) {
+        // Insertion sort, the window is tiny
+        for (int i = 0; i < count; i++) {
+            double v = net_stats_metric(&window[i], (NetMetric)m);
+            int j = i;
+            while (j > 0 && values[j - 1] > v) {
+                values[j] = values[j - 1];
+                j--;
+            }
+            values[j] = v;
+        }
+
+        cached_p50[m] = values[(count - 1) * 50 / 100];
+        cached_p95[m] = values[(count - 1) * 95 / 100];
+    }
+}
+
+// Write the queued rows; runs on the log's flush thread, and on a recording
+// thread only when the queue filled up before the flush thread came by
+static void net_stats_flush_csv(void) {
+    LightLock_Lock(&csv_lock);
+    LightLock_Lock(&stats_lock);
+    int count = csv_pending_count;
+    memcpy(csv_batch, csv_pending, count * sizeof(CsvRow));
+    csv_pending_count = 0;
+    LightLock_Unlock(&stats_lock);
+
+    for (int i = 0; i < count && csv_file; i++) {
+        const NetSample* s = &csv_batch[i].sample;
+        fprintf(csv_file, "%ld,%ld,%s,%s,%d,%ld,%.3f,%.3f,%.3f,%.3f,%.3f,%lld,%lld,%.3f,%.3f,%d,%.3f,%d\n",
+                session_id, csv_batch[i].time, s->method, s->endpoint, s->ok ? 1 : 0, s->http_status,
+                s->namelookup_ms, s->connect_ms, s->appconnect_ms, s->starttransfer_ms, s->total_ms,
+                s->bytes_down, s->bytes_up, s->parse_ms, s->extract_ms, s->aborted ? 1 : 0, s->abort_ms,
+                s->coalesced ? 1 : 0);
+    }
+    if (count > 0 && csv_file) {
+        fflush(csv_file);
+    }
+    LightLock_Unlock(&csv_lock);
+}
+
+void net_stats_record(const NetSample* sample) {
+    LightLock_Lock(&stats_lock);
+    window[window_next] = *sample;
+    window_next = (window_next + 1) % NET_STATS_WINDOW;
+    total_samples++;
+
+    update_percentiles();
+    bool full = false;
+    if (csv_file) {
+        csv_pending[csv_pending_count].sample = *sample;
+        csv_pending[csv_pending_count].time = (long)time(NULL);
+        full = ++csv_pending_count == NET_STATS_CSV_PENDING;
+    }
+    LightLock_Unlock(&stats_lock);
+
+    if (full) {
+        net_stats_flush_csv();
+    }
+}
+
+bool net_stats_percentiles(NetMetric metric, double* p50, double* p95) {
+    if (total_samples == 0 || metric < 0 || metric >= NET_METRIC_COUNT) {
+        return false;
+    }
+
+    LightLock_Lock(&stats_lock);
+    *p50 = cached_p50[metric];
+    *p95 = cached_p95[metric];
+    LightLock_Unlock(&stats_lock);
+    return true;
+}
+
+int net_stats_sample_count(void) {
+    return total_samples;
+}
+
+bool net_stats_last(NetSample* out) {
+    LightLock_Lock(&stats_lock);
+    bool any = total_samples > 0;
+    if (any) {
+        *out = window[(window_next + NET_STATS_WINDOW - 1) % NET_STATS_WINDOW];
+    }
+    LightLock_Unlock(&stats_lock);
+    return any;
+}
+
+const char* net_stats_metric_name(NetMetric metric) {
+    if (metric < 0 || metric >= NET_METRIC_COUNT) {
+        return "?";
+    }
+    return metric_names[metric];
+}
+
+void net_stats_cleanup(void) {
+    log_set_flush_hook(NULL);
+    if (csv_file) {
+        net_stats_flush_csv();
+        LightLock_Lock(&csv_lock);
+        fclose(csv_file);
+        csv_file = NULL;
+        LightLock_Unlock(&csv_lock);
+    }
+}
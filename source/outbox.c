@@ -0,0 +1,482 @@
+#include "outbox.h"
+#include "timing.h"
+#include "profiler.h"
+#include "log.h"
+#include "wake.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <3ds.h>
+
+// Persisted format, one entry per block (content is raw bytes):
+//
+//   NONCE CHANNEL_ID STATE ATTEMPTS CONTENT_LENGTH [PATH_LENGTH]
+//   <content>
+//   [<file path>]
+//
+// PATH_LENGTH and the path line are only there for uploads.
+
+#define OUTBOX_LATENCY_WINDOW 64
+#define OUTBOX_STACK_SIZE (64 * 1024)
+
+// Discord snowflakes count milliseconds from 2015-01-01
+#define DISCORD_EPOCH_MS 1420070400000ULL
+
+static OutboxEntry entries[OUTBOX_CAPACITY];
+static int entry_count = 0;
+
+static DiscordClient* outbox_client = NULL;
+static char outbox_path[128];
+static LightLock outbox_lock;
+static LightEvent outbox_wake;
+static Thread worker = NULL;
+static volatile bool running = false;
+static CancelToken* in_flight = NULL;     // Send to abort on cleanup
+static bool acked = false;
+static uint32_t nonce_sequence = 0;
+
+static OutboxStats stats;
+static double latencies[OUTBOX_LATENCY_WINDOW];
+static int latency_count = 0;
+
+// Rewrite the queue file; called with outbox_lock held
+static void outbox_save(void) {
+    if (outbox_path[0] == '\0') {
+        return;
+    }
+
+    char tmp_path[sizeof(outbox_path) + 4];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", outbox_path);
+
+    FILE* f = fopen(tmp_path, "wb");
+    if (!f) {
+        log_write(LOG_ERROR, "Failed to open %s", tmp_path);
+        return;
+    }
+    for (int i = 0; i < entry_count; i++) {
+        OutboxEntry* entry = &entries[i];
+        // An interrupted send is retried on the next launch
+        int state = entry->state == OUTBOX_FAILED ? OUTBOX_FAILED : OUTBOX_PENDING;
+        fprintf(f, "%s %s %d %d %zu", entry->nonce, entry->channel_id, state,
+                entry->attempts, strlen(entry->content));
+        if (entry->file_path[0] != '\0') {
+            fprintf(f, " %zu", strlen(entry->file_path));
+        }
+        fputc('\n', f);
+        fputs(entry->content, f);
+        fputc('\n', f);
+        if (entry->file_path[0] != '\0') {
+            fputs(entry->file_path, f);
+            fputc('\n', f);
+        }
+    }
+    fclose(f);
+
+    remove(outbox_path);
+    rename(tmp_path, outbox_path);
+}
+
+static void outbox_load(void) {
+    FILE* f = fopen(outbox_path, "rb");
+    if (!f) {
+        return;
+    }
+
+    while (entry_count < OUTBOX_CAPACITY) {
+        OutboxEntry* entry = &entries[entry_count];
+        int state = 0;
+        size_t len = 0;
+        size_t path_len = 0;
+
+        memset(entry, 0, sizeof(OutboxEntry));
+        if (fscanf(f, "%23s %31s %d %d %zu", entry->nonce, entry->channel_id, &state,
+                   &entry->attempts, &len) != 5 || len >= sizeof(entry->content)) {
+            break;
+        }
+        int c = fgetc(f);
+        if (c == ' ' && (fscanf(f, "%zu", &path_len) != 1 || path_len >= sizeof(entry->file_path))) {
+            break;
+        }
+        if ((c == ' ' && fgetc(f) != '\n') || (c != ' ' && c != '\n')) {
+            break;
+        }
+        if (fread(entry->content, 1, len, f) != len) {
+            break;
+        }
+        fgetc(f); // trailing newline
+        if (path_len > 0) {
+            if (fread(entry->file_path, 1, path_len, f) != path_len) {
+                break;
+            }
+            fgetc(f);
+        }
+
+        entry->content[len] = '\0';
+        entry->file_path[path_len] = '\0';
+        entry->state = state == OUTBOX_FAILED ? OUTBOX_FAILED : OUTBOX_PENDING;
+        entry->queued_at = timing_now();
+        entry->next_attempt_at = entry->queued_at;
+        entry_count++;
+    }
+    fclose(f);
+
+    if (entry_count > 0) {
+        log_write(LOG_INFO, "Outbox: %d unsent message(s)", entry_count);
+    }
+}
+
+// Snowflake-style nonce, unique per client and roughly time ordered
+static void make_nonce(char* nonce, size_t size) {
+    uint64_t ms = (uint64_t)time(NULL) * 1000ULL;
+    uint64_t id = ((ms - DISCORD_EPOCH_MS) << 22) | (nonce_sequence++ & 0x3FFFFF);
+    snprintf(nonce, size, "%llu", (unsigned long long)id);
+}
+
+static int find_entry(const char* nonce) {
+    for (int i = 0; i < entry_count; i++) {
+        if (strcmp(entries[i].nonce, nonce) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void remove_entry(int index) {
+    memmove(&entries[index], &entries[index + 1], (entry_count - index - 1) * sizeof(OutboxEntry));
+    entry_count--;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Called with outbox_lock held
+static void record_latency(double ms) {
+    latencies[latency_count % OUTBOX_LATENCY_WINDOW] = ms;
+    latency_count++;
+    stats.last_latency_ms = ms;
+
+    int count = latency_count < OUTBOX_LATENCY_WINDOW ? latency_count : OUTBOX_LATENCY_WINDOW;
+    double sorted[OUTBOX_LATENCY_WINDOW];
+    memcpy(sorted, latencies, count * sizeof(double));
+    qsort(sorted, count, sizeof(double), compare_doubles);
+    stats.p50_latency_ms = sorted[(count - 1) / 2];
+    stats.p95_latency_ms = sorted[(count - 1) * 95 / 100];
+}
+
+// Exponential backoff with +-25% jitter so retries don't move in lockstep
+static uint32_t backoff_ms(int attempts) {
+    uint32_t delay = OUTBOX_RETRY_BASE_MS;
+    for (int i = 1; i < attempts && delay < OUTBOX_RETRY_MAX_MS; i++) {
+        delay *= 2;
+    }
+    if (delay > OUTBOX_RETRY_MAX_MS) {
+        delay = OUTBOX_RETRY_MAX_MS;
+    }
+    uint32_t spread = delay / 2;
+    if (spread > 0) {
+        delay = delay - delay / 4 + (uint32_t)(timing_now() % spread);
+    }
+    return delay;
+}
+
+// Retry timeouts, rate limits and server errors; anything else is final
+static bool status_is_retryable(long status) {
+    return status == 0 || status == 408 || status == 429 || status >= 500;
+}
+
+// Upload progress of the entry whose nonce is ctx; redraws on each percent
+static void on_upload_progress(uint64_t sent, uint64_t total, void* ctx) {
+    bool changed = false;
+
+    LightLock_Lock(&outbox_lock);
+    int index = find_entry((const char*)ctx);
+    if (index >= 0) {
+        OutboxEntry* entry = &entries[index];
+        changed = entry->total != total || sent * 100 / total != entry->sent * 100 / total;
+        entry->sent = sent;
+        entry->total = total;
+    }
+    LightLock_Unlock(&outbox_lock);
+
+    if (changed) {
+        wake_request();
+    }
+}
+
+static void outbox_worker(void* arg) {
+    (void)arg;
+
+    while (running) {
+        OutboxEntry send;
+        int64_t wait_ns = -1;
+        bool have_entry = false;
+
+        LightLock_Lock(&outbox_lock);
+        // Strict FIFO: a message waiting for its retry holds back later ones
+        // so the channel keeps the order they were typed in
+        for (int i = 0; i < entry_count; i++) {
+            if (entries[i].state != OUTBOX_PENDING) {
+                continue;
+            }
+            uint64_t now = timing_now();
+            if (entries[i].next_attempt_at <= now) {
+                entries[i].state = OUTBOX_SENDING;
+                send = entries[i];
+                have_entry = true;
+            } else {
+                wait_ns = (int64_t)(timing_ticks_to_us(entries[i].next_attempt_at - now) * 1000.0);
+            }
+            break;
+        }
+        LightLock_Unlock(&outbox_lock);
+
+        if (!have_entry) {
+            if (wait_ns < 0) {
+                LightEvent_Wait(&outbox_wake);
+            } else {
+                LightEvent_WaitTimeout(&outbox_wake, wait_ns);
+            }
+            continue;
+        }
+
+        // An upload takes as long as the file needs; only a stall ends it
+        bool upload = send.file_path[0] != '\0';
+        CancelToken cancel;
+        cancel_token_init(&cancel, upload ? 0 : DISCORD_REQUEST_TIMEOUT_MS);
+        LightLock_Lock(&outbox_lock);
+        in_flight = &cancel;
+        LightLock_Unlock(&outbox_lock);
+
+        double retry_after_s = 0;
+        long status;
+        if (upload) {
+            PROFILE_ZONE("outbox_upload");
+            status = discord_upload_file(outbox_client, send.channel_id, send.content, send.file_path,
+                                         send.nonce, &cancel, on_upload_progress, send.nonce, &retry_after_s);
+        } else {
+            PROFILE_ZONE("outbox_send");
+            status = discord_post_message(outbox_client, send.channel_id, send.content,
+                                          send.nonce, &cancel, &retry_after_s);
+        }
+
+        LightLock_Lock(&outbox_lock);
+        in_flight = NULL;
+        int index = find_entry(send.nonce);
+        if (index >= 0 && upload && cancel.cancelled && !cancel.expired && running) {
+            // Cancelled from the UI rather than by shutdown
+            log_write(LOG_INFO, "Upload cancelled");
+            remove_entry(index);
+            outbox_save();
+            wake_request();
+        } else if (index >= 0) {
+            OutboxEntry* entry = &entries[index];
+            entry->attempts++;
+            entry->sent = 0;
+            entry->last_status = status;
+            if (entry->attempts > 1) {
+                stats.retries++;
+            }
+
+            if (status >= 200 && status < 300) {
+                record_latency(timing_ticks_to_ms(timing_now() - entry->queued_at));
+                stats.sent++;
+                remove_entry(index);
+                acked = true;
+            } else if (status_is_retryable(status)) {
+                uint32_t delay = backoff_ms(entry->attempts);
+                if (status == 429 && retry_after_s * 1000.0 > delay) {
+                    delay = (uint32_t)(retry_after_s * 1000.0);
+                }
+                entry->state = OUTBOX_PENDING;
+                entry->next_attempt_at = timing_now() + (uint64_t)delay * TIMING_TICKS_PER_SEC / 1000;
+            } else {
+                entry->state = OUTBOX_FAILED;
+                stats.failed++;
+            }
+            outbox_save();
+            // The entry's state line on the top screen changed
+            wake_request();
+        }
+        LightLock_Unlock(&outbox_lock);
+    }
+}
+
+bool outbox_init(DiscordClient* client, const char* path) {
+    LightLock_Init(&outbox_lock);
+    LightEvent_Init(&outbox_wake, RESET_ONESHOT);
+
+    outbox_client = client;
+    entry_count = 0;
+    acked = false;
+    latency_count = 0;
+    memset(&stats, 0, sizeof(stats));
+    nonce_sequence = (uint32_t)timing_now();
+
+    outbox_path[0] = '\0';
+    if (path) {
+        strncpy(outbox_path, path, sizeof(outbox_path) - 1);
+        outbox_path[sizeof(outbox_path) - 1] = '\0';
+        outbox_load();
+    }
+
+    // Run below the UI thread so sends never steal frames
+    s32 priority = 0x30;
+    svcGetThreadPriority(&priority, CUR_THREAD_HANDLE);
+
+    running = true;
+    worker = threadCreate(outbox_worker, NULL, OUTBOX_STACK_SIZE, priority + 1, -2, false);
+    if (!worker) {
+        log_write(LOG_ERROR, "Failed to start outbox worker");
+        running = false;
+        return false;
+    }
+    return true;
+}
+
+// Add an entry; path may be NULL for text only
+static bool outbox_add(const char* channel_id, const char* content, const char* path) {
+    LightLock_Lock(&outbox_lock);
+    if (entry_count == OUTBOX_CAPACITY) {
+        LightLock_Unlock(&outbox_lock);
+        return false;
+    }
+
+    OutboxEntry* entry = &entries[entry_count++];
+    memset(entry, 0, sizeof(OutboxEntry));
+    make_nonce(entry->nonce, sizeof(entry->nonce));
+    strncpy(entry->channel_id, channel_id, sizeof(entry->channel_id) - 1);
+    strncpy(entry->content, content, sizeof(entry->content) - 1);
+    if (path) {
+        strncpy(entry->file_path, path, sizeof(entry->file_path) - 1);
+    }
+    entry->state = OUTBOX_PENDING;
+    entry->queued_at = timing_now();
+    entry->next_attempt_at = entry->queued_at;
+
+    // Persist before sending so a crash mid-request can't lose the text
+    outbox_save();
+    LightLock_Unlock(&outbox_lock);
+    wake_request();
+
+    LightEvent_Signal(&outbox_wake);
+    return true;
+}
+
+bool outbox_enqueue(const char* channel_id, const char* content) {
+    if (!channel_id || channel_id[0] == '\0' || !content || content[0] == '\0') {
+        return false;
+    }
+    return outbox_add(channel_id, content, NULL);
+}
+
+bool outbox_enqueue_file(const char* channel_id, const char* content, const char* path) {
+    if (!channel_id || channel_id[0] == '\0' || !path || path[0] == '\0' ||
+        strlen(path) >= sizeof(((OutboxEntry*)0)->file_path)) {
+        return false;
+    }
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+    fclose(f);
+    return outbox_add(channel_id, content ? content : "", path);
+}
+
+bool outbox_cancel_upload(const char* channel_id) {
+    bool found = false;
+
+    LightLock_Lock(&outbox_lock);
+    for (int i = 0; i < entry_count && !found; i++) {
+        OutboxEntry* entry = &entries[i];
+        if (entry->file_path[0] == '\0' || strcmp(entry->channel_id, channel_id) != 0) {
+            continue;
+        }
+        found = true;
+        if (entry->state == OUTBOX_SENDING) {
+            // The worker drops the entry once the transfer stops
+            if (in_flight) {
+                cancel_token_cancel(in_flight);
+            }
+        } else {
+            remove_entry(i);
+            outbox_save();
+        }
+    }
+    LightLock_Unlock(&outbox_lock);
+
+    if (found) {
+        wake_request();
+    }
+    return found;
+}
+
+int outbox_list(const char* channel_id, OutboxEntry* out, int max) {
+    int count = 0;
+
+    LightLock_Lock(&outbox_lock);
+    for (int i = 0; i < entry_count && count < max; i++) {
+        if (strcmp(entries[i].channel_id, channel_id) == 0) {
+            out[count++] = entries[i];
+        }
+    }
+    LightLock_Unlock(&outbox_lock);
+    return count;
+}
+
+bool outbox_take_failed(const char* channel_id, char* buffer, size_t size) {
+    bool found = false;
+
+    LightLock_Lock(&outbox_lock);
+    for (int i = entry_count - 1; i >= 0; i--) {
+        if (entries[i].state == OUTBOX_FAILED && entries[i].file_path[0] == '\0' &&
+            strcmp(entries[i].channel_id, channel_id) == 0) {
+            snprintf(buffer, size, "%s", entries[i].content);
+            remove_entry(i);
+            outbox_save();
+            found = true;
+            break;
+        }
+    }
+    LightLock_Unlock(&outbox_lock);
+    return found;
+}
+
+bool outbox_take_acked(void) {
+    LightLock_Lock(&outbox_lock);
+    bool result = acked;
+    acked = false;
+    LightLock_Unlock(&outbox_lock);
+    return result;
+}
+
+OutboxStats outbox_get_stats(void) {
+    LightLock_Lock(&outbox_lock);
+    OutboxStats result = stats;
+    result.depth = entry_count;
+    LightLock_Unlock(&outbox_lock);
+    return result;
+}
+
+void outbox_cleanup(void) {
+    if (worker) {
+        // Abandon a send in progress; it stays queued and retries next launch
+        LightLock_Lock(&outbox_lock);
+        running = false;
+        if (in_flight) {
+            cancel_token_cancel(in_flight);
+        }
+        LightLock_Unlock(&outbox_lock);
+        LightEvent_Signal(&outbox_wake);
+        threadJoin(worker, U64_MAX);
+        threadFree(worker);
+        worker = NULL;
+    }
+
+    LightLock_Lock(&outbox_lock);
+    outbox_save();
+    LightLock_Unlock(&outbox_lock);
+    outbox_client = NULL;
+}
@@ -0,0 +1,298 @@
+#include "png.h"
+#include "mem.h"
+#include <string.h>
+#include <zlib.h>
+
+#define PNG_COLOR_GREY 0
+#define PNG_COLOR_RGB 2
+#define PNG_COLOR_PALETTE 3
+#define PNG_COLOR_GREY_ALPHA 4
+#define PNG_COLOR_RGBA 6
+
+static const uint8_t png_signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+// Decoder state between IDAT chunks
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    int depth;
+    int color_type;
+    int channels;
+    size_t stride;              // Bytes of one row, without its filter byte
+    size_t bpp;                 // Bytes per pixel for the filters, at least 1
+
+    uint8_t palette[256][4];
+    int palette_size;
+
+    z_stream z;
+    uint8_t* row;               // Filter byte + stride, being inflated
+    uint8_t* prev;              // Previous row after unfiltering
+    size_t row_fill;
+    uint32_t y;
+    uint8_t* out;
+} PngDecoder;
+
+static voidpf zlib_alloc(voidpf opaque, uInt items, uInt size) {
+    (void)opaque;
+    return mem_alloc(MEM_NET, (size_t)items * size);
+}
+
+static void zlib_free(voidpf opaque, voidpf ptr) {
+    (void)opaque;
+    mem_free(ptr);
+}
+
+static uint32_t read_be32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint8_t paeth(uint8_t a, uint8_t b, uint8_t c) {
+    int p = (int)a + b - c;
+    int pa = p > a ? p - a : a - p;
+    int pb = p > b ? p - b : b - p;
+    int pc = p > c ? p - c : c - p;
+    if (pa <= pb && pa <= pc) {
+        return a;
+    }
+    return pb <= pc ? b : c;
+}
+
+// Undo the row's filter in place against the previous row
+static bool unfilter_row(PngDecoder* d) {
+    uint8_t* cur = d->row + 1;
+    const uint8_t* up = d->prev;
+    size_t bpp = d->bpp;
+
+    switch (d->row[0]) {
+        case 0:
+            break;
+        case 1:
+            for (size_t i = bpp; i < d->stride; i++) {
+                cur[i] += cur[i - bpp];
+            }
+            break;
+        case 2:
+            for (size_t i = 0; i < d->stride; i++) {
+                cur[i] += up[i];
+            }
+            break;
+        case 3:
+            for (size_t i = 0; i < d->stride; i++) {
+                uint8_t left = i >= bpp ? cur[i - bpp] : 0;
+                cur[i] += (uint8_t)(((int)left + up[i]) / 2);
+            }
+            break;
+        case 4:
+            for (size_t i = 0; i < d->stride; i++) {
+                uint8_t left = i >= bpp ? cur[i - bpp] : 0;
+                uint8_t corner = i >= bpp ? up[i - bpp] : 0;
+                cur[i] += paeth(left, up[i], corner);
+            }
+            break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+// Sample x of a row with fewer than 8 bits per sample
+static int packed_sample(const uint8_t* row, uint32_t x, int depth) {
+    uint32_t bit = x * depth;
+    int shift = 8 - depth - (int)(bit & 7);
+    return (row[bit >> 3] >> shift) & ((1 << depth) - 1);
+}
+
+// Convert the unfiltered row to RGBA8 in the output
+static bool emit_row(PngDecoder* d) {
+    const uint8_t* src = d->row + 1;
+    uint8_t* dst = d->out + (size_t)d->y * d->width * 4;
+
+    for (uint32_t x = 0; x < d->width; x++, dst += 4) {
+        switch (d->color_type) {
+            case PNG_COLOR_GREY: {
+                int v = d->depth == 8 ? src[x] : packed_sample(src, x, d->depth) * 255 / ((1 << d->depth) - 1);
+                dst[0] = dst[1] = dst[2] = (uint8_t)v;
+                dst[3] = 255;
+                break;
+            }
+            case PNG_COLOR_RGB:
+                memcpy(dst, src + x * 3, 3);
+                dst[3] = 255;
+                break;
+            case PNG_COLOR_PALETTE: {
+                int index = d->depth == 8 ? src[x] : packed_sample(src, x, d->depth);
+                if (index >= d->palette_size) {
+                    return false;
+                }
+                memcpy(dst, d->palette[index], 4);
+                break;
+            }
+            case PNG_COLOR_GREY_ALPHA:
+                dst[0] = dst[1] = dst[2] = src[x * 2];
+                dst[3] = src[x * 2 + 1];
+                break;
+            default:
+                memcpy(dst, src + x * 4, 4);
+                break;
+        }
+    }
+    return true;
+}
+
+// Inflate one IDAT chunk, finishing rows as they fill
+static bool feed_idat(PngDecoder* d, const uint8_t* data, uint32_t length) {
+    d->z.next_in = (Bytef*)data;
+    d->z.avail_in = length;
+
+    while (d->z.avail_in > 0 && d->y < d->height) {
+        d->z.next_out = d->row + d->row_fill;
+        d->z.avail_out = (uInt)(d->stride + 1 - d->row_fill);
+        int ret = inflate(&d->z, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END) {
+            return false;
+        }
+        d->row_fill = d->stride + 1 - d->z.avail_out;
+        if (d->row_fill == d->stride + 1) {
+            if (!unfilter_row(d) || !emit_row(d)) {
+                return false;
+            }
+            memcpy(d->prev, d->row + 1, d->stride);
+            d->row_fill = 0;
+            d->y++;
+        } else if (ret == Z_STREAM_END) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool parse_header(PngDecoder* d, const uint8_t* data, uint32_t length, uint32_t max_dimension) {
+    if (length != 13) {
+        return false;
+    }
+    d->width = read_be32(data);
+    d->height = read_be32(data + 4);
+    d->depth = data[8];
+    d->color_type = data[9];
+    // Compression, filter method, interlace
+    if (data[10] != 0 || data[11] != 0 || data[12] != 0) {
+        return false;
+    }
+    if (d->width == 0 || d->height == 0 || d->width > max_dimension || d->height > max_dimension) {
+        return false;
+    }
+
+    switch (d->color_type) {
+        case PNG_COLOR_GREY:
+        case PNG_COLOR_PALETTE:
+            d->channels = 1;
+            if (d->depth != 1 && d->depth != 2 && d->depth != 4 && d->depth != 8) {
+                return false;
+            }
+            break;
+        case PNG_COLOR_RGB:
+            d->channels = 3;
+            break;
+        case PNG_COLOR_GREY_ALPHA:
+            d->channels = 2;
+            break;
+        case PNG_COLOR_RGBA:
+            d->channels = 4;
+            break;
+        default:
+            return false;
+    }
+    if (d->channels > 1 && d->depth != 8) {
+        return false;
+    }
+    d->stride = ((size_t)d->width * d->channels * d->depth + 7) / 8;
+    d->bpp = d->depth >= 8 ? (size_t)d->channels : 1;
+    return true;
+}
+
+bool png_decode(const uint8_t* data, size_t size, uint32_t max_dimension, PngImage* image) {
+    PngDecoder d;
+    memset(&d, 0, sizeof(d));
+    memset(image, 0, sizeof(PngImage));
+
+    if (size < sizeof(png_signature) || memcmp(data, png_signature, sizeof(png_signature)) != 0) {
+        return false;
+    }
+
+    bool ok = false;
+    bool have_header = false;
+    bool inflating = false;
+    size_t pos = sizeof(png_signature);
+
+    while (pos + 12 <= size) {
+        uint32_t length = read_be32(data + pos);
+        const uint8_t* type = data + pos + 4;
+        const uint8_t* body = data + pos + 8;
+        if (length > size - pos - 12) {
+            break;
+        }
+        if (crc32(crc32(0, type, 4), body, length) != read_be32(body + length)) {
+            break;
+        }
+        pos += 12 + (size_t)length;
+
+        if (memcmp(type, "IHDR", 4) == 0) {
+            if (have_header || !parse_header(&d, body, length, max_dimension)) {
+                break;
+            }
+            have_header = true;
+        } else if (memcmp(type, "PLTE", 4) == 0) {
+            if (length % 3 != 0 || length / 3 > 256) {
+                break;
+            }
+            d.palette_size = (int)(length / 3);
+            for (int i = 0; i < d.palette_size; i++) {
+                memcpy(d.palette[i], body + i * 3, 3);
+                d.palette[i][3] = 255;
+            }
+        } else if (memcmp(type, "tRNS", 4) == 0) {
+            // Palette alpha; a colour key for grey or RGB images is ignored
+            for (uint32_t i = 0; d.color_type == PNG_COLOR_PALETTE && i < length && i < 256; i++) {
+                d.palette[i][3] = body[i];
+            }
+        } else if (memcmp(type, "IDAT", 4) == 0) {
+            if (!have_header) {
+                break;
+            }
+            if (!inflating) {
+                d.z.zalloc = zlib_alloc;
+                d.z.zfree = zlib_free;
+                d.row = mem_alloc(MEM_NET, d.stride + 1);
+                d.prev = mem_calloc(MEM_NET, 1, d.stride);
+                d.out = mem_alloc(MEM_NET, (size_t)d.width * d.height * 4);
+                if (!d.row || !d.prev || !d.out || inflateInit(&d.z) != Z_OK) {
+                    break;
+                }
+                inflating = true;
+            }
+            if (!feed_idat(&d, body, length)) {
+                break;
+            }
+        } else if (memcmp(type, "IEND", 4) == 0) {
+            ok = inflating && d.y == d.height;
+            break;
+        } else if (!(type[0] & 0x20)) {
+            // An unknown critical chunk
+            break;
+        }
+    }
+
+    if (inflating) {
+        inflateEnd(&d.z);
+    }
+    mem_free(d.row);
+    mem_free(d.prev);
+    if (!ok) {
+        mem_free(d.out);
+        return false;
+    }
+    image->width = d.width;
+    image->height = d.height;
+    image->pixels = d.out;
+    return true;
+}
@@ -0,0 +1,460 @@
+#include "poller.h"
+#include "timing.h"
+#include "profiler.h"
+#include "log.h"
+#include "wake.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <3ds.h>
+
+#define POLLER_STACK_SIZE (32 * 1024)
+
+// Rate assumed for a channel before anything was observed, per minute
+#define POLLER_PRIOR_RATE 1.0f
+
+// Weight of the newest observation in the smoothed rate
+#define POLLER_RATE_ALPHA 0.3f
+
+// Pause after a 429 that did not say how long to wait
+#define POLLER_RATE_LIMIT_MS 5000
+
+static PollerChannel channels[POLLER_MAX_CHANNELS];
+static int channel_count = 0;
+static uint64_t focus_id = 0;
+static bool focus_updated = false;
+
+static DiscordClient* poller_client = NULL;
+static LightLock poller_lock;
+static LightEvent poller_wake;
+static Thread worker = NULL;
+static volatile bool running = false;
+static CancelToken* in_flight = NULL;     // Probe to abort on cleanup
+
+// Token bucket shared by every probe, and the pause after a 429
+static double tokens = POLLER_BUDGET_BURST;
+static uint64_t refilled_at = 0;
+static uint64_t paused_until = 0;
+static bool suspended = false;          // No probes until poller_set_suspended(false)
+static bool waiting_for_budget = false;
+
+static PollerStats stats;
+
+static uint64_t ms_to_ticks(double ms) {
+    return (uint64_t)(ms * TIMING_TICKS_PER_SEC / 1000.0);
+}
+
+static uint64_t parse_id(const char* id) {
+    return id ? strtoull(id, NULL, 10) : 0;
+}
+
+// Called with poller_lock held
+static PollerChannel* find_channel(uint64_t channel_id) {
+    for (int i = 0; i < channel_count; i++) {
+        if (channels[i].channel_id == channel_id) {
+            return &channels[i];
+        }
+    }
+    return NULL;
+}
+
+// Aim for about one new message per probe, within the channel's bounds
+static uint32_t adapt_interval(const PollerChannel* channel) {
+    bool focused = channel->channel_id == focus_id;
+    double lo = focused ? POLLER_FOCUS_MIN_MS : POLLER_MIN_MS;
+    double hi = focused ? POLLER_FOCUS_MAX_MS : POLLER_MAX_MS;
+    double interval = channel->rate_per_min > 0.0f ? 60000.0 / channel->rate_per_min : hi;
+    if (interval < lo) {
+        interval = lo;
+    }
+    if (interval > hi) {
+        interval = hi;
+    }
+    return (uint32_t)interval;
+}
+
+// Called with poller_lock held
+static int count_watched(void) {
+    int watched = 0;
+    for (int i = 0; i < channel_count; i++) {
+        watched += channels[i].watched;
+    }
+    return watched;
+}
+
+// Add a watched channel or the focused one, or update it if it is there.
+// Watched channels leave one slot free, so the focus always fits: at most one
+// unwatched channel is in the table, the focused one. Called with
+// poller_lock held.
+static PollerChannel* add_channel(uint64_t channel_id, uint64_t server_id, bool watch) {
+    PollerChannel* channel = find_channel(channel_id);
+    if (watch && !(channel && channel->watched) && count_watched() >= POLLER_MAX_CHANNELS - 1) {
+        return NULL;
+    }
+    if (channel) {
+        if (server_id) {
+            channel->server_id = server_id;
+        }
+        channel->watched = channel->watched || watch;
+        return channel;
+    }
+    if (channel_count == POLLER_MAX_CHANNELS) {
+        return NULL;
+    }
+    channel = &channels[channel_count++];
+    memset(channel, 0, sizeof(PollerChannel));
+    channel->channel_id = channel_id;
+    channel->server_id = server_id;
+    channel->watched = watch;
+    channel->rate_per_min = POLLER_PRIOR_RATE;
+    channel->interval_ms = adapt_interval(channel);
+    // Take the first probe soon; the budget spaces them out
+    channel->next_probe_at = timing_now();
+    stats.watched = channel_count;
+    return channel;
+}
+
+static void refill_tokens(uint64_t now) {
+    double elapsed_ms = timing_ticks_to_ms(now - refilled_at);
+    tokens += elapsed_ms * POLLER_BUDGET_REQUESTS / POLLER_BUDGET_WINDOW_MS;
+    if (tokens > POLLER_BUDGET_BURST) {
+        tokens = POLLER_BUDGET_BURST;
+    }
+    refilled_at = now;
+}
+
+// Pick the channel to probe now, taking a token for it, or NULL with
+// *wake_at set to when to look again (0 to wait for a signal). Called with
+// poller_lock held.
+static PollerChannel* take_due(uint64_t now, uint64_t* wake_at) {
+    PollerChannel* due = NULL;
+    *wake_at = 0;
+    if (suspended) {
+        return NULL;
+    }
+    for (int i = 0; i < channel_count; i++) {
+        PollerChannel* channel = &channels[i];
+        // The focused channel goes first among those due
+        if (channel->channel_id == focus_id && channel->next_probe_at <= now) {
+            due = channel;
+            break;
+        }
+        if (!due || channel->next_probe_at < due->next_probe_at) {
+            due = channel;
+        }
+    }
+    if (!due) {
+        return NULL;
+    }
+    if (due->next_probe_at > now || paused_until > now) {
+        *wake_at = due->next_probe_at > paused_until ? due->next_probe_at : paused_until;
+        return NULL;
+    }
+
+    refill_tokens(now);
+    if (tokens < 1.0) {
+        if (!waiting_for_budget) {
+            stats.throttled++;
+            waiting_for_budget = true;
+        }
+        *wake_at = now + ms_to_ticks((1.0 - tokens) * POLLER_BUDGET_WINDOW_MS / POLLER_BUDGET_REQUESTS) + 1;
+        return NULL;
+    }
+    tokens -= 1.0;
+    waiting_for_budget = false;
+    return due;
+}
+
+// Fold one probe result into the channel; called with poller_lock held
+static void record_probe(PollerChannel* channel, long status, const DiscordProbe* probe,
+                         double retry_after_s, uint64_t now) {
+    stats.probes++;
+    channel->probes++;
+
+    if (status == 200) {
+        if (channel->last_message_id == 0) {
+            // First probe only sets the baseline
+            channel->last_message_id = probe->newest_id;
+        } else if (probe->count > 0) {
+            if (probe->newest_id > channel->last_message_id) {
+                channel->last_message_id = probe->newest_id;
+            }
+            stats.new_messages += probe->count;
+            if (channel->channel_id == focus_id) {
+                focus_updated = true;
+            } else {
+                int unread = channel->unread + probe->count;
+                channel->unread = unread > UINT16_MAX ? UINT16_MAX : (uint16_t)unread;
+            }
+            // The main loop fetches the focused channel or redraws the counts
+            wake_request();
+        }
+        if (channel->last_probe_at) {
+            double elapsed_ms = timing_ticks_to_ms(now - channel->last_probe_at);
+            float observed = (float)(probe->count * 60000.0 / elapsed_ms);
+            channel->rate_per_min += POLLER_RATE_ALPHA * (observed - channel->rate_per_min);
+        }
+        channel->last_probe_at = now;
+        channel->interval_ms = adapt_interval(channel);
+    } else if (status == 429) {
+        // The budget is shared, so a rate limit holds back every channel
+        stats.rate_limited++;
+        double pause_ms = retry_after_s > 0 ? retry_after_s * 1000.0 : POLLER_RATE_LIMIT_MS;
+        paused_until = now + ms_to_ticks(pause_ms);
+        channel->next_probe_at = paused_until;
+        return;
+    } else {
+        // Back off from a failing channel, within its bounds
+        stats.failed++;
+        uint32_t interval = channel->interval_ms * 2;
+        uint32_t hi = channel->channel_id == focus_id ? POLLER_FOCUS_MAX_MS : POLLER_MAX_MS;
+        channel->interval_ms = interval > hi ? hi : interval;
+    }
+    channel->next_probe_at = now + ms_to_ticks(channel->interval_ms);
+}
+
+static void poller_worker(void* arg) {
+    (void)arg;
+
+    while (running) {
+        char channel_id[32];
+        uint64_t id = 0;
+        uint64_t after_id = 0;
+        uint64_t wake_at = 0;
+
+        LightLock_Lock(&poller_lock);
+        uint64_t now = timing_now();
+        PollerChannel* due = take_due(now, &wake_at);
+        if (due) {
+            id = due->channel_id;
+            after_id = due->last_message_id;
+        }
+        LightLock_Unlock(&poller_lock);
+
+        if (!due) {
+            if (wake_at == 0) {
+                LightEvent_Wait(&poller_wake);
+            } else {
+                LightEvent_WaitTimeout(&poller_wake, (s64)(timing_ticks_to_us(wake_at - now) * 1000.0));
+            }
+            continue;
+        }
+
+        CancelToken cancel;
+        cancel_token_init(&cancel, DISCORD_REQUEST_TIMEOUT_MS);
+        LightLock_Lock(&poller_lock);
+        in_flight = &cancel;
+        LightLock_Unlock(&poller_lock);
+
+        DiscordProbe probe = {0};
+        double retry_after_s = 0;
+        long status;
+        snprintf(channel_id, sizeof(channel_id), "%llu", (unsigned long long)id);
+        {
+            PROFILE_ZONE("poller_probe");
+            status = discord_probe_channel(poller_client, channel_id, after_id, &cancel, &probe, &retry_after_s);
+        }
+
+        LightLock_Lock(&poller_lock);
+        in_flight = NULL;
+        // The channel may have been unwatched meanwhile
+        PollerChannel* channel = find_channel(id);
+        if (channel) {
+            record_probe(channel, status, &probe, retry_after_s, timing_now());
+        }
+        LightLock_Unlock(&poller_lock);
+    }
+}
+
+static void poller_load(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return;
+    }
+
+    char line[96];
+    while (fgets(line, sizeof(line), f)) {
+        char channel_id[32];
+        char server_id[32] = "";
+        if (sscanf(line, "%31s %31s", channel_id, server_id) >= 1 && channel_id[0] != '#') {
+            if (!add_channel(parse_id(channel_id), parse_id(server_id), true)) {
+                log_write(LOG_WARN, "Watch list full, ignoring channel %s", channel_id);
+            }
+        }
+    }
+    fclose(f);
+
+    if (channel_count > 0) {
+        log_write(LOG_INFO, "Watching %d channel(s)", channel_count);
+    }
+}
+
+bool poller_init(DiscordClient* client, const char* path) {
+    LightLock_Init(&poller_lock);
+    LightEvent_Init(&poller_wake, RESET_ONESHOT);
+
+    poller_client = client;
+    channel_count = 0;
+    focus_id = 0;
+    focus_updated = false;
+    tokens = POLLER_BUDGET_BURST;
+    refilled_at = timing_now();
+    paused_until = 0;
+    suspended = false;
+    waiting_for_budget = false;
+    memset(&stats, 0, sizeof(stats));
+
+    if (path) {
+        poller_load(path);
+    }
+
+    // Below the UI thread, like the outbox
+    s32 priority = 0x30;
+    svcGetThreadPriority(&priority, CUR_THREAD_HANDLE);
+
+    running = true;
+    worker = threadCreate(poller_worker, NULL, POLLER_STACK_SIZE, priority + 1, -2, false);
+    if (!worker) {
+        log_write(LOG_ERROR, "Failed to start poller");
+        running = false;
+        return false;
+    }
+    return true;
+}
+
+bool poller_watch(const char* channel_id, const char* server_id) {
+    uint64_t id = parse_id(channel_id);
+    if (id == 0) {
+        return false;
+    }
+
+    LightLock_Lock(&poller_lock);
+    bool ok = add_channel(id, parse_id(server_id), true) != NULL;
+    LightLock_Unlock(&poller_lock);
+
+    LightEvent_Signal(&poller_wake);
+    return ok;
+}
+
+// Called with poller_lock held
+static void remove_channel(PollerChannel* channel) {
+    int index = channel - channels;
+    memmove(channel, channel + 1, (channel_count - index - 1) * sizeof(PollerChannel));
+    channel_count--;
+    stats.watched = channel_count;
+}
+
+void poller_unwatch(const char* channel_id) {
+    uint64_t id = parse_id(channel_id);
+
+    LightLock_Lock(&poller_lock);
+    PollerChannel* channel = find_channel(id);
+    if (channel && id == focus_id) {
+        // Keep polling it until focus moves on
+        channel->watched = false;
+    } else if (channel) {
+        remove_channel(channel);
+    }
+    LightLock_Unlock(&poller_lock);
+}
+
+void poller_set_focus(const char* channel_id, const char* server_id, const char* newest_message_id) {
+    uint64_t id = parse_id(channel_id);
+    if (id == 0) {
+        return;
+    }
+
+    LightLock_Lock(&poller_lock);
+    uint64_t previous = focus_id;
+    focus_id = id;
+    // The channel left behind is polled only if it is watched
+    PollerChannel* left = previous != id ? find_channel(previous) : NULL;
+    if (left && !left->watched) {
+        remove_channel(left);
+    }
+    PollerChannel* channel = add_channel(id, parse_id(server_id), false);
+    if (channel) {
+        uint64_t newest = parse_id(newest_message_id);
+        if (newest > channel->last_message_id) {
+            channel->last_message_id = newest;
+        }
+        channel->unread = 0;
+        if (previous != id) {
+            // Tighter bounds apply from now on
+            channel->interval_ms = adapt_interval(channel);
+            uint64_t next = timing_now() + ms_to_ticks(channel->interval_ms);
+            if (next < channel->next_probe_at) {
+                channel->next_probe_at = next;
+            }
+        }
+    }
+    LightLock_Unlock(&poller_lock);
+
+    LightEvent_Signal(&poller_wake);
+}
+
+void poller_set_suspended(bool on) {
+    LightLock_Lock(&poller_lock);
+    suspended = on;
+    // A probe started before sleep would only time out
+    if (on && in_flight) {
+        cancel_token_cancel(in_flight);
+    }
+    LightLock_Unlock(&poller_lock);
+    LightEvent_Signal(&poller_wake);
+}
+
+bool poller_take_focus_update(void) {
+    LightLock_Lock(&poller_lock);
+    bool result = focus_updated;
+    focus_updated = false;
+    LightLock_Unlock(&poller_lock);
+    return result;
+}
+
+int poller_unread_for_server(const char* server_id) {
+    uint64_t id = parse_id(server_id);
+    int unread = 0;
+
+    LightLock_Lock(&poller_lock);
+    for (int i = 0; i < channel_count; i++) {
+        if (channels[i].server_id == id) {
+            unread += channels[i].unread;
+        }
+    }
+    LightLock_Unlock(&poller_lock);
+    return unread;
+}
+
+int poller_list(PollerChannel* out, int max) {
+    LightLock_Lock(&poller_lock);
+    int count = channel_count < max ? channel_count : max;
+    memcpy(out, channels, count * sizeof(PollerChannel));
+    LightLock_Unlock(&poller_lock);
+    return count;
+}
+
+PollerStats poller_get_stats(void) {
+    LightLock_Lock(&poller_lock);
+    PollerStats result = stats;
+    LightLock_Unlock(&poller_lock);
+    return result;
+}
+
+void poller_cleanup(void) {
+    if (!worker) {
+        return;
+    }
+
+    LightLock_Lock(&poller_lock);
+    running = false;
+    if (in_flight) {
+        cancel_token_cancel(in_flight);
+    }
+    LightLock_Unlock(&poller_lock);
+
+    LightEvent_Signal(&poller_wake);
+    threadJoin(worker, U64_MAX);
+    threadFree(worker);
+    worker = NULL;
+}
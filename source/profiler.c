@@ -0,0 +1,78 @@
+#include "profiler.h"
+#include <stdio.h>
+#include <string.h>
+
+#define PROFILER_MASK (PROFILER_CAPACITY - 1)
+
+typedef struct {
+    const char* name;
+    uint64_t start;
+    uint64_t end;
+    uint32_t thread;
+    // Index + 1 of the write that completed this slot, 0 if never written
+    uint32_t seq;
+} ProfileEvent;
+
+static ProfileEvent events[PROFILER_CAPACITY];
+static uint32_t event_head = 0;
+static uint64_t trace_origin = 0;
+static uint32_t next_thread_id = 0;
+
+// Small per-thread id for the trace "tid" field
+static __thread uint32_t thread_id = 0;
+
+static uint32_t current_thread_id(void) {
+    if (thread_id == 0) {
+        thread_id = __atomic_add_fetch(&next_thread_id, 1, __ATOMIC_RELAXED);
+    }
+    return thread_id;
+}
+
+void profiler_init(void) {
+    memset(events, 0, sizeof(events));
+    __atomic_store_n(&event_head, 0, __ATOMIC_RELAXED);
+    trace_origin = timing_now();
+}
+
+void profiler_zone_end(ProfileZone* zone) {
+    uint64_t end = timing_now();
+    uint32_t index = __atomic_fetch_add(&event_head, 1, __ATOMIC_RELAXED);
+    ProfileEvent* event = &events[index & PROFILER_MASK];
+
+    event->name = zone->name;
+    event->start = zone->start;
+    event->end = end;
+    event->thread = current_thread_id();
+    // Publish last so the dump can skip slots that are mid-write
+    __atomic_store_n(&event->seq, index + 1, __ATOMIC_RELEASE);
+}
+
+bool profiler_dump(const char* path) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        printf("Failed to open %s\n", path);
+        return false;
+    }
+
+    uint32_t head = __atomic_load_n(&event_head, __ATOMIC_ACQUIRE);
+    uint32_t first = head > PROFILER_CAPACITY ? head - PROFILER_CAPACITY : 0;
+    bool comma = false;
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (uint32_t i = first; i < head; i++) {
+        ProfileEvent* event = &events[i & PROFILER_MASK];
+        if (__atomic_load_n(&event->seq, __ATOMIC_ACQUIRE) != i + 1 || event->start < trace_origin) {
+            continue;
+        }
+
+        fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%lu,\"ts\":%.3f,\"dur\":%.3f}",
+                comma ? ",\n" : "", event->name, (unsigned long)event->thread,
+                timing_ticks_to_us(event->start - trace_origin),
+                timing_ticks_to_us(event->end - event->start));
+        comma = true;
+    }
+    fprintf(f, "\n]}\n");
+
+    fclose(f);
+    return true;
+}
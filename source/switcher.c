@@ -0,0 +1,499 @@
+#include "switcher.h"
+#include "text.h"
+#include "mem.h"
+#include "timing.h"
+#include "log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <3ds.h>
+
+#if SWITCHER_MAX_ENTRIES > 65536
+#error "SWITCHER_MAX_ENTRIES must fit the 16-bit postings"
+#endif
+
+// Both hash tables are open-addressed, power-of-two sized and grown at 3/4
+#define TABLE_MIN_BITS 10
+
+// Folded name plus the two spaces in front
+#define FOLDED_SIZE 72
+
+typedef struct {
+    uint64_t id;
+    uint64_t server_id;
+    uint32_t name_at;           // Offset of the display name in names
+    uint8_t name_len;
+    uint8_t kind;
+    bool renamed;               // Superseded by a later entry with the same id
+} Entry;
+
+typedef struct {
+    uint32_t key;               // Trigram | TRIGRAM_USED, 0 for an empty bucket
+    uint32_t count;
+    uint32_t capacity;
+    uint16_t* postings;         // Entry numbers, ascending
+} TrigramBucket;
+
+#define TRIGRAM_USED (1u << 24)
+
+static Entry* entries = NULL;
+static int entry_count = 0;
+static int entry_capacity = 0;
+
+static char* names = NULL;
+static uint32_t names_used = 0;
+static uint32_t names_capacity = 0;
+
+static TrigramBucket* buckets = NULL;
+static int bucket_bits = 0;
+static int trigram_count = 0;
+static size_t posting_count = 0;
+static size_t posting_bytes = 0;
+
+// Entry number + 1 by kind and id, 0 for an empty slot
+static uint32_t* ids = NULL;
+static int id_bits = 0;
+
+// Search scratch, one per entry: trigram hits, and which entries have any
+static uint8_t* hits = NULL;
+static uint16_t* touched = NULL;
+
+static LightLock switcher_lock;
+static bool initialized = false;
+static bool full_logged = false;
+static SwitcherStats stats;
+
+static uint32_t hash_trigram(uint32_t key, int bits) {
+    return (key * 2654435761u) >> (32 - bits);
+}
+
+static uint32_t hash_id(uint64_t id, SwitcherKind kind, int bits) {
+    return (uint32_t)(((id ^ (uint64_t)kind) * 0x9E3779B97F4A7C15ULL) >> (64 - bits));
+}
+
+// Lower-case name into out after two spaces, with - _ . as spaces; returns
+// the folded length including the padding
+static size_t fold_name(const char* name, size_t len, char* out) {
+    out[0] = ' ';
+    out[1] = ' ';
+    size_t n = 2;
+    for (size_t i = 0; i < len && n < FOLDED_SIZE - 1; i++) {
+        char c = name[i];
+        if (c >= 'A' && c <= 'Z') {
+            c = (char)(c - 'A' + 'a');
+        } else if (c == '-' || c == '_' || c == '.') {
+            c = ' ';
+        }
+        out[n++] = c;
+    }
+    out[n] = '\0';
+    return n;
+}
+
+static uint32_t trigram_at(const char* folded, size_t i) {
+    return ((uint32_t)(uint8_t)folded[i] << 16) | ((uint32_t)(uint8_t)folded[i + 1] << 8) |
+           (uint8_t)folded[i + 2] | TRIGRAM_USED;
+}
+
+// Called with switcher_lock held
+static TrigramBucket* find_bucket(uint32_t key) {
+    uint32_t mask = (1u << bucket_bits) - 1;
+    for (uint32_t i = hash_trigram(key, bucket_bits);; i = (i + 1) & mask) {
+        if (buckets[i].key == key || buckets[i].key == 0) {
+            return &buckets[i];
+        }
+    }
+}
+
+// Called with switcher_lock held
+static bool grow_buckets(void) {
+    int old_bits = bucket_bits;
+    TrigramBucket* old = buckets;
+    int bits = old ? old_bits + 1 : TABLE_MIN_BITS;
+
+    TrigramBucket* table = mem_calloc(MEM_UI, (size_t)1 << bits, sizeof(TrigramBucket));
+    if (!table) {
+        return false;
+    }
+    buckets = table;
+    bucket_bits = bits;
+    for (size_t i = 0; old && i < ((size_t)1 << old_bits); i++) {
+        if (old[i].key) {
+            *find_bucket(old[i].key) = old[i];
+        }
+    }
+    mem_free(old);
+    return true;
+}
+
+// Called with switcher_lock held; returns the entry number + 1, or 0
+static uint32_t* find_id(uint64_t id, SwitcherKind kind) {
+    uint32_t mask = (1u << id_bits) - 1;
+    for (uint32_t i = hash_id(id, kind, id_bits);; i = (i + 1) & mask) {
+        if (ids[i] == 0 || (entries[ids[i] - 1].id == id && entries[ids[i] - 1].kind == kind)) {
+            return &ids[i];
+        }
+    }
+}
+
+// Called with switcher_lock held
+static bool grow_ids(void) {
+    int old_bits = id_bits;
+    uint32_t* old = ids;
+    int bits = old ? old_bits + 1 : TABLE_MIN_BITS;
+
+    uint32_t* table = mem_calloc(MEM_UI, (size_t)1 << bits, sizeof(uint32_t));
+    if (!table) {
+        return false;
+    }
+    ids = table;
+    id_bits = bits;
+    for (size_t i = 0; old && i < ((size_t)1 << old_bits); i++) {
+        if (old[i]) {
+            const Entry* entry = &entries[old[i] - 1];
+            *find_id(entry->id, (SwitcherKind)entry->kind) = old[i];
+        }
+    }
+    mem_free(old);
+    return true;
+}
+
+// Make room for one more entry and its scratch; called with switcher_lock held
+static bool reserve_entry(void) {
+    if (entry_count < entry_capacity) {
+        return true;
+    }
+    int capacity = entry_capacity ? entry_capacity * 2 : 256;
+    if (capacity > SWITCHER_MAX_ENTRIES) {
+        capacity = SWITCHER_MAX_ENTRIES;
+    }
+    Entry* grown_entries = mem_realloc(MEM_UI, entries, capacity * sizeof(Entry));
+    if (grown_entries) {
+        entries = grown_entries;
+    }
+    uint8_t* grown_hits = mem_realloc(MEM_UI, hits, capacity);
+    if (grown_hits) {
+        hits = grown_hits;
+    }
+    uint16_t* grown_touched = mem_realloc(MEM_UI, touched, capacity * sizeof(uint16_t));
+    if (grown_touched) {
+        touched = grown_touched;
+    }
+    if (!grown_entries || !grown_hits || !grown_touched) {
+        return false;
+    }
+    // New counters start at zero; searches put them back to zero after use
+    memset(hits + entry_capacity, 0, capacity - entry_capacity);
+    entry_capacity = capacity;
+    return true;
+}
+
+// Called with switcher_lock held
+static bool store_name(const char* name, size_t len, uint32_t* at) {
+    if (names_used + len > names_capacity) {
+        uint32_t capacity = names_capacity ? names_capacity * 2 : 4096;
+        while (capacity < names_used + len) {
+            capacity *= 2;
+        }
+        char* grown = mem_realloc(MEM_UI, names, capacity);
+        if (!grown) {
+            return false;
+        }
+        names = grown;
+        names_capacity = capacity;
+    }
+    memcpy(names + names_used, name, len);
+    *at = names_used;
+    names_used += (uint32_t)len;
+    return true;
+}
+
+// Add entry number to the posting list of key; called with switcher_lock held
+static bool add_posting(uint32_t key, uint16_t number) {
+    if ((trigram_count + 1) * 4 > (3 << bucket_bits) && !grow_buckets()) {
+        return false;
+    }
+    TrigramBucket* bucket = find_bucket(key);
+    if (bucket->key == 0) {
+        bucket->key = key;
+        trigram_count++;
+    }
+    // A trigram that occurs twice in the name is listed once
+    if (bucket->count > 0 && bucket->postings[bucket->count - 1] == number) {
+        return true;
+    }
+    if (bucket->count == bucket->capacity) {
+        uint32_t capacity = bucket->capacity ? bucket->capacity * 2 : 4;
+        uint16_t* grown = mem_realloc(MEM_UI, bucket->postings, capacity * sizeof(uint16_t));
+        if (!grown) {
+            return false;
+        }
+        posting_bytes += (capacity - bucket->capacity) * sizeof(uint16_t);
+        bucket->postings = grown;
+        bucket->capacity = capacity;
+    }
+    bucket->postings[bucket->count++] = number;
+    posting_count++;
+    return true;
+}
+
+// Index one name unless it is known already; called with switcher_lock held
+static void add_entry(SwitcherKind kind, const char* id_text, const char* server_id_text, const char* name) {
+    uint64_t id = strtoull(id_text, NULL, 10);
+    uint64_t server_id = strtoull(server_id_text, NULL, 10);
+    size_t len = strlen(name);
+    if (id == 0 || len == 0) {
+        return;
+    }
+    if (len > 255) {
+        len = 255;
+    }
+
+    if ((entry_count + 1) * 4 > (3 << id_bits) && !grow_ids()) {
+        return;
+    }
+    uint32_t* slot = find_id(id, kind);
+    uint32_t known = *slot;
+    if (known) {
+        const Entry* entry = &entries[known - 1];
+        if (entry->server_id == server_id && entry->name_len == len &&
+            memcmp(names + entry->name_at, name, len) == 0) {
+            return;
+        }
+    }
+
+    if (entry_count >= SWITCHER_MAX_ENTRIES) {
+        if (!full_logged) {
+            log_write(LOG_WARN, "Quick switcher index is full");
+            full_logged = true;
+        }
+        return;
+    }
+    uint32_t name_at;
+    if (!reserve_entry() || !store_name(name, len, &name_at)) {
+        log_write(LOG_ERROR, "Out of memory for the quick switcher");
+        return;
+    }
+
+    uint16_t number = (uint16_t)entry_count;
+    Entry* entry = &entries[entry_count++];
+    entry->id = id;
+    entry->server_id = server_id;
+    entry->name_at = name_at;
+    entry->name_len = (uint8_t)len;
+    entry->kind = (uint8_t)kind;
+    entry->renamed = false;
+    if (known) {
+        entries[known - 1].renamed = true;
+    }
+    *slot = number + 1;
+
+    char folded[FOLDED_SIZE];
+    size_t folded_len = fold_name(name, len, folded);
+    for (size_t i = 0; i + 3 <= folded_len; i++) {
+        if (!add_posting(trigram_at(folded, i), number)) {
+            log_write(LOG_ERROR, "Out of memory for the quick switcher");
+            return;
+        }
+    }
+}
+
+void switcher_init(void) {
+    LightLock_Init(&switcher_lock);
+    memset(&stats, 0, sizeof(stats));
+    full_logged = false;
+    initialized = true;
+}
+
+void switcher_add_servers(const DiscordServer* servers, int count) {
+    if (!initialized) {
+        return;
+    }
+    LightLock_Lock(&switcher_lock);
+    for (int i = 0; i < count; i++) {
+        add_entry(SWITCHER_SERVER, servers[i].id, servers[i].id, servers[i].name);
+    }
+    LightLock_Unlock(&switcher_lock);
+}
+
+void switcher_add_channels(const char* server_id, const DiscordChannel* channels, int count) {
+    if (!initialized || !server_id) {
+        return;
+    }
+    LightLock_Lock(&switcher_lock);
+    for (int i = 0; i < count; i++) {
+        add_entry(SWITCHER_CHANNEL, channels[i].id, server_id, channels[i].name);
+    }
+    LightLock_Unlock(&switcher_lock);
+}
+
+// Copy an entry's display name; called with switcher_lock held
+static void copy_name(const Entry* entry, char* out, size_t size) {
+    size_t len = entry->name_len < size - 1 ? entry->name_len : size - 1;
+    memcpy(out, names + entry->name_at, len);
+    out[len] = '\0';
+}
+
+// Rank a candidate: the share of the query's trigrams it has, then whether
+// it starts with or contains the query, then shorter names first
+static int score_entry(const Entry* entry, int entry_hits, int trigrams, const char* query, size_t query_len) {
+    char folded[FOLDED_SIZE];
+    size_t len = fold_name(names + entry->name_at, entry->name_len, folded);
+    int score = entry_hits * 1000 / trigrams;
+    if (strncmp(folded + 2, query, query_len) == 0) {
+        score += 600;
+    } else if (strstr(folded + 2, query)) {
+        score += 300;
+    }
+    if (entry->kind == SWITCHER_SERVER) {
+        score += 10;
+    }
+    return score - (int)len;
+}
+
+int switcher_search(const char* query, SwitcherResult* results, int max) {
+    if (!initialized || max <= 0) {
+        return 0;
+    }
+    uint64_t start = timing_now();
+
+    // Typed text is UTF-8; names are console glyphs
+    char glyphs[FOLDED_SIZE];
+    size_t glyph_len = text_decode_json(query, strlen(query), glyphs, sizeof(glyphs) - 2, TEXT_CONSOLE);
+    char folded[FOLDED_SIZE];
+    size_t folded_len = fold_name(glyphs, glyph_len, folded);
+    // Trailing spaces would only add trigrams no name ends with
+    while (folded_len > 2 && folded[folded_len - 1] == ' ') {
+        folded[--folded_len] = '\0';
+    }
+    if (folded_len < 3) {
+        return 0;
+    }
+
+    uint32_t keys[FOLDED_SIZE];
+    int key_count = 0;
+    for (size_t i = 0; i + 3 <= folded_len; i++) {
+        uint32_t key = trigram_at(folded, i);
+        bool seen = false;
+        for (int k = 0; k < key_count && !seen; k++) {
+            seen = keys[k] == key;
+        }
+        if (!seen) {
+            keys[key_count++] = key;
+        }
+    }
+    // All of one or two trigrams, at least half of more
+    int need = key_count <= 2 ? key_count : (key_count + 1) / 2;
+
+    int count = 0;
+    LightLock_Lock(&switcher_lock);
+    int touched_count = 0;
+    for (int k = 0; k < key_count && buckets; k++) {
+        const TrigramBucket* bucket = find_bucket(keys[k]);
+        for (uint32_t p = 0; p < bucket->count; p++) {
+            uint16_t number = bucket->postings[p];
+            if (hits[number]++ == 0) {
+                touched[touched_count++] = number;
+            }
+        }
+    }
+
+    // A slip near the start of a short name can leave it fewer than half;
+    // if little else matches, any trigram in common will do
+    int passing = 0;
+    for (int t = 0; t < touched_count && passing < max; t++) {
+        passing += hits[touched[t]] >= need;
+    }
+    if (passing < max) {
+        need = 1;
+    }
+
+    for (int t = 0; t < touched_count; t++) {
+        uint16_t number = touched[t];
+        int entry_hits = hits[number];
+        hits[number] = 0;
+        const Entry* entry = &entries[number];
+        if (entry_hits < need || entry->renamed) {
+            continue;
+        }
+        int score = score_entry(entry, entry_hits, key_count, folded + 2, folded_len - 2);
+        if (count == max && score <= results[max - 1].score) {
+            continue;
+        }
+
+        // Insert in order, dropping the lowest when full
+        int at = count < max ? count++ : max - 1;
+        while (at > 0 && results[at - 1].score < score) {
+            results[at] = results[at - 1];
+            at--;
+        }
+        SwitcherResult* result = &results[at];
+        result->kind = (SwitcherKind)entry->kind;
+        result->score = score;
+        snprintf(result->id, sizeof(result->id), "%llu", (unsigned long long)entry->id);
+        snprintf(result->server_id, sizeof(result->server_id), "%llu", (unsigned long long)entry->server_id);
+        copy_name(entry, result->name, sizeof(result->name));
+        result->server_name[0] = '\0';
+        if (entry->kind == SWITCHER_CHANNEL) {
+            uint32_t server = *find_id(entry->server_id, SWITCHER_SERVER);
+            if (server) {
+                copy_name(&entries[server - 1], result->server_name, sizeof(result->server_name));
+            }
+        }
+    }
+
+    double elapsed = timing_ticks_to_ms(timing_now() - start);
+    stats.searches++;
+    stats.last_search_ms = elapsed;
+    if (elapsed > stats.max_search_ms) {
+        stats.max_search_ms = elapsed;
+    }
+    LightLock_Unlock(&switcher_lock);
+    return count;
+}
+
+SwitcherStats switcher_get_stats(void) {
+    if (!initialized) {
+        SwitcherStats empty = {0};
+        return empty;
+    }
+    LightLock_Lock(&switcher_lock);
+    SwitcherStats snapshot = stats;
+    snapshot.entries = entry_count;
+    snapshot.trigrams = trigram_count;
+    snapshot.postings = posting_count;
+    snapshot.bytes = entry_capacity * (sizeof(Entry) + sizeof(uint8_t) + sizeof(uint16_t)) + names_capacity +
+                     (buckets ? ((size_t)1 << bucket_bits) * sizeof(TrigramBucket) : 0) + posting_bytes +
+                     (ids ? ((size_t)1 << id_bits) * sizeof(uint32_t) : 0);
+    LightLock_Unlock(&switcher_lock);
+    return snapshot;
+}
+
+void switcher_cleanup(void) {
+    if (!initialized) {
+        return;
+    }
+    LightLock_Lock(&switcher_lock);
+    for (size_t i = 0; buckets && i < ((size_t)1 << bucket_bits); i++) {
+        mem_free(buckets[i].postings);
+    }
+    mem_free(buckets);
+    mem_free(ids);
+    mem_free(entries);
+    mem_free(names);
+    mem_free(hits);
+    mem_free(touched);
+    buckets = NULL;
+    ids = NULL;
+    entries = NULL;
+    names = NULL;
+    hits = NULL;
+    touched = NULL;
+    bucket_bits = id_bits = 0;
+    trigram_count = 0;
+    entry_count = entry_capacity = 0;
+    names_used = names_capacity = 0;
+    posting_count = posting_bytes = 0;
+    initialized = false;
+    LightLock_Unlock(&switcher_lock);
+}
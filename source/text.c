@@ -0,0 +1,217 @@
+#include "text.h"
+#include "glyph_table.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define REPLACEMENT_CHAR 0xFFFD
+
+static inline uint8_t console_glyph(uint32_t cp) {
+    if (cp < GLYPH_PAGE_LIMIT) {
+        uint8_t page = glyph_page_index[cp >> 8];
+        return page == GLYPH_NO_PAGE ? GLYPH_MISSING : glyph_pages[page][cp & 0xFF];
+    }
+    for (size_t i = 0; i < sizeof(glyph_ranges) / sizeof(glyph_ranges[0]); i++) {
+        if (cp >= glyph_ranges[i].first && cp <= glyph_ranges[i].last) {
+            return glyph_ranges[i].glyph;
+        }
+    }
+    return GLYPH_MISSING;
+}
+
+static inline int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+// Four hex digits at p, or -1
+static inline int32_t read_hex4(const char* p) {
+    int32_t value = 0;
+    for (int i = 0; i < 4; i++) {
+        int digit = hex_value(p[i]);
+        if (digit < 0) {
+            return -1;
+        }
+        value = (value << 4) | digit;
+    }
+    return value;
+}
+
+// Decode the escape at src[*pos] (just past the backslash)
+static uint32_t decode_escape(const char* src, size_t len, size_t* pos) {
+    size_t i = *pos;
+    if (i >= len) {
+        return REPLACEMENT_CHAR;
+    }
+
+    char c = src[i++];
+    *pos = i;
+    switch (c) {
+        case 'n': return '\n';
+        case 't': return '\t';
+        case 'r': return '\r';
+        case 'b': return '\b';
+        case 'f': return '\f';
+        case '"': case '\\': case '/': return (uint8_t)c;
+        case 'u': break;
+        default: return REPLACEMENT_CHAR;
+    }
+
+    int32_t unit = i + 4 <= len ? read_hex4(src + i) : -1;
+    if (unit < 0) {
+        return REPLACEMENT_CHAR;
+    }
+    i += 4;
+    *pos = i;
+
+    if (unit >= 0xD800 && unit <= 0xDBFF) {
+        // A high surrogate needs its low half in the next escape
+        int32_t low = i + 6 <= len && src[i] == '\\' && src[i + 1] == 'u' ? read_hex4(src + i + 2) : -1;
+        if (low < 0xDC00 || low > 0xDFFF) {
+            return REPLACEMENT_CHAR;
+        }
+        *pos = i + 6;
+        return 0x10000 + (((uint32_t)unit - 0xD800) << 10) + ((uint32_t)low - 0xDC00);
+    }
+    if (unit >= 0xDC00 && unit <= 0xDFFF) {
+        return REPLACEMENT_CHAR;
+    }
+    return (uint32_t)unit;
+}
+
+// Decode the UTF-8 sequence at src[*pos] (lead byte >= 0x80). Overlong
+// forms, surrogates and truncated sequences consume one byte and give U+FFFD.
+static uint32_t decode_utf8(const uint8_t* src, size_t len, size_t* pos) {
+    size_t i = *pos;
+    uint8_t lead = src[i];
+    uint32_t cp;
+    uint32_t min;
+    int extra;
+
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        cp = lead & 0x1F;
+        min = 0x80;
+        extra = 1;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        cp = lead & 0x0F;
+        min = 0x800;
+        extra = 2;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        cp = lead & 0x07;
+        min = 0x10000;
+        extra = 3;
+    } else {
+        *pos = i + 1;
+        return REPLACEMENT_CHAR;
+    }
+
+    if (i + extra >= len) {
+        *pos = i + 1;
+        return REPLACEMENT_CHAR;
+    }
+    for (int k = 1; k <= extra; k++) {
+        uint8_t next = src[i + k];
+        if ((next & 0xC0) != 0x80) {
+            *pos = i + 1;
+            return REPLACEMENT_CHAR;
+        }
+        cp = (cp << 6) | (next & 0x3F);
+    }
+    if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+        *pos = i + 1;
+        return REPLACEMENT_CHAR;
+    }
+
+    *pos = i + 1 + extra;
+    return cp;
+}
+
+// Append cp as UTF-8 if it fits in out[*written..limit)
+static inline bool put_utf8(uint32_t cp, char* out, size_t* written, size_t limit) {
+    uint8_t bytes[4];
+    size_t n;
+
+    if (cp < 0x80) {
+        bytes[0] = (uint8_t)cp;
+        n = 1;
+    } else if (cp < 0x800) {
+        bytes[0] = (uint8_t)(0xC0 | (cp >> 6));
+        bytes[1] = (uint8_t)(0x80 | (cp & 0x3F));
+        n = 2;
+    } else if (cp < 0x10000) {
+        bytes[0] = (uint8_t)(0xE0 | (cp >> 12));
+        bytes[1] = (uint8_t)(0x80 | ((cp >> 6) & 0x3F));
+        bytes[2] = (uint8_t)(0x80 | (cp & 0x3F));
+        n = 3;
+    } else {
+        bytes[0] = (uint8_t)(0xF0 | (cp >> 18));
+        bytes[1] = (uint8_t)(0x80 | ((cp >> 12) & 0x3F));
+        bytes[2] = (uint8_t)(0x80 | ((cp >> 6) & 0x3F));
+        bytes[3] = (uint8_t)(0x80 | (cp & 0x3F));
+        n = 4;
+    }
+
+    if (*written + n > limit) {
+        return false;
+    }
+    memcpy(out + *written, bytes, n);
+    *written += n;
+    return true;
+}
+
+size_t text_decode_json(const char* src, size_t len, char* out, size_t size, TextMode mode) {
+    if (size == 0) {
+        return 0;
+    }
+
+    const uint8_t* bytes = (const uint8_t*)src;
+    size_t limit = size - 1;
+    size_t written = 0;
+    size_t pos = 0;
+
+    while (pos < len && written < limit) {
+        // Fast path: printable ASCII is the same in every mode
+        size_t run = pos;
+        while (run < len && bytes[run] >= 0x20 && bytes[run] < 0x7F && bytes[run] != '\\') {
+            run++;
+        }
+        if (run > pos) {
+            size_t n = run - pos;
+            if (n > limit - written) {
+                n = limit - written;
+            }
+            memcpy(out + written, src + pos, n);
+            written += n;
+            pos += n;
+            continue;
+        }
+
+        uint32_t cp;
+        if (bytes[pos] == '\\') {
+            pos++;
+            cp = decode_escape(src, len, &pos);
+        } else if (bytes[pos] >= 0x80) {
+            cp = decode_utf8(bytes, len, &pos);
+        } else {
+            cp = bytes[pos++];
+        }
+
+        if (mode == TEXT_CONSOLE) {
+            uint8_t glyph = console_glyph(cp);
+            if (glyph != GLYPH_DROP) {
+                out[written++] = (char)glyph;
+            }
+        } else if (!put_utf8(cp, out, &written, limit)) {
+            break;
+        }
+    }
+
+    out[written] = '\0';
+    return written;
+}
@@ -0,0 +1,317 @@
+#include "transport.h"
+#include "timing.h"
+#include "mem.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <3ds.h>
+
+// Identical GETs share one network request: a request that finds the same
+// method + endpoint in flight waits for it and gets a copy of its response,
+// and one that finds it completed less than window_ms ago is answered from
+// that response. Any other method passes straight through and drops the
+// completed responses, since it may have changed what a GET would return.
+// Only 2xx responses are shared: a 429 or 5xx goes back to its own
+// requester alone, and the next identical request asks the network again.
+// A fresh request is never answered from another one, since the data is
+// known to have changed since; its own response replaces the kept one.
+
+#define COALESCE_SLOTS 8
+
+// How often a waiting request checks its own cancel token
+#define COALESCE_POLL_MS 5
+
+typedef struct {
+    char method[8];
+    char endpoint[256];
+    bool in_use;
+    bool in_flight;
+    bool ok;
+    int waiters;
+    uint64_t finished_at;
+    TransportResponse response;     // Kept while waiters or the window need it
+    NetSample sample;
+    LightEvent done;
+} Flight;
+
+typedef struct {
+    Transport base;
+    Transport* inner;
+    uint32_t window_ms;
+    LightLock lock;
+    Flight flights[COALESCE_SLOTS];
+    TransportCoalesceStats stats;
+} CoalesceTransport;
+
+static void flight_release(Flight* flight) {
+    mem_free(flight->response.body);
+    flight->response.body = NULL;
+    flight->ok = false;
+    flight->in_use = false;
+}
+
+// Drop completed responses nobody is waiting for; called with the lock held
+static void drop_completed(CoalesceTransport* ct, bool expired_only) {
+    uint64_t window = (uint64_t)ct->window_ms * TIMING_TICKS_PER_SEC / 1000;
+    uint64_t now = timing_now();
+
+    for (int i = 0; i < COALESCE_SLOTS; i++) {
+        Flight* flight = &ct->flights[i];
+        if (flight->in_use && !flight->in_flight && flight->waiters == 0 &&
+            (!expired_only || now - flight->finished_at >= window)) {
+            flight_release(flight);
+        }
+    }
+}
+
+// Cached responses are the first thing to go when memory runs short
+static size_t coalesce_evict(size_t needed, void* ctx) {
+    CoalesceTransport* ct = (CoalesceTransport*)ctx;
+    size_t freed = 0;
+
+    if (LightLock_TryLock(&ct->lock) != 0) {
+        return 0;
+    }
+    for (int i = 0; i < COALESCE_SLOTS; i++) {
+        Flight* flight = &ct->flights[i];
+        if (flight->in_use && !flight->in_flight && flight->waiters == 0) {
+            freed += flight->response.size;
+            flight_release(flight);
+        }
+    }
+    LightLock_Unlock(&ct->lock);
+    return freed;
+}
+
+// In-flight or successfully completed request with the same key
+static Flight* find_flight(CoalesceTransport* ct, const TransportRequest* request) {
+    for (int i = 0; i < COALESCE_SLOTS; i++) {
+        Flight* flight = &ct->flights[i];
+        if (flight->in_use && (flight->in_flight || flight->ok) && strcmp(flight->method, request->method) == 0 &&
+            strcmp(flight->endpoint, request->endpoint) == 0) {
+            return flight;
+        }
+    }
+    return NULL;
+}
+
+// Free slot, or the oldest completed one nobody waits for
+static Flight* claim_flight(CoalesceTransport* ct) {
+    Flight* oldest = NULL;
+    for (int i = 0; i < COALESCE_SLOTS; i++) {
+        Flight* flight = &ct->flights[i];
+        if (!flight->in_use) {
+            return flight;
+        }
+        if (!flight->in_flight && flight->waiters == 0 &&
+            (!oldest || flight->finished_at < oldest->finished_at)) {
+            oldest = flight;
+        }
+    }
+    if (oldest) {
+        flight_release(oldest);
+    }
+    return oldest;
+}
+
+// Give the caller its own copy of a shared response
+static bool copy_response(const Flight* flight, TransportResponse* response, NetSample* sample) {
+    response->body = mem_alloc(MEM_NET, flight->response.size + 1);
+    if (!response->body) {
+        return false;
+    }
+    memcpy(response->body, flight->response.body, flight->response.size + 1);
+    response->size = flight->response.size;
+    response->status = flight->response.status;
+
+    sample->http_status = flight->sample.http_status;
+    sample->bytes_down = flight->sample.bytes_down;
+    sample->coalesced = true;
+    return true;
+}
+
+// Wait for another caller's request to finish. Returns false if our own
+// token tripped first.
+static bool wait_for_flight(CoalesceTransport* ct, Flight* flight, CancelToken* cancel) {
+    while (true) {
+        LightLock_Lock(&ct->lock);
+        bool in_flight = flight->in_flight;
+        LightLock_Unlock(&ct->lock);
+
+        if (!in_flight) {
+            return true;
+        }
+        if (cancel_token_check(cancel)) {
+            return false;
+        }
+        LightEvent_WaitTimeout(&flight->done, (s64)COALESCE_POLL_MS * 1000000LL);
+    }
+}
+
+static bool coalesce_perform(Transport* transport, const TransportRequest* request,
+                             TransportResponse* response, NetSample* sample) {
+    CoalesceTransport* ct = (CoalesceTransport*)transport;
+    uint64_t start = timing_now();
+
+    if (strcmp(request->method, "GET") != 0) {
+        bool ok = ct->inner->perform(ct->inner, request, response, sample);
+        LightLock_Lock(&ct->lock);
+        drop_completed(ct, false);
+        LightLock_Unlock(&ct->lock);
+        return ok;
+    }
+
+    LightLock_Lock(&ct->lock);
+    ct->stats.requests++;
+    drop_completed(ct, true);
+
+    uint64_t window = (uint64_t)ct->window_ms * TIMING_TICKS_PER_SEC / 1000;
+    Flight* flight = find_flight(ct, request);
+    if (flight && request->fresh) {
+        if (flight->in_flight || flight->waiters > 0) {
+            // Started before the change, and still shared; go around it
+            LightLock_Unlock(&ct->lock);
+            return ct->inner->perform(ct->inner, request, response, sample);
+        }
+        flight_release(flight);
+        flight = NULL;
+    }
+    while (flight) {
+        if (!flight->in_flight) {
+            // Completed, and only kept around for its waiters if the window
+            // has already passed
+            bool ok = timing_now() - flight->finished_at < window && copy_response(flight, response, sample);
+            if (ok) {
+                ct->stats.debounced++;
+                LightLock_Unlock(&ct->lock);
+                sample->total_ms = timing_ticks_to_ms(timing_now() - start);
+                return true;
+            }
+            if (flight->waiters == 0) {
+                flight_release(flight);
+            }
+            break;
+        }
+
+        // Attach to the request in flight
+        flight->waiters++;
+        LightLock_Unlock(&ct->lock);
+        bool finished = wait_for_flight(ct, flight, request->cancel);
+        LightLock_Lock(&ct->lock);
+        flight->waiters--;
+
+        if (!finished) {
+            LightLock_Unlock(&ct->lock);
+            return false;
+        }
+        if (flight->ok && copy_response(flight, response, sample)) {
+            ct->stats.attached++;
+            if (flight->waiters == 0 && ct->window_ms == 0) {
+                flight_release(flight);
+            }
+            LightLock_Unlock(&ct->lock);
+            sample->total_ms = timing_ticks_to_ms(timing_now() - start);
+            return true;
+        }
+
+        // The request we waited on failed (maybe cancelled by its owner);
+        // make our own attempt unless someone already started a new one
+        if (flight->waiters == 0 && flight->in_use && !flight->in_flight) {
+            flight_release(flight);
+        }
+        flight = find_flight(ct, request);
+    }
+
+    flight = claim_flight(ct);
+    if (!flight) {
+        // Every slot is busy; just go to the network
+        LightLock_Unlock(&ct->lock);
+        return ct->inner->perform(ct->inner, request, response, sample);
+    }
+    memset(&flight->response, 0, sizeof(flight->response));
+    strncpy(flight->method, request->method, sizeof(flight->method) - 1);
+    flight->method[sizeof(flight->method) - 1] = '\0';
+    strncpy(flight->endpoint, request->endpoint, sizeof(flight->endpoint) - 1);
+    flight->endpoint[sizeof(flight->endpoint) - 1] = '\0';
+    flight->in_use = true;
+    flight->in_flight = true;
+    flight->ok = false;
+    flight->waiters = 0;
+    LightEvent_Clear(&flight->done);
+    LightLock_Unlock(&ct->lock);
+
+    bool ok = ct->inner->perform(ct->inner, request, response, sample);
+
+    LightLock_Lock(&ct->lock);
+    flight->in_flight = false;
+    flight->finished_at = timing_now();
+    flight->sample = *sample;
+    bool success = ok && response->status >= 200 && response->status < 300;
+    if (success && (flight->waiters > 0 || ct->window_ms > 0)) {
+        // Keep a copy for waiters and later identical requests
+        flight->response.body = mem_alloc(MEM_CACHE, response->size + 1);
+        if (flight->response.body) {
+            memcpy(flight->response.body, response->body, response->size + 1);
+            flight->response.size = response->size;
+            flight->response.status = response->status;
+            flight->ok = true;
+        }
+    }
+    if (!flight->ok && flight->waiters == 0) {
+        flight_release(flight);
+    }
+    LightEvent_Signal(&flight->done);
+    LightLock_Unlock(&ct->lock);
+
+    return ok;
+}
+
+// Downloads are streamed and never shared
+static bool coalesce_download(Transport* transport, const TransportDownload* request, NetSample* sample) {
+    CoalesceTransport* ct = (CoalesceTransport*)transport;
+    return transport_download(ct->inner, request, sample);
+}
+
+static void coalesce_destroy(Transport* transport) {
+    CoalesceTransport* ct = (CoalesceTransport*)transport;
+
+    mem_unregister_evictor(coalesce_evict, ct);
+    for (int i = 0; i < COALESCE_SLOTS; i++) {
+        mem_free(ct->flights[i].response.body);
+    }
+    transport_destroy(ct->inner);
+    mem_free(ct);
+}
+
+Transport* transport_coalesce_create(Transport* inner, uint32_t window_ms) {
+    CoalesceTransport* ct = mem_calloc(MEM_NET, 1, sizeof(CoalesceTransport));
+    if (!ct) {
+        return inner;
+    }
+
+    ct->base.name = "coalesce";
+    ct->base.perform = coalesce_perform;
+    ct->base.destroy = coalesce_destroy;
+    ct->base.download = coalesce_download;
+    ct->inner = inner;
+    ct->window_ms = window_ms;
+    LightLock_Init(&ct->lock);
+    for (int i = 0; i < COALESCE_SLOTS; i++) {
+        LightEvent_Init(&ct->flights[i].done, RESET_STICKY);
+    }
+
+    mem_register_evictor(MEM_CACHE, coalesce_evict, ct);
+    return &ct->base;
+}
+
+bool transport_coalesce_stats(const Transport* transport, TransportCoalesceStats* stats) {
+    if (!transport || transport->perform != coalesce_perform) {
+        return false;
+    }
+
+    CoalesceTransport* ct = (CoalesceTransport*)transport;
+    LightLock_Lock(&ct->lock);
+    *stats = ct->stats;
+    LightLock_Unlock(&ct->lock);
+    return true;
+}
@@ -0,0 +1,304 @@
+#include "transport.h"
+#include "mem.h"
+#include "cancel.h"
+#include "log.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <curl/curl.h>
+
+#define CONNECT_TIMEOUT_MS 5000
+
+// Give up on a connection that moves fewer than LOW_SPEED_LIMIT bytes/s for
+// LOW_SPEED_TIME seconds, even if the overall deadline is further away
+#define LOW_SPEED_LIMIT 64
+#define LOW_SPEED_TIME 10
+
+// curl's buffer for a streamed request body, the most of it in memory at once
+#define UPLOAD_BUFFER_SIZE (16 * 1024)
+
+typedef struct {
+    Transport base;
+    char base_url[128];
+} CurlTransport;
+
+// Structure to hold HTTP response
+typedef struct {
+    char* data;
+    size_t size;
+} HTTPResponse;
+
+static int curl_users = 0;
+
+// Callback for curl to write response data
+static size_t write_callback(void* contents, size_t size, size_t nmemb, void* userp) {
+    size_t realsize = size * nmemb;
+    HTTPResponse* resp = (HTTPResponse*)userp;
+    
+    char* ptr = mem_realloc(MEM_NET, resp->data, resp->size + realsize + 1);
+    if (ptr == NULL) {
+        log_write(LOG_ERROR, "Failed to allocate memory for response");
+        return 0;
+    }
+    
+    resp->data = ptr;
+    memcpy(&(resp->data[resp->size]), contents, realsize);
+    resp->size += realsize;
+    resp->data[resp->size] = 0;
+    
+    return realsize;
+}
+
+// Callback for curl to pull the next piece of a streamed request body
+static size_t read_callback(char* buffer, size_t size, size_t nitems, void* userp) {
+    const TransportRequest* request = (const TransportRequest*)userp;
+    size_t length = 0;
+    
+    if (!request->read(buffer, size * nitems, &length, request->read_ctx)) {
+        return CURL_READFUNC_ABORT;
+    }
+    return length;
+}
+
+// Progress callback: abort the transfer once the request's token trips
+static int xferinfo_callback(void* clientp, curl_off_t dltotal, curl_off_t dlnow,
+                             curl_off_t ultotal, curl_off_t ulnow) {
+    return cancel_token_check((CancelToken*)clientp) ? 1 : 0;
+}
+
+// Copy curl's per-phase timings and byte counts into a sample
+static void fill_net_sample(CURL* curl, NetSample* sample) {
+    double seconds = 0;
+    curl_off_t bytes = 0;
+    
+    if (curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME, &seconds) == CURLE_OK) {
+        sample->namelookup_ms = seconds * 1000.0;
+    }
+    if (curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME, &seconds) == CURLE_OK) {
+        sample->connect_ms = seconds * 1000.0;
+    }
+    if (curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME, &seconds) == CURLE_OK) {
+        sample->appconnect_ms = seconds * 1000.0;
+    }
+    if (curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME, &seconds) == CURLE_OK) {
+        sample->starttransfer_ms = seconds * 1000.0;
+    }
+    if (curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &seconds) == CURLE_OK) {
+        sample->total_ms = seconds * 1000.0;
+    }
+    if (curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &bytes) == CURLE_OK) {
+        sample->bytes_down = (long long)bytes;
+    }
+    if (curl_easy_getinfo(curl, CURLINFO_SIZE_UPLOAD_T, &bytes) == CURLE_OK) {
+        sample->bytes_up = (long long)bytes;
+    }
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &sample->http_status);
+}
+
+static bool curl_perform(Transport* transport, const TransportRequest* request,
+                         TransportResponse* response, NetSample* sample) {
+    CurlTransport* ct = (CurlTransport*)transport;
+    CURL* curl;
+    CURLcode res;
+    HTTPResponse http = {0};
+    
+    http.data = mem_alloc(MEM_NET, 1);
+    http.size = 0;
+    if (!http.data) {
+        return false;
+    }
+    http.data[0] = '\0';
+    
+    curl = curl_easy_init();
+    if (!curl) {
+        mem_free(http.data);
+        return false;
+    }
+    
+    char url[512];
+    snprintf(url, sizeof(url), "%s%s", ct->base_url, request->endpoint);
+    
+    char auth_header[256];
+    snprintf(auth_header, sizeof(auth_header), "Authorization: %s", request->token);
+    char type_header[128];
+    snprintf(type_header, sizeof(type_header), "Content-Type: %s",
+             request->content_type ? request->content_type : "application/json");
+    
+    struct curl_slist* headers = NULL;
+    headers = curl_slist_append(headers, auth_header);
+    headers = curl_slist_append(headers, type_header);
+    headers = curl_slist_append(headers, "User-Agent: Discord3DS/1.0");
+    
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void*)&http);
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, "Discord3DS/1.0");
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 2L);
+    
+    // Timeouts, and no signals since requests also run on the outbox thread
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, (long)CONNECT_TIMEOUT_MS);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, (long)LOW_SPEED_LIMIT);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, (long)LOW_SPEED_TIME);
+    if (request->cancel) {
+        if (request->cancel->deadline) {
+            curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, (long)cancel_token_remaining_ms(request->cancel));
+        }
+        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+        curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, xferinfo_callback);
+        curl_easy_setopt(curl, CURLOPT_XFERINFODATA, (void*)request->cancel);
+    }
+    
+    if (request->read) {
+        // Pulled through curl's own upload buffer as it goes out
+        curl_easy_setopt(curl, CURLOPT_POST, 1L);
+        curl_easy_setopt(curl, CURLOPT_READFUNCTION, read_callback);
+        curl_easy_setopt(curl, CURLOPT_READDATA, (void*)request);
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)request->read_len);
+        curl_easy_setopt(curl, CURLOPT_UPLOAD_BUFFERSIZE, (long)UPLOAD_BUFFER_SIZE);
+    } else if (request->body) {
+        // POSTFIELDS does not copy, the body stays owned by the caller
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request->body);
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)request->body_len);
+    }
+    if (strcmp(request->method, "GET") != 0 && strcmp(request->method, "POST") != 0) {
+        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, request->method);
+    }
+    
+    res = curl_easy_perform(curl);
+    fill_net_sample(curl, sample);
+    
+    curl_slist_free_all(headers);
+    curl_easy_cleanup(curl);
+    
+    if (res != CURLE_OK) {
+        if (res == CURLE_OPERATION_TIMEDOUT && request->cancel) {
+            // curl enforced the deadline itself
+            request->cancel->expired = true;
+            cancel_token_cancel(request->cancel);
+        }
+        if (res != CURLE_ABORTED_BY_CALLBACK) {
+            log_write(LOG_ERROR, "curl_easy_perform() failed: %s", curl_easy_strerror(res));
+        }
+        // Drop whatever arrived so far; callers only ever see whole bodies
+        mem_free(http.data);
+        return false;
+    }
+    
+    response->status = sample->http_status;
+    response->body = http.data;
+    response->size = http.size;
+    return true;
+}
+
+// State of a streamed download between curl callbacks
+typedef struct {
+    CURL* curl;
+    const TransportDownload* request;
+    bool begun;
+} CurlDownload;
+
+static size_t download_callback(void* contents, size_t size, size_t nmemb, void* userp) {
+    CurlDownload* download = (CurlDownload*)userp;
+    const TransportDownload* request = download->request;
+    size_t realsize = size * nmemb;
+    
+    // The status and length are known once the first body bytes arrive
+    if (!download->begun) {
+        long status = 0;
+        curl_off_t length = -1;
+        curl_easy_getinfo(download->curl, CURLINFO_RESPONSE_CODE, &status);
+        curl_easy_getinfo(download->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+        download->begun = true;
+        if (!request->begin(status, (int64_t)length, request->ctx)) {
+            return 0;
+        }
+    }
+    return request->write(contents, realsize, request->ctx) ? realsize : 0;
+}
+
+static bool curl_download(Transport* transport, const TransportDownload* request, NetSample* sample) {
+    (void)transport;
+    CURL* curl = curl_easy_init();
+    if (!curl) {
+        return false;
+    }
+    CurlDownload download = { curl, request, false };
+    
+    char range[32];
+    if (request->offset > 0) {
+        snprintf(range, sizeof(range), "%llu-", (unsigned long long)request->offset);
+        curl_easy_setopt(curl, CURLOPT_RANGE, range);
+    }
+    
+    // The CDN link is signed, so no Authorization header
+    curl_easy_setopt(curl, CURLOPT_URL, request->url);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, download_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void*)&download);
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, "Discord3DS/1.0");
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 2L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, (long)CONNECT_TIMEOUT_MS);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, (long)LOW_SPEED_LIMIT);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, (long)LOW_SPEED_TIME);
+    if (request->cancel) {
+        if (request->cancel->deadline) {
+            curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, (long)cancel_token_remaining_ms(request->cancel));
+        }
+        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+        curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, xferinfo_callback);
+        curl_easy_setopt(curl, CURLOPT_XFERINFODATA, (void*)request->cancel);
+    }
+    
+    CURLcode res = curl_easy_perform(curl);
+    fill_net_sample(curl, sample);
+    curl_easy_cleanup(curl);
+    
+    // A response without a body (a 416 for a finished file) still begins
+    if (!download.begun && res == CURLE_OK && !request->begin(sample->http_status, 0, request->ctx)) {
+        return false;
+    }
+    if (res != CURLE_OK) {
+        if (res == CURLE_OPERATION_TIMEDOUT && request->cancel) {
+            request->cancel->expired = true;
+            cancel_token_cancel(request->cancel);
+        }
+        if (res != CURLE_ABORTED_BY_CALLBACK && res != CURLE_WRITE_ERROR) {
+            log_write(LOG_ERROR, "Download failed: %s", curl_easy_strerror(res));
+        }
+        return false;
+    }
+    return true;
+}
+
+static void curl_destroy(Transport* transport) {
+    mem_free(transport);
+    
+    // Cleanup curl once the last transport is gone
+    if (--curl_users == 0) {
+        curl_global_cleanup();
+    }
+}
+
+Transport* transport_curl_create(const char* base_url) {
+    CurlTransport* ct = mem_calloc(MEM_NET, 1, sizeof(CurlTransport));
+    if (!ct) {
+        return NULL;
+    }
+    
+    // Initialize curl globally
+    if (curl_users++ == 0) {
+        curl_global_init(CURL_GLOBAL_DEFAULT);
+    }
+    
+    ct->base.name = "curl";
+    ct->base.perform = curl_perform;
+    ct->base.destroy = curl_destroy;
+    ct->base.download = curl_download;
+    strncpy(ct->base_url, base_url, sizeof(ct->base_url) - 1);
+    return &ct->base;
+}
@@ -0,0 +1,325 @@
+#include "transport.h"
+#include "timing.h"
+#include "mem.h"
+#include "log.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <3ds.h>
+
+// Recording format, one exchange per block (bodies are raw bytes):
+//
+//   > METHOD ENDPOINT REQUEST_BODY_LENGTH
+//   <request body>
+//   < STATUS RESPONSE_BODY_LENGTH
+//   <response body>
+
+// How often a delayed reply checks its cancel token
+#define REPLAY_POLL_MS 5
+
+// Piece of a streamed request body pulled per read
+#define REPLAY_READ_CHUNK (4 * 1024)
+
+typedef struct {
+    char method[8];
+    char endpoint[256];
+    long status;
+    char* body;
+    size_t size;
+    int served;
+} ReplayEntry;
+
+typedef struct {
+    Transport base;
+    ReplayEntry* entries;
+    int count;
+    int capacity;
+    uint32_t latency_ms;
+    uint32_t jitter_ms;
+    uint32_t rng;
+    LightLock lock;     // Guards served counts and the PRNG
+} ReplayTransport;
+
+typedef struct {
+    Transport base;
+    Transport* inner;
+    FILE* file;
+    LightLock lock;     // Keeps concurrent exchanges from interleaving
+} RecordTransport;
+
+static const char not_found_body[] = "{\"message\": \"404: Not Found\", \"code\": 0}";
+
+// Small deterministic PRNG so jittered runs are repeatable
+static uint32_t replay_random(ReplayTransport* rt) {
+    rt->rng ^= rt->rng << 13;
+    rt->rng ^= rt->rng >> 17;
+    rt->rng ^= rt->rng << 5;
+    return rt->rng;
+}
+
+// Match a recorded endpoint against a request; '*' in the recording matches
+// one path segment so synthetic sessions can serve any id
+static bool endpoint_matches(const char* pattern, const char* endpoint) {
+    while (*pattern) {
+        if (*pattern == '*') {
+            pattern++;
+            while (*endpoint && *endpoint != '/' && *endpoint != '?') {
+                endpoint++;
+            }
+        } else if (*pattern++ != *endpoint++) {
+            return false;
+        }
+    }
+    return *endpoint == '\0';
+}
+
+static ReplayEntry* replay_find(ReplayTransport* rt, const char* method, const char* endpoint) {
+    // Identical requests cycle through their recordings in order
+    ReplayEntry* best = NULL;
+    for (int i = 0; i < rt->count; i++) {
+        ReplayEntry* entry = &rt->entries[i];
+        if (strcmp(entry->method, method) == 0 && endpoint_matches(entry->endpoint, endpoint) &&
+            (!best || entry->served < best->served)) {
+            best = entry;
+        }
+    }
+    return best;
+}
+
+static bool replay_perform(Transport* transport, const TransportRequest* request,
+                           TransportResponse* response, NetSample* sample) {
+    ReplayTransport* rt = (ReplayTransport*)transport;
+    uint64_t start = timing_now();
+    
+    uint32_t delay = rt->latency_ms;
+    if (rt->jitter_ms > 0) {
+        LightLock_Lock(&rt->lock);
+        delay += replay_random(rt) % (rt->jitter_ms + 1);
+        LightLock_Unlock(&rt->lock);
+    }
+    // Sleep in short slices so cancellation is noticed like on a real socket
+    uint64_t wake = start + (uint64_t)delay * TIMING_TICKS_PER_SEC / 1000;
+    while (timing_now() < wake) {
+        if (cancel_token_check(request->cancel)) {
+            return false;
+        }
+        uint32_t left = (uint32_t)timing_ticks_to_ms(wake - timing_now());
+        timing_sleep_ms(left < REPLAY_POLL_MS ? left + 1 : REPLAY_POLL_MS);
+    }
+    if (cancel_token_check(request->cancel)) {
+        return false;
+    }
+    
+    // Consume a streamed body as a socket would, so its reader runs
+    long long bytes_up = (long long)request->body_len;
+    if (request->read) {
+        char chunk[REPLAY_READ_CHUNK];
+        size_t length;
+        do {
+            if (!request->read(chunk, sizeof(chunk), &length, request->read_ctx) ||
+                cancel_token_check(request->cancel)) {
+                return false;
+            }
+            bytes_up += (long long)length;
+        } while (length > 0);
+    }
+    
+    // Entries are never removed, so the body stays valid after unlocking
+    LightLock_Lock(&rt->lock);
+    ReplayEntry* entry = replay_find(rt, request->method, request->endpoint);
+    const char* body = not_found_body;
+    size_t size = sizeof(not_found_body) - 1;
+    long status = 404;
+    if (entry) {
+        entry->served++;
+        body = entry->body;
+        size = entry->size;
+        status = entry->status;
+    }
+    LightLock_Unlock(&rt->lock);
+    
+    response->body = mem_alloc(MEM_NET, size + 1);
+    if (!response->body) {
+        return false;
+    }
+    memcpy(response->body, body, size);
+    response->body[size] = '\0';
+    response->size = size;
+    response->status = status;
+    
+    sample->http_status = status;
+    sample->bytes_down = size;
+    sample->bytes_up = bytes_up;
+    sample->total_ms = timing_ticks_to_ms(timing_now() - start);
+    sample->starttransfer_ms = sample->total_ms;
+    return true;
+}
+
+static void replay_destroy(Transport* transport) {
+    ReplayTransport* rt = (ReplayTransport*)transport;
+    for (int i = 0; i < rt->count; i++) {
+        mem_free(rt->entries[i].body);
+    }
+    mem_free(rt->entries);
+    mem_free(rt);
+}
+
+bool transport_replay_add(Transport* transport, const char* method, const char* endpoint,
+                          long status, const char* body, size_t body_len) {
+    ReplayTransport* rt = (ReplayTransport*)transport;
+    
+    if (rt->count == rt->capacity) {
+        int capacity = rt->capacity ? rt->capacity * 2 : 16;
+        ReplayEntry* grown = mem_realloc(MEM_NET, rt->entries, capacity * sizeof(ReplayEntry));
+        if (!grown) {
+            return false;
+        }
+        rt->entries = grown;
+        rt->capacity = capacity;
+    }
+    
+    ReplayEntry* entry = &rt->entries[rt->count];
+    memset(entry, 0, sizeof(ReplayEntry));
+    entry->body = mem_alloc(MEM_NET, body_len + 1);
+    if (!entry->body) {
+        return false;
+    }
+    memcpy(entry->body, body, body_len);
+    entry->body[body_len] = '\0';
+    entry->size = body_len;
+    entry->status = status;
+    strncpy(entry->method, method, sizeof(entry->method) - 1);
+    strncpy(entry->endpoint, endpoint, sizeof(entry->endpoint) - 1);
+    
+    rt->count++;
+    return true;
+}
+
+// Read one "> ..." / "< ..." block; returns false at end of file
+static bool replay_load_exchange(Transport* transport, FILE* f) {
+    char method[8], endpoint[256];
+    long status = 0;
+    size_t request_len = 0, response_len = 0;
+    
+    if (fscanf(f, "> %7s %255s %zu", method, endpoint, &request_len) != 3 || fgetc(f) != '\n') {
+        return false;
+    }
+    // The request body is only kept for reference in the file
+    fseek(f, (long)request_len + 1, SEEK_CUR);
+    
+    if (fscanf(f, "< %ld %zu", &status, &response_len) != 2 || fgetc(f) != '\n') {
+        return false;
+    }
+    
+    char* body = mem_alloc(MEM_NET, response_len + 1);
+    if (!body) {
+        return false;
+    }
+    bool ok = fread(body, 1, response_len, f) == response_len;
+    fgetc(f); // trailing newline
+    if (ok) {
+        ok = transport_replay_add(transport, method, endpoint, status, body, response_len);
+    }
+    mem_free(body);
+    return ok;
+}
+
+Transport* transport_replay_create(const char* path, uint32_t latency_ms, uint32_t jitter_ms) {
+    ReplayTransport* rt = mem_calloc(MEM_NET, 1, sizeof(ReplayTransport));
+    if (!rt) {
+        return NULL;
+    }
+    
+    rt->base.name = "replay";
+    rt->base.perform = replay_perform;
+    rt->base.destroy = replay_destroy;
+    rt->latency_ms = latency_ms;
+    rt->jitter_ms = jitter_ms;
+    rt->rng = 0x3D5u;
+    LightLock_Init(&rt->lock);
+    
+    if (path) {
+        FILE* f = fopen(path, "rb");
+        if (!f) {
+            log_write(LOG_ERROR, "Failed to open %s", path);
+            replay_destroy(&rt->base);
+            return NULL;
+        }
+        while (replay_load_exchange(&rt->base, f)) {
+        }
+        fclose(f);
+    }
+    
+    return &rt->base;
+}
+
+static bool record_perform(Transport* transport, const TransportRequest* request,
+                           TransportResponse* response, NetSample* sample) {
+    RecordTransport* rec = (RecordTransport*)transport;
+    
+    if (!rec->inner->perform(rec->inner, request, response, sample)) {
+        return false;
+    }
+    
+    LightLock_Lock(&rec->lock);
+    fprintf(rec->file, "> %s %s %zu\n", request->method, request->endpoint, request->body_len);
+    if (request->body_len > 0) {
+        fwrite(request->body, 1, request->body_len, rec->file);
+    }
+    fprintf(rec->file, "\n< %ld %zu\n", response->status, response->size);
+    fwrite(response->body, 1, response->size, rec->file);
+    fputc('\n', rec->file);
+    fflush(rec->file);
+    LightLock_Unlock(&rec->lock);
+    
+    return true;
+}
+
+// Downloads are not recorded; a replay never serves them
+static bool record_download(Transport* transport, const TransportDownload* request, NetSample* sample) {
+    RecordTransport* rec = (RecordTransport*)transport;
+    return transport_download(rec->inner, request, sample);
+}
+
+static void record_destroy(Transport* transport) {
+    RecordTransport* rec = (RecordTransport*)transport;
+    fclose(rec->file);
+    transport_destroy(rec->inner);
+    mem_free(rec);
+}
+
+Transport* transport_record_create(Transport* inner, const char* path) {
+    RecordTransport* rec = mem_calloc(MEM_NET, 1, sizeof(RecordTransport));
+    if (!rec) {
+        return inner;
+    }
+    
+    rec->file = fopen(path, "ab");
+    if (!rec->file) {
+        log_write(LOG_ERROR, "Failed to open %s", path);
+        mem_free(rec);
+        return inner;
+    }
+    
+    rec->base.name = "record";
+    rec->base.perform = record_perform;
+    rec->base.destroy = record_destroy;
+    rec->base.download = record_download;
+    rec->inner = inner;
+    LightLock_Init(&rec->lock);
+    return &rec->base;
+}
+
+bool transport_download(Transport* transport, const TransportDownload* request, NetSample* sample) {
+    if (!transport || !transport->download) {
+        log_write(LOG_ERROR, "Transport %s cannot download", transport ? transport->name : "(none)");
+        return false;
+    }
+    return transport->download(transport, request, sample);
+}
+
+void transport_destroy(Transport* transport) {
+    if (transport && transport->destroy) {
+        transport->destroy(transport);
+    }
+}
@@ -1,29 +1,257 @@
 #include "ui.h"
+#include "net_stats.h"
+#include "mem.h"
+#include "outbox.h"
+#include "history.h"
+#include "client_view.h"
+#include "text.h"
+#include "poller.h"
+#include "vlist.h"
+#include "log.h"
+#include "download.h"
+#include "image_cache.h"
+#include "timing.h"
 #include <stdio.h>
 #include <string.h>
 #include <3ds.h>
 
+// Keyboard text that sends a file from the SD card: "/upload PATH [caption]"
+#define UI_UPLOAD_COMMAND "/upload "
+
 static PrintConsole topScreen, bottomScreen;
 
+// Client whose requests ui_poll_cancel may interrupt
+static DiscordClient* attached_client = NULL;
+
 void ui_init(void) {
     // Initialize console on both screens
     consoleInit(GFX_TOP, &topScreen);
     consoleInit(GFX_BOTTOM, &bottomScreen);
 }
 
-void ui_render_top_screen(DiscordClient* client, UIState* state) {
-    consoleSelect(&topScreen);
-    consoleClear();
+void ui_state_init(UIState* state) {
+    memset(state, 0, sizeof(UIState));
+    vlist_init(&state->server_list, UI_LIST_ROWS);
+    vlist_init(&state->channel_list, UI_LIST_ROWS);
+    vlist_init(&state->member_list, UI_LIST_ROWS);
+    vlist_init(&state->switcher_list, UI_LIST_ROWS);
+}
+
+// Cancel hook, called from inside blocking requests. B abandons the
+// request, START abandons it and exits, and L/R abandon it in favour of a
+// switch to the newly selected server, made by ui_resume_switch. Other keys
+// pressed meanwhile are kept for the main loop, since this scan consumes
+// their edges.
+static bool ui_poll_cancel(void* ctx) {
+    UIState* state = (UIState*)ctx;
+    
+    hidScanInput();
+    u32 kDown = hidKeysDown();
+    state->deferred_keys |= kDown & ~(KEY_START | KEY_B | KEY_L | KEY_R);
+    
+    if (kDown & KEY_START) {
+        state->exit_requested = true;
+        return true;
+    }
+    if (kDown & KEY_B) {
+        return true;
+    }
+    if (kDown & (KEY_L | KEY_R)) {
+        int target = state->selected_server + ((kDown & KEY_L) ? -1 : 1);
+        if (target >= 0 && target < attached_client->server_count) {
+            state->selected_server = target;
+            state->switch_pending = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ui_attach(DiscordClient* client, UIState* state) {
+    attached_client = client;
+    discord_set_cancel_hook(client, ui_poll_cancel, state);
+}
+
+void ui_mark_read(DiscordClient* client) {
+    const char* newest = client->message_count > 0 ? client->messages[client->message_count - 1].id : NULL;
+    poller_set_focus(client->current_channel_id, client->current_server_id, newest);
+}
+
+// Switch to state->selected_server, following further L/R presses made
+// while loading. A failed switch restores the previous selection.
+static void ui_switch_to_selected(DiscordClient* client, UIState* state, int previous) {
+    do {
+        state->switch_pending = false;
+        const char* server_id = client->servers[state->selected_server].id;
+        bool switched = discord_switch_server(client, server_id);
+        if (strcmp(client->current_server_id, server_id) == 0) {
+            previous = state->selected_server;
+            // The client opens the server's first channel
+            state->selected_channel = 0;
+        }
+        if (switched) {
+            if (discord_fetch_messages(client)) {
+                ui_mark_read(client);
+            }
+            // L/R during the message fetch moves on without loading users
+            if (!state->switch_pending && !client->users_attempted) {
+                discord_fetch_users(client);
+            }
+        }
+    } while (state->switch_pending && !state->exit_requested);
+    
+    if (strcmp(client->current_server_id, client->servers[state->selected_server].id) != 0) {
+        state->selected_server = previous;
+    }
+}
+
+void ui_resume_switch(DiscordClient* client, UIState* state) {
+    if (!state->switch_pending || state->exit_requested) {
+        return;
+    }
+    // A failed switch falls back to the server actually loaded
+    int previous = state->selected_server;
+    for (int i = 0; i < client->server_count; i++) {
+        if (strcmp(client->servers[i].id, client->current_server_id) == 0) {
+            previous = i;
+            break;
+        }
+    }
+    ui_switch_to_selected(client, state, previous);
+}
+
+// Network timing overlay drawn over the bottom rows of the top screen
+static void ui_render_net_hud(DiscordClient* client) {
+    TransportCoalesceStats coalesce = {0};
+    transport_coalesce_stats(client->transport, &coalesce);
+    
+    printf("\x1b[21;0H");
+    printf("\x1b[44;37m--- Net HUD (%d req, %d saved) p50/p95 ms ---\x1b[0m\n",
+           net_stats_sample_count(), coalesce.attached + coalesce.debounced);
+    
+    if (net_stats_sample_count() == 0) {
+        printf("\x1b[44;37m No requests yet                       \x1b[0m\n");
+        return;
+    }
+    
+    // Two metrics per row
+    for (int m = 0; m < NET_METRIC_COUNT; m += 2) {
+        double p50 = 0, p95 = 0;
+        printf("\x1b[44;37m");
+        net_stats_percentiles((NetMetric)m, &p50, &p95);
+        printf(" %-5s %7.1f/%-7.1f", net_stats_metric_name((NetMetric)m), p50, p95);
+        if (m + 1 < NET_METRIC_COUNT) {
+            net_stats_percentiles((NetMetric)(m + 1), &p50, &p95);
+            printf(" %-5s %7.1f/%-7.1f", net_stats_metric_name((NetMetric)(m + 1)), p50, p95);
+        }
+        printf("\x1b[0m\n");
+    }
+    
+    NetSample last;
+    net_stats_last(&last);
+    if (last.aborted) {
+        printf("\x1b[44;37m Last: %s %.24s aborted in %.0fms\x1b[0m\n",
+               last.method, last.endpoint, last.abort_ms);
+    } else {
+        printf("\x1b[44;37m Last: %s %.24s %lldB %.0fms\x1b[0m\n",
+               last.method, last.endpoint, last.bytes_down, last.total_ms);
+    }
+    
+    OutboxStats outbox = outbox_get_stats();
+    printf("\x1b[44;37m Outbox %d queued %d sent %d retry %.0f/%.0fms\x1b[0m\n",
+           outbox.depth, outbox.sent, outbox.retries, outbox.p50_latency_ms, outbox.p95_latency_ms);
+}
+
+// Heap usage per subsystem, drawn over the same rows as the network HUD
+static void ui_render_mem_overlay(void) {
+    printf("\x1b[21;0H");
+    printf("\x1b[45;37m--- Memory (KB) cur/peak  allocs  budget ---\x1b[0m\n");
+    
+    for (int t = 0; t < MEM_TAG_COUNT; t++) {
+        MemStats stats = mem_get_stats((MemTag)t);
+        printf("\x1b[45;37m %-8s %6zu/%-6zu %7zu ", mem_tag_name((MemTag)t),
+               stats.current / 1024, stats.peak / 1024, stats.allocations);
+        if (stats.budget > 0) {
+            printf("%6zu", stats.budget / 1024);
+        } else {
+            printf("     -");
+        }
+        printf("\x1b[0m\n");
+    }
+    
+    // Compressed channel history: windows kept, size, ratio, restore time
+    HistoryStats history = history_get_stats();
+    printf("\x1b[45;37m Total %zu KB  History %dch %zuKB %.1fx %.1fms\x1b[0m\n",
+           mem_total_current() / 1024, history.channels, history.compressed_bytes / 1024,
+           history.compressed_bytes ? (double)history.struct_bytes / history.compressed_bytes : 0.0,
+           history.last_inflate_ms);
+}
+
+// Newest log records, drawn over the same rows as the network HUD
+static void ui_render_log_pane(void) {
+    static const int level_colors[LOG_LEVEL_COUNT] = { 36, 37, 33, 31 };
+    LogRecord records[LOG_RECENT];
+    int count = log_recent(records, LOG_RECENT);
+    LogStats stats = log_get_stats();
+    
+    printf("\x1b[21;0H");
+    printf("\x1b[40;37m--- Log (%lu written, %lu dropped) age ---\x1b[0m\n",
+           (unsigned long)stats.written, (unsigned long)stats.dropped);
+    
+    uint64_t now = timing_now();
+    for (int i = 0; i < LOG_RECENT; i++) {
+        if (i < count) {
+            const LogRecord* record = &records[i];
+            printf("\x1b[40;%dm%5.0fs %-5s %-36.36s\x1b[0m\n", level_colors[record->level],
+                   timing_ticks_to_ms(now - record->time) / 1000.0, log_level_name(record->level), record->text);
+        } else {
+            printf("\x1b[40m%49s\x1b[0m\n", "");
+        }
+    }
+}
+
+// One line for a message's attachment and how far its download got
+static void ui_render_attachment(const DiscordMessage* msg, bool selected) {
+    const DiscordAttachment* attachment = &msg->attachment;
+    DownloadStatus status;
+    char state_text[24];
+    
+    switch (download_status(attachment->id, &status)) {
+        case DOWNLOAD_QUEUED:
+            snprintf(state_text, sizeof(state_text), "\x1b[33mqueued\x1b[0m");
+            break;
+        case DOWNLOAD_ACTIVE:
+            snprintf(state_text, sizeof(state_text), "\x1b[33m%d%%\x1b[0m",
+                     status.total ? (int)(status.done * 100 / status.total) : 0);
+            break;
+        case DOWNLOAD_DONE:
+            snprintf(state_text, sizeof(state_text), "\x1b[32msaved\x1b[0m");
+            break;
+        case DOWNLOAD_FAILED:
+            snprintf(state_text, sizeof(state_text), "\x1b[31mfailed, A\x1b[0m");
+            break;
+        default:
+            // Not requested; no url means the CDN link was too long to keep
+            snprintf(state_text, sizeof(state_text), "%s", attachment->url[0] == '\0' ? "no link" :
+                     selected ? "\x1b[33mA: save\x1b[0m" : "");
+            break;
+    }
     
+    printf("  %s[file]\x1b[0m %.24s (%lu KB) %s\n", selected ? "\x1b[47;30m" : "\x1b[36m",
+           attachment->filename, (unsigned long)((attachment->size + 1023) / 1024), state_text);
+}
+
+// Draw the top screen from one consistent snapshot
+static void ui_draw_top_screen(const ClientView* view, DiscordClient* client, UIState* state) {
     printf("\x1b[0;0H"); // Move cursor to top-left
     
     // Header
     printf("\x1b[1;37m=== Discord Chat Messages ===\x1b[0m\n");
     printf("Server: \x1b[32m%s\x1b[0m\n", 
-           client->server_count > 0 ? client->servers[state->selected_server].name : "None");
+           state->selected_server < view->server_count ? view->servers[state->selected_server].name : "None");
     printf("\x1b[34m--------------------------------\x1b[0m\n");
     
-    if (!client->connected) {
+    if (!view->connected) {
         printf("\n\x1b[31mNot connected to Discord!\x1b[0m\n");
         return;
     }
@@ -32,83 +260,346 @@ void ui_render_top_screen(DiscordClient* client, UIState* state) {
     int start_msg = state->message_scroll;
     int max_msgs = 20; // Max messages to display on screen
     
-    if (client->message_count == 0) {
+    if (view->message_count == 0) {
         printf("\n\x1b[33mNo messages to display.\x1b[0m\n");
         printf("Try refreshing or check channel.\n");
     } else {
-        for (int i = start_msg; i < client->message_count && i < start_msg + max_msgs; i++) {
-            DiscordMessage* msg = &client->messages[i];
+        static char line[MARKUP_RENDER_MAX];
+        for (int i = start_msg; i < view->message_count && i < start_msg + max_msgs; i++) {
+            const DiscordMessage* msg = &view->messages[i];
             
             // Display message with formatting
             printf("\x1b[36m[%s]\x1b[0m ", msg->timestamp);
             printf("\x1b[35m%s:\x1b[0m\n", msg->author);
-            printf("  %s\n", msg->content);
+            markup_render(msg->content, &msg->markup, line, sizeof(line));
+            if (line[0] != '\0' || msg->attachment_count == 0) {
+                printf("  %s\n", line);
+            }
+            if (msg->attachment_count > 0) {
+                ui_render_attachment(msg, i == start_msg && state->focus == UI_FOCUS_MESSAGES);
+            }
+        }
+    }
+    
+    // Messages still in the outbox for this channel
+    OutboxEntry pending[4];
+    int pending_count = outbox_list(view->current_channel_id, pending, 4);
+    for (int i = 0; i < pending_count; i++) {
+        bool upload = pending[i].file_path[0] != '\0';
+        if (pending[i].state == OUTBOX_FAILED) {
+            printf("\x1b[31m[failed %ld, %s]\x1b[0m\n", pending[i].last_status, upload ? "B to drop" : "X to edit");
+        } else if (upload && pending[i].state == OUTBOX_SENDING && pending[i].total > 0) {
+            printf("\x1b[33m[uploading %d%%, B to cancel]\x1b[0m\n", (int)(pending[i].sent * 100 / pending[i].total));
+        } else if (pending[i].attempts > 0) {
+            printf("\x1b[33m[retrying %d]\x1b[0m\n", pending[i].attempts);
+        } else {
+            printf("\x1b[33m[sending]\x1b[0m\n");
+        }
+        if (upload) {
+            const char* slash = strrchr(pending[i].file_path, '/');
+            printf("  \x1b[36m[file]\x1b[0m %.36s\n", slash ? slash + 1 : pending[i].file_path);
+        }
+        if (pending[i].content[0] != '\0') {
+            printf("  %s\n", pending[i].content);
         }
     }
     
     // Footer
     printf("\n\x1b[34m--------------------------------\x1b[0m\n");
     printf("\x1b[33mDPAD-UP/DOWN:\x1b[0m Scroll | \x1b[33mY:\x1b[0m Refresh\n");
+    
+    if (state->overlay == UI_OVERLAY_NET) {
+        ui_render_net_hud(client);
+    } else if (state->overlay == UI_OVERLAY_MEM) {
+        ui_render_mem_overlay();
+    } else if (state->overlay == UI_OVERLAY_LOG) {
+        ui_render_log_pane();
+    }
 }
 
-void ui_render_bottom_screen(DiscordClient* client, UIState* state) {
-    consoleSelect(&bottomScreen);
+void ui_render_top_screen(DiscordClient* client, UIState* state) {
+    consoleSelect(&topScreen);
     consoleClear();
     
+    const ClientView* view = client_view_acquire(CLIENT_VIEW_READER_RENDER);
+    ui_draw_top_screen(view, client, state);
+    client_view_release(CLIENT_VIEW_READER_RENDER);
+}
+
+// What the list row formatters draw from
+typedef struct {
+    const ClientView* view;
+    const UIState* state;
+    bool focused;               // The D-pad moves this list's cursor
+} UIListContext;
+
+// Highlight for a row: green for the open server or channel, inverse for
+// the cursor of the focused list
+static const char* ui_row_style(const UIListContext* list, bool selected, bool current) {
+    if (current) {
+        return "\x1b[42;30m";
+    }
+    return selected && list->focused ? "\x1b[47;30m" : "";
+}
+
+// A square in the console colour nearest to an icon or avatar, which the
+// cache fetches in the background; blank until then or if there is none
+static void ui_format_swatch(ImageKind kind, const char* owner_id, const char* hash, const char* style,
+                             char* out, size_t size) {
+    static const char* colors[16] = {
+        "\x1b[1;30m", "\x1b[31m", "\x1b[32m", "\x1b[33m", "\x1b[34m", "\x1b[35m", "\x1b[36m", "\x1b[37m",
+        "\x1b[1;30m", "\x1b[1;31m", "\x1b[1;32m", "\x1b[1;33m", "\x1b[1;34m", "\x1b[1;35m", "\x1b[1;36m", "\x1b[1;37m"
+    };
+    uint8_t rgb[3];
+    if (!image_cache_average(kind, owner_id, hash, rgb)) {
+        snprintf(out, size, " ");
+        return;
+    }
+    int index = (rgb[0] >= 96) | ((rgb[1] >= 96) << 1) | ((rgb[2] >= 96) << 2);
+    int peak = rgb[0] > rgb[1] ? rgb[0] : rgb[1];
+    peak = rgb[2] > peak ? rgb[2] : peak;
+    snprintf(out, size, "%s" TEXT_GLYPH_SQUARE "\x1b[0m%s", colors[index + (peak >= 176 ? 8 : 0)], style);
+}
+
+static void ui_format_server(int index, bool selected, char* line, size_t size, void* ctx) {
+    const UIListContext* list = (const UIListContext*)ctx;
+    const DiscordServer* server = &list->view->servers[index];
+    const char* style = ui_row_style(list, selected, index == list->state->selected_server);
+    char icon[32];
+    ui_format_swatch(IMAGE_SERVER_ICON, server->id, server->icon, style, icon, sizeof(icon));
+    
+    // Messages the poller saw in its watched channels
+    char unread_text[32] = "";
+    int unread = poller_unread_for_server(server->id);
+    if (unread > 0) {
+        snprintf(unread_text, sizeof(unread_text), " \x1b[1;31m(%d)\x1b[0m", unread);
+    }
+    snprintf(line, size, "%s%c %s %.28s\x1b[0m%s", style, selected ? '>' : ' ', icon, server->name, unread_text);
+}
+
+static void ui_format_channel(int index, bool selected, char* line, size_t size, void* ctx) {
+    const UIListContext* list = (const UIListContext*)ctx;
+    snprintf(line, size, "%s%c #%.34s\x1b[0m", ui_row_style(list, selected, index == list->state->selected_channel),
+             selected ? '>' : ' ', list->view->channels[index].name);
+}
+
+static void ui_format_member(int index, bool selected, char* line, size_t size, void* ctx) {
+    const UIListContext* list = (const UIListContext*)ctx;
+    const DiscordUser* user = &list->view->users[index];
+    const char* style = ui_row_style(list, selected, false);
+    char avatar[32];
+    ui_format_swatch(IMAGE_USER_AVATAR, user->id, user->avatar, style, avatar, sizeof(avatar));
+    snprintf(line, size, "%s%s" TEXT_GLYPH_BULLET "\x1b[0m%s %s %.26s#%s\x1b[0m", style,
+             user->online ? "\x1b[32m" : "\x1b[37m", style, avatar, user->username, user->discriminator);
+}
+
+static void ui_format_result(int index, bool selected, char* line, size_t size, void* ctx) {
+    const UIListContext* list = (const UIListContext*)ctx;
+    const SwitcherResult* result = &list->state->switcher_results[index];
+    const char* style = ui_row_style(list, selected, false);
+    if (result->kind == SWITCHER_SERVER) {
+        snprintf(line, size, "%s%c %.34s\x1b[0m", style, selected ? '>' : ' ', result->name);
+    } else {
+        snprintf(line, size, "%s%c #%.20s \x1b[0m\x1b[36m%.14s\x1b[0m", style, selected ? '>' : ' ', result->name,
+                 result->server_name);
+    }
+}
+
+// A titled list section; only its visible rows are formatted
+static void ui_draw_list(const char* title, VList* list, VListFormatFn format, UIListContext* ctx) {
+    static char rows[UI_LIST_ROWS * 128];
+    
+    printf("%s=== %s ===\x1b[0m", ctx->focused ? "\x1b[1;33m" : "\x1b[1;37m", title);
+    if (list->count > list->rows) {
+        printf(" %d/%d", list->cursor + 1, list->count);
+    }
+    printf("\n");
+    
+    if (list->count == 0) {
+        printf("\x1b[33m  (none)\x1b[0m\n");
+        return;
+    }
+    vlist_render(list, format, ctx, rows, sizeof(rows));
+    printf("%s", rows);
+}
+
+// Draw the bottom screen from one consistent snapshot
+static void ui_draw_bottom_screen(const ClientView* view, UIState* state) {
     printf("\x1b[0;0H"); // Move cursor to top-left
     
-    if (!client->connected) {
+    if (!view->connected) {
         printf("\x1b[31mNot connected!\x1b[0m\n");
         printf("\nPress START to exit.\n");
         return;
     }
     
-    // Servers section
-    printf("\x1b[1;37m=== Servers ===\x1b[0m\n");
-    for (int i = 0; i < client->server_count && i < 10; i++) {
-        if (i == state->selected_server) {
-            printf("\x1b[42;30m> %s\x1b[0m\n", client->servers[i].name);
-        } else {
-            printf("  %s\n", client->servers[i].name);
-        }
+    if (state->switcher_open) {
+        UIListContext ctx = { view, state, true };
+        char title[96];
+        snprintf(title, sizeof(title), "Jump to \"%.24s\"", state->switcher_query);
+        ui_draw_list(title, &state->switcher_list, ui_format_result, &ctx);
+        printf("\n\x1b[34m--------------------------------\x1b[0m\n");
+        printf("\x1b[33mU/D:\x1b[0m Select  \x1b[33mA:\x1b[0m Open  \x1b[33mB:\x1b[0m Close\n");
+        printf("\x1b[33mTouch:\x1b[0m Search again\n");
+        return;
     }
     
-    printf("\n\x1b[1;37m=== Users Online ===\x1b[0m\n");
-    
-    // Fetch users if not loaded
-    if (client->user_count == 0) {
-        discord_fetch_users(client);
+    // Lists follow the snapshot; unfocused ones keep the open entry in view
+    vlist_set_count(&state->server_list, view->server_count);
+    vlist_set_count(&state->channel_list, view->channel_count);
+    vlist_set_count(&state->member_list, view->user_count);
+    if (state->focus != UI_FOCUS_SERVERS) {
+        vlist_set_cursor(&state->server_list, state->selected_server);
+    }
+    if (state->focus != UI_FOCUS_CHANNELS) {
+        vlist_set_cursor(&state->channel_list, state->selected_channel);
     }
     
-    // Display users
-    int online_count = 0;
-    for (int i = 0; i < client->user_count && i < 5; i++) {
-        DiscordUser* user = &client->users[i];
-        if (user->online) {
-            printf("\x1b[32m● \x1b[0m%s#%s\n", user->username, user->discriminator);
-            online_count++;
+    UIListContext ctx = { view, state, state->focus == UI_FOCUS_SERVERS };
+    ui_draw_list("Servers", &state->server_list, ui_format_server, &ctx);
+    
+    ctx.focused = state->focus == UI_FOCUS_CHANNELS;
+    ui_draw_list("Channels", &state->channel_list, ui_format_channel, &ctx);
+    
+    ctx.focused = state->focus == UI_FOCUS_MEMBERS;
+    ui_draw_list("Members", &state->member_list, ui_format_member, &ctx);
+    
+    // Controls
+    printf("\n\x1b[34m--------------------------------\x1b[0m\n");
+    printf("\x1b[33mDPAD L/R:\x1b[0m Focus  \x1b[33mU/D:\x1b[0m Scroll  \x1b[33mA:\x1b[0m Open\n");
+    printf("\x1b[33mL/R:\x1b[0m Server  \x1b[33mX:\x1b[0m Keyboard  \x1b[33mY:\x1b[0m Refresh\n");
+    printf("\x1b[33mB:\x1b[0m Cancel  \x1b[33mSELECT:\x1b[0m Debug  \x1b[33mSTART:\x1b[0m Exit\n");
+    printf("\x1b[33mTouch:\x1b[0m Jump to a server or channel\n");
+}
+
+void ui_render_bottom_screen(DiscordClient* client, UIState* state) {
+    (void)client;
+    consoleSelect(&bottomScreen);
+    consoleClear();
+    
+    const ClientView* view = client_view_acquire(CLIENT_VIEW_READER_RENDER);
+    ui_draw_bottom_screen(view, state);
+    client_view_release(CLIENT_VIEW_READER_RENDER);
+}
+
+// List the D-pad scrolls, or NULL for the messages
+static VList* ui_focused_list(UIState* state) {
+    switch (state->focus) {
+        case UI_FOCUS_SERVERS:
+            return &state->server_list;
+        case UI_FOCUS_CHANNELS:
+            return &state->channel_list;
+        case UI_FOCUS_MEMBERS:
+            return &state->member_list;
+        default:
+            return NULL;
+    }
+}
+
+// Open the server or channel under the focused list's cursor, or save the
+// attachment of the message at the top of the message pane
+static void ui_open_selected(DiscordClient* client, UIState* state) {
+    if (state->focus == UI_FOCUS_MESSAGES) {
+        int target = state->message_scroll;
+        if (target < client->message_count && client->messages[target].attachment_count > 0 &&
+            client->messages[target].attachment.url[0] != '\0' && !download_queue(&client->messages[target].attachment)) {
+            log_write(LOG_WARN, "Download queue full");
+        }
+    } else if (state->focus == UI_FOCUS_SERVERS) {
+        int target = state->server_list.cursor;
+        if (target != state->selected_server && target < client->server_count) {
+            int previous = state->selected_server;
+            state->selected_server = target;
+            ui_switch_to_selected(client, state, previous);
+        }
+    } else if (state->focus == UI_FOCUS_CHANNELS) {
+        int target = state->channel_list.cursor;
+        if (target < client->channel_count && discord_select_channel(client, client->channels[target].id)) {
+            state->selected_channel = target;
+            state->message_scroll = 0;
+            if (discord_fetch_messages(client)) {
+                ui_mark_read(client);
+            }
         }
     }
+}
+
+// Ask for a name on the keyboard and list the servers and channels it
+// matches; the previous query is offered for editing
+static void ui_search_switcher(UIState* state) {
+    SwkbdState swkbd;
+    char query[sizeof(state->switcher_query)];
     
-    if (online_count == 0) {
-        printf("\x1b[33mNo users online.\x1b[0m\n");
+    swkbdInit(&swkbd, SWKBD_TYPE_NORMAL, 2, -1);
+    swkbdSetHintText(&swkbd, "Server or channel name...");
+    swkbdSetValidation(&swkbd, SWKBD_NOTEMPTY_NOTBLANK, 0, 0);
+    swkbdSetInitialText(&swkbd, state->switcher_query);
+    if (swkbdInputText(&swkbd, query, sizeof(query)) != SWKBD_BUTTON_CONFIRM) {
+        return;
     }
     
-    // Chat input section
-    printf("\n\x1b[1;37m=== Chat Input ===\x1b[0m\n");
-    printf("[Press X for keyboard]\n");
-    printf("\n");
+    snprintf(state->switcher_query, sizeof(state->switcher_query), "%s", query);
+    int count = switcher_search(query, state->switcher_results, SWITCHER_MAX_RESULTS);
+    vlist_set_count(&state->switcher_list, count);
+    vlist_set_cursor(&state->switcher_list, 0);
+    state->switcher_open = true;
+}
+
+// Open the switcher result under the cursor: its server first, then the
+// channel if it is one
+static void ui_open_result(DiscordClient* client, UIState* state) {
+    if (state->switcher_list.cursor >= state->switcher_list.count) {
+        return;
+    }
+    SwitcherResult result = state->switcher_results[state->switcher_list.cursor];
+    state->switcher_open = false;
+    state->focus = UI_FOCUS_MESSAGES;
     
-    // Controls
-    printf("\n\x1b[34m-------------------\x1b[0m\n");
-    printf("\x1b[33mL/R:\x1b[0m Change server\n");
-    printf("\x1b[33mX:\x1b[0m Open keyboard\n");
-    printf("\x1b[33mY:\x1b[0m Refresh messages\n");
-    printf("\x1b[33mDPAD:\x1b[0m Scroll messages\n");
-    printf("\x1b[33mSTART:\x1b[0m Exit\n");
+    if (strcmp(client->current_server_id, result.server_id) != 0) {
+        for (int i = 0; i < client->server_count; i++) {
+            if (strcmp(client->servers[i].id, result.server_id) == 0) {
+                int previous = state->selected_server;
+                state->selected_server = i;
+                ui_switch_to_selected(client, state, previous);
+                break;
+            }
+        }
+    }
+    if (result.kind != SWITCHER_CHANNEL || strcmp(client->current_server_id, result.server_id) != 0 ||
+        strcmp(client->current_channel_id, result.id) == 0) {
+        return;
+    }
+    for (int i = 0; i < client->channel_count; i++) {
+        if (strcmp(client->channels[i].id, result.id) == 0 && discord_select_channel(client, result.id)) {
+            state->selected_channel = i;
+            state->message_scroll = 0;
+            if (discord_fetch_messages(client)) {
+                ui_mark_read(client);
+            }
+            break;
+        }
+    }
+}
+
+// Keys while the switcher's results are shown; touch searches again
+static void ui_handle_switcher_input(DiscordClient* client, UIState* state, u32 kDown) {
+    if (kDown & KEY_TOUCH) {
+        ui_search_switcher(state);
+    } else if (kDown & KEY_B) {
+        state->switcher_open = false;
+    } else if (kDown & (KEY_DUP | KEY_DDOWN)) {
+        vlist_move(&state->switcher_list, (kDown & KEY_DUP) ? -1 : 1);
+    } else if (kDown & KEY_A) {
+        ui_open_result(client, state);
+    }
 }
 
 void ui_handle_input(DiscordClient* client, UIState* state, u32 kDown, u32 kHeld) {
+    if (state->switcher_open) {
+        ui_handle_switcher_input(client, state, kDown);
+        return;
+    }
+    
     // Normal mode controls
     if (kDown & KEY_X) {
         // Open touchscreen keyboard for text input
@@ -120,44 +611,73 @@ void ui_handle_input(DiscordClient* client, UIState* state, u32 kDown, u32 kHeld
         swkbdSetHintText(&swkbd, "Enter message...");
         swkbdSetValidation(&swkbd, SWKBD_NOTEMPTY_NOTBLANK, 0, 0);
         
+        // Offer a message Discord rejected for editing instead of losing it
+        if (outbox_take_failed(client->current_channel_id, text_buffer, sizeof(text_buffer))) {
+            swkbdSetInitialText(&swkbd, text_buffer);
+        }
+        
         button = swkbdInputText(&swkbd, text_buffer, sizeof(text_buffer));
         
-        if (button == SWKBD_BUTTON_CONFIRM && strlen(text_buffer) > 0) {
-            // Send the message
-            discord_send_message(client, text_buffer);
+        if (button == SWKBD_BUTTON_CONFIRM && strncmp(text_buffer, UI_UPLOAD_COMMAND, strlen(UI_UPLOAD_COMMAND)) == 0) {
+            char* path = text_buffer + strlen(UI_UPLOAD_COMMAND);
+            char* caption = strchr(path, ' ');
+            if (caption) {
+                *caption++ = '\0';
+            }
+            if (!outbox_enqueue_file(client->current_channel_id, caption ? caption : "", path)) {
+                log_write(LOG_WARN, "Cannot upload %s", path);
+            }
+        } else if (button == SWKBD_BUTTON_CONFIRM && strlen(text_buffer) > 0) {
+            // Queue the message; the outbox worker sends it in the background
+            if (!outbox_enqueue(client->current_channel_id, text_buffer)) {
+                log_write(LOG_WARN, "Outbox full, message not sent");
+            }
         }
         // If SWKBD_BUTTON_LEFT (cancel) or empty, do nothing
+    } else if (kDown & KEY_B) {
+        // Stop an upload to this channel, or drop one that failed
+        outbox_cancel_upload(client->current_channel_id);
     } else if (kDown & KEY_Y) {
         // Refresh messages
-        discord_fetch_messages(client);
+        if (discord_refresh_messages(client)) {
+            ui_mark_read(client);
+        }
     } else if (kDown & KEY_L) {
         // Previous server
         if (state->selected_server > 0) {
             state->selected_server--;
-            if (discord_switch_server(client, client->servers[state->selected_server].id)) {
-                discord_fetch_messages(client);
-                discord_fetch_users(client);
-            }
+            ui_switch_to_selected(client, state, state->selected_server + 1);
         }
     } else if (kDown & KEY_R) {
         // Next server
         if (state->selected_server < client->server_count - 1) {
             state->selected_server++;
-            if (discord_switch_server(client, client->servers[state->selected_server].id)) {
-                discord_fetch_messages(client);
-                discord_fetch_users(client);
-            }
+            ui_switch_to_selected(client, state, state->selected_server - 1);
         }
-    } else if (kDown & KEY_DUP) {
-        // Scroll messages up
-        if (state->message_scroll > 0) {
+    } else if (kDown & KEY_SELECT) {
+        // Cycle debug overlays (off, network, memory, log)
+        state->overlay = (UIOverlay)((state->overlay + 1) % UI_OVERLAY_COUNT);
+    } else if (kDown & (KEY_DLEFT | KEY_DRIGHT)) {
+        // Move the D-pad between the messages and the bottom-screen lists
+        int step = (kDown & KEY_DLEFT) ? UI_FOCUS_COUNT - 1 : 1;
+        state->focus = (UIFocus)((state->focus + step) % UI_FOCUS_COUNT);
+    } else if (kDown & (KEY_DUP | KEY_DDOWN)) {
+        int delta = (kDown & KEY_DUP) ? -1 : 1;
+        VList* list = ui_focused_list(state);
+        if (list) {
+            vlist_move(list, delta);
+        } else if (delta < 0 && state->message_scroll > 0) {
+            // Scroll messages up
             state->message_scroll--;
-        }
-    } else if (kDown & KEY_DDOWN) {
-        // Scroll messages down
-        if (state->message_scroll < client->message_count - 1) {
+        } else if (delta > 0 && state->message_scroll < client->message_count - 1) {
+            // Scroll messages down
             state->message_scroll++;
         }
+    } else if (kDown & KEY_A) {
+        ui_open_selected(client, state);
+    } else if (kDown & KEY_TOUCH) {
+        // Quick switcher
+        ui_search_switcher(state);
     }
 }
 
@@ -0,0 +1,55 @@
+#include "vlist.h"
+#include <string.h>
+
+void vlist_init(VList* list, int rows) {
+    list->count = 0;
+    list->cursor = 0;
+    list->top = 0;
+    list->rows = rows > 0 ? rows : 1;
+}
+
+void vlist_set_cursor(VList* list, int index) {
+    if (index > list->count - 1) {
+        index = list->count - 1;
+    }
+    if (index < 0) {
+        index = 0;
+    }
+    list->cursor = index;
+
+    if (list->cursor < list->top) {
+        list->top = list->cursor;
+    } else if (list->cursor >= list->top + list->rows) {
+        list->top = list->cursor - list->rows + 1;
+    }
+    // Keep the window full when the list shrank below it
+    if (list->top > list->count - list->rows) {
+        list->top = list->count > list->rows ? list->count - list->rows : 0;
+    }
+}
+
+void vlist_set_count(VList* list, int count) {
+    list->count = count > 0 ? count : 0;
+    vlist_set_cursor(list, list->cursor);
+}
+
+void vlist_move(VList* list, int delta) {
+    vlist_set_cursor(list, list->cursor + delta);
+}
+
+size_t vlist_render(const VList* list, VListFormatFn format, void* ctx, char* out, size_t size) {
+    size_t pos = 0;
+    if (size == 0) {
+        return 0;
+    }
+
+    int end = list->top + list->rows < list->count ? list->top + list->rows : list->count;
+    for (int i = list->top; i < end && pos + 1 < size - 1; i++) {
+        // Each row formats straight into the output, leaving room for '\n'
+        format(i, i == list->cursor, out + pos, size - 1 - pos, ctx);
+        pos += strlen(out + pos);
+        out[pos++] = '\n';
+    }
+    out[pos] = '\0';
+    return pos;
+}
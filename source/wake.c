@@ -0,0 +1,67 @@
+#include "wake.h"
+#include "timing.h"
+#include <string.h>
+#include <3ds.h>
+
+static LightEvent wake_event;
+static bool initialized = false;
+static bool dirty = false;          // Set by wake_request, taken by wake_begin_frame
+static uint64_t last_input = 0;
+static uint64_t last_render = 0;
+
+static WakeStats stats;
+
+void wake_init(void) {
+    LightEvent_Init(&wake_event, RESET_ONESHOT);
+    memset(&stats, 0, sizeof(stats));
+    last_input = timing_now();
+    last_render = 0;
+    __atomic_store_n(&dirty, true, __ATOMIC_RELEASE);
+    initialized = true;
+}
+
+void wake_request(void) {
+    __atomic_add_fetch(&stats.requests, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&dirty, true, __ATOMIC_RELEASE);
+    if (initialized) {
+        LightEvent_Signal(&wake_event);
+    }
+}
+
+bool wake_begin_frame(bool input, bool live) {
+    uint64_t now = timing_now();
+    stats.frames++;
+
+    bool render = __atomic_exchange_n(&dirty, false, __ATOMIC_ACQ_REL);
+    if (input) {
+        last_input = now;
+        render = true;
+    }
+    if (live && timing_ticks_to_ms(now - last_render) >= WAKE_LIVE_MS) {
+        render = true;
+    }
+    if (render) {
+        last_render = now;
+        stats.rendered++;
+    }
+    return render;
+}
+
+void wake_end_frame(void) {
+    if (timing_ticks_to_ms(timing_now() - last_input) < WAKE_IDLE_AFTER_MS) {
+        gspWaitForVBlank();
+        return;
+    }
+    stats.idle_waits++;
+    LightEvent_WaitTimeout(&wake_event, (s64)WAKE_IDLE_POLL_MS * 1000000LL);
+}
+
+WakeStats wake_get_stats(void) {
+    WakeStats snapshot = stats;
+    snapshot.requests = __atomic_load_n(&stats.requests, __ATOMIC_RELAXED);
+    return snapshot;
+}
+
+void wake_cleanup(void) {
+    initialized = false;
+}
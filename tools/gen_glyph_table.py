@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+"""Generate include/glyph_table.h, the code point -> console glyph table.
+
+The libctru console draws each byte with its built-in 8x8 font, which follows
+code page 437. This script maps Unicode code points onto those 256 glyphs:
+exact CP437 matches first, then a single-character transliteration (accents
+stripped via NFKD, typographic punctuation folded to ASCII), then a drop
+marker for zero-width characters. Everything else shows as a "missing" box.
+
+Run it after changing the mapping rules; the output is deterministic.
+"""
+import os
+import unicodedata
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+OUTPUT = os.path.join(HERE, "..", "include", "glyph_table.h")
+
+GLYPH_DROP = 0x1B       # ESC is never emitted, so it doubles as "skip this"
+GLYPH_MISSING = 0xFE    # ■
+GLYPH_INVALID = ord("?")
+
+# Code points below this go through the paged table, the rest through ranges
+PAGE_LIMIT = 0x3000
+
+# Bytes the console treats as control characters rather than glyphs
+CONSOLE_CONTROLS = {0x00, 0x08, 0x09, 0x0A, 0x0D, 0x1B, 0x7F}
+
+# The pictures CP437 draws in its control range
+CP437_LOW = {
+    0x01: "☺", 0x02: "☻", 0x03: "♥", 0x04: "♦", 0x05: "♣", 0x06: "♠", 0x07: "•",
+    0x0B: "♂", 0x0C: "♀", 0x0E: "♫", 0x0F: "☼", 0x10: "►", 0x11: "◄", 0x12: "↕",
+    0x13: "‼", 0x14: "¶", 0x15: "§", 0x16: "▬", 0x17: "↨", 0x18: "↑", 0x19: "↓",
+    0x1A: "→", 0x1C: "∟", 0x1D: "↔", 0x1E: "▲", 0x1F: "▼",
+}
+
+# Look-alikes NFKD doesn't produce
+EXTRA = {
+    "‘": "'", "’": "'", "‚": "'", "‛": "'", "′": "'", "‹": "<", "›": ">",
+    "“": '"', "”": '"', "„": '"', "‟": '"', "″": '"',
+    "‐": "-", "‑": "-", "‒": "-", "–": "-", "—": "-", "―": "-", "−": "-",
+    "…": ".", "‧": "·", "⋅": "·", "●": "•", "◦": "o", "‣": "►",
+    "Ł": "L", "ł": "l", "Đ": "D", "đ": "d", "Ø": "O", "ø": "o", "Œ": "O",
+    "œ": "o", "Ħ": "H", "ħ": "h", "ı": "i", "ŧ": "t", "Ŧ": "T", "Þ": "P",
+    "þ": "p", "Ð": "D", "ð": "d", "€": "E", "™": "T", "©": "c", "®": "r",
+    "❤": "♥", "♡": "♥", "✓": "√", "✔": "√", "★": "*", "☆": "*", "✨": "*",
+    "☹": "☺", "⚠": "!", "✖": "x", "✗": "x", "✘": "x", "❌": "x",
+}
+
+# Ranges above PAGE_LIMIT: (first, last, glyph)
+RANGES = [
+    (0xFE00, 0xFE0F, GLYPH_DROP),       # Variation selectors
+    (0xFEFF, 0xFEFF, GLYPH_DROP),       # BOM / zero-width no-break space
+    (0xFFFD, 0xFFFD, GLYPH_INVALID),    # Replacement character
+    (0x1F3FB, 0x1F3FF, GLYPH_DROP),     # Skin tone modifiers
+    (0x1F493, 0x1F49F, 0x03),           # Hearts
+    (0x1F600, 0x1F64F, 0x01),           # Emoticons
+    (0x1F910, 0x1F92F, 0x01),           # More faces
+    (0x1F970, 0x1F97A, 0x01),
+    (0x1F9E1, 0x1F9E1, 0x03),           # Orange heart
+    (0xE0020, 0xE007F, GLYPH_DROP),     # Tag characters (flag sequences)
+]
+
+
+def cp437_map():
+    table = {}
+    for byte in range(0x80, 0x100):
+        table[bytes([byte]).decode("cp437")] = byte
+    for byte, ch in CP437_LOW.items():
+        table[ch] = byte
+    for byte in range(0x20, 0x7F):
+        table[chr(byte)] = byte
+    return table
+
+
+def glyph_for(cp, cp437):
+    ch = chr(cp)
+    if cp == 0x0A:
+        return 0x0A
+    if cp == 0x09 or cp == 0xA0:
+        return ord(" ")
+    if ch in cp437 and cp437[ch] not in CONSOLE_CONTROLS:
+        return cp437[ch]
+    category = unicodedata.category(ch)
+    if category in ("Cc", "Cf", "Mn", "Me") or 0xD800 <= cp <= 0xDFFF:
+        return GLYPH_DROP
+    if ch in EXTRA:
+        return cp437[EXTRA[ch]]
+    base = "".join(c for c in unicodedata.normalize("NFKD", ch) if not unicodedata.combining(c))
+    if len(base) == 1 and base in cp437 and cp437[base] not in CONSOLE_CONTROLS:
+        return cp437[base]
+    if category.startswith("Z"):
+        return ord(" ")
+    return GLYPH_MISSING
+
+
+def main():
+    cp437 = cp437_map()
+    pages = []
+    page_index = []
+    for page in range(PAGE_LIMIT >> 8):
+        glyphs = [glyph_for(cp, cp437) for cp in range(page << 8, (page + 1) << 8)]
+        if all(g == GLYPH_MISSING for g in glyphs):
+            page_index.append(0xFF)
+        else:
+            page_index.append(len(pages))
+            pages.append((page, glyphs))
+
+    lines = [
+        "// Generated by tools/gen_glyph_table.py; do not edit.",
+        "#ifndef GLYPH_TABLE_H",
+        "#define GLYPH_TABLE_H",
+        "",
+        "#include <stdint.h>",
+        "",
+        "#define GLYPH_DROP 0x%02X" % GLYPH_DROP,
+        "#define GLYPH_MISSING 0x%02X" % GLYPH_MISSING,
+        "#define GLYPH_INVALID 0x%02X" % GLYPH_INVALID,
+        "#define GLYPH_PAGE_LIMIT 0x%X" % PAGE_LIMIT,
+        "#define GLYPH_NO_PAGE 0xFF",
+        "",
+        "// Page number (code point >> 8) -> row of glyph_pages, or GLYPH_NO_PAGE",
+        "static const uint8_t glyph_page_index[%d] = {" % len(page_index),
+    ]
+    for i in range(0, len(page_index), 16):
+        lines.append("    " + " ".join("0x%02X," % v for v in page_index[i:i + 16]))
+    lines += ["};", "", "static const uint8_t glyph_pages[%d][256] = {" % len(pages)]
+    for page, glyphs in pages:
+        lines.append("    { // U+%04X" % (page << 8))
+        for i in range(0, 256, 16):
+            lines.append("        " + " ".join("0x%02X," % g for g in glyphs[i:i + 16]))
+        lines.append("    },")
+    lines += [
+        "};",
+        "",
+        "// Code points at or above GLYPH_PAGE_LIMIT; anything else is GLYPH_MISSING",
+        "static const struct {",
+        "    uint32_t first;",
+        "    uint32_t last;",
+        "    uint8_t glyph;",
+        "} glyph_ranges[%d] = {" % len(RANGES),
+    ]
+    for first, last, glyph in RANGES:
+        lines.append("    { 0x%05X, 0x%05X, 0x%02X }," % (first, last, glyph))
+    lines += ["};", "", "#endif // GLYPH_TABLE_H", ""]
+
+    with open(OUTPUT, "w") as f:
+        f.write("\n".join(lines))
+    print("Wrote %s (%d pages)" % (os.path.relpath(OUTPUT), len(pages)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+"""Generate include/history_dict.h, the zlib preset dictionary for history.c.
+
+A 50-message window is only a few KB, too short for deflate to learn much on
+its own, so the compressor is primed with strings that recur across Discord
+chat: common words and phrases, mention and emoji markup, author names.
+
+The training set is synthetic chat from bench/corpus/generate.py with a
+different seed than the checked-in corpus, so bench_client's ratio is not
+measured on the text the dictionary was built from. Fields are encoded the
+way the client stores them (console glyphs, see text.h).
+"""
+import collections
+import importlib.util
+import os
+import random
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+OUTPUT = os.path.join(HERE, "..", "include", "history_dict.h")
+GENERATOR = os.path.join(HERE, "..", "bench", "corpus", "generate.py")
+
+DICT_SIZE = 4096
+TRAINING_PAGES = 40
+MAX_WORDS = 4
+
+
+def load_generator():
+    spec = importlib.util.spec_from_file_location("generate", GENERATOR)
+    module = importlib.util.module_from_spec(spec)
+    spec.loader.exec_module(module)
+    module.rng = random.Random(97)
+    return module
+
+
+def console_bytes(text):
+    return text.encode("cp437", errors="replace")
+
+
+def training_fields(gen):
+    for _ in range(TRAINING_PAGES):
+        for msg in gen.messages_page():
+            yield console_bytes(msg["content"])
+            yield console_bytes(msg["author"]["username"])
+
+
+def build_dictionary(fields):
+    counts = collections.Counter()
+    for field in fields:
+        # Ids in mentions and custom emoji differ between servers; keep only
+        # the markup around them
+        words = [word for word in field.split(b" ") if sum(c in b"0123456789" for c in word) < 6]
+        for n in range(1, MAX_WORDS + 1):
+            for i in range(len(words) - n + 1):
+                gram = b" ".join(words[i:i + n]) + b" "
+                if len(gram) > 2:
+                    counts[gram] += 1
+
+    # Bytes saved if the phrase is found in the dictionary instead of spelled out
+    scored = sorted(((count - 1) * len(gram), gram) for gram, count in counts.items() if count > 1)
+    chosen = [b"<@", b"<:"]
+    size = 4
+    for score, gram in reversed(scored):
+        if size + len(gram) > DICT_SIZE:
+            continue
+        if any(gram in other for other in chosen):
+            continue
+        chosen.append(gram)
+        size += len(gram)
+
+    # zlib finds matches fastest near the end of the dictionary
+    return b"".join(reversed(chosen))
+
+
+def c_literal(data):
+    lines = []
+    line = ""
+    for byte in data:
+        ch = chr(byte)
+        if ch == '"' or ch == "\\":
+            piece = "\\" + ch
+        elif 0x20 <= byte < 0x7F and ch != "?":
+            piece = ch
+        else:
+            piece = "\\%03o" % byte
+        line += piece
+        if len(line) >= 76:
+            lines.append('    "%s"' % line)
+            line = ""
+    if line:
+        lines.append('    "%s"' % line)
+    return "\n".join(lines)
+
+
+def main():
+    dictionary = build_dictionary(training_fields(load_generator()))
+    text = "\n".join([
+        "// Generated by tools/gen_history_dict.py; do not edit.",
+        "#ifndef HISTORY_DICT_H",
+        "#define HISTORY_DICT_H",
+        "",
+        "static const char history_dictionary[%d] =" % (len(dictionary) + 1),
+        c_literal(dictionary) + ";",
+        "",
+        "#define HISTORY_DICTIONARY_SIZE %d" % len(dictionary),
+        "",
+        "#endif // HISTORY_DICT_H",
+        "",
+    ])
+    with open(OUTPUT, "w") as f:
+        f.write(text)
+    print("Wrote %s (%d bytes)" % (os.path.relpath(OUTPUT), len(dictionary)))
+
+
+if __name__ == "__main__":
+    main()